@@ -4,58 +4,18 @@
  */
 
 #include <air.hpp>
+#include <algorithm>
 #include <climits>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <codegen.hpp>
 #include <x64/precolorer.hpp>
 
-static void UseSlot(Slot* slot, AirInstruction* instruction)
-{
-  Assert(instruction->index != -1, "Instruction must have been pushed");
-
-  if (slot->liveRanges.size() >= 1u)
-  {
-    LiveRange& lastRange = slot->liveRanges.back();
-
-    if (lastRange.definition)
-    {
-      Assert(lastRange.definition->index < instruction->index, FormatString("Slot used before being defined: %s", slot->AsString().c_str()).c_str());
-      lastRange.lastUse = instruction;
-    }
-  }
-  else
-  {
-    RaiseError(ERROR_BIND_USED_BEFORE_INIT, slot->AsString().c_str());
-  }
-}
-
-void VariableSlot     ::Use(AirInstruction* instruction) { UseSlot(this, instruction); }
-void ParameterSlot    ::Use(AirInstruction* instruction) { UseSlot(this, instruction); }
-void MemberSlot       ::Use(AirInstruction* instruction) { UseSlot(this, instruction); }
-void TemporarySlot    ::Use(AirInstruction* instruction) { UseSlot(this, instruction); }
-void ReturnResultSlot ::Use(AirInstruction* instruction) { UseSlot(this, instruction); }
-
-static void ChangeSlotValue(Slot* slot, AirInstruction* instruction)
-{
-  Assert(instruction->index != -1, "Instruction must have been pushed");
-  slot->liveRanges.push_back(LiveRange(instruction, nullptr));
-}
-
-void VariableSlot     ::ChangeValue(AirInstruction* instruction) { ChangeSlotValue(this, instruction); }
-void ParameterSlot    ::ChangeValue(AirInstruction* instruction) { ChangeSlotValue(this, instruction); }
-void MemberSlot       ::ChangeValue(AirInstruction* instruction) { ChangeSlotValue(this, instruction); }
-void TemporarySlot    ::ChangeValue(AirInstruction* instruction) { ChangeSlotValue(this, instruction); }
-void ReturnResultSlot ::ChangeValue(AirInstruction* instruction) { ChangeSlotValue(this, instruction); }
-
-LiveRange::LiveRange(AirInstruction* definition, AirInstruction* lastUse)
-  :definition(definition)
-  ,lastUse(lastUse)
-{
-}
-
 Slot::Slot(CodeThing* code)
-  :color(-1)
+  :index(code->slots.size())
+  ,color(-1)
   ,interferences()
-  ,liveRanges()
 #ifdef OUTPUT_DOT
   ,dotTag(0u)
 #endif
@@ -66,11 +26,17 @@ Slot::Slot(CodeThing* code)
 VariableSlot::VariableSlot(CodeThing* code, VariableDef* variable)
   :Slot(code)
   ,variable(variable)
+  ,version(0u)
 {
 }
 
 std::string VariableSlot::AsString()
 {
+  if (version > 0u)
+  {
+    return FormatString("%s.%u(V)-%c", variable->name.c_str(), version, variable->GetStorageChar());
+  }
+
   return FormatString("%s(V)-%c", variable->name.c_str(), variable->GetStorageChar());
 }
 
@@ -158,6 +124,18 @@ std::string ReturnResultSlot::AsString()
   return FormatString("r%u", tag);
 }
 
+SpillSlot::SpillSlot(CodeThing* code, Slot* spilledSlot, int offset)
+  :Slot(code)
+  ,spilledSlot(spilledSlot)
+  ,offset(offset)
+{
+}
+
+std::string SpillSlot::AsString()
+{
+  return FormatString("%s(S)(%d)", spilledSlot->AsString().c_str(), offset);
+}
+
 template<>
 std::string ConstantSlot<unsigned int>::AsString()
 {
@@ -188,19 +166,15 @@ std::string ConstantSlot<StringConstant*>::AsString()
   return FormatString("\"%s\"", value->str.c_str());
 }
 
-AirInstruction::AirInstruction()
-  :index(-1)
+AirInstruction::AirInstruction(InstructionType instructionType)
+  :instructionType(instructionType)
+  ,index(-1)
   ,next(nullptr)
 {
 }
 
-AirInstruction::~AirInstruction()
-{
-  delete next;
-}
-
 LabelInstruction::LabelInstruction()
-  :AirInstruction()
+  :AirInstruction(InstructionType::LABEL)
   ,offset(0u)
 {
 }
@@ -212,7 +186,7 @@ std::string LabelInstruction::AsString()
 }
 
 ReturnInstruction::ReturnInstruction(Slot* returnValue)
-  :AirInstruction()
+  :AirInstruction(InstructionType::RETURN)
   ,returnValue(returnValue)
 {
 }
@@ -223,7 +197,7 @@ std::string ReturnInstruction::AsString()
 }
 
 JumpInstruction::JumpInstruction(JumpInstruction::Condition condition, LabelInstruction* label)
-  :AirInstruction()
+  :AirInstruction(InstructionType::JUMP)
   ,condition(condition)
   ,label(label)
 {
@@ -252,7 +226,7 @@ std::string JumpInstruction::AsString()
 }
 
 MovInstruction::MovInstruction(Slot* src, Slot* dest)
-  :AirInstruction()
+  :AirInstruction(InstructionType::MOV)
   ,src(src)
   ,dest(dest)
 {
@@ -264,7 +238,7 @@ std::string MovInstruction::AsString()
 }
 
 CmpInstruction::CmpInstruction(Slot* a, Slot* b)
-  :AirInstruction()
+  :AirInstruction(InstructionType::CMP)
   ,a(a)
   ,b(b)
 {
@@ -276,7 +250,7 @@ std::string CmpInstruction::AsString()
 }
 
 UnaryOpInstruction::UnaryOpInstruction(UnaryOpInstruction::Operation op, IntrinsicOpType type, Slot* result, Slot* operand)
-  :AirInstruction()
+  :AirInstruction(InstructionType::UNARY_OP)
   ,op(op)
   ,type(type)
   ,result(result)
@@ -298,7 +272,7 @@ std::string UnaryOpInstruction::AsString()
 }
 
 BinaryOpInstruction::BinaryOpInstruction(BinaryOpInstruction::Operation op, IntrinsicOpType type, Slot* result, Slot* left, Slot* right)
-  :AirInstruction()
+  :AirInstruction(InstructionType::BINARY_OP)
   ,op(op)
   ,type(type)
   ,result(result)
@@ -321,8 +295,11 @@ std::string BinaryOpInstruction::AsString()
 }
 
 CallInstruction::CallInstruction(CodeThing* thing)
-  :AirInstruction()
+  :AirInstruction(InstructionType::CALL)
   ,thing(thing)
+  ,params()
+  ,returnResult(nullptr)
+  ,liveColors(0u)
 {
 }
 
@@ -331,6 +308,70 @@ std::string CallInstruction::AsString()
   return FormatString("%u: CALL %s", index, thing->mangledName.c_str());
 }
 
+PhiInstruction::PhiInstruction(Slot* result)
+  :AirInstruction(InstructionType::PHI)
+  ,result(result)
+  ,operands()
+{
+}
+
+std::string PhiInstruction::AsString()
+{
+  std::string values;
+  for (Operand& operand : operands)
+  {
+    values += FormatString("%s%s[%d]", (values.size() > 0u ? ", " : ""), operand.value->AsString().c_str(),
+                           operand.from->index);
+  }
+
+  return FormatString("%u: %s = PHI %s", index, result->AsString().c_str(), values.c_str());
+}
+
+void ReplaceInstructions(CodeThing* code, const std::vector<AirInstruction*>& instructions)
+{
+  code->airHead = nullptr;
+  code->airTail = nullptr;
+
+  for (unsigned int i = 0u;
+       i < instructions.size();
+       i++)
+  {
+    instructions[i]->index = static_cast<signed int>(i);
+    instructions[i]->next = ((i + 1u) < instructions.size() ? instructions[i + 1u] : nullptr);
+  }
+
+  if (instructions.size() > 0u)
+  {
+    code->airHead = instructions.front();
+    code->airTail = instructions.back();
+  }
+}
+
+AirPassManager::~AirPassManager()
+{
+  for (AirTransformPass* pass : passes)
+  {
+    delete pass;
+  }
+}
+
+void AirPassManager::Add(AirTransformPass* pass)
+{
+  passes.push_back(pass);
+}
+
+void AirPassManager::Run(CodeThing* code)
+{
+  for (AirTransformPass* pass : passes)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    pass->Apply(code);
+    auto end = std::chrono::steady_clock::now();
+
+    pass->microseconds += std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+  }
+}
+
 // AirGenerator
 static JumpInstruction::Condition MapReverseCondition(ConditionNode::Condition condition)
 {
@@ -347,6 +388,18 @@ static JumpInstruction::Condition MapReverseCondition(ConditionNode::Condition c
   __builtin_unreachable();
 }
 
+Slot* AirState::GetSlot(VariableDef* variable)
+{
+  if (!inlinedThing)
+  {
+    return variable->slot;
+  }
+
+  auto it = inlinedSlots.find(variable);
+  Assert(it != inlinedSlots.end(), "Inlined code used a variable that wasn't given a slot");
+  return it->second;
+}
+
 static void PushInstruction(CodeThing* code, AirInstruction* instruction)
 {
   Assert(instruction->index == -1, "Instruction has already been pushed");
@@ -377,8 +430,21 @@ Slot* AirGenerator::VisitNode(BreakNode* node, AirState* state)
 Slot* AirGenerator::VisitNode(ReturnNode* node, AirState* state)
 {
   Slot* returnValue = (node->returnValue ? Dispatch(node->returnValue, state) : nullptr);
-  ReturnInstruction* ret = new ReturnInstruction(returnValue);
-  PushInstruction(state->code, ret);
+
+  // Returning from inlined code just takes us to the end of it
+  if (state->inlinedThing)
+  {
+    if (returnValue)
+    {
+      PushInstruction(state->code, new MovInstruction(returnValue, state->returnResult));
+    }
+
+    PushInstruction(state->code, new JumpInstruction(JumpInstruction::Condition::UNCONDITIONAL, state->returnLabel));
+  }
+  else
+  {
+    PushInstruction(state->code, new ReturnInstruction(returnValue));
+  }
 
   if (node->next) (void)Dispatch(node->next, state);
   return nullptr;
@@ -405,16 +471,12 @@ Slot* AirGenerator::VisitNode(UnaryOpNode* node, AirState* state)
     {
       AirInstruction* neg = new UnaryOpInstruction(UnaryOpInstruction::Operation::NEGATE, node->intrinsicType, result, operand);
       PushInstruction(state->code, neg);
-      operand->Use(neg);
-      result->ChangeValue(neg);
     } break;
 
     case UnaryOpNode::Operator::LOGICAL_NOT:
     {
       AirInstruction* notI = new UnaryOpInstruction(UnaryOpInstruction::Operation::LOGICAL_NOT, node->intrinsicType, result, operand);
       PushInstruction(state->code, notI);
-      operand->Use(notI);
-      result->ChangeValue(notI);
     } break;
 
     case UnaryOpNode::Operator::TAKE_REFERENCE:
@@ -426,8 +488,6 @@ Slot* AirGenerator::VisitNode(UnaryOpNode* node, AirState* state)
     {
       AirInstruction* inc = new UnaryOpInstruction(UnaryOpInstruction::Operation::INCREMENT, node->intrinsicType, result, operand);
       PushInstruction(state->code, inc);
-      operand->Use(inc);
-      result->ChangeValue(inc);
     } break;
 
     case UnaryOpNode::Operator::POST_INCREMENT:
@@ -437,19 +497,12 @@ Slot* AirGenerator::VisitNode(UnaryOpNode* node, AirState* state)
 
       PushInstruction(state->code, mov);
       PushInstruction(state->code, inc);
-
-      operand->Use(mov);
-      operand->Use(inc);
-      result->ChangeValue(mov);
-      operand->ChangeValue(inc);
     } break;
 
     case UnaryOpNode::Operator::PRE_DECREMENT:
     {
       AirInstruction* dec = new UnaryOpInstruction(UnaryOpInstruction::Operation::DECREMENT, node->intrinsicType, result, operand);
       PushInstruction(state->code, dec);
-      operand->Use(dec);
-      result->ChangeValue(dec);
     } break;
 
     case UnaryOpNode::Operator::POST_DECREMENT:
@@ -459,11 +512,6 @@ Slot* AirGenerator::VisitNode(UnaryOpNode* node, AirState* state)
 
       PushInstruction(state->code, mov);
       PushInstruction(state->code, dec);
-
-      operand->Use(mov);
-      operand->Use(dec);
-      result->ChangeValue(mov);
-      result->ChangeValue(dec);
     } break;
   }
 
@@ -507,9 +555,6 @@ Slot* AirGenerator::VisitNode(BinaryOpNode* node, AirState* state)
     Assert(node->intrinsicType != NUM_INTRINSIC_OP_TYPES, "Intrinsic operations must have a predecided type");
     BinaryOpInstruction* op = new BinaryOpInstruction(operation, node->intrinsicType, result, left, right);
     PushInstruction(state->code, op);
-    left->Use(op);
-    right->Use(op);
-    result->ChangeValue(op);
   }
 
   if (node->next) (void)Dispatch(node->next, state);
@@ -521,7 +566,7 @@ Slot* AirGenerator::VisitNode(VariableNode* node, AirState* state)
   Assert(node->isResolved, "Tried to generate AIR for unresolved variable");
 
   if (node->next) (void)Dispatch(node->next, state);
-  return node->var->slot;
+  return state->GetSlot(node->var);
 }
 
 Slot* AirGenerator::VisitNode(ConditionNode* node, AirState* state)
@@ -532,9 +577,6 @@ Slot* AirGenerator::VisitNode(ConditionNode* node, AirState* state)
   CmpInstruction* cmp = new CmpInstruction(a, b);
   PushInstruction(state->code, cmp);
 
-  a->Use(cmp);
-  b->Use(cmp);
-
   if (node->next) (void)Dispatch(node->next, state);
   return nullptr;
 }
@@ -640,63 +682,203 @@ Slot* AirGenerator::VisitNode(StringNode* node, AirState* state)
   return slot;
 }
 
-Slot* AirGenerator::VisitNode(CallNode* node, AirState* state)
+/*
+ * Calls to small things are inlined, which means the AIR for the called thing's AST is generated in place of the
+ * call. Things marked with #[Inline] are always inlined (if they can be), and things marked with #[NoInline] never
+ * are. Other things are inlined if their code fits into a small budget of instructions, which is bigger for each
+ * argument that's a constant, as constant propagation can then probably simplify the inlined code.
+ */
+static const unsigned int MAX_INLINE_DEPTH      = 4u;
+static const unsigned int INLINE_BUDGET         = 14u;
+static const unsigned int CONSTANT_ARG_BONUS    = 4u;
+
+bool AirGenerator::CanInline(CodeThing* thing, AirState* state)
 {
-  // TODO: parameterise the parameters into the correct places, issue the call instruction, and return the
-  // result in a ReturnResultSlot correctly
-  std::vector<Slot*> paramSlots;
-  unsigned int numGeneralParams = 0u;
+  if (thing->attribs.isPrototype || thing->attribs.isNoInline || !(thing->ast) || thing->errorState->hasErrored)
+  {
+    return false;
+  }
 
-  for (ASTNode* paramNode : node->params)
+  // Don't inline recursive calls (they'd never end), or go too deep into inlined code
+  unsigned int depth = 0u;
+  for (AirState* caller = state;
+       caller;
+       caller = caller->caller)
   {
-    Assert(numGeneralParams < state->target->numGeneralRegisters, "Filled up general registers");
-    Slot* slot = Dispatch(paramNode, state);
+    if (caller->code == thing || caller->inlinedThing == thing || (++depth) > MAX_INLINE_DEPTH)
+    {
+      return false;
+    }
+  }
 
-    switch (slot->GetType())
+  // TODO: inline things that have variables of composite types (their members are kept on the stack)
+  for (VariableDef* param : thing->params)
+  {
+    if (param->members.size() > 0u)
     {
-      case SlotType::VARIABLE:
-      case SlotType::PARAMETER:
-      case SlotType::MEMBER:
-      case SlotType::TEMPORARY:
-      {
-        slot->color = state->target->intParamColors[numGeneralParams++];
-        paramSlots.push_back(slot);
-      } break;
+      return false;
+    }
+  }
 
-      case SlotType::RETURN_RESULT:
-      case SlotType::INT_CONSTANT:
-      case SlotType::UNSIGNED_INT_CONSTANT:
-      case SlotType::FLOAT_CONSTANT:
-      case SlotType::BOOL_CONSTANT:
-      case SlotType::STRING_CONSTANT:
+  for (ScopeDef* scope : thing->scopes)
+  {
+    for (VariableDef* local : scope->locals)
+    {
+      if (local->members.size() > 0u)
       {
-        TemporarySlot* tempSlot = new TemporarySlot(state->code);
-        tempSlot->color = state->target->intParamColors[numGeneralParams++];
-        AirInstruction* mov = new MovInstruction(slot, tempSlot);
-        PushInstruction(state->code, mov);
-        paramSlots.push_back(tempSlot);
-
-        slot->Use(mov);
-        tempSlot->ChangeValue(mov);
-      } break;
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool AirGenerator::TryInline(CallNode* node, const std::vector<Slot*>& args, AirState* state, Slot*& result)
+{
+  CodeThing* thing = node->resolvedFunction;
+  if (!CanInline(thing, state))
+  {
+    return false;
+  }
+
+  AirState inlineState(state->target, state->code);
+  inlineState.caller        = state;
+  inlineState.inlinedThing  = thing;
+  inlineState.returnLabel   = new LabelInstruction();
+  inlineState.returnResult  = (thing->returnType ? new TemporarySlot(state->code) : nullptr);
+
+  // The inlined code may change its parameters, so the arguments are copied into new slots
+  AirInstruction* beforeInlined = state->code->airTail;
+  unsigned int numConstantArgs = 0u;
+
+  for (unsigned int i = 0u;
+       i < args.size();
+       i++)
+  {
+    Slot* param = new VariableSlot(state->code, thing->params[i]);
+    inlineState.inlinedSlots[thing->params[i]] = param;
+    PushInstruction(state->code, new MovInstruction(args[i], param));
+
+    if (args[i]->IsConstant())
+    {
+      numConstantArgs++;
+    }
+  }
+
+  for (ScopeDef* scope : thing->scopes)
+  {
+    for (VariableDef* local : scope->locals)
+    {
+      inlineState.inlinedSlots[local] = new VariableSlot(state->code, local);
+    }
+  }
+
+  AirInstruction* bodyTail = state->code->airTail;
+  signed int bodyStart = (bodyTail ? bodyTail->index : -1);
+  Dispatch(thing->ast, &inlineState);
+
+  // If the inlined code ends by returning, it doesn't need to jump to the end, because it's already there
+  AirInstruction* last = state->code->airTail;
+  if (last != bodyTail && last->instructionType == InstructionType::JUMP &&
+      static_cast<JumpInstruction*>(last)->label == inlineState.returnLabel)
+  {
+    AirInstruction* beforeLast = (bodyTail ? bodyTail : state->code->airHead);
+    while (beforeLast && beforeLast->next != last)
+    {
+      beforeLast = beforeLast->next;
+    }
+
+    if (beforeLast)
+    {
+      beforeLast->next = nullptr;
+      state->code->airTail = beforeLast;
+      delete last;
+    }
+  }
+
+  PushInstruction(state->code, inlineState.returnLabel);
+
+  // If the inlined code is too big, throw it away and call the thing instead
+  unsigned int size = static_cast<unsigned int>(state->code->airTail->index - bodyStart);
+  if (!(thing->attribs.isInline) && size > INLINE_BUDGET + CONSTANT_ARG_BONUS * numConstantArgs)
+  {
+    AirInstruction* firstInlined = (beforeInlined ? beforeInlined->next : state->code->airHead);
+
+    if (beforeInlined)
+    {
+      beforeInlined->next = nullptr;
+    }
+    else
+    {
+      state->code->airHead = nullptr;
     }
+
+    state->code->airTail = beforeInlined;
+
+    while (firstInlined)
+    {
+      AirInstruction* next = firstInlined->next;
+      delete firstInlined;
+      firstInlined = next;
+    }
+
+    return false;
   }
 
+  result = inlineState.returnResult;
+  return true;
+}
+
+Slot* AirGenerator::VisitNode(CallNode* node, AirState* state)
+{
   Assert(node->isResolved, "Tried to emit call to unresolved function");
-  AirInstruction* call = new CallInstruction(node->resolvedFunction);
-  PushInstruction(state->code, call);
 
-  for (Slot* paramSlot : paramSlots)
+  std::vector<Slot*> args;
+  for (ASTNode* paramNode : node->params)
   {
-    paramSlot->Use(call);
+    args.push_back(Dispatch(paramNode, state));
   }
 
   Slot* returnSlot = nullptr;
+  if (TryInline(node, args, state, returnSlot))
+  {
+    if (node->next) (void)Dispatch(node->next, state);
+    return returnSlot;
+  }
+
+  /*
+   * Each argument is copied into a new temporary that's precolored with the register it's passed in, rather than
+   * precoloring the slot it's already in. That slot may be live across other calls, or be passed in a different
+   * register elsewhere, so it can't always be given the same register. The allocator coalesces the copies away
+   * when it can.
+   */
+  std::vector<Slot*> paramSlots;
+  unsigned int numGeneralParams = 0u;
+
+  for (Slot* slot : args)
+  {
+    Assert(numGeneralParams < state->target->numGeneralRegisters, "Filled up general registers");
+
+    TemporarySlot* tempSlot = new TemporarySlot(state->code);
+    tempSlot->color = state->target->intParamColors[numGeneralParams++];
+    PushInstruction(state->code, new MovInstruction(slot, tempSlot));
+    paramSlots.push_back(tempSlot);
+  }
+
+  CallInstruction* call = new CallInstruction(node->resolvedFunction);
+  call->params = paramSlots;
+  PushInstruction(state->code, call);
+
+  // The result is copied out of the return register straight away, for the same reasons
   if (node->resolvedFunction->returnType)
   {
-    returnSlot = new ReturnResultSlot(state->code);
-    returnSlot->ChangeValue(call);
-    returnSlot->color = state->target->functionReturnColor;
+    Slot* resultSlot = new ReturnResultSlot(state->code);
+    resultSlot->color = state->target->functionReturnColor;
+    call->returnResult = resultSlot;
+
+    returnSlot = new TemporarySlot(state->code);
+    PushInstruction(state->code, new MovInstruction(resultSlot, returnSlot));
   }
 
   if (node->next) (void)Dispatch(node->next, state);
@@ -711,9 +893,6 @@ Slot* AirGenerator::VisitNode(VariableAssignmentNode* node, AirState* state)
   AirInstruction* mov = new MovInstruction(newValue, variable);
   PushInstruction(state->code, mov);
 
-  variable->ChangeValue(mov);
-  newValue->Use(mov);
-
   if (node->next) (void)Dispatch(node->next, state);
   return variable;
 }
@@ -729,12 +908,9 @@ Slot* AirGenerator::VisitNode(MemberAccessNode* node, AirState* state)
   Assert(node->isResolved, "Tried to generate AIR for unresolved member access");
   Slot* tempSlot = new TemporarySlot(state->code);
 
-  AirInstruction* mov = new MovInstruction(node->member->slot, tempSlot);
+  AirInstruction* mov = new MovInstruction(state->GetSlot(node->member), tempSlot);
   PushInstruction(state->code, mov);
 
-  node->member->slot->Use(mov);
-  tempSlot->ChangeValue(mov);
-
   if (node->next) (void)Dispatch(node->next, state);
   return tempSlot;
 }
@@ -788,278 +964,1200 @@ Slot* AirGenerator::VisitNode(ConstructNode* node, AirState* state)
        itemIt++, memberIt++)
   {
     Slot* itemSlot = Dispatch(*itemIt, state);
-    Slot* memberSlot = (*memberIt)->slot;
+    Slot* memberSlot = state->GetSlot(*memberIt);
 
     AirInstruction* mov = new MovInstruction(itemSlot, memberSlot);
     PushInstruction(state->code, mov);
-    memberSlot->ChangeValue(mov);
-    itemSlot->Use(mov);
   }
 
   if (node->next) (void)Dispatch(node->next, state);
   return nullptr;
 }
 
-static bool DoRangesIntersect(LiveRange& a, LiveRange& b)
+/*
+ * Two slots interfere if one of them is written to while the other is live, as they then can't share a register.
+ * We walk backwards through each basic block, keeping track of the slots that are live after each instruction,
+ * and make whatever the instruction defines interfere with them.
+ *
+ * A defined slot also interferes with the other slots the instruction reads, as the code generator may write the
+ * result before it's finished with the operands (e.g. x64's two-operand arithmetic). The exception is a MOV, whose
+ * source and destination hold the same value afterwards, so can share a register (otherwise the register allocator
+ * could never coalesce them).
+ */
+static void GenerateInterferenceGraph(CodeThing* code, ControlFlowGraph* graph)
 {
-  unsigned int definitionA = (a.definition ? a.definition->index : 0u);
-  unsigned int definitionB = (b.definition ? b.definition->index : 0u);
-
-  /*
-   * If we don't use the variable, it doesn't interfere with anything, so we set it's last use to it's definition
-   */
-  unsigned int useA = (a.lastUse ? a.lastUse->index : a.definition->index);
-  unsigned int useB = (b.lastUse ? b.lastUse->index : b.definition->index);
+  for (BasicBlock& block : graph->blocks)
+  {
+    graph->WalkBackwards(block, [code](AirInstruction* instruction, SlotSet& live, LiveOperands& operands)
+      {
+        Slot* moveSource = (instruction->instructionType == InstructionType::MOV ?
+                              static_cast<MovInstruction*>(instruction)->src : nullptr);
 
-  return ((definitionA <= useB) && (definitionB <= useA));
-}
+        for (Slot* def : operands.defs)
+        {
+          auto interfere = [code, def, moveSource](unsigned int index)
+            {
+              Slot* slot = code->slots[index];
+
+              if (slot != def && slot != moveSource)
+              {
+                def->interferences.push_back(slot);
+                slot->interferences.push_back(def);
+              }
+            };
+
+          live.ForEach(interfere);
+          for (Slot* use : operands.uses)
+          {
+            interfere(use->index);
+          }
+        }
+      });
+  }
 
-static void GenerateInterferenceGraph(CodeThing* code)
-{
   /*
-   * We have to use iterators here, because we need to only visit each *pair* of slots once.
+   * Slots can be found to interfere with the same slot at lots of points, so remove the duplicates. We remember
+   * which slot's list we last saw each slot in, so this is linear in the number of interferences.
    */
-  for (auto itA = code->slots.begin();
-       itA != code->slots.end();
-       itA++)
+  std::vector<unsigned int> lastSeenIn(code->slots.size(), UINT_MAX);
+  for (Slot* slot : code->slots)
   {
-    Slot* a = *itA;
-
-    if (a->IsConstant())
-    {
-      continue;
-    }
+    size_t numUnique = 0u;
 
-    for (auto itB = std::next(itA);
-         itB != code->slots.end();
-         itB++)
+    for (Slot* interference : slot->interferences)
     {
-      Slot* b = *itB;
-
-      for (LiveRange& rangeA : a->liveRanges)
+      if (lastSeenIn[interference->index] != slot->index)
       {
-        for (LiveRange& rangeB : b->liveRanges)
-        {
-          if (DoRangesIntersect(rangeA, rangeB))
-          {
-            a->interferences.push_back(b);
-            b->interferences.push_back(a);
-            goto FoundInterference;
-          }
-        }
+        lastSeenIn[interference->index] = slot->index;
+        slot->interferences[numUnique++] = interference;
       }
-
-FoundInterference:
-      continue;
     }
+
+    slot->interferences.resize(numUnique);
   }
 }
 
 /*
- * This assigns a color to each slot (each color then corresponds to a register) so that no edge of the
- * interference graph is between nodes of the same color.
+ * Register allocation
+ * -------------------
+ * We allocate registers by coloring the interference graph (each color corresponds to a register), with a
+ * Chaitin-Briggs allocator:
+ *    - Coalesce: MOVs between slots that don't interfere are removed by giving both slots the same color. We only
+ *      do this when it can't make the graph harder to color (Briggs' conservative test).
+ *    - Simplify: a slot with fewer than K neighbours (where K is the number of registers we can allocate) can always
+ *      be colored, so we remove it from the graph and push it onto a stack. When no such slots are left, we pick
+ *      the one that'd be cheapest to spill, and optimistically push that instead.
+ *    - Select: we pop the slots off the stack and give each one a color that none of its neighbours have. If there
+ *      isn't one, the slot is spilled onto the stack, the AIR is rewritten to load and store it, and we start again.
  *
- * XXX: Atm, this is very naive and could do with a lot more improvement to achieve a more efficient k-coloring,
- * especially concerning the register pressure (or lack of it).
+ * Slots are identified by their index into the `CodeThing`'s slots. Coalesced slots are represented by the slot
+ * they were merged into (their "alias").
  */
-static void ColorSlots(TargetMachine* target, CodeThing* code)
+struct InterferenceGraph
+{
+  InterferenceGraph(CodeThing* code, const std::vector<bool>& isPrecolored, const std::vector<bool>& isSpilled);
+
+  unsigned int GetAlias(unsigned int slot);
+  bool AreAdjacent(unsigned int a, unsigned int b);
+  void Merge(unsigned int from, unsigned int into);
+
+  std::vector<bool>                       isNode;     // Does this slot need to be allocated a register?
+  std::vector<unsigned int>               alias;
+  std::vector<std::vector<unsigned int>>  adjacent;   // NOTE(Isaac): only valid for slots that are their own alias
+  std::vector<unsigned int>               marks;      // Used to quickly find the union of two slots' neighbours
+  unsigned int                            currentMark;
+};
+
+InterferenceGraph::InterferenceGraph(CodeThing* code, const std::vector<bool>& isPrecolored, const std::vector<bool>& isSpilled)
+  :isNode(code->slots.size(), false)
+  ,alias(code->slots.size())
+  ,adjacent(code->slots.size())
+  ,marks(code->slots.size(), 0u)
+  ,currentMark(0u)
 {
   for (Slot* slot : code->slots)
   {
-    // Skip slots that are uncolorable or already colored
-    if ((slot->color != -1) || !slot->ShouldColor())
+    alias[slot->index] = slot->index;
+    isNode[slot->index] = (!(slot->IsConstant()) && !isSpilled[slot->index] &&
+                           (slot->ShouldColor() || isPrecolored[slot->index]));
+  }
+
+  for (Slot* slot : code->slots)
+  {
+    if (!isNode[slot->index])
     {
       continue;
     }
 
-    // Find colors already used by interfering slots
-    bool usedColors[target->numGeneralRegisters];
-    memset(usedColors, false, sizeof(bool)*target->numGeneralRegisters);
-    for (Slot* interferingSlot : slot->interferences)
+    for (Slot* interference : slot->interferences)
     {
-      if (interferingSlot->color != -1)
+      if (isNode[interference->index])
       {
-        usedColors[interferingSlot->color] = true;
+        adjacent[slot->index].push_back(interference->index);
       }
     }
+  }
+}
+
+unsigned int InterferenceGraph::GetAlias(unsigned int slot)
+{
+  while (alias[slot] != slot)
+  {
+    alias[slot] = alias[alias[slot]];
+    slot = alias[slot];
+  }
+
+  return slot;
+}
+
+bool InterferenceGraph::AreAdjacent(unsigned int a, unsigned int b)
+{
+  const std::vector<unsigned int>& shorter = (adjacent[a].size() < adjacent[b].size() ? adjacent[a] : adjacent[b]);
+  unsigned int other = (&shorter == &adjacent[a] ? b : a);
+
+  for (unsigned int neighbour : shorter)
+  {
+    if (neighbour == other)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void InterferenceGraph::Merge(unsigned int from, unsigned int into)
+{
+  alias[from] = into;
+
+  currentMark++;
+  for (unsigned int neighbour : adjacent[into])
+  {
+    marks[neighbour] = currentMark;
+  }
+
+  for (unsigned int neighbour : adjacent[from])
+  {
+    std::vector<unsigned int>& neighbours = adjacent[neighbour];
 
-    // Choose a free color
     for (unsigned int i = 0u;
-         i < target->numGeneralRegisters;
+         i < neighbours.size();
          i++)
     {
-      /*
-       * Some registers may be reserved for special purposes - we should not use these for general stuff
-       */
-      if (!usedColors[i] && target->registerSet[i]->usage == BaseRegisterDef::Usage::GENERAL)
+      if (neighbours[i] == from)
       {
-        slot->color = static_cast<signed int>(i);
+        neighbours[i] = neighbours.back();
+        neighbours.pop_back();
         break;
       }
     }
 
-    // Deal with it if we can't find a free color for this slot
-    if (slot->color == -1)
+    if (marks[neighbour] != currentMark)
     {
-      // TODO: we should do something more helpful here, like spill something or rewrite the AIR
-      RaiseError(code->errorState, ICE_GENERIC, "Failed to find a valid k-coloring of the interference graph!");
+      adjacent[into].push_back(neighbour);
+      neighbours.push_back(into);
     }
   }
+
+  adjacent[from].clear();
 }
 
-#ifdef OUTPUT_DOT
-static void EmitInterferenceGraphDOT(CodeThing* code)
+/*
+ * Slots of these types are kept in registers by the code generator, so can be coalesced with each other and moved
+ * straight to and from the stack.
+ */
+bool IsRegisterSlot(Slot* slot)
 {
-  if (!(code->airHead))
+  switch (slot->GetType())
   {
-    return;
-  }
+    case SlotType::VARIABLE:
+    case SlotType::PARAMETER:
+    case SlotType::TEMPORARY:
+    case SlotType::RETURN_RESULT:
+    {
+      return true;
+    }
 
-  std::string fileName = std::string(code->mangledName) + "_interference.dot";
-  FILE* f = fopen(fileName.c_str(), "w");
+    default:
+    {
+      return false;
+    }
+  }
+}
 
-  if (!f)
+unsigned int GetSlotOperands(AirInstruction* instruction, SlotOperand operands[3u])
+{
+  switch (instruction->instructionType)
+  {
+    case InstructionType::RETURN:
+    {
+      ReturnInstruction* ret = static_cast<ReturnInstruction*>(instruction);
+
+      if (!(ret->returnValue))
+      {
+        return 0u;
+      }
+
+      operands[0u] = SlotOperand{&(ret->returnValue), true};
+      return 1u;
+    }
+
+    case InstructionType::MOV:
+    {
+      MovInstruction* mov = static_cast<MovInstruction*>(instruction);
+      operands[0u] = SlotOperand{&(mov->src),   true};
+      operands[1u] = SlotOperand{&(mov->dest),  false};
+      return 2u;
+    }
+
+    case InstructionType::CMP:
+    {
+      CmpInstruction* cmp = static_cast<CmpInstruction*>(instruction);
+      operands[0u] = SlotOperand{&(cmp->a), true};
+      operands[1u] = SlotOperand{&(cmp->b), true};
+      return 2u;
+    }
+
+    case InstructionType::UNARY_OP:
+    {
+      UnaryOpInstruction* op = static_cast<UnaryOpInstruction*>(instruction);
+      operands[0u] = SlotOperand{&(op->operand), true};
+      operands[1u] = SlotOperand{&(op->result),  false};
+      return 2u;
+    }
+
+    case InstructionType::BINARY_OP:
+    {
+      BinaryOpInstruction* op = static_cast<BinaryOpInstruction*>(instruction);
+      operands[0u] = SlotOperand{&(op->left),   true};
+      operands[1u] = SlotOperand{&(op->right),  true};
+      operands[2u] = SlotOperand{&(op->result), false};
+      return 3u;
+    }
+
+    /*
+     * NOTE(Isaac): a phi's operands are read on the edges into its block, rather than by the phi itself, so they're
+     * left for the SSA passes to deal with.
+     */
+    case InstructionType::PHI:
+    {
+      operands[0u] = SlotOperand{&(static_cast<PhiInstruction*>(instruction)->result), false};
+      return 1u;
+    }
+
+    /*
+     * NOTE(Isaac): the parameters and result of a call are precolored, so are never spilled or coalesced away.
+     */
+    case InstructionType::LABEL:
+    case InstructionType::JUMP:
+    case InstructionType::CALL:
+    {
+      return 0u;
+    }
+  }
+
+  __builtin_unreachable();
+}
+
+/*
+ * Coalesces the source and destination of each MOV, if they don't interfere and if it's safe to do so. We can
+ * coalesce a slot into a precolored one, but not two precolored slots together.
+ */
+static void CoalesceMoves(CodeThing* code, InterferenceGraph& graph, const std::vector<bool>& isPrecolored,
+                          unsigned int numColors)
+{
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType != InstructionType::MOV)
+    {
+      continue;
+    }
+
+    MovInstruction* mov = static_cast<MovInstruction*>(instruction);
+    if (!IsRegisterSlot(mov->src) || !IsRegisterSlot(mov->dest) ||
+        !graph.isNode[mov->src->index] || !graph.isNode[mov->dest->index])
+    {
+      continue;
+    }
+
+    unsigned int into = graph.GetAlias(mov->src->index);
+    unsigned int from = graph.GetAlias(mov->dest->index);
+
+    if (into == from)
+    {
+      continue;
+    }
+
+    if (isPrecolored[from])
+    {
+      std::swap(into, from);
+    }
+
+    if (isPrecolored[from] || graph.AreAdjacent(into, from))
+    {
+      continue;
+    }
+
+    /*
+     * If we're coalescing into a precolored slot, we can't if the other slot interferes with a slot that needs
+     * the same register.
+     */
+    bool canCoalesce = true;
+    if (isPrecolored[into])
+    {
+      for (unsigned int neighbour : graph.adjacent[from])
+      {
+        if (isPrecolored[neighbour] && code->slots[neighbour]->color == code->slots[into]->color)
+        {
+          canCoalesce = false;
+          break;
+        }
+      }
+    }
+
+    /*
+     * Briggs' test: coalescing is safe if the merged slot would have fewer than K neighbours with K or more
+     * neighbours themselves. Precolored slots are never removed from the graph, so they always count.
+     */
+    if (canCoalesce)
+    {
+      unsigned int numSignificantNeighbours = 0u;
+      graph.currentMark++;
+
+      for (unsigned int slot : {into, from})
+      {
+        for (unsigned int neighbour : graph.adjacent[slot])
+        {
+          if (graph.marks[neighbour] == graph.currentMark)
+          {
+            continue;
+          }
+
+          graph.marks[neighbour] = graph.currentMark;
+          if (isPrecolored[neighbour] || graph.adjacent[neighbour].size() >= numColors)
+          {
+            numSignificantNeighbours++;
+          }
+        }
+      }
+
+      canCoalesce = (numSignificantNeighbours < numColors);
+    }
+
+    if (canCoalesce)
+    {
+      graph.Merge(from, into);
+    }
+  }
+}
+
+/*
+ * Estimates how expensive it would be to spill each slot, from the number of times it's used and defined. Each
+ * access inside a loop is weighted ten times more heavily than one outside it, so we avoid spilling slots that are
+ * used in hot loops.
+ */
+static std::vector<double> CalculateSpillCosts(CodeThing* code, InterferenceGraph& graph,
+                                               const std::vector<bool>& isUnspillable)
+{
+  // A jump backwards to a label is the end of a loop, which starts at the label
+  std::vector<signed int> loopDepthChanges(code->airTail->index + 2u, 0);
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType != InstructionType::JUMP)
+    {
+      continue;
+    }
+
+    JumpInstruction* jump = static_cast<JumpInstruction*>(instruction);
+    if (jump->label->index <= jump->index)
+    {
+      loopDepthChanges[jump->label->index]++;
+      loopDepthChanges[jump->index + 1u]--;
+    }
+  }
+
+  std::vector<double> costs(code->slots.size(), 0.0);
+  signed int loopDepth = 0;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    loopDepth += loopDepthChanges[instruction->index];
+
+    SlotOperand operands[3u];
+    unsigned int numOperands = GetSlotOperands(instruction, operands);
+
+    for (unsigned int i = 0u;
+         i < numOperands;
+         i++)
+    {
+      Slot* slot = *(operands[i].slot);
+
+      if (graph.isNode[slot->index])
+      {
+        costs[graph.GetAlias(slot->index)] += pow(10.0, loopDepth);
+      }
+    }
+  }
+
+  // Spilling the temporaries created by spilling something else wouldn't help, so make sure we never pick them
+  for (Slot* slot : code->slots)
+  {
+    if (graph.isNode[slot->index] && isUnspillable[slot->index])
+    {
+      costs[graph.GetAlias(slot->index)] = HUGE_VAL;
+    }
+  }
+
+  return costs;
+}
+
+/*
+ * Removes slots from the graph until it's empty, and returns the order they should be colored in (the reverse of
+ * the order they were removed).
+ */
+static std::vector<unsigned int> SimplifyGraph(InterferenceGraph& graph, const std::vector<bool>& isPrecolored,
+                                               const std::vector<double>& spillCosts, unsigned int numColors)
+{
+  std::vector<unsigned int> degrees(graph.isNode.size(), 0u);
+  std::vector<bool> isRemoved(graph.isNode.size(), false);
+  std::vector<unsigned int> lowDegree;
+  std::vector<unsigned int> highDegree;
+  std::vector<unsigned int> stack;
+
+  for (unsigned int i = 0u;
+       i < graph.isNode.size();
+       i++)
+  {
+    if (!graph.isNode[i] || isPrecolored[i] || graph.GetAlias(i) != i)
+    {
+      continue;
+    }
+
+    degrees[i] = graph.adjacent[i].size();
+    (degrees[i] < numColors ? lowDegree : highDegree).push_back(i);
+  }
+
+  while (true)
+  {
+    while (lowDegree.size() > 0u)
+    {
+      unsigned int slot = lowDegree.back();
+      lowDegree.pop_back();
+
+      if (isRemoved[slot])
+      {
+        continue;
+      }
+
+      isRemoved[slot] = true;
+      stack.push_back(slot);
+
+      for (unsigned int neighbour : graph.adjacent[slot])
+      {
+        if (isPrecolored[neighbour] || isRemoved[neighbour])
+        {
+          continue;
+        }
+
+        if (degrees[neighbour]-- == numColors)
+        {
+          lowDegree.push_back(neighbour);
+        }
+      }
+    }
+
+    // Every slot left has at least K neighbours, so pick one to (hopefully not) spill
+    unsigned int numLeft = 0u;
+    double bestCost = HUGE_VAL;
+    unsigned int bestSlot = UINT_MAX;
+
+    for (unsigned int slot : highDegree)
+    {
+      if (isRemoved[slot])
+      {
+        continue;
+      }
+
+      highDegree[numLeft++] = slot;
+      double cost = spillCosts[slot] / degrees[slot];
+
+      if (bestSlot == UINT_MAX || cost < bestCost)
+      {
+        bestCost = cost;
+        bestSlot = slot;
+      }
+    }
+    highDegree.resize(numLeft);
+
+    if (bestSlot == UINT_MAX)
+    {
+      break;
+    }
+
+    lowDegree.push_back(bestSlot);
+  }
+
+  std::reverse(stack.begin(), stack.end());
+  return stack;
+}
+
+/*
+ * Rewrites the AIR so each of the given slots is kept on the stack instead of in a register. Each instruction that
+ * uses one instead uses a new temporary that's loaded from the stack just before it, and each instruction that
+ * defines one defines a new temporary that's stored to the stack just after it. A MOV between a spilled slot and
+ * a register can access the stack directly, so doesn't need a temporary.
+ * NOTE(Isaac): constants are still moved through a temporary, because x64 can only store a 32-bit immediate.
+ */
+static void RewriteSpilledSlots(TargetMachine* target, CodeThing* code, const std::vector<unsigned int>& spilledSlots)
+{
+  std::vector<SpillSlot*> spillSlots(code->slots.size(), nullptr);
+
+  for (unsigned int index : spilledSlots)
+  {
+    Slot* slot = code->slots[index];
+    code->neededStackSpace += target->generalRegisterSize;
+    spillSlots[index] = new SpillSlot(code, slot, -static_cast<signed int>(code->neededStackSpace));
+  }
+
+  #define IS_SPILLED(slot) ((slot)->index < spillSlots.size() && spillSlots[(slot)->index])
+
+  AirInstruction* previous = nullptr;
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       previous = instruction, instruction = instruction->next)
+  {
+    if (instruction->instructionType == InstructionType::MOV)
+    {
+      MovInstruction* mov = static_cast<MovInstruction*>(instruction);
+
+      if (IS_SPILLED(mov->src) && !IS_SPILLED(mov->dest) && IsRegisterSlot(mov->dest))
+      {
+        mov->src = spillSlots[mov->src->index];
+        continue;
+      }
+
+      if (IS_SPILLED(mov->dest) && !IS_SPILLED(mov->src) && IsRegisterSlot(mov->src))
+      {
+        mov->dest = spillSlots[mov->dest->index];
+        continue;
+      }
+    }
+
+    SlotOperand operands[3u];
+    unsigned int numOperands = GetSlotOperands(instruction, operands);
+    AirInstruction* lastStore = instruction;
+
+    for (unsigned int i = 0u;
+         i < numOperands;
+         i++)
+    {
+      Slot* slot = *(operands[i].slot);
+
+      if (!IS_SPILLED(slot))
+      {
+        continue;
+      }
+
+      // Replace all of the instruction's references to the spilled slot with the same temporary
+      TemporarySlot* temporary = new TemporarySlot(code);
+      bool isUsed = false;
+      bool isDefined = false;
+
+      for (unsigned int j = i;
+           j < numOperands;
+           j++)
+      {
+        if (*(operands[j].slot) != slot)
+        {
+          continue;
+        }
+
+        if (operands[j].isUse)
+        {
+          isUsed = true;
+        }
+        else
+        {
+          isDefined = true;
+        }
+
+        *(operands[j].slot) = temporary;
+      }
+
+      if (isUsed)
+      {
+        MovInstruction* load = new MovInstruction(spillSlots[slot->index], temporary);
+        load->next = instruction;
+
+        if (previous)
+        {
+          previous->next = load;
+        }
+        else
+        {
+          code->airHead = load;
+        }
+        previous = load;
+      }
+
+      if (isDefined)
+      {
+        MovInstruction* store = new MovInstruction(temporary, spillSlots[slot->index]);
+        store->next = lastStore->next;
+        lastStore->next = store;
+        lastStore = store;
+      }
+    }
+
+    if (code->airTail == instruction)
+    {
+      code->airTail = lastStore;
+    }
+
+    instruction = lastStore;
+  }
+
+  #undef IS_SPILLED
+
+  // Renumber the instructions, now we've inserted the loads and stores
+  signed int index = 0;
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    instruction->index = index++;
+  }
+}
+
+/*
+ * Finds the slots that hold values still needed after a call. These are better off in callee-saved registers,
+ * which are only saved once for the whole function, than in caller-saved ones, which have to be saved around every
+ * call they're live across.
+ */
+static std::vector<bool> FindSlotsLiveAcrossCalls(CodeThing* code)
+{
+  ControlFlowGraph* graph = code->controlFlowGraph;
+  std::vector<bool> isLiveAcrossCall(code->slots.size(), false);
+
+  for (BasicBlock& block : graph->blocks)
+  {
+    graph->WalkBackwards(block, [&isLiveAcrossCall](AirInstruction* instruction, SlotSet& live, LiveOperands& operands)
+      {
+        if (instruction->instructionType != InstructionType::CALL)
+        {
+          return;
+        }
+
+        live.ForEach([&isLiveAcrossCall, &operands](unsigned int index)
+          {
+            // The call's result is written by it, so isn't live across it
+            for (Slot* def : operands.defs)
+            {
+              if (def->index == index)
+              {
+                return;
+              }
+            }
+
+            isLiveAcrossCall[index] = true;
+          });
+      });
+  }
+
+  return isLiveAcrossCall;
+}
+
+/*
+ * Colors the interference graph. If every slot could be colored, this sets their colors and returns nothing;
+ * otherwise, it returns the slots that should be spilled. Slots that are live across a call try the colors in the
+ * order of `acrossCallColors` instead of `colors`.
+ */
+static std::vector<unsigned int> ColorInterferenceGraph(TargetMachine* target, CodeThing* code,
+                                                        const std::vector<signed int>& colors,
+                                                        const std::vector<signed int>& acrossCallColors,
+                                                        const std::vector<bool>& isPrecolored,
+                                                        const std::vector<bool>& isSpilled,
+                                                        const std::vector<bool>& isUnspillable)
+{
+  GenerateInterferenceGraph(code, code->controlFlowGraph);
+
+  InterferenceGraph graph(code, isPrecolored, isSpilled);
+
+  /*
+   * Precolored slots keep their colors, so two that interfere can't have been given the same one. The AIR generator
+   * copies values into and out of new precolored slots so that this never happens.
+   */
+  for (Slot* slot : code->slots)
+  {
+    if (!graph.isNode[slot->index] || !isPrecolored[slot->index])
+    {
+      continue;
+    }
+
+    for (unsigned int neighbour : graph.adjacent[slot->index])
+    {
+      Assert(!(isPrecolored[neighbour] && code->slots[neighbour]->color == slot->color),
+             "Interfering slots have been precolored with the same register");
+    }
+  }
+
+  CoalesceMoves(code, graph, isPrecolored, colors.size());
+  std::vector<double> spillCosts = CalculateSpillCosts(code, graph, isUnspillable);
+  std::vector<unsigned int> stack = SimplifyGraph(graph, isPrecolored, spillCosts, colors.size());
+
+  // A coalesced slot is live across a call if any of the slots coalesced into it are
+  std::vector<bool> isLiveAcrossCall = FindSlotsLiveAcrossCalls(code);
+  for (Slot* slot : code->slots)
+  {
+    if (graph.isNode[slot->index] && isLiveAcrossCall[slot->index])
+    {
+      isLiveAcrossCall[graph.GetAlias(slot->index)] = true;
+    }
+  }
+
+  // Select a color for each slot, in the reverse order to which they were removed from the graph
+  std::vector<signed int> slotColors(code->slots.size(), -1);
+  std::vector<bool> isUncolorable(code->slots.size(), false);
+  bool anyUncolorable = false;
+
+  for (Slot* slot : code->slots)
+  {
+    if (isPrecolored[slot->index])
+    {
+      slotColors[slot->index] = slot->color;
+    }
+  }
+
+  for (unsigned int slot : stack)
+  {
+    bool usedColors[target->numRegisters];
+    memset(usedColors, false, sizeof(bool)*target->numRegisters);
+
+    for (unsigned int neighbour : graph.adjacent[slot])
+    {
+      if (slotColors[neighbour] != -1)
+      {
+        usedColors[slotColors[neighbour]] = true;
+      }
+    }
+
+    for (signed int color : (isLiveAcrossCall[slot] ? acrossCallColors : colors))
+    {
+      if (!usedColors[color])
+      {
+        slotColors[slot] = color;
+        break;
+      }
+    }
+
+    if (slotColors[slot] == -1)
+    {
+      isUncolorable[slot] = true;
+      anyUncolorable = true;
+    }
+  }
+
+  std::vector<unsigned int> spilledSlots;
+
+  if (!anyUncolorable)
   {
-    RaiseError(ERROR_FAILED_TO_OPEN_FILE, fileName.c_str());
+    for (Slot* slot : code->slots)
+    {
+      if (graph.isNode[slot->index] && !isPrecolored[slot->index])
+      {
+        slot->color = slotColors[graph.GetAlias(slot->index)];
+      }
+    }
+
+    return spilledSlots;
   }
 
-  fprintf(f, "digraph G\n{\n");
-  unsigned int i = 0u;
+  // Spill every slot that was coalesced into a slot we couldn't color
+  for (Slot* slot : code->slots)
+  {
+    if (graph.isNode[slot->index] && isUncolorable[graph.GetAlias(slot->index)] && !isUnspillable[slot->index])
+    {
+      spilledSlots.push_back(slot->index);
+    }
+  }
 
-  const char* snazzyColors[] =
+  if (spilledSlots.size() == 0u)
   {
-    "cyan2",      "deeppink",   "darkgoldenrod2",     "mediumpurple2",  "slategray",    "chartreuse3",
-    "green3",     "lightblue2", "mediumspringgreeen", "orange1",        "mistyrose3",   "maroon2",
-    "steelblue2", "blue",       "lightseagreen",      "plum",           "dodgerblue4",  "darkorchid1",
+    RaiseError(code->errorState, ICE_GENERIC, "Failed to find a valid k-coloring of the interference graph!");
+  }
+
+  return spilledSlots;
+}
+
+/*
+ * Linear-scan register allocation
+ * -------------------------------
+ * This is much faster than coloring the interference graph (it doesn't build one), but produces worse code, so is
+ * meant for when compile times matter more. Each slot is treated as being live from the first instruction it's live
+ * at (according to the liveness analysis) to the last one, which covers the whole of any loop it's live around. We
+ * visit these intervals in the order they start, keeping a list of the ones
+ * that are still live (and so are holding on to their registers), and give each one a register that isn't being
+ * used by a live interval or by a precolored slot at any point in the interval. If there isn't one, we spill
+ * whichever interval ends last, as it would hold on to a register for longest.
+ *
+ * Like `ColorInterferenceGraph`, this either sets the colors of every slot, or returns the slots to spill.
+ */
+static std::vector<unsigned int> ScanLiveIntervals(TargetMachine* target, CodeThing* code,
+                                                   const std::vector<signed int>& colors,
+                                                   const std::vector<signed int>& acrossCallColors,
+                                                   const std::vector<bool>& isPrecolored,
+                                                   const std::vector<bool>& isSpilled,
+                                                   const std::vector<bool>& isUnspillable)
+{
+  struct Interval
+  {
+    unsigned int  slot;
+    unsigned int  start;
+    unsigned int  end;
   };
 
-  // First emit a colored node for each slot
+  /*
+   * Find the runs of instructions each slot is live at (or is read or written by). We walk backwards through the
+   * blocks, last to first, so these are found from last to first too.
+   */
+  ControlFlowGraph* graph = code->controlFlowGraph;
+  std::vector<std::vector<Interval>> liveRuns(code->slots.size());
+
+  for (unsigned int i = graph->blocks.size();
+       i > 0u;
+       i--)
+  {
+    BasicBlock& block = graph->blocks[i - 1u];
+    graph->WalkBackwards(block, [&liveRuns](AirInstruction* instruction, SlotSet& live, LiveOperands& operands)
+      {
+        unsigned int index = instruction->index;
+        auto occupy = [&liveRuns, index](unsigned int slot)
+          {
+            std::vector<Interval>& runs = liveRuns[slot];
+
+            if (runs.size() > 0u && runs.back().start <= index + 1u)
+            {
+              runs.back().start = index;
+            }
+            else
+            {
+              runs.push_back(Interval{slot, index, index});
+            }
+          };
+
+        live.ForEach(occupy);
+        for (Slot* use : operands.uses) occupy(use->index);
+        for (Slot* def : operands.defs) occupy(def->index);
+      });
+  }
+
+  std::vector<Interval> intervals;
+  std::vector<std::vector<Interval>> precoloredIntervals(target->numRegisters);
+
   for (Slot* slot : code->slots)
   {
-    if (slot->IsConstant())
+    if (slot->IsConstant() || isSpilled[slot->index] || !(slot->ShouldColor() || isPrecolored[slot->index]))
     {
       continue;
     }
 
-    const char* color = "black";
+    std::vector<Interval>& runs = liveRuns[slot->index];
 
-    if (slot->color < 0)
+    // Slots that are never defined or used can go anywhere
+    if (runs.size() == 0u)
     {
-      fprintf(stderr, "WARNING: Found uncolored slot (%s): Presenting as red on interference graph\n", slot->AsString().c_str());
-      color = "red";
+      if (!isPrecolored[slot->index])
+      {
+        slot->color = colors[0u];
+      }
+
+      continue;
     }
-    else
+
+    // The registers of precolored slots are only taken while they're actually live
+    if (isPrecolored[slot->index])
     {
-      color = snazzyColors[slot->color];
+      precoloredIntervals[slot->color].insert(precoloredIntervals[slot->color].end(), runs.begin(), runs.end());
+      continue;
     }
 
-    fprintf(f, "\t%u[label=\"%s\" color=\"%s\" fontcolor=\"%s\"];\n", i, slot->AsString().c_str(), color, color);
-    slot->dotTag = i;
-    i++;
+    intervals.push_back(Interval{slot->index, runs.back().start, runs.front().end});
   }
 
-  // Then emit the interferences between slots
-  for (Slot* slot : code->slots)
+  auto byStart = [](const Interval& a, const Interval& b)
+    {
+      return a.start < b.start;
+    };
+
+  std::sort(intervals.begin(), intervals.end(), byStart);
+  for (std::vector<Interval>& registerIntervals : precoloredIntervals)
   {
-    for (Slot* interference : slot->interferences)
+    std::sort(registerIntervals.begin(), registerIntervals.end(), byStart);
+
+    /*
+     * Precolored slots keep their registers, so two with the same register can't be live at once. They can meet at
+     * the instruction where one is last read and the other is written.
+     */
+    unsigned int lastEnd = 0u;
+    for (Interval& interval : registerIntervals)
     {
-      // NOTE(Isaac): This stops us from emitting duplicate lines, as this will only be true one way around
-      fprintf(f, "\t%u -> %u[dir=none];\n", slot->dotTag, interference->dotTag);
+      Assert(&interval == &registerIntervals.front() || interval.start >= lastEnd,
+             "Slots precolored with the same register are live at the same time");
+      lastEnd = std::max(lastEnd, interval.end);
     }
   }
 
-  fprintf(f, "}\n");
-  fclose(f);
-}
-#endif
+  std::vector<bool> isLiveAcrossCall = FindSlotsLiveAcrossCalls(code);
+  std::vector<size_t> nextPrecolored(target->numRegisters, 0u);
+  std::vector<Interval> active;
+  std::vector<unsigned int> spilledSlots;
 
-void AirGenerator::Apply(ParseResult& parse, TargetMachine* target)
-{
-  for (CodeThing* code : parse.codeThings)
+  for (Interval& interval : intervals)
   {
-    if (code->attribs.isPrototype)
+    // Expire the intervals that have ended, freeing up their registers
+    size_t numStillActive = 0u;
+    for (Interval& activeInterval : active)
     {
-      continue;
+      if (activeInterval.end >= interval.start)
+      {
+        active[numStillActive++] = activeInterval;
+      }
     }
+    active.resize(numStillActive);
 
-    Assert(!(code->airHead), "Tried to generate AIR for CodeThing already with generated code");
-    unsigned int numParams = 0u;
+    bool isFree[target->numRegisters];
+    bool isBlocked[target->numRegisters];
+    memset(isFree, true, sizeof(bool)*target->numRegisters);
+    memset(isBlocked, false, sizeof(bool)*target->numRegisters);
 
-    // Generate slots for the parameters
-    for (VariableDef* param : code->params)
+    for (Interval& activeInterval : active)
+    {
+      isFree[code->slots[activeInterval.slot]->color] = false;
+    }
+
+    /*
+     * A register is blocked if a slot precolored with it is live at any point in this interval. Intervals are
+     * visited in the order they start, so we can skip past precolored intervals that have already ended for good.
+     */
+    for (signed int color : colors)
     {
-      param->slot = new ParameterSlot(code, param);
-      param->slot->color = target->intParamColors[numParams++];
+      std::vector<Interval>& registerIntervals = precoloredIntervals[color];
+      size_t& next = nextPrecolored[color];
 
-      for (VariableDef* member : param->members)
+      while (next < registerIntervals.size() && registerIntervals[next].end < interval.start)
       {
-        member->slot = new MemberSlot(code, param->slot, member);
+        next++;
       }
+
+      isBlocked[color] = (next < registerIntervals.size() && registerIntervals[next].start <= interval.end);
     }
 
-    // Generate slots for the locals
-    for (ScopeDef* scope : code->scopes)
+    Slot* slot = code->slots[interval.slot];
+    for (signed int color : (isLiveAcrossCall[interval.slot] ? acrossCallColors : colors))
     {
-      for (VariableDef* local : scope->locals)
+      if (isFree[color] && !isBlocked[color])
       {
-        local->slot = new VariableSlot(code, local);
-        Assert(local->type.isResolved, "Tried to generate AIR without type information");
+        slot->color = color;
+        break;
+      }
+    }
 
-        for (VariableDef* member : local->members)
-        {
-          member->slot = new MemberSlot(code, local->slot, member);
-        }
+    if (slot->IsColored())
+    {
+      active.push_back(interval);
+      continue;
+    }
+
+    // Find the interval that ends last out of the ones we could take a register from
+    Interval* longest = nullptr;
+    for (Interval& activeInterval : active)
+    {
+      if (isUnspillable[activeInterval.slot] || isBlocked[code->slots[activeInterval.slot]->color])
+      {
+        continue;
+      }
+
+      if (!longest || activeInterval.end > longest->end)
+      {
+        longest = &activeInterval;
       }
     }
 
-    if (!(code->ast))
+    if (longest && (longest->end > interval.end || isUnspillable[interval.slot]))
+    {
+      slot->color = code->slots[longest->slot]->color;
+      spilledSlots.push_back(longest->slot);
+      *longest = interval;
+    }
+    else if (!isUnspillable[interval.slot])
+    {
+      spilledSlots.push_back(interval.slot);
+    }
+    else
+    {
+      RaiseError(code->errorState, ICE_GENERIC, "Failed to find a register for a slot that can't be spilled!");
+    }
+  }
+
+  return spilledSlots;
+}
+
+static void AllocateRegisters(TargetMachine* target, CodeThing* code, bool useLinearScan)
+{
+  if (!(code->airHead))
+  {
+    return;
+  }
+
+  /*
+   * Some registers may be reserved for special purposes - we should not use these for general stuff.
+   *
+   * Values that are live across a call prefer callee-saved registers, as they're only saved once, in the
+   * prologue, instead of around every call. Other values prefer caller-saved registers, which don't need saving
+   * at all if they're not live across a call, so that functions that don't need callee-saved registers don't
+   * have to save any.
+   */
+  std::vector<signed int> colors;
+  std::vector<signed int> acrossCallColors;
+  for (unsigned int i = 0u;
+       i < target->numRegisters;
+       i++)
+  {
+    if (target->registerSet[i]->usage == BaseRegisterDef::Usage::GENERAL)
     {
-      return;
+      (target->registerSet[i]->isCalleeSaved ? acrossCallColors : colors).push_back(static_cast<signed int>(i));
     }
+  }
+
+  unsigned int numCallerSaved = colors.size();
+  colors.insert(colors.end(), acrossCallColors.begin(), acrossCallColors.end());
+  acrossCallColors.insert(acrossCallColors.end(), colors.begin(), colors.begin() + numCallerSaved);
+
+  std::vector<bool> isPrecolored;
+  for (Slot* slot : code->slots)
+  {
+    isPrecolored.push_back(slot->IsColored());
+  }
+
+  std::vector<bool> isSpilled(code->slots.size(), false);
+  std::vector<bool> isUnspillable(code->slots.size(), false);
 
-    // Generate AIR from the AST
-    AirState state(target, code);
-    Dispatch(code->ast, &state);
+  while (true)
+  {
+    std::vector<unsigned int> spilledSlots =
+      (useLinearScan ?
+        ScanLiveIntervals(target, code, colors, acrossCallColors, isPrecolored, isSpilled, isUnspillable) :
+        ColorInterferenceGraph(target, code, colors, acrossCallColors, isPrecolored, isSpilled, isUnspillable));
 
-    // Precolor the interference graph
-    InstructionPrecolorer* precolorer = target->CreateInstructionPrecolorer();
-    for (AirInstruction* instruction = code->airHead;
-         instruction;
-         instruction = instruction->next)
+    if (spilledSlots.size() == 0u)
     {
-      precolorer->Dispatch(instruction);
+      break;
     }
-    delete precolorer;
-    
-    // Color the interference graph
-    GenerateInterferenceGraph(code);
-    ColorSlots(target, code);
 
-    // Print an AIR instruction listing and a slot listing
-#if 1
-    printf("\nInstruction listing for %s:\n", code->mangledName.c_str());
-    for (AirInstruction* instruction = code->airHead;
-         instruction;
-         instruction = instruction->next)
+    for (unsigned int index : spilledSlots)
+    {
+      isSpilled[index] = true;
+    }
+
+    unsigned int firstNewSlot = code->slots.size();
+    RewriteSpilledSlots(target, code, spilledSlots);
+    code->numSpilledSlots += spilledSlots.size();
+
+    // The temporaries for the loads and stores are the only new slots that need a register
+    isPrecolored.resize(code->slots.size(), false);
+    isSpilled.resize(code->slots.size(), false);
+    isUnspillable.resize(code->slots.size(), false);
+
+    for (unsigned int i = firstNewSlot;
+         i < code->slots.size();
+         i++)
     {
-      printf("%s\n", instruction->AsString().c_str());
+      isUnspillable[i] = (code->slots[i]->GetType() == SlotType::TEMPORARY);
     }
 
-    printf("\nSlots for %s:\n", code->mangledName.c_str());
+    // Start again from scratch with the rewritten AIR
+    delete code->controlFlowGraph;
+    code->controlFlowGraph = new ControlFlowGraph(code);
+
     for (Slot* slot : code->slots)
     {
-      printf("%s\n", slot->AsString().c_str());
+      slot->interferences.clear();
+
+      if (!isPrecolored[slot->index])
+      {
+        slot->color = -1;
+      }
     }
-#endif
+  }
+}
 
-#ifdef OUTPUT_DOT
-    EmitInterferenceGraphDOT(code);
-#endif
+/*
+ * Finds the registers that hold values still needed after each call, so the code generator knows which ones to
+ * preserve across it. This is one walk over the AIR, instead of searching for each register at every call site.
+ */
+static void FindLiveColorsAtCalls(CodeThing* code)
+{
+  ControlFlowGraph* graph = code->controlFlowGraph;
+
+  for (BasicBlock& block : graph->blocks)
+  {
+    graph->WalkBackwards(block, [code](AirInstruction* instruction, SlotSet& live, LiveOperands& /*operands*/)
+      {
+        if (instruction->instructionType != InstructionType::CALL)
+        {
+          return;
+        }
+
+        CallInstruction* call = static_cast<CallInstruction*>(instruction);
+        call->liveColors = 0u;
+
+        live.ForEach([code, call](unsigned int index)
+          {
+            Slot* slot = code->slots[index];
+
+            // The call writes its result, so the old value of the result's register isn't needed afterwards
+            if (slot->IsColored() && slot != call->returnResult)
+            {
+              call->liveColors |= (1u << slot->color);
+            }
+          });
+      });
   }
 }
 
-bool IsColorInUseAtPoint(CodeThing* code, AirInstruction* instruction, signed int color)
+#ifdef OUTPUT_DOT
+static void EmitInterferenceGraphDOT(CodeThing* code)
 {
+  if (!(code->airHead))
+  {
+    return;
+  }
+
+  std::string fileName = code->mangledName.Str() + "_interference.dot";
+  FILE* f = fopen(fileName.c_str(), "w");
+
+  if (!f)
+  {
+    RaiseError(ERROR_FAILED_TO_OPEN_FILE, fileName.c_str());
+  }
+
+  fprintf(f, "digraph G\n{\n");
+  unsigned int i = 0u;
+
+  const char* snazzyColors[] =
+  {
+    "cyan2",      "deeppink",   "darkgoldenrod2",     "mediumpurple2",  "slategray",    "chartreuse3",
+    "green3",     "lightblue2", "mediumspringgreeen", "orange1",        "mistyrose3",   "maroon2",
+    "steelblue2", "blue",       "lightseagreen",      "plum",           "dodgerblue4",  "darkorchid1",
+  };
+
+  // First emit a colored node for each slot
   for (Slot* slot : code->slots)
   {
     if (slot->IsConstant())
@@ -1067,28 +2165,151 @@ bool IsColorInUseAtPoint(CodeThing* code, AirInstruction* instruction, signed in
       continue;
     }
 
-    if (slot->color != color)
+    const char* color = "black";
+
+    if (slot->color < 0)
     {
-      continue;
+      fprintf(stderr, "WARNING: Found uncolored slot (%s): Presenting as red on interference graph\n", slot->AsString().c_str());
+      color = "red";
+    }
+    else
+    {
+      color = snazzyColors[slot->color];
     }
 
-    for (LiveRange& range : slot->liveRanges)
+    fprintf(f, "\t%u[label=\"%s\" color=\"%s\" fontcolor=\"%s\"];\n", i, slot->AsString().c_str(), color, color);
+    slot->dotTag = i;
+    i++;
+  }
+
+  // Then emit the interferences between slots
+  for (Slot* slot : code->slots)
+  {
+    for (Slot* interference : slot->interferences)
     {
-      /*
-       * If the slot is never used, it doesn't matter if it's overwritten, so skip it
-       */
-      if (!(range.lastUse))
+      // NOTE(Isaac): This stops us from emitting duplicate lines, as this will only be true one way around
+      if (slot->index < interference->index)
       {
-        continue;
+        fprintf(f, "\t%u -> %u[dir=none];\n", slot->dotTag, interference->dotTag);
       }
+    }
+  }
+
+  fprintf(f, "}\n");
+  fclose(f);
+}
+#endif
+
+void AirGenerator::ApplyTo(ParseResult& parse, TargetMachine* target, CodeThing* code)
+{
+  if (code->attribs.isPrototype)
+  {
+    return;
+  }
+
+  Assert(!(code->airHead), "Tried to generate AIR for CodeThing already with generated code");
+
+  // Generate slots for the parameters
+  for (VariableDef* param : code->params)
+  {
+    param->slot = new ParameterSlot(code, param);
+
+    for (VariableDef* member : param->members)
+    {
+      member->slot = new MemberSlot(code, param->slot, member);
+    }
+  }
+
+  // Generate slots for the locals
+  for (ScopeDef* scope : code->scopes)
+  {
+    for (VariableDef* local : scope->locals)
+    {
+      local->slot = new VariableSlot(code, local);
+      Assert(local->type.isResolved, "Tried to generate AIR without type information");
 
-      signed int definitionIndex = (range.definition ? range.definition->index : 0u);
-      if ((instruction->index >= definitionIndex) && (instruction->index <= range.lastUse->index))
+      for (VariableDef* member : local->members)
       {
-        return true;
+        member->slot = new MemberSlot(code, local->slot, member);
       }
     }
   }
 
-  return false;
+  if (!(code->ast))
+  {
+    return;
+  }
+
+  /*
+   * The parameters are copied out of the registers they're passed in when the function starts, so they aren't
+   * stuck in them for the whole function (they may be needed to pass arguments to other functions).
+   */
+  unsigned int numParams = 0u;
+  for (VariableDef* param : code->params)
+  {
+    TemporarySlot* passedSlot = new TemporarySlot(code);
+    passedSlot->color = target->intParamColors[numParams++];
+    PushInstruction(code, new MovInstruction(passedSlot, param->slot));
+  }
+
+  // Generate AIR from the AST, then transform it
+  AirState state(target, code);
+  Dispatch(code->ast, &state);
+  passes.Run(code);
+
+  // Precolor the interference graph
+  InstructionPrecolorer* precolorer = target->CreateInstructionPrecolorer();
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    precolorer->Dispatch(instruction);
+  }
+  delete precolorer;
+
+  /*
+   * Work out which slots are live where. A variable that's live on entry to the function is read before it's given
+   * a value, along at least one path through it.
+   */
+  code->controlFlowGraph = new ControlFlowGraph(code);
+  if (code->controlFlowGraph->blocks.size() > 0u)
+  {
+    code->controlFlowGraph->blocks[0u].liveIn.ForEach([code](unsigned int index)
+      {
+        if (code->slots[index]->GetType() == SlotType::VARIABLE)
+        {
+          RaiseError(code->errorState, ERROR_BIND_USED_BEFORE_INIT, code->slots[index]->AsString().c_str());
+        }
+      });
+  }
+
+  // Allocate registers, by coloring the interference graph unless we've been asked to be quick about it
+  AllocateRegisters(target, code, parse.useLinearScan);
+  FindLiveColorsAtCalls(code);
+
+  /*
+   * Print an AIR instruction listing and a slot listing.
+   * NOTE(Isaac): this is built up and printed in one go, so listings of things compiled at the same time don't
+   * get mixed up with each other.
+   */
+#if 1
+  std::string listing = FormatString("\nInstruction listing for %s:\n", code->mangledName.c_str());
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    listing += instruction->AsString() + "\n";
+  }
+
+  listing += FormatString("\nSlots for %s:\n", code->mangledName.c_str());
+  for (Slot* slot : code->slots)
+  {
+    listing += slot->AsString() + "\n";
+  }
+  fputs(listing.c_str(), stdout);
+#endif
+
+#ifdef OUTPUT_DOT
+  EmitInterferenceGraphDOT(code);
+#endif
 }
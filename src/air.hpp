@@ -7,24 +7,15 @@
 
 #include <cstdint>
 #include <vector>
+#include <atomic>
+#include <unordered_map>
 #include <ast.hpp>
 #include <ir.hpp>
+#include <liveness.hpp>
 
 struct AirInstruction;
 struct TargetMachine;
 
-struct LiveRange
-{
-  LiveRange(AirInstruction* definition, AirInstruction* lastUse);
-  ~LiveRange() { }
-
-  /*
-   * If `definition` is nullptr, the slot has a value on entry into the scope.
-   */
-  AirInstruction* definition;
-  AirInstruction* lastUse;
-};
-
 enum class SlotType
 {
   VARIABLE,
@@ -32,6 +23,7 @@ enum class SlotType
   MEMBER,
   TEMPORARY,
   RETURN_RESULT,
+  SPILL,
   UNSIGNED_INT_CONSTANT,
   INT_CONSTANT,
   FLOAT_CONSTANT,
@@ -39,14 +31,14 @@ enum class SlotType
   STRING_CONSTANT
 };
 
-struct Slot
+struct Slot : ArenaObject
 {
   Slot(CodeThing* code);
   virtual ~Slot() = default;
 
+  unsigned int            index;          // Index into the `CodeThing`'s slots
   signed int              color;          // -1 means it hasn't been colored
-  std::vector<Slot*>      interferences;
-  std::vector<LiveRange>  liveRanges;
+  std::vector<Slot*>      interferences;  // NOTE(Isaac): each interfering slot appears once
 #ifdef OUTPUT_DOT
   unsigned int dotTag;
 #endif
@@ -59,8 +51,6 @@ struct Slot
   virtual SlotType GetType() = 0;
   virtual bool IsConstant() = 0;
   virtual bool ShouldColor() = 0;
-  virtual void Use(AirInstruction* instruction) = 0;
-  virtual void ChangeValue(AirInstruction* instruction) = 0;
   virtual std::string AsString() = 0;
 };
 
@@ -70,12 +60,11 @@ struct VariableSlot : Slot
   ~VariableSlot() { }
 
   VariableDef* variable;
+  unsigned int version;   // Which SSA version of the variable this slot holds (0 for the original slot)
 
   SlotType GetType()  { return SlotType::VARIABLE;  }
   bool IsConstant()   { return false;               }
   bool ShouldColor()  { return true;                }
-  void Use(AirInstruction* instruction);
-  void ChangeValue(AirInstruction* instruction);
   std::string AsString();
 };
 
@@ -88,9 +77,7 @@ struct ParameterSlot : Slot
 
   SlotType GetType()  { return SlotType::PARAMETER; }
   bool IsConstant()   { return false;               }
-  bool ShouldColor()  { return false;               }
-  void Use(AirInstruction* instruction);
-  void ChangeValue(AirInstruction* instruction);
+  bool ShouldColor()  { return true;                }
   std::string AsString();
 };
 
@@ -107,8 +94,6 @@ struct MemberSlot : Slot
   SlotType GetType()  { return SlotType::MEMBER;  }
   bool IsConstant()   { return false;             }
   bool ShouldColor()  { return false;             }
-  void Use(AirInstruction* instruction);
-  void ChangeValue(AirInstruction* instruction);
   std::string AsString();
 };
 
@@ -121,8 +106,6 @@ struct TemporarySlot : Slot
   SlotType GetType()  { return SlotType::TEMPORARY; }
   bool IsConstant()   { return false;               }
   bool ShouldColor()  { return true;                }
-  void Use(AirInstruction* instruction);
-  void ChangeValue(AirInstruction* instruction);
   std::string AsString();
 };
 
@@ -135,8 +118,26 @@ struct ReturnResultSlot : Slot
   SlotType GetType()  { return SlotType::RETURN_RESULT; }
   bool IsConstant()   { return false;                   }
   bool ShouldColor()  { return false;                   }
-  void Use(AirInstruction* instruction);
-  void ChangeValue(AirInstruction* instruction);
+  std::string AsString();
+};
+
+/*
+ * When the register allocator can't fit a slot into a register, it gives it one of these instead - a place on the
+ * stack to keep its value. The allocator then rewrites the AIR, so the value is loaded from the stack into a
+ * short-lived temporary before each use of the slot, and stored back after each definition.
+ * NOTE(Isaac): these live in memory, so aren't tracked by the liveness analysis.
+ */
+struct SpillSlot : Slot
+{
+  SpillSlot(CodeThing* code, Slot* spilledSlot, int offset);
+  ~SpillSlot() { }
+
+  Slot* spilledSlot;
+  int   offset;       // From the base pointer
+
+  SlotType GetType()  { return SlotType::SPILL; }
+  bool IsConstant()   { return false;           }
+  bool ShouldColor()  { return false;           }
   std::string AsString();
 };
 
@@ -183,20 +184,36 @@ struct ConstantSlot : Slot
 
   bool IsConstant()   { return true;  }
   bool ShouldColor()  { return false; }
-  void Use(AirInstruction* /*instruction*/) { }
-  void ChangeValue(AirInstruction* /*instruction*/) { }
   std::string AsString();
 };
 
-struct AirInstruction
+/*
+ * Each type of instruction is tagged with one of these, so passes can find what it is without going through RTTI.
+ * NOTE(Isaac): `AirPass::Dispatch` switches on this, so should be kept in sync with the instruction types below.
+ */
+enum class InstructionType
+{
+  LABEL,
+  RETURN,
+  JUMP,
+  MOV,
+  CMP,
+  UNARY_OP,
+  BINARY_OP,
+  CALL,
+  PHI
+};
+
+struct AirInstruction : ArenaObject
 {
-  AirInstruction();
-  virtual ~AirInstruction();
+  AirInstruction(InstructionType instructionType);
+  virtual ~AirInstruction() = default;
 
   virtual std::string AsString() = 0;
 
-  signed int      index;    // NOTE(Isaac): value of -1 used to detect instructions that haven't been pushed yet
-  AirInstruction* next;
+  const InstructionType instructionType;
+  signed int            index;    // NOTE(Isaac): value of -1 used to detect instructions that haven't been pushed yet
+  AirInstruction*       next;
 };
 
 /*
@@ -205,6 +222,8 @@ struct AirInstruction
  */
 struct LabelInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::LABEL;
+
   LabelInstruction();
 
   std::string AsString();
@@ -217,6 +236,8 @@ struct LabelInstruction : AirInstruction
 
 struct ReturnInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::RETURN;
+
   ReturnInstruction(Slot* returnValue);
   ~ReturnInstruction() { }
 
@@ -227,6 +248,8 @@ struct ReturnInstruction : AirInstruction
 
 struct JumpInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::JUMP;
+
   enum Condition
   {
     UNCONDITIONAL,
@@ -255,6 +278,8 @@ struct JumpInstruction : AirInstruction
 
 struct MovInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::MOV;
+
   MovInstruction(Slot* src, Slot* dest);
   ~MovInstruction() { }
 
@@ -266,6 +291,8 @@ struct MovInstruction : AirInstruction
 
 struct CmpInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::CMP;
+
   CmpInstruction(Slot* a, Slot* b);
   ~CmpInstruction() { }
 
@@ -277,6 +304,8 @@ struct CmpInstruction : AirInstruction
 
 struct UnaryOpInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::UNARY_OP;
+
   enum Operation
   {
     INCREMENT,
@@ -301,6 +330,8 @@ struct UnaryOpInstruction : AirInstruction
  */
 struct BinaryOpInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::BINARY_OP;
+
   enum Operation
   {
     ADD,
@@ -323,12 +354,46 @@ struct BinaryOpInstruction : AirInstruction
 
 struct CallInstruction : AirInstruction
 {
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::CALL;
+
   CallInstruction(CodeThing* thing);
   ~CallInstruction() { }
 
   std::string AsString();
 
-  CodeThing* thing;
+  CodeThing*          thing;
+  std::vector<Slot*>  params;         // NOTE(Isaac): these are precolored into the parameter registers
+  Slot*               returnResult;   // `nullptr` if the called thing doesn't return anything
+
+  /*
+   * Bit `n` is set if a slot with color `n` holds a value that's still needed after the call, so the register
+   * must be preserved across it. This is filled in once registers have been allocated.
+   */
+  uint32_t            liveColors;
+};
+
+/*
+ * These only exist while the AIR is in SSA form (see `ssa.hpp`), and are removed before registers are allocated.
+ * They sit at the top of a block, just after its label, and pick which version of a slot to use depending on which
+ * predecessor control came from. All of a block's phis happen at once, on entry to the block.
+ */
+struct PhiInstruction : AirInstruction
+{
+  static constexpr InstructionType INSTRUCTION_TYPE = InstructionType::PHI;
+
+  struct Operand
+  {
+    Slot*           value;
+    AirInstruction* from;   // The last instruction of the predecessor the value comes from
+  };
+
+  PhiInstruction(Slot* result);
+  ~PhiInstruction() { }
+
+  std::string AsString();
+
+  Slot*                 result;
+  std::vector<Operand>  operands;   // One for each predecessor of the block
 };
 
 /*
@@ -342,10 +407,20 @@ struct AirState
     :target(target)
     ,code(code)
     ,breakLabel(nullptr)
+    ,caller(nullptr)
+    ,inlinedThing(nullptr)
+    ,inlinedSlots()
+    ,returnLabel(nullptr)
+    ,returnResult(nullptr)
   {
   }
   ~AirState() { }
 
+  /*
+   * Finds the slot that holds a variable. This is the variable's own slot, unless we're generating inlined code.
+   */
+  Slot* GetSlot(VariableDef* variable);
+
   TargetMachine* target;
   CodeThing* code;
 
@@ -353,15 +428,30 @@ struct AirState
    * If we're inside a loop, we set this to the label that should be jumped to upon a `break`
    */
   LabelInstruction* breakLabel;
+
+  /*
+   * When a call is inlined, the AIR for the called thing's AST is generated into the caller with its own state.
+   * Its variables are given new slots in the caller, and its returns move the result into `returnResult` and
+   * jump to `returnLabel`, which is at the end of the inlined code.
+   */
+  AirState*                                 caller;         // `nullptr` if this isn't inlined code
+  CodeThing*                                inlinedThing;
+  std::unordered_map<VariableDef*, Slot*>   inlinedSlots;
+  LabelInstruction*                         returnLabel;
+  Slot*                                     returnResult;   // `nullptr` if the inlined thing doesn't return anything
 };
 
+struct AirPassManager;
 struct AirGenerator : ASTPass<Slot*, AirState>
 {
-  AirGenerator()
+  AirGenerator(AirPassManager& passes)
     :ASTPass()
+    ,passes(passes)
   { }
 
-  void Apply(ParseResult& parse, TargetMachine* target);
+  AirPassManager& passes;   // Run over the AIR once it's been generated, before registers are allocated
+
+  void ApplyTo(ParseResult& parse, TargetMachine* target, CodeThing* code);
 
   Slot* VisitNode(BreakNode* node                   , AirState* state);
   Slot* VisitNode(ReturnNode* node                  , AirState* state);
@@ -383,9 +473,65 @@ struct AirGenerator : ASTPass<Slot*, AirState>
   Slot* VisitNode(ArrayInitNode* node               , AirState* state);
   Slot* VisitNode(InfiniteLoopNode* node            , AirState* state);
   Slot* VisitNode(ConstructNode* node               , AirState* state);
+
+private:
+  bool CanInline(CodeThing* thing, AirState* state);
+  bool TryInline(CallNode* node, const std::vector<Slot*>& args, AirState* state, Slot*& result);
+};
+
+bool IsRegisterSlot(Slot* slot);
+
+/*
+ * Finds the slots an instruction reads from (uses) and writes to (defines), as pointers into the instruction so
+ * they can be changed. Returns the number of operands found.
+ */
+struct SlotOperand
+{
+  Slot**  slot;
+  bool    isUse;
+};
+
+unsigned int GetSlotOperands(AirInstruction* instruction, SlotOperand operands[3u]);
+
+/*
+ * Replaces a thing's AIR with the given instructions, in order, and numbers them. Passes that change the AIR build
+ * up a new list of instructions and then use this, so the instructions are always numbered in order.
+ */
+void ReplaceInstructions(CodeThing* code, const std::vector<AirInstruction*>& instructions);
+
+/*
+ * These are passes that transform a thing's AIR after it's been generated, such as optimizations, and are run in
+ * order by an `AirPassManager`. Things are compiled in parallel, so a pass shouldn't keep any state between calls
+ * to `Apply`.
+ */
+struct AirTransformPass
+{
+  AirTransformPass(const char* name)
+    :name(name)
+    ,microseconds(0u)
+  {
+  }
+  virtual ~AirTransformPass() { }
+
+  virtual void Apply(CodeThing* code) = 0;
+
+  const char*           name;
+  std::atomic<uint64_t> microseconds;   // How long this pass has taken, over all the things it's been applied to
 };
 
-bool IsColorInUseAtPoint(CodeThing* code, AirInstruction* instruction, signed int color);
+struct AirPassManager
+{
+  AirPassManager() = default;
+  ~AirPassManager();
+
+  /*
+   * Takes ownership of the pass. Passes are run in the order they were added.
+   */
+  void Add(AirTransformPass* pass);
+  void Run(CodeThing* code);
+
+  std::vector<AirTransformPass*> passes;
+};
 
 /*
  * This allows dynamic dispatch based upon the type of an AIR instruction.
@@ -403,38 +549,37 @@ struct AirPass
   virtual void Visit(UnaryOpInstruction*,   T* = nullptr) = 0;
   virtual void Visit(BinaryOpInstruction*,  T* = nullptr) = 0;
   virtual void Visit(CallInstruction*,      T* = nullptr) = 0;
+  virtual void Visit(PhiInstruction*,       T* = nullptr) = 0;
 
   /*
-   * This uses the same bodged dynamic dispatch approach as the AST pass system.
-   * There is more justification for it there.
+   * This switches on the instruction's tag, in the same way as the AST pass system.
    */
   void Dispatch(AirInstruction* instruction, T* state = nullptr)
   {
     Assert(instruction, "Tried to dispatch on a nullptr instruction");
 
-    // XXX: Again, if this is too slow, we could instead compare an id returned from the node virtually
-    // (but this is more fragile because we have to manange the ids ourselves)
     #define DISPATCH(instructionType)\
-      if (strcmp(typeid(*instruction).name(), typeid(instructionType).name()) == 0)\
+      case instructionType::INSTRUCTION_TYPE:\
       {\
         Visit(reinterpret_cast<instructionType*>(instruction), state);\
         return;\
       }
 
-         DISPATCH(LabelInstruction)
-    else DISPATCH(ReturnInstruction)
-    else DISPATCH(JumpInstruction)
-    else DISPATCH(MovInstruction)
-    else DISPATCH(CmpInstruction)
-    else DISPATCH(UnaryOpInstruction)
-    else DISPATCH(BinaryOpInstruction)
-    else DISPATCH(CallInstruction)
-    else
+    switch (instruction->instructionType)
     {
-      RaiseError(ICE_UNHANDLED_INSTRUCTION_TYPE, "Dispatch(AirPass)", typeid(*instruction).name());
+      DISPATCH(LabelInstruction)
+      DISPATCH(ReturnInstruction)
+      DISPATCH(JumpInstruction)
+      DISPATCH(MovInstruction)
+      DISPATCH(CmpInstruction)
+      DISPATCH(UnaryOpInstruction)
+      DISPATCH(BinaryOpInstruction)
+      DISPATCH(CallInstruction)
+      DISPATCH(PhiInstruction)
     }
     #undef DISPATCH
 
+    RaiseError(ICE_UNHANDLED_INSTRUCTION_TYPE, "Dispatch(AirPass)", typeid(*instruction).name());
     __builtin_unreachable();
   }
 };
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <arena.hpp>
+#include <cstdlib>
+#include <error.hpp>
+
+/*
+ * Blocks start off at a page, which is enough for the AST and AIR of most small functions (so most `CodeThing`s
+ * only need one), and double in size each time we need a new one, up to a maximum. Allocations bigger than a quarter of the maximum are given a block of their own, so we
+ * don't waste the rest of the current one.
+ */
+static const size_t ARENA_MIN_BLOCK_SIZE  = 0x1000u;
+static const size_t ARENA_MAX_BLOCK_SIZE  = 0x10000u;
+static const size_t ARENA_ALIGNMENT       = alignof(void*);
+static const size_t OBJECT_HEADER_SIZE    = sizeof(Arena::ObjectHeader);
+
+static_assert(OBJECT_HEADER_SIZE % ARENA_ALIGNMENT == 0u, "Object headers must keep the objects after them aligned");
+
+static thread_local Arena* g_currentArena = nullptr;
+
+Arena::Arena()
+  :numAllocations(0u)
+  ,bytesAllocated(0u)
+  ,blocks()
+  ,head(nullptr)
+  ,blockEnd(nullptr)
+  ,newestObject(nullptr)
+  ,oldestObject(nullptr)
+{
+}
+
+Arena::Arena(Arena&& other)
+  :Arena()
+{
+  Adopt(other);
+}
+
+Arena& Arena::operator=(Arena&& other)
+{
+  FreeBlocks();
+  Adopt(other);
+  return *this;
+}
+
+Arena::~Arena()
+{
+  FreeBlocks();
+}
+
+void Arena::FreeBlocks()
+{
+  for (ObjectHeader* header = newestObject;
+       header;
+       header = header->GetNext())
+  {
+    if (header->IsLive())
+    {
+      header->MarkDeleted();
+      reinterpret_cast<ArenaObject*>(reinterpret_cast<uint8_t*>(header) + OBJECT_HEADER_SIZE)->~ArenaObject();
+    }
+  }
+
+  for (uint8_t* block : blocks)
+  {
+    free(block);
+  }
+
+  blocks.clear();
+  head            = nullptr;
+  blockEnd        = nullptr;
+  newestObject    = nullptr;
+  oldestObject    = nullptr;
+  numAllocations  = 0u;
+  bytesAllocated  = 0u;
+}
+
+void* Arena::Allocate(size_t size)
+{
+  size = (size + ARENA_ALIGNMENT - 1u) & ~(ARENA_ALIGNMENT - 1u);
+  numAllocations++;
+  bytesAllocated += size;
+
+  if (size > ARENA_MAX_BLOCK_SIZE / 4u)
+  {
+    uint8_t* block = static_cast<uint8_t*>(malloc(size));
+    Assert(block, "Failed to allocate block for arena");
+
+    // NOTE(Isaac): put it behind the current block, so we carry on allocating from that one
+    blocks.insert((blocks.size() > 0u ? blocks.end() - 1u : blocks.end()), block);
+    return block;
+  }
+
+  if (!head || static_cast<size_t>(blockEnd - head) < size)
+  {
+    size_t blockSize = (head ? static_cast<size_t>(blockEnd - blocks.back()) * 2u : ARENA_MIN_BLOCK_SIZE);
+    if (blockSize > ARENA_MAX_BLOCK_SIZE)
+    {
+      blockSize = ARENA_MAX_BLOCK_SIZE;
+    }
+
+    while (blockSize < size)
+    {
+      blockSize *= 2u;
+    }
+
+    head = static_cast<uint8_t*>(malloc(blockSize));
+    Assert(head, "Failed to allocate block for arena");
+    blockEnd = head + blockSize;
+    blocks.push_back(head);
+  }
+
+  void* allocation = head;
+  head += size;
+  return allocation;
+}
+
+void* Arena::AllocateObject(size_t size)
+{
+  ObjectHeader* header = static_cast<ObjectHeader*>(Allocate(OBJECT_HEADER_SIZE + size));
+  header->link = reinterpret_cast<uintptr_t>(newestObject);
+
+  newestObject = header;
+  if (!oldestObject)
+  {
+    oldestObject = header;
+  }
+
+  return reinterpret_cast<uint8_t*>(header) + OBJECT_HEADER_SIZE;
+}
+
+void Arena::Adopt(Arena& other)
+{
+  if (other.blocks.size() == 0u)
+  {
+    return;
+  }
+
+  if (other.newestObject)
+  {
+    other.oldestObject->link = reinterpret_cast<uintptr_t>(newestObject) | (other.oldestObject->link & 1u);
+    newestObject = other.newestObject;
+    oldestObject = (oldestObject ? oldestObject : other.oldestObject);
+  }
+
+  /*
+   * We carry on allocating from whichever current block has the most space left, so put that one at the end.
+   */
+  if (head && static_cast<size_t>(blockEnd - head) >= static_cast<size_t>(other.blockEnd - other.head))
+  {
+    blocks.insert(blocks.end() - 1u, other.blocks.begin(), other.blocks.end());
+  }
+  else
+  {
+    blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+    head      = other.head;
+    blockEnd  = other.blockEnd;
+  }
+
+  numAllocations += other.numAllocations;
+  bytesAllocated += other.bytesAllocated;
+
+  other.blocks.clear();
+  other.head            = nullptr;
+  other.blockEnd        = nullptr;
+  other.newestObject    = nullptr;
+  other.oldestObject    = nullptr;
+  other.numAllocations  = 0u;
+  other.bytesAllocated  = 0u;
+}
+
+ArenaScope::ArenaScope(Arena& arena)
+  :previous(g_currentArena)
+{
+  g_currentArena = &arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+  g_currentArena = previous;
+}
+
+void* AllocateFromCurrentArena(size_t size)
+{
+  Assert(g_currentArena, "Tried to allocate an arena object without a current arena");
+  return g_currentArena->AllocateObject(size);
+}
+
+void ArenaObject::operator delete(void* ptr)
+{
+  if (!ptr)
+  {
+    return;
+  }
+
+  // NOTE(Isaac): the memory is freed with the rest of the arena, but we shouldn't destroy the object again
+  reinterpret_cast<Arena::ObjectHeader*>(static_cast<uint8_t*>(ptr) - OBJECT_HEADER_SIZE)->MarkDeleted();
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * An Arena is a bump allocator: memory is handed out from big blocks, and is never given back individually. Instead,
+ * all of the blocks are freed at once when the arena is destroyed. We have one arena for each compilation (owned by
+ * the `ParseResult`, for things created while parsing and completing the IR), and one for each `CodeThing` (for
+ * things created while running the passes on it and generating its AIR).
+ *
+ * The arena also owns the objects allocated from it: the ones that haven't already been deleted are destroyed
+ * just before the blocks are freed, so the memory they own (e.g. in `std::vector`s) is freed too. This means an
+ * object shouldn't delete the arena objects it points to in its destructor - they'll be destroyed by their arena.
+ *
+ * NOTE(Isaac): an arena must only be used by one thread at a time. This holds because the only things compiled
+ * in parallel are different files (which have their own `ParseResult`s) and different `CodeThing`s.
+ */
+struct Arena
+{
+  Arena();
+  Arena(Arena&& other);
+  Arena& operator=(Arena&& other);
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* Allocate(size_t size);
+
+  /*
+   * Allocates the memory for an `ArenaObject`, which is destroyed along with the arena unless it's been deleted
+   * before then.
+   */
+  void* AllocateObject(size_t size);
+
+  /*
+   * Takes ownership of all of the memory allocated from another arena, leaving it empty. This is used when merging
+   * the results of parsing different files.
+   */
+  void Adopt(Arena& other);
+
+  unsigned int  numAllocations;
+  size_t        bytesAllocated;
+
+  /*
+   * Each object is allocated with one of these in front of it, so the arena can find the objects it needs to destroy.
+   * NOTE(Isaac): there are lots of small objects, so this is kept to a single pointer: headers are at least
+   * pointer-aligned, so the bottom bit of the link to the object allocated before this one is used to mark whether
+   * this one has been deleted.
+   */
+  struct ObjectHeader
+  {
+    uintptr_t link;
+
+    ObjectHeader* GetNext() const { return reinterpret_cast<ObjectHeader*>(link & ~uintptr_t(1u)); }
+    bool IsLive() const           { return !(link & 1u); }
+    void MarkDeleted()            { link |= 1u; }
+  };
+
+private:
+  void FreeBlocks();
+
+  std::vector<uint8_t*> blocks;
+  uint8_t*              head;       // Next free byte in the current block
+  uint8_t*              blockEnd;
+  ObjectHeader*         newestObject;
+  ObjectHeader*         oldestObject;
+};
+
+/*
+ * Objects that are allocated with `new` are allocated from the current thread's current arena. This sets the
+ * current arena until it goes out of scope, when the previous one is restored.
+ */
+struct ArenaScope
+{
+  ArenaScope(Arena& arena);
+  ~ArenaScope();
+
+  Arena* previous;
+};
+
+void* AllocateFromCurrentArena(size_t size);
+
+/*
+ * Types that should be allocated from an arena should inherit from this. Deleting one still calls its
+ * destructor, but the memory isn't actually freed until its arena is. Otherwise, it's destroyed when its arena is.
+ * NOTE(Isaac): the arena destroys an object through a pointer to the start of its allocation, so this must be the
+ * first (and only) base of the types that inherit from it. Arena memory is only pointer-aligned, so they also
+ * can't have members that need more than that (e.g. SIMD vectors).
+ */
+struct ArenaObject
+{
+  virtual ~ArenaObject() { }
+
+  static void* operator new(size_t size) { return AllocateFromCurrentArena(size); }
+  static void operator delete(void* ptr);
+};
@@ -7,9 +7,10 @@
 
 using namespace std::string_literals;
 
-ASTNode::ASTNode()
+ASTNode::ASTNode(NodeType nodeType)
   :next(nullptr)
   ,prev(nullptr)
+  ,nodeType(nodeType)
   ,type(nullptr)
   ,shouldFreeTypeRef(false)
   ,containingScope(nullptr)
@@ -23,8 +24,6 @@ ASTNode::~ASTNode()
     Assert(type, "Nullptr type-ref marked as should be freed");
     delete type;
   }
-
-  delete next;
 }
 
 std::string BreakNode::AsString()
@@ -33,16 +32,11 @@ std::string BreakNode::AsString()
 }
 
 ReturnNode::ReturnNode(ASTNode* returnValue)
-  :ASTNode()
+  :ASTNode(NodeType::RETURN)
   ,returnValue(returnValue)
 {
 }
 
-ReturnNode::~ReturnNode()
-{
-  delete returnValue;
-}
-
 std::string ReturnNode::AsString()
 {
   if (returnValue)
@@ -56,7 +50,7 @@ std::string ReturnNode::AsString()
 }
 
 UnaryOpNode::UnaryOpNode(Operator op, ASTNode* operand)
-  :ASTNode()
+  :ASTNode(NodeType::UNARY_OP)
   ,op(op)
   ,intrinsicType(NUM_INTRINSIC_OP_TYPES)
   ,operand(operand)
@@ -64,11 +58,6 @@ UnaryOpNode::UnaryOpNode(Operator op, ASTNode* operand)
 {
 }
 
-UnaryOpNode::~UnaryOpNode()
-{
-  delete operand;
-}
-
 std::string UnaryOpNode::AsString()
 {
   switch (op)
@@ -88,7 +77,7 @@ std::string UnaryOpNode::AsString()
 }
 
 BinaryOpNode::BinaryOpNode(Operator op, ASTNode* left, ASTNode* right)
-  :ASTNode()
+  :ASTNode(NodeType::BINARY_OP)
   ,op(op)
   ,intrinsicType(NUM_INTRINSIC_OP_TYPES)
   ,left(left)
@@ -97,12 +86,6 @@ BinaryOpNode::BinaryOpNode(Operator op, ASTNode* left, ASTNode* right)
 {
 }
 
-BinaryOpNode::~BinaryOpNode()
-{
-  delete left;
-  delete right;
-}
-
 std::string BinaryOpNode::AsString()
 {
   switch (op)
@@ -122,28 +105,20 @@ std::string BinaryOpNode::AsString()
   __builtin_unreachable();
 }
 
-VariableNode::VariableNode(char* name)
-  :ASTNode()
+VariableNode::VariableNode(InternedString name)
+  :ASTNode(NodeType::VARIABLE)
   ,name(name)
   ,isResolved(false)
 {
 }
 
 VariableNode::VariableNode(VariableDef* variable)
-  :ASTNode()
+  :ASTNode(NodeType::VARIABLE)
   ,var(variable)
   ,isResolved(true)
 {
 }
 
-VariableNode::~VariableNode()
-{
-  if (!isResolved)
-  {
-    free(name);
-  }
-}
-
 std::string VariableNode::AsString()
 {
   if (isResolved)
@@ -152,24 +127,18 @@ std::string VariableNode::AsString()
   }
   else
   {
-    return FormatString("Var(UR): %s", name);
+    return FormatString("Var(UR): %s", name.c_str());
   }
 }
 
 ConditionNode::ConditionNode(Condition condition, ASTNode* left, ASTNode* right)
-  :ASTNode()
+  :ASTNode(NodeType::CONDITION)
   ,condition(condition)
   ,left(left)
   ,right(right)
 {
 }
 
-ConditionNode::~ConditionNode()
-{
-  delete left;
-  delete right;
-}
-
 std::string ConditionNode::AsString()
 {
   switch (condition)
@@ -190,19 +159,13 @@ std::string ConditionNode::AsString()
 }
 
 CompositeConditionNode::CompositeConditionNode(CompositeConditionNode::Type type, ConditionNode* left, ConditionNode* right)
-  :ASTNode()
+  :ASTNode(NodeType::COMPOSITE_CONDITION)
   ,type(type)
   ,left(left)
   ,right(right)
 {
 }
 
-CompositeConditionNode::~CompositeConditionNode()
-{
-  delete left;
-  delete right;
-}
-
 std::string CompositeConditionNode::AsString()
 {
   switch (type)
@@ -220,20 +183,13 @@ std::string CompositeConditionNode::AsString()
 }
 
 BranchNode::BranchNode(ASTNode* condition, ASTNode* thenCode, ASTNode* elseCode)
-  :ASTNode()
+  :ASTNode(NodeType::BRANCH)
   ,condition(condition)
   ,thenCode(thenCode)
   ,elseCode(elseCode)
 {
 }
 
-BranchNode::~BranchNode()
-{
-  delete condition;
-  delete thenCode;
-  delete elseCode;
-}
-
 std::string BranchNode::AsString()
 {
   return FormatString("(%s) => (%s) | (%s)", condition->AsString().c_str(), thenCode->AsString().c_str(),
@@ -241,18 +197,12 @@ std::string BranchNode::AsString()
 }
 
 WhileNode::WhileNode(ASTNode* condition, ASTNode* loopBody)
-  :ASTNode()
+  :ASTNode(NodeType::WHILE)
   ,condition(condition)
   ,loopBody(loopBody)
 {
 }
 
-WhileNode::~WhileNode()
-{
-  delete condition;
-  delete loopBody;
-}
-
 std::string WhileNode::AsString()
 {
   return FormatString("While (%s) => (%s)", condition->AsString().c_str(), loopBody->AsString().c_str());
@@ -283,7 +233,7 @@ std::string ConstantNode<bool>::AsString()
 }
 
 StringNode::StringNode(StringConstant* string)
-  :ASTNode()
+  :ASTNode(NodeType::STRING)
   ,string(string)
 {
 }
@@ -297,22 +247,14 @@ std::string StringNode::AsString()
   return FormatString("\"%s\"", string->str.c_str());
 }
 
-CallNode::CallNode(char* name, const std::vector<ASTNode*>& params)
-  :ASTNode()
+CallNode::CallNode(InternedString name, const std::vector<ASTNode*>& params)
+  :ASTNode(NodeType::CALL)
   ,name(name)
   ,isResolved(false)
   ,params(params)
 {
 }
 
-CallNode::~CallNode()
-{
-  if (!isResolved)
-  {
-    free(name);
-  }
-}
-
 std::string CallNode::AsString()
 {
   std::string paramString;
@@ -338,47 +280,31 @@ std::string CallNode::AsString()
   }
   else
   {
-    return FormatString("Call(UR) (%s) {%s}", name, paramString.c_str());
+    return FormatString("Call(UR) (%s) {%s}", name.c_str(), paramString.c_str());
   }
 }
 
 VariableAssignmentNode::VariableAssignmentNode(ASTNode* variable, ASTNode* newValue, bool ignoreImmutability)
-  :ASTNode()
+  :ASTNode(NodeType::VARIABLE_ASSIGNMENT)
   ,variable(variable)
   ,newValue(newValue)
   ,ignoreImmutability(ignoreImmutability)
 {
 }
 
-VariableAssignmentNode::~VariableAssignmentNode()
-{
-  delete variable;
-  delete newValue;
-}
-
 std::string VariableAssignmentNode::AsString()
 {
   return FormatString("(%s) = (%s)", variable->AsString().c_str(), newValue->AsString().c_str());
 }
 
 MemberAccessNode::MemberAccessNode(ASTNode* parent, ASTNode* child)
-  :ASTNode()
+  :ASTNode(NodeType::MEMBER_ACCESS)
   ,parent(parent)
   ,child(child)
   ,isResolved(false)
 {
 }
 
-MemberAccessNode::~MemberAccessNode()
-{
-  delete parent;
-  
-  if (!isResolved)
-  {
-    delete child;
-  }
-}
-
 std::string MemberAccessNode::AsString()
 {
   if (isResolved)
@@ -392,19 +318,11 @@ std::string MemberAccessNode::AsString()
 }
 
 ArrayInitNode::ArrayInitNode(const std::vector<ASTNode*>& items)
-  :ASTNode()
+  :ASTNode(NodeType::ARRAY_INIT)
   ,items(items)
 {
 }
 
-ArrayInitNode::~ArrayInitNode()
-{
-  for (auto* item : items)
-  {
-    delete item;
-  }
-}
-
 std::string ArrayInitNode::AsString()
 {
   std::string itemString;
@@ -420,39 +338,24 @@ std::string ArrayInitNode::AsString()
 }
 
 InfiniteLoopNode::InfiniteLoopNode(ASTNode* loopBody)
-  :ASTNode()
+  :ASTNode(NodeType::INFINITE_LOOP)
   ,loopBody(loopBody)
 {
 }
 
-InfiniteLoopNode::~InfiniteLoopNode()
-{
-  delete loopBody;
-}
-
 std::string InfiniteLoopNode::AsString()
 {
   return FormatString("Loop(%s)", loopBody->AsString().c_str());
 }
 
-ConstructNode::ConstructNode(ASTNode* variable, const std::string& typeName, const std::vector<ASTNode*>& items)
-  :ASTNode()
+ConstructNode::ConstructNode(ASTNode* variable, InternedString typeName, const std::vector<ASTNode*>& items)
+  :ASTNode(NodeType::CONSTRUCT)
   ,variable(variable)
   ,typeName(typeName)
   ,items(items)
 {
 }
 
-ConstructNode::~ConstructNode()
-{
-  delete variable;
-
-  for (auto* item : items)
-  {
-    delete item;
-  }
-}
-
 std::string ConstructNode::AsString()
 {
   std::string str;
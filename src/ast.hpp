@@ -16,9 +16,37 @@
 template<typename R, typename T>
 struct ASTPass;
 
-struct ASTNode
+/*
+ * Each type of node is tagged with one of these, so we can find what it is without having to go through RTTI.
+ * NOTE(Isaac): `ASTPass::Dispatch` switches on this, so should be kept in sync with the node types below.
+ */
+enum class NodeType
+{
+  BREAK,
+  RETURN,
+  UNARY_OP,
+  BINARY_OP,
+  VARIABLE,
+  CONDITION,
+  COMPOSITE_CONDITION,
+  BRANCH,
+  WHILE,
+  CONSTANT_UNSIGNED_INT,
+  CONSTANT_SIGNED_INT,
+  CONSTANT_FLOAT,
+  CONSTANT_BOOL,
+  STRING,
+  CALL,
+  VARIABLE_ASSIGNMENT,
+  MEMBER_ACCESS,
+  ARRAY_INIT,
+  INFINITE_LOOP,
+  CONSTRUCT
+};
+
+struct ASTNode : ArenaObject
 {
-  ASTNode();
+  ASTNode(NodeType nodeType);
   virtual ~ASTNode();
 
   virtual std::string AsString() = 0;
@@ -30,6 +58,8 @@ struct ASTNode
   ASTNode*  next;
   ASTNode*  prev;
 
+  const NodeType nodeType;
+
   TypeRef*  type;
   bool      shouldFreeTypeRef;    // TODO: eww
 
@@ -51,7 +81,9 @@ void RemoveNode(CodeThing* code, ASTNode* node);
 
 struct BreakNode : ASTNode
 {
-  BreakNode() : ASTNode() {}
+  static constexpr NodeType NODE_TYPE = NodeType::BREAK;
+
+  BreakNode() : ASTNode(NODE_TYPE) {}
   ~BreakNode() {}
 
   std::string AsString();
@@ -59,8 +91,9 @@ struct BreakNode : ASTNode
 
 struct ReturnNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::RETURN;
+
   ReturnNode(ASTNode* returnValue);
-  ~ReturnNode();
 
   std::string AsString();
   
@@ -69,6 +102,8 @@ struct ReturnNode : ASTNode
 
 struct UnaryOpNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::UNARY_OP;
+
   enum Operator
   {
     POSITIVE,         // +x
@@ -83,7 +118,6 @@ struct UnaryOpNode : ASTNode
   };
 
   UnaryOpNode(Operator op, ASTNode* operand);
-  ~UnaryOpNode();
 
   std::string AsString();
 
@@ -96,6 +130,8 @@ struct UnaryOpNode : ASTNode
 
 struct BinaryOpNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::BINARY_OP;
+
   enum Operator
   {
     ADD,
@@ -106,7 +142,6 @@ struct BinaryOpNode : ASTNode
   };
 
   BinaryOpNode(Operator op, ASTNode* left, ASTNode* right);
-  ~BinaryOpNode();
 
   std::string AsString();
 
@@ -125,22 +160,25 @@ struct BinaryOpNode : ASTNode
 
 struct VariableNode : ASTNode
 {
-  VariableNode(char* name);
+  static constexpr NodeType NODE_TYPE = NodeType::VARIABLE;
+
+  VariableNode(InternedString name);
   VariableNode(VariableDef* variable);
-  ~VariableNode();
 
   std::string AsString();
 
   union
   {
-    char*         name;
-    VariableDef*  var;
+    InternedString  name;
+    VariableDef*    var;
   };
   bool isResolved;
 };
 
 struct ConditionNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::CONDITION;
+
   enum Condition
   {
     EQUAL,
@@ -154,7 +192,6 @@ struct ConditionNode : ASTNode
   std::string AsString();
 
   ConditionNode(Condition condition, ASTNode* left, ASTNode* right);
-  ~ConditionNode();
 
   Condition condition;
   ASTNode*  left;
@@ -163,6 +200,8 @@ struct ConditionNode : ASTNode
 
 struct CompositeConditionNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::COMPOSITE_CONDITION;
+
   enum Type
   {
     AND,
@@ -172,7 +211,6 @@ struct CompositeConditionNode : ASTNode
   std::string AsString();
 
   CompositeConditionNode(Type type, ConditionNode* left, ConditionNode* right);
-  ~CompositeConditionNode();
 
   Type            type;
   ConditionNode*  left;
@@ -181,8 +219,9 @@ struct CompositeConditionNode : ASTNode
 
 struct BranchNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::BRANCH;
+
   BranchNode(ASTNode* condition, ASTNode* thenCode, ASTNode* elseCode);
-  ~BranchNode();
 
   std::string AsString();
 
@@ -193,8 +232,9 @@ struct BranchNode : ASTNode
 
 struct WhileNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::WHILE;
+
   WhileNode(ASTNode* condition, ASTNode* loopBody);
-  ~WhileNode();
 
   std::string AsString();
 
@@ -212,8 +252,14 @@ struct WhileNode : ASTNode
 template<typename T>
 struct ConstantNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = std::is_same<T, unsigned int>::value  ? NodeType::CONSTANT_UNSIGNED_INT :
+                                        std::is_same<T, int>::value           ? NodeType::CONSTANT_SIGNED_INT   :
+                                        std::is_same<T, float>::value         ? NodeType::CONSTANT_FLOAT        :
+                                                                                NodeType::CONSTANT_BOOL;
+
   ConstantNode(T value)
-    :value(value)
+    :ASTNode(NODE_TYPE)
+    ,value(value)
   {
     static_assert(std::is_same<T, unsigned int>::value  ||
                   std::is_same<T, int>::value           ||
@@ -229,6 +275,8 @@ struct ConstantNode : ASTNode
 
 struct StringNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::STRING;
+
   StringNode(StringConstant* string);
   ~StringNode();
 
@@ -239,14 +287,15 @@ struct StringNode : ASTNode
 
 struct CallNode : ASTNode
 {
-  CallNode(char* name, const std::vector<ASTNode*>& params);
-  ~CallNode();
+  static constexpr NodeType NODE_TYPE = NodeType::CALL;
+
+  CallNode(InternedString name, const std::vector<ASTNode*>& params);
 
   std::string AsString();
 
   union
   {
-    char*               name;
+    InternedString      name;
     CodeThing*          resolvedFunction;
   };
   bool                  isResolved;
@@ -255,8 +304,9 @@ struct CallNode : ASTNode
 
 struct VariableAssignmentNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::VARIABLE_ASSIGNMENT;
+
   VariableAssignmentNode(ASTNode* variable, ASTNode* newValue, bool ignoreImmutability);
-  ~VariableAssignmentNode();
 
   std::string AsString();
 
@@ -267,8 +317,9 @@ struct VariableAssignmentNode : ASTNode
 
 struct MemberAccessNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::MEMBER_ACCESS;
+
   MemberAccessNode(ASTNode* parent, ASTNode* child);
-  ~MemberAccessNode();
 
   std::string AsString();
 
@@ -283,8 +334,9 @@ struct MemberAccessNode : ASTNode
 
 struct ArrayInitNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::ARRAY_INIT;
+
   ArrayInitNode(const std::vector<ASTNode*>& items);
-  ~ArrayInitNode();
 
   std::string AsString();
 
@@ -293,8 +345,9 @@ struct ArrayInitNode : ASTNode
 
 struct InfiniteLoopNode : ASTNode
 {
+  static constexpr NodeType NODE_TYPE = NodeType::INFINITE_LOOP;
+
   InfiniteLoopNode(ASTNode* loopBody);
-  ~InfiniteLoopNode();
 
   std::string AsString();
 
@@ -307,23 +360,22 @@ struct InfiniteLoopNode : ASTNode
  */
 struct ConstructNode : ASTNode
 {
-  ConstructNode(ASTNode* variable, const std::string& typeName, const std::vector<ASTNode*>& items);
-  ~ConstructNode();
+  static constexpr NodeType NODE_TYPE = NodeType::CONSTRUCT;
+
+  ConstructNode(ASTNode* variable, InternedString typeName, const std::vector<ASTNode*>& items);
 
   std::string AsString();
 
   ASTNode*              variable;   // Should either be a VariableNode or a MemberAccessNode
-  std::string           typeName;
+  InternedString        typeName;
   std::vector<ASTNode*> items;
 };
 
 template<typename T>
 bool IsNodeOfType(ASTNode* node)
 {
-  static const char* TYPE_NAME = typeid(T).name();
-
   Assert(node, "Tried to find type of nullptr node");
-  return (strcmp(typeid(*node).name(), TYPE_NAME) == 0);
+  return (node->nodeType == T::NODE_TYPE);
 }
 
 struct TargetMachine;
@@ -354,7 +406,20 @@ struct ASTPass
   virtual R VisitNode(InfiniteLoopNode*             , T* = nullptr) = 0;
   virtual R VisitNode(ConstructNode*                , T* = nullptr) = 0;
 
-  virtual void Apply(ParseResult& parse, TargetMachine* target) = 0;
+  /*
+   * Applies the pass to a single CodeThing. A pass may only change the AST and state of the thing it's given, so
+   * this can be called on different things at the same time. `RunPasses` in main.cpp drives the AST passes like
+   * this, and `CompileCodeThing` does the same for AIR generation.
+   */
+  virtual void ApplyTo(ParseResult& parse, TargetMachine* target, CodeThing* code) = 0;
+
+  void Apply(ParseResult& parse, TargetMachine* target)
+  {
+    for (CodeThing* code : parse.codeThings)
+    {
+      ApplyTo(parse, target, code);
+    }
+  }
 
   /*
    * This is required since we can't use a normal visitor pattern (because we can't template a virtual function,
@@ -365,44 +430,41 @@ struct ASTPass
     Assert(node, "Tried to dispatch on a nullptr node");
 
     /*
-     * Poor man's dynamic dispatch - we compare the type-identifier of the node with each node type, then
-     * cast and call the correct virtual function.
-     *
-     * XXX: If this is too slow, I guess we could provide a virtual function to get a id number for each node
-     *      which could then by dispatched from (but that's got the same problems as before)
+     * We switch on the node's tag, which should be compiled down to a jump table, then cast and call the correct
+     * virtual function.
      */
     #define DISPATCH(nodeType)\
-      if (strcmp(typeid(*node).name(), typeid(nodeType).name()) == 0)\
+      case nodeType::NODE_TYPE:\
       {\
         return VisitNode(reinterpret_cast<nodeType*>(node), state);\
       }
 
-         DISPATCH(BreakNode)
-    else DISPATCH(ReturnNode)
-    else DISPATCH(UnaryOpNode)
-    else DISPATCH(BinaryOpNode)
-    else DISPATCH(VariableNode)
-    else DISPATCH(ConditionNode)
-    else DISPATCH(CompositeConditionNode)
-    else DISPATCH(BranchNode)
-    else DISPATCH(WhileNode)
-    else DISPATCH(ConstantNode<unsigned int>)
-    else DISPATCH(ConstantNode<int>)
-    else DISPATCH(ConstantNode<float>)
-    else DISPATCH(ConstantNode<bool>)
-    else DISPATCH(StringNode)
-    else DISPATCH(CallNode)
-    else DISPATCH(VariableAssignmentNode)
-    else DISPATCH(MemberAccessNode)
-    else DISPATCH(ArrayInitNode)
-    else DISPATCH(InfiniteLoopNode)
-    else DISPATCH(ConstructNode)
-    else
+    switch (node->nodeType)
     {
-      RaiseError(ICE_UNHANDLED_NODE_TYPE, "DispatchNode", typeid(*node).name());
+      DISPATCH(BreakNode)
+      DISPATCH(ReturnNode)
+      DISPATCH(UnaryOpNode)
+      DISPATCH(BinaryOpNode)
+      DISPATCH(VariableNode)
+      DISPATCH(ConditionNode)
+      DISPATCH(CompositeConditionNode)
+      DISPATCH(BranchNode)
+      DISPATCH(WhileNode)
+      DISPATCH(ConstantNode<unsigned int>)
+      DISPATCH(ConstantNode<int>)
+      DISPATCH(ConstantNode<float>)
+      DISPATCH(ConstantNode<bool>)
+      DISPATCH(StringNode)
+      DISPATCH(CallNode)
+      DISPATCH(VariableAssignmentNode)
+      DISPATCH(MemberAccessNode)
+      DISPATCH(ArrayInitNode)
+      DISPATCH(InfiniteLoopNode)
+      DISPATCH(ConstructNode)
     }
     #undef DISPATCH
 
+    RaiseError(ICE_UNHANDLED_NODE_TYPE, "DispatchNode", typeid(*node).name());
     __builtin_unreachable();
   }
 };
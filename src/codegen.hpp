@@ -29,6 +29,7 @@ struct InstructionPrecolorer : AirPass<void>
   virtual void Visit(UnaryOpInstruction* instruction,   void*) = 0;
   virtual void Visit(BinaryOpInstruction* instruction,  void*) = 0;
   virtual void Visit(CallInstruction* instruction,      void*) = 0;
+  virtual void Visit(PhiInstruction* instruction,       void*) = 0;
 };
 
 struct ElfThing;
@@ -54,6 +55,7 @@ struct CodeGenerator : AirPass<void>
   virtual void Visit(UnaryOpInstruction* instruction,   void*) = 0;
   virtual void Visit(BinaryOpInstruction* instruction,  void*) = 0;
   virtual void Visit(CallInstruction* instruction,      void*) = 0;
+  virtual void Visit(PhiInstruction* instruction,       void*) = 0;
 };
 
 void Generate(const std::string& outputPath, TargetMachine* target, ParseResult& result);
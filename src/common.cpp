@@ -8,8 +8,14 @@
 #include <cstring>
 #include <cstddef>
 #include <cstdarg>
+#include <ctime>
+#include <unordered_map>
+#include <mutex>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <ast.hpp>
 
 #define USING_GDB
@@ -112,37 +118,104 @@ char* itoa(int num, char* str, int base)
   return str;
 }
 
-char* ReadFile(const std::string& path)
+/*
+ * Source files are mapped into memory, rather than being read into a buffer. Mappings are cached, so compiling the
+ * same (unchanged) file again in the same process doesn't map it again.
+ */
+struct MappedFile
 {
-  FILE* file = fopen(path.c_str(), "rb");
+  dev_t       device;
+  ino_t       inode;
+  off_t       size;
+  timespec    modificationTime;
+  timespec    mappedAt;
+
+  const char* contents;
+  size_t      mappingSize;
+};
+
+/*
+ * How far apart two writes to a file have to be for it to be given different modification times. This is 2 seconds
+ * on FAT, and a second on some others, so we assume the worst.
+ */
+static const time_t MODIFICATION_TIME_GRANULARITY = 2;
 
-  if (!file)
+static std::unordered_map<std::string, MappedFile>  g_mappedFiles;
+static std::mutex                                   g_mappedFilesLock;
+
+/*
+ * A mapping is stale if the file it was made from has changed since. A file rewritten with something of the same size
+ * soon after it was last written can keep its modification time, so if the file was written that close to when we
+ * mapped it, we can't tell if it's changed since, and have to treat the mapping as stale too. Once it's been mapped
+ * again later on, we can.
+ */
+static bool IsMappingStale(const MappedFile& mapping, const struct stat& info)
+{
+  return (mapping.device                    != info.st_dev          ||
+          mapping.inode                     != info.st_ino          ||
+          mapping.size                      != info.st_size         ||
+          mapping.modificationTime.tv_sec   != info.st_mtim.tv_sec  ||
+          mapping.modificationTime.tv_nsec  != info.st_mtim.tv_nsec ||
+          mapping.mappedAt.tv_sec           <= info.st_mtim.tv_sec + MODIFICATION_TIME_GRANULARITY);
+}
+
+const char* MapFile(const std::string& path)
+{
+  std::lock_guard<std::mutex> guard(g_mappedFilesLock);
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  int file = open(path.c_str(), O_RDONLY);
+  struct stat info;
+
+  if (file == -1 || fstat(file, &info) == -1)
   {
     fprintf(stderr, "Failed to read source file: %s\n", path.c_str());
     Crash();
   }
 
-  fseek(file, 0, SEEK_END);
-  unsigned long length = ftell(file);
-  fseek(file, 0, SEEK_SET);
-  char* contents = static_cast<char*>(malloc(length + 1));
+  auto cached = g_mappedFiles.find(path);
+  if (cached != g_mappedFiles.end())
+  {
+    if (!IsMappingStale(cached->second, info))
+    {
+      close(file);
+      return cached->second.contents;
+    }
+
+    /*
+     * NOTE(Isaac): tokens only point into the source while it's being parsed (everything that outlives the parser
+     * is copied out), so nothing can still be using the old mapping.
+     */
+    munmap(const_cast<char*>(cached->second.contents), cached->second.mappingSize);
+    g_mappedFiles.erase(cached);
+  }
+
+  /*
+   * The lexer expects the source to be terminated by a '\0'. To get one without copying the file, we reserve enough
+   * zeroed pages to fit the file plus one extra byte, then map the file over the start of them. The byte after the
+   * end of the file is either in the zero-filled tail of the file's last page, or in the extra page.
+   */
+  size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t mappingSize = ((static_cast<size_t>(info.st_size) + 1u + pageSize - 1u) / pageSize) * pageSize;
 
-  if (!contents)
+  void* contents = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (contents == MAP_FAILED)
   {
     fprintf(stderr, "Failed to allocate space for source file!\n");
     Crash();
   }
 
-  if (fread(contents, 1, length, file) != length)
+  if (info.st_size > 0 &&
+      mmap(contents, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE | MAP_FIXED, file, 0) == MAP_FAILED)
   {
     fprintf(stderr, "Failed to read source file: %s\n", path.c_str());
     Crash();
   }
 
-  contents[length] = '\0';
-  fclose(file);
-
-  return contents;
+  close(file);
+  g_mappedFiles[path] = MappedFile{info.st_dev, info.st_ino, info.st_size, info.st_mtim, now,
+                                   static_cast<const char*>(contents), mappingSize};
+  return static_cast<const char*>(contents);
 }
 
 bool DoesFileExist(const std::string& path)
@@ -37,7 +37,7 @@ struct Directory
 
 // --- Common functions ---
 char* itoa(int num, char* str, int base);
-char* ReadFile(const std::string& path);
+const char* MapFile(const std::string& path);
 bool DoesFileExist(const std::string& path);
 
 template<typename... Args>
@@ -0,0 +1,1047 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <constantPropagation.hpp>
+#include <climits>
+#include <liveness.hpp>
+
+/*
+ * What we know about the value of a slot. Slots start off UNDEFINED (we haven't seen them given a value yet), can
+ * then become CONSTANT, and then VARYING if they're found to be able to hold more than one value. They never move
+ * back up, which is what stops the propagation going on forever.
+ */
+struct LatticeValue
+{
+  enum Kind
+  {
+    UNDEFINED,
+    CONSTANT,
+    VARYING
+  };
+
+  Kind  kind;
+  Slot* constant;   // If `kind` is CONSTANT
+};
+
+static LatticeValue Undefined()                 { return LatticeValue{LatticeValue::UNDEFINED, nullptr};  }
+static LatticeValue Constant(Slot* constant)    { return LatticeValue{LatticeValue::CONSTANT, constant};  }
+static LatticeValue Varying()                   { return LatticeValue{LatticeValue::VARYING, nullptr};    }
+
+static bool GetInteger(Slot* slot, int64_t& value)
+{
+  switch (slot->GetType())
+  {
+    case SlotType::UNSIGNED_INT_CONSTANT: value = static_cast<ConstantSlot<unsigned int>*>(slot)->value;  return true;
+    case SlotType::INT_CONSTANT:          value = static_cast<ConstantSlot<int>*>(slot)->value;           return true;
+    case SlotType::BOOL_CONSTANT:         value = static_cast<ConstantSlot<bool>*>(slot)->value;          return true;
+    default:                              return false;
+  }
+}
+
+/*
+ * NOTE(Isaac): a double can hold any of our integers or floats exactly, so we can compare them in one.
+ */
+static bool GetNumber(Slot* slot, double& value)
+{
+  int64_t integer;
+  if (GetInteger(slot, integer))
+  {
+    value = static_cast<double>(integer);
+    return true;
+  }
+
+  if (slot->GetType() == SlotType::FLOAT_CONSTANT)
+  {
+    value = static_cast<ConstantSlot<float>*>(slot)->value;
+    return true;
+  }
+
+  return false;
+}
+
+static bool IsSameConstant(Slot* a, Slot* b)
+{
+  if (a == b)
+  {
+    return true;
+  }
+
+  if (a->GetType() != b->GetType())
+  {
+    return false;
+  }
+
+  if (a->GetType() == SlotType::STRING_CONSTANT)
+  {
+    return (static_cast<ConstantSlot<StringConstant*>*>(a)->value ==
+            static_cast<ConstantSlot<StringConstant*>*>(b)->value);
+  }
+
+  double valueA, valueB;
+  return (GetNumber(a, valueA) && GetNumber(b, valueB) && valueA == valueB);
+}
+
+/*
+ * The x64 backend can only use integer constants as the immediate operands of comparisons and arithmetic.
+ */
+static bool IsIntegerConstant(Slot* slot)
+{
+  return (slot->GetType() == SlotType::UNSIGNED_INT_CONSTANT || slot->GetType() == SlotType::INT_CONSTANT);
+}
+
+/*
+ * Integer arithmetic wraps around, as it would on the target, so we do it on unsigned 32-bit integers.
+ */
+static Slot* MakeIntegerConstant(CodeThing* code, IntrinsicOpType type, uint32_t value)
+{
+  if (type == UNSIGNED_INT_INTRINSIC)
+  {
+    return new ConstantSlot<unsigned int>(code, value);
+  }
+
+  return new ConstantSlot<int>(code, static_cast<int>(value));
+}
+
+/*
+ * Returns the constant an operation on a constant produces, or `nullptr` if we can't work it out.
+ */
+static Slot* FoldUnaryOp(CodeThing* code, UnaryOpInstruction* op, Slot* operand)
+{
+  switch (op->type)
+  {
+    case UNSIGNED_INT_INTRINSIC:
+    case SIGNED_INT_INTRINSIC:
+    {
+      int64_t value;
+      if (!GetInteger(operand, value))
+      {
+        return nullptr;
+      }
+
+      uint32_t bits = static_cast<uint32_t>(value);
+      switch (op->op)
+      {
+        case UnaryOpInstruction::Operation::INCREMENT:    return MakeIntegerConstant(code, op->type, bits + 1u);
+        case UnaryOpInstruction::Operation::DECREMENT:    return MakeIntegerConstant(code, op->type, bits - 1u);
+        case UnaryOpInstruction::Operation::NEGATE:       return MakeIntegerConstant(code, op->type, 0u - bits);
+        case UnaryOpInstruction::Operation::LOGICAL_NOT:  return nullptr;
+      }
+    } break;
+
+    case FLOAT_INTRINSIC:
+    {
+      if (operand->GetType() != SlotType::FLOAT_CONSTANT)
+      {
+        return nullptr;
+      }
+
+      float value = static_cast<ConstantSlot<float>*>(operand)->value;
+      switch (op->op)
+      {
+        case UnaryOpInstruction::Operation::INCREMENT:    return new ConstantSlot<float>(code, value + 1.0f);
+        case UnaryOpInstruction::Operation::DECREMENT:    return new ConstantSlot<float>(code, value - 1.0f);
+        case UnaryOpInstruction::Operation::NEGATE:       return new ConstantSlot<float>(code, -value);
+        case UnaryOpInstruction::Operation::LOGICAL_NOT:  return nullptr;
+      }
+    } break;
+
+    case BOOL_INTRINSIC:
+    {
+      if (operand->GetType() == SlotType::BOOL_CONSTANT && op->op == UnaryOpInstruction::Operation::LOGICAL_NOT)
+      {
+        return new ConstantSlot<bool>(code, !(static_cast<ConstantSlot<bool>*>(operand)->value));
+      }
+    } break;
+
+    case STRING_INTRINSIC:
+    case NUM_INTRINSIC_OP_TYPES:
+    {
+    } break;
+  }
+
+  return nullptr;
+}
+
+static Slot* FoldBinaryOp(CodeThing* code, BinaryOpInstruction* op, Slot* left, Slot* right)
+{
+  switch (op->type)
+  {
+    case UNSIGNED_INT_INTRINSIC:
+    case SIGNED_INT_INTRINSIC:
+    {
+      int64_t a, b;
+      if (!GetInteger(left, a) || !GetInteger(right, b))
+      {
+        return nullptr;
+      }
+
+      uint32_t bitsA = static_cast<uint32_t>(a);
+      uint32_t bitsB = static_cast<uint32_t>(b);
+
+      switch (op->op)
+      {
+        case BinaryOpInstruction::Operation::ADD:       return MakeIntegerConstant(code, op->type, bitsA + bitsB);
+        case BinaryOpInstruction::Operation::SUBTRACT:  return MakeIntegerConstant(code, op->type, bitsA - bitsB);
+        case BinaryOpInstruction::Operation::MULTIPLY:  return MakeIntegerConstant(code, op->type, bitsA * bitsB);
+
+        // NOTE(Isaac): dividing by zero (or INT_MIN by -1) faults at runtime, so we leave it to do that
+        case BinaryOpInstruction::Operation::DIVIDE:
+        {
+          if (op->type == UNSIGNED_INT_INTRINSIC)
+          {
+            return (bitsB == 0u ? nullptr : MakeIntegerConstant(code, op->type, bitsA / bitsB));
+          }
+
+          int32_t signedA = static_cast<int32_t>(bitsA);
+          int32_t signedB = static_cast<int32_t>(bitsB);
+
+          if (signedB == 0 || (signedA == INT_MIN && signedB == -1))
+          {
+            return nullptr;
+          }
+
+          return MakeIntegerConstant(code, op->type, static_cast<uint32_t>(signedA / signedB));
+        }
+      }
+    } break;
+
+    case FLOAT_INTRINSIC:
+    {
+      if (left->GetType() != SlotType::FLOAT_CONSTANT || right->GetType() != SlotType::FLOAT_CONSTANT)
+      {
+        return nullptr;
+      }
+
+      float a = static_cast<ConstantSlot<float>*>(left)->value;
+      float b = static_cast<ConstantSlot<float>*>(right)->value;
+
+      switch (op->op)
+      {
+        case BinaryOpInstruction::Operation::ADD:       return new ConstantSlot<float>(code, a + b);
+        case BinaryOpInstruction::Operation::SUBTRACT:  return new ConstantSlot<float>(code, a - b);
+        case BinaryOpInstruction::Operation::MULTIPLY:  return new ConstantSlot<float>(code, a * b);
+        case BinaryOpInstruction::Operation::DIVIDE:    return new ConstantSlot<float>(code, a / b);
+      }
+    } break;
+
+    case BOOL_INTRINSIC:
+    case STRING_INTRINSIC:
+    case NUM_INTRINSIC_OP_TYPES:
+    {
+    } break;
+  }
+
+  return nullptr;
+}
+
+/*
+ * Works out whether a jump with the given condition would be taken after comparing two constants. Returns false if
+ * this can't be known (the condition depends on flags other than the result of the comparison, for example).
+ */
+static bool EvaluateCondition(JumpInstruction::Condition condition, Slot* a, Slot* b, bool& isTaken)
+{
+  double valueA, valueB;
+
+  if (a->GetType() == SlotType::STRING_CONSTANT || b->GetType() == SlotType::STRING_CONSTANT)
+  {
+    if (condition != JumpInstruction::Condition::IF_EQUAL && condition != JumpInstruction::Condition::IF_NOT_EQUAL)
+    {
+      return false;
+    }
+
+    isTaken = (IsSameConstant(a, b) == (condition == JumpInstruction::Condition::IF_EQUAL));
+    return true;
+  }
+
+  if (!GetNumber(a, valueA) || !GetNumber(b, valueB))
+  {
+    return false;
+  }
+
+  switch (condition)
+  {
+    case JumpInstruction::Condition::UNCONDITIONAL:       isTaken = true;               return true;
+    case JumpInstruction::Condition::IF_EQUAL:            isTaken = (valueA == valueB); return true;
+    case JumpInstruction::Condition::IF_NOT_EQUAL:        isTaken = (valueA != valueB); return true;
+    case JumpInstruction::Condition::IF_GREATER:          isTaken = (valueA >  valueB); return true;
+    case JumpInstruction::Condition::IF_GREATER_OR_EQUAL: isTaken = (valueA >= valueB); return true;
+    case JumpInstruction::Condition::IF_LESSER:           isTaken = (valueA <  valueB); return true;
+    case JumpInstruction::Condition::IF_LESSER_OR_EQUAL:  isTaken = (valueA <= valueB); return true;
+
+    case JumpInstruction::Condition::IF_OVERFLOW:
+    case JumpInstruction::Condition::IF_NOT_OVERFLOW:
+    case JumpInstruction::Condition::IF_SIGN:
+    case JumpInstruction::Condition::IF_NOT_SIGN:
+    case JumpInstruction::Condition::IF_PARITY_EVEN:
+    case JumpInstruction::Condition::IF_PARITY_ODD:
+    {
+      return false;
+    }
+  }
+
+  return false;
+}
+
+enum class BranchOutcome
+{
+  UNKNOWN,    // We don't know what's being compared yet
+  TAKEN,
+  NOT_TAKEN,
+  EITHER
+};
+
+struct ConstantPropagator
+{
+  ConstantPropagator(CodeThing* code);
+
+  void Propagate();
+  void Rewrite();
+
+private:
+  LatticeValue ValueOf(Slot* slot);
+  void SetValue(Slot* slot, LatticeValue value);
+  bool IsEdgeExecutable(unsigned int from, unsigned int to);
+  void MarkEdgeExecutable(unsigned int from, unsigned int to);
+  CmpInstruction* GetComparison(unsigned int jumpIndex);
+  BranchOutcome EvaluateBranch(unsigned int jumpIndex);
+  void Visit(unsigned int index);
+
+  CodeThing*                              code;
+  ControlFlowGraph                        graph;
+  unsigned int                            numSlots;
+  std::vector<bool>                       isTracked;          // By slot
+  std::vector<LatticeValue>               values;             // By slot
+  std::vector<std::vector<unsigned int>>  users;              // The instructions that use each slot
+  std::vector<bool>                       isBlockExecutable;
+  std::vector<std::vector<bool>>          isEdgeExecutable;   // By block, then by position in its predecessors
+  std::vector<unsigned int>               blockWorklist;
+  std::vector<unsigned int>               instructionWorklist;
+};
+
+/*
+ * We only track the slots that are defined exactly once, by an instruction that comes before all of their uses (in
+ * that it dominates them). Others are just assumed to vary - parameters, the results of calls, and slots that
+ * haven't been put into SSA form.
+ */
+ConstantPropagator::ConstantPropagator(CodeThing* code)
+  :code(code)
+  ,graph(code)
+  ,numSlots(code->slots.size())
+  ,isTracked(numSlots, false)
+  ,values(numSlots, Varying())
+  ,users(numSlots)
+  ,isBlockExecutable(graph.blocks.size(), false)
+  ,isEdgeExecutable(graph.blocks.size())
+  ,blockWorklist()
+  ,instructionWorklist()
+{
+  std::vector<unsigned int> numDefs(numSlots, 0u);
+  std::vector<signed int> defIndex(numSlots, -1);
+  LiveOperands operands;
+
+  for (AirInstruction* instruction : graph.instructions)
+  {
+    GetLiveOperands(instruction, operands);
+
+    for (Slot* use : operands.uses)
+    {
+      users[use->index].push_back(instruction->index);
+    }
+
+    for (Slot* def : operands.defs)
+    {
+      numDefs[def->index]++;
+      defIndex[def->index] = instruction->index;
+    }
+  }
+
+  for (Slot* slot : code->slots)
+  {
+    isTracked[slot->index] = (IsRegisterSlot(slot) && slot->ShouldColor() && !(slot->IsColored()) &&
+                              numDefs[slot->index] == 1u);
+  }
+
+  // Members are found through their parent's slot, so the parent has to stay as it is
+  for (Slot* slot : code->slots)
+  {
+    if (slot->GetType() == SlotType::MEMBER)
+    {
+      isTracked[static_cast<MemberSlot*>(slot)->parent->index] = false;
+    }
+  }
+
+  // NOTE(Isaac): a phi's operands are used at the end of the predecessors they come from
+  auto isDefinedBefore = [&](Slot* slot, unsigned int use, bool isAfterUse)
+    {
+      unsigned int def = static_cast<unsigned int>(defIndex[slot->index]);
+
+      if (graph.blockOf[def] == graph.blockOf[use])
+      {
+        return (isAfterUse ? def <= use : def < use);
+      }
+
+      return graph.Dominates(graph.blockOf[def], graph.blockOf[use]);
+    };
+
+  for (AirInstruction* instruction : graph.instructions)
+  {
+    if (instruction->instructionType == InstructionType::PHI)
+    {
+      for (PhiInstruction::Operand& operand : static_cast<PhiInstruction*>(instruction)->operands)
+      {
+        Slot* value = operand.value;
+
+        if (IsRegisterSlot(value) && isTracked[value->index] &&
+            !isDefinedBefore(value, operand.from->index, true))
+        {
+          isTracked[value->index] = false;
+        }
+      }
+
+      continue;
+    }
+
+    GetLiveOperands(instruction, operands);
+    for (Slot* use : operands.uses)
+    {
+      if (isTracked[use->index] && !isDefinedBefore(use, instruction->index, false))
+      {
+        isTracked[use->index] = false;
+      }
+    }
+  }
+
+  for (unsigned int i = 0u;
+       i < numSlots;
+       i++)
+  {
+    if (isTracked[i])
+    {
+      values[i] = Undefined();
+    }
+  }
+
+  for (BasicBlock& block : graph.blocks)
+  {
+    isEdgeExecutable[block.index].assign(block.predecessors.size(), false);
+  }
+}
+
+LatticeValue ConstantPropagator::ValueOf(Slot* slot)
+{
+  if (slot->IsConstant())
+  {
+    return Constant(slot);
+  }
+
+  return (slot->index < numSlots ? values[slot->index] : Varying());
+}
+
+void ConstantPropagator::SetValue(Slot* slot, LatticeValue value)
+{
+  if (slot->index >= numSlots || !isTracked[slot->index])
+  {
+    return;
+  }
+
+  LatticeValue& current = values[slot->index];
+
+  if (value.kind < current.kind ||
+      (value.kind == current.kind && (value.kind != LatticeValue::CONSTANT ||
+                                      IsSameConstant(value.constant, current.constant))))
+  {
+    return;
+  }
+
+  // A slot that's been found to hold two different constants can hold either
+  current = ((value.kind == LatticeValue::CONSTANT && current.kind == LatticeValue::CONSTANT) ? Varying() : value);
+  instructionWorklist.insert(instructionWorklist.end(), users[slot->index].begin(), users[slot->index].end());
+}
+
+bool ConstantPropagator::IsEdgeExecutable(unsigned int from, unsigned int to)
+{
+  std::vector<unsigned int>& predecessors = graph.blocks[to].predecessors;
+
+  for (unsigned int i = 0u;
+       i < predecessors.size();
+       i++)
+  {
+    if (predecessors[i] == from)
+    {
+      return isEdgeExecutable[to][i];
+    }
+  }
+
+  return false;
+}
+
+void ConstantPropagator::MarkEdgeExecutable(unsigned int from, unsigned int to)
+{
+  BasicBlock& block = graph.blocks[to];
+
+  for (unsigned int i = 0u;
+       i < block.predecessors.size();
+       i++)
+  {
+    if (block.predecessors[i] != from)
+    {
+      continue;
+    }
+
+    if (isEdgeExecutable[to][i])
+    {
+      return;
+    }
+
+    isEdgeExecutable[to][i] = true;
+  }
+
+  if (!isBlockExecutable[to])
+  {
+    isBlockExecutable[to] = true;
+    blockWorklist.push_back(to);
+    return;
+  }
+
+  // The block has already been visited, but its phis now have another value to take into account
+  for (unsigned int i = block.first;
+       i <= block.last;
+       i++)
+  {
+    if (graph.instructions[i]->instructionType == InstructionType::PHI)
+    {
+      instructionWorklist.push_back(i);
+    }
+  }
+}
+
+/*
+ * Finds the comparison a conditional jump depends on, which is just before it in the same block.
+ */
+CmpInstruction* ConstantPropagator::GetComparison(unsigned int jumpIndex)
+{
+  if (jumpIndex == 0u || graph.blockOf[jumpIndex - 1u] != graph.blockOf[jumpIndex] ||
+      graph.instructions[jumpIndex - 1u]->instructionType != InstructionType::CMP)
+  {
+    return nullptr;
+  }
+
+  return static_cast<CmpInstruction*>(graph.instructions[jumpIndex - 1u]);
+}
+
+BranchOutcome ConstantPropagator::EvaluateBranch(unsigned int jumpIndex)
+{
+  JumpInstruction* jump = static_cast<JumpInstruction*>(graph.instructions[jumpIndex]);
+
+  if (jump->condition == JumpInstruction::Condition::UNCONDITIONAL)
+  {
+    return BranchOutcome::TAKEN;
+  }
+
+  CmpInstruction* cmp = GetComparison(jumpIndex);
+  if (!cmp)
+  {
+    return BranchOutcome::EITHER;
+  }
+
+  LatticeValue a = ValueOf(cmp->a);
+  LatticeValue b = ValueOf(cmp->b);
+
+  if (a.kind == LatticeValue::UNDEFINED || b.kind == LatticeValue::UNDEFINED)
+  {
+    return BranchOutcome::UNKNOWN;
+  }
+
+  bool isTaken;
+  if (a.kind == LatticeValue::CONSTANT && b.kind == LatticeValue::CONSTANT &&
+      EvaluateCondition(jump->condition, a.constant, b.constant, isTaken))
+  {
+    return (isTaken ? BranchOutcome::TAKEN : BranchOutcome::NOT_TAKEN);
+  }
+
+  return BranchOutcome::EITHER;
+}
+
+void ConstantPropagator::Visit(unsigned int index)
+{
+  AirInstruction* instruction = graph.instructions[index];
+  BasicBlock& block = graph.blocks[graph.blockOf[index]];
+
+  if (!isBlockExecutable[block.index])
+  {
+    return;
+  }
+
+  switch (instruction->instructionType)
+  {
+    // Only the values coming in along edges we know can be taken count
+    case InstructionType::PHI:
+    {
+      PhiInstruction* phi = static_cast<PhiInstruction*>(instruction);
+      LatticeValue value = Undefined();
+
+      for (PhiInstruction::Operand& operand : phi->operands)
+      {
+        if (!IsEdgeExecutable(graph.blockOf[operand.from->index], block.index))
+        {
+          continue;
+        }
+
+        LatticeValue operandValue = ValueOf(operand.value);
+
+        if (operandValue.kind == LatticeValue::VARYING ||
+            (operandValue.kind == LatticeValue::CONSTANT && value.kind == LatticeValue::CONSTANT &&
+             !IsSameConstant(operandValue.constant, value.constant)))
+        {
+          value = Varying();
+          break;
+        }
+
+        if (operandValue.kind == LatticeValue::CONSTANT)
+        {
+          value = operandValue;
+        }
+      }
+
+      SetValue(phi->result, value);
+    } break;
+
+    case InstructionType::MOV:
+    {
+      MovInstruction* mov = static_cast<MovInstruction*>(instruction);
+      SetValue(mov->dest, ValueOf(mov->src));
+    } break;
+
+    case InstructionType::UNARY_OP:
+    {
+      UnaryOpInstruction* op = static_cast<UnaryOpInstruction*>(instruction);
+      LatticeValue operand = ValueOf(op->operand);
+
+      if (operand.kind == LatticeValue::CONSTANT)
+      {
+        Slot* folded = FoldUnaryOp(code, op, operand.constant);
+        SetValue(op->result, (folded ? Constant(folded) : Varying()));
+      }
+      else
+      {
+        SetValue(op->result, operand);
+      }
+    } break;
+
+    case InstructionType::BINARY_OP:
+    {
+      BinaryOpInstruction* op = static_cast<BinaryOpInstruction*>(instruction);
+      LatticeValue left = ValueOf(op->left);
+      LatticeValue right = ValueOf(op->right);
+
+      if (left.kind == LatticeValue::VARYING || right.kind == LatticeValue::VARYING)
+      {
+        SetValue(op->result, Varying());
+      }
+      else if (left.kind == LatticeValue::CONSTANT && right.kind == LatticeValue::CONSTANT)
+      {
+        Slot* folded = FoldBinaryOp(code, op, left.constant, right.constant);
+        SetValue(op->result, (folded ? Constant(folded) : Varying()));
+      }
+    } break;
+
+    // The comparison only matters to the jump after it
+    case InstructionType::CMP:
+    {
+      if (index < block.last && graph.instructions[index + 1u]->instructionType == InstructionType::JUMP)
+      {
+        Visit(index + 1u);
+      }
+    } break;
+
+    case InstructionType::JUMP:
+    {
+      JumpInstruction* jump = static_cast<JumpInstruction*>(instruction);
+      unsigned int target = graph.blockOf[jump->label->index];
+      BranchOutcome outcome = EvaluateBranch(index);
+
+      if (outcome == BranchOutcome::TAKEN || outcome == BranchOutcome::EITHER)
+      {
+        MarkEdgeExecutable(block.index, target);
+      }
+
+      if ((outcome == BranchOutcome::NOT_TAKEN || outcome == BranchOutcome::EITHER) &&
+          (block.index + 1u) < graph.blocks.size())
+      {
+        MarkEdgeExecutable(block.index, block.index + 1u);
+      }
+    } break;
+
+    case InstructionType::LABEL:
+    case InstructionType::RETURN:
+    case InstructionType::CALL:
+    {
+    } break;
+  }
+
+  // Blocks that don't end in a jump or return fall through into the next one
+  if (index == block.last && (block.index + 1u) < graph.blocks.size() &&
+      instruction->instructionType != InstructionType::JUMP &&
+      instruction->instructionType != InstructionType::RETURN)
+  {
+    MarkEdgeExecutable(block.index, block.index + 1u);
+  }
+}
+
+void ConstantPropagator::Propagate()
+{
+  isBlockExecutable[0u] = true;
+  blockWorklist.push_back(0u);
+
+  while (blockWorklist.size() > 0u || instructionWorklist.size() > 0u)
+  {
+    if (blockWorklist.size() > 0u)
+    {
+      BasicBlock& block = graph.blocks[blockWorklist.back()];
+      blockWorklist.pop_back();
+
+      for (unsigned int i = block.first;
+           i <= block.last;
+           i++)
+      {
+        Visit(i);
+      }
+    }
+    else
+    {
+      unsigned int index = instructionWorklist.back();
+      instructionWorklist.pop_back();
+      Visit(index);
+    }
+  }
+}
+
+/*
+ * Once we know which slots are constant, and which blocks can be reached, we change the AIR to match:
+ *   - Instructions in blocks that can't be reached are removed
+ *   - Uses of constant slots are replaced by the constant, where the backend can use a constant there
+ *   - Instructions that define constant slots are removed, or replaced by a MOV if the slot is still used
+ *   - Jumps on comparisons of constants are made unconditional, or removed if they'd never be taken
+ *   - Phis lose the values that come from edges that can't be taken
+ */
+void ConstantPropagator::Rewrite()
+{
+  unsigned int numInstructions = graph.instructions.size();
+  std::vector<bool> isRemoved(numInstructions, false);
+  std::vector<AirInstruction*> replacements(numInstructions, nullptr);
+  std::vector<unsigned int> foldedDefs;
+
+  auto substitute = [this](Slot*& slot, bool onlyIntegers)
+    {
+      LatticeValue value = ValueOf(slot);
+
+      if (value.kind == LatticeValue::CONSTANT && (!onlyIntegers || IsIntegerConstant(value.constant)))
+      {
+        slot = value.constant;
+      }
+    };
+
+  auto isConstantDef = [this](Slot* slot)
+    {
+      return (slot->index < numSlots && isTracked[slot->index] && values[slot->index].kind == LatticeValue::CONSTANT);
+    };
+
+  for (unsigned int i = 0u;
+       i < numInstructions;
+       i++)
+  {
+    AirInstruction* instruction = graph.instructions[i];
+    BasicBlock& block = graph.blocks[graph.blockOf[i]];
+
+    if (!isBlockExecutable[block.index])
+    {
+      isRemoved[i] = true;
+      continue;
+    }
+
+    switch (instruction->instructionType)
+    {
+      case InstructionType::PHI:
+      {
+        PhiInstruction* phi = static_cast<PhiInstruction*>(instruction);
+
+        if (isConstantDef(phi->result))
+        {
+          isRemoved[i] = true;
+          foldedDefs.push_back(i);
+          break;
+        }
+
+        std::vector<PhiInstruction::Operand> operands;
+        for (PhiInstruction::Operand& operand : phi->operands)
+        {
+          if (IsEdgeExecutable(graph.blockOf[operand.from->index], block.index))
+          {
+            operands.push_back(operand);
+            substitute(operands.back().value, false);
+          }
+        }
+        phi->operands = operands;
+      } break;
+
+      case InstructionType::MOV:
+      {
+        MovInstruction* mov = static_cast<MovInstruction*>(instruction);
+
+        if (isConstantDef(mov->dest))
+        {
+          isRemoved[i] = true;
+          foldedDefs.push_back(i);
+          break;
+        }
+
+        substitute(mov->src, false);
+      } break;
+
+      case InstructionType::UNARY_OP:
+      {
+        if (isConstantDef(static_cast<UnaryOpInstruction*>(instruction)->result))
+        {
+          isRemoved[i] = true;
+          foldedDefs.push_back(i);
+        }
+      } break;
+
+      case InstructionType::BINARY_OP:
+      {
+        BinaryOpInstruction* op = static_cast<BinaryOpInstruction*>(instruction);
+
+        if (isConstantDef(op->result))
+        {
+          isRemoved[i] = true;
+          foldedDefs.push_back(i);
+          break;
+        }
+
+        if (op->type == UNSIGNED_INT_INTRINSIC || op->type == SIGNED_INT_INTRINSIC)
+        {
+          substitute(op->left, true);
+          substitute(op->right, true);
+        }
+      } break;
+
+      /*
+       * NOTE(Isaac): the backend expects a constant operand of a comparison to be the second one, so we only
+       * replace the first if the comparison can be removed altogether.
+       */
+      case InstructionType::CMP:
+      {
+        CmpInstruction* cmp = static_cast<CmpInstruction*>(instruction);
+
+        if (i < block.last && graph.instructions[i + 1u]->instructionType == InstructionType::JUMP)
+        {
+          BranchOutcome outcome = EvaluateBranch(i + 1u);
+
+          if (outcome == BranchOutcome::TAKEN || outcome == BranchOutcome::NOT_TAKEN)
+          {
+            isRemoved[i] = true;
+            break;
+          }
+        }
+
+        if (!(cmp->a->IsConstant()))
+        {
+          substitute(cmp->b, true);
+        }
+      } break;
+
+      case InstructionType::JUMP:
+      {
+        JumpInstruction* jump = static_cast<JumpInstruction*>(instruction);
+
+        if (jump->condition != JumpInstruction::Condition::UNCONDITIONAL && GetComparison(i))
+        {
+          BranchOutcome outcome = EvaluateBranch(i);
+
+          if (outcome == BranchOutcome::TAKEN)
+          {
+            jump->condition = JumpInstruction::Condition::UNCONDITIONAL;
+          }
+          else if (outcome == BranchOutcome::NOT_TAKEN)
+          {
+            isRemoved[i] = true;
+            break;
+          }
+        }
+
+        Assert(isBlockExecutable[graph.blockOf[jump->label->index]], "Jump to a block that can't be reached");
+      } break;
+
+      case InstructionType::RETURN:
+      {
+        ReturnInstruction* ret = static_cast<ReturnInstruction*>(instruction);
+
+        if (ret->returnValue)
+        {
+          substitute(ret->returnValue, false);
+        }
+      } break;
+
+      case InstructionType::LABEL:
+      case InstructionType::CALL:
+      {
+      } break;
+    }
+  }
+
+  /*
+   * Some constant slots are still used where we couldn't replace them with the constant (as the parameters of
+   * calls, for example), so they still need to be given their value.
+   */
+  std::vector<bool> isStillUsed(numSlots, false);
+  LiveOperands operands;
+
+  for (unsigned int i = 0u;
+       i < numInstructions;
+       i++)
+  {
+    if (isRemoved[i])
+    {
+      continue;
+    }
+
+    GetLiveOperands(graph.instructions[i], operands);
+    for (Slot* use : operands.uses)
+    {
+      if (use->index < numSlots)
+      {
+        isStillUsed[use->index] = true;
+      }
+    }
+  }
+
+  SlotOperand slotOperands[3u];
+  for (unsigned int i : foldedDefs)
+  {
+    Slot* def = nullptr;
+    unsigned int numOperands = GetSlotOperands(graph.instructions[i], slotOperands);
+    for (unsigned int j = 0u;
+         j < numOperands;
+         j++)
+    {
+      if (!slotOperands[j].isUse)
+      {
+        def = *slotOperands[j].slot;
+      }
+    }
+
+    if (isStillUsed[def->index])
+    {
+      replacements[i] = new MovInstruction(values[def->index].constant, def);
+      isRemoved[i] = false;
+    }
+  }
+
+  /*
+   * Put the AIR back together. Phis refer to the last instruction of each predecessor, so we keep track of what
+   * that is now, and give blocks that have been emptied a label to stand in for them. The MOVs that replace phis
+   * are moved after the phis left in the block, as all of a block's phis must happen at once.
+   */
+  std::vector<AirInstruction*> instructions;
+  std::vector<AirInstruction*> lastInBlock(graph.blocks.size(), nullptr);
+  std::vector<bool> isPhiPredecessor(graph.blocks.size(), false);
+  isPhiPredecessor[0u] = true;
+
+  for (unsigned int i = 0u;
+       i < numInstructions;
+       i++)
+  {
+    if (!isRemoved[i] && !replacements[i] && graph.instructions[i]->instructionType == InstructionType::PHI)
+    {
+      for (PhiInstruction::Operand& operand : static_cast<PhiInstruction*>(graph.instructions[i])->operands)
+      {
+        isPhiPredecessor[graph.blockOf[operand.from->index]] = true;
+      }
+    }
+  }
+
+  std::vector<AirInstruction*> replacedPhis;
+
+  for (BasicBlock& block : graph.blocks)
+  {
+    unsigned int blockStart = instructions.size();
+
+    for (unsigned int i = block.first;
+         i <= block.last;
+         i++)
+    {
+      AirInstruction* instruction = graph.instructions[i];
+
+      if (instruction->instructionType != InstructionType::PHI &&
+          instruction->instructionType != InstructionType::LABEL)
+      {
+        instructions.insert(instructions.end(), replacedPhis.begin(), replacedPhis.end());
+        replacedPhis.clear();
+      }
+
+      if (isRemoved[i])
+      {
+        continue;
+      }
+
+      if (instruction->instructionType == InstructionType::PHI && replacements[i])
+      {
+        replacedPhis.push_back(replacements[i]);
+      }
+      else
+      {
+        instructions.push_back(replacements[i] ? replacements[i] : instruction);
+      }
+    }
+
+    instructions.insert(instructions.end(), replacedPhis.begin(), replacedPhis.end());
+    replacedPhis.clear();
+
+    if (instructions.size() == blockStart && isBlockExecutable[block.index] && isPhiPredecessor[block.index])
+    {
+      instructions.push_back(new LabelInstruction());
+    }
+
+    if (instructions.size() > blockStart)
+    {
+      lastInBlock[block.index] = instructions.back();
+    }
+  }
+
+  for (AirInstruction* instruction : instructions)
+  {
+    if (instruction->instructionType == InstructionType::PHI)
+    {
+      for (PhiInstruction::Operand& operand : static_cast<PhiInstruction*>(instruction)->operands)
+      {
+        operand.from = lastInBlock[graph.blockOf[operand.from->index]];
+      }
+    }
+  }
+
+  ReplaceInstructions(code, instructions);
+
+  for (unsigned int i = 0u;
+       i < numInstructions;
+       i++)
+  {
+    if (isRemoved[i] || replacements[i])
+    {
+      delete graph.instructions[i];
+    }
+  }
+}
+
+void ConstantPropagationPass::Apply(CodeThing* code)
+{
+  if (!(code->airHead))
+  {
+    return;
+  }
+
+  ConstantPropagator propagator(code);
+  propagator.Propagate();
+  propagator.Rewrite();
+}
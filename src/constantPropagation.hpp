@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <air.hpp>
+
+/*
+ * Sparse Conditional Constant Propagation
+ * ---------------------------------------
+ * This finds the slots that always hold the same constant, replaces uses of them with the constant, and folds
+ * intrinsic operations on constants into the constant they produce. Comparisons between constants are worked out,
+ * so conditional jumps on them become unconditional (or go away), and the blocks that can then never be reached
+ * are removed.
+ *
+ * It follows "Constant Propagation with Conditional Branches" by Wegman and Zadeck: values are only propagated
+ * along edges of the control flow graph that have been found to be taken, so a value that's only different on a
+ * path that can't happen doesn't stop a slot being constant. This must be run while the AIR is in SSA form.
+ */
+struct ConstantPropagationPass : AirTransformPass
+{
+  ConstantPropagationPass() : AirTransformPass("Constant propagation") { }
+
+  void Apply(CodeThing* code);
+};
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <deadCode.hpp>
+#include <algorithm>
+#include <unordered_set>
+#include <liveness.hpp>
+
+/*
+ * Instructions that define a slot can be removed if nothing uses it, as long as the register allocator is free to
+ * put it anywhere. Precolored slots stand for specific registers (parameters, return values etc.) and members are
+ * kept in memory, so writing to them has effects we can't see from the AIR.
+ */
+static bool IsNeededFor(AirInstruction* instruction, const std::vector<bool>& isMemberParent)
+{
+  switch (instruction->instructionType)
+  {
+    case InstructionType::LABEL:
+    case InstructionType::RETURN:
+    case InstructionType::JUMP:
+    case InstructionType::CMP:
+    case InstructionType::CALL:
+    {
+      return true;
+    }
+
+    case InstructionType::MOV:
+    case InstructionType::UNARY_OP:
+    case InstructionType::BINARY_OP:
+    case InstructionType::PHI:
+    {
+      SlotOperand operands[3u];
+      unsigned int numOperands = GetSlotOperands(instruction, operands);
+
+      for (unsigned int i = 0u;
+           i < numOperands;
+           i++)
+      {
+        Slot* slot = *(operands[i].slot);
+
+        if (!(operands[i].isUse) &&
+            !(IsRegisterSlot(slot) && slot->ShouldColor() && !(slot->IsColored()) && !isMemberParent[slot->index]))
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+  }
+
+  __builtin_unreachable();
+}
+
+void DeadCodeEliminationPass::Apply(CodeThing* code)
+{
+  if (!(code->airHead))
+  {
+    return;
+  }
+
+  ControlFlowGraph graph(code);
+  unsigned int numInstructions = graph.instructions.size();
+  unsigned int numSlots = code->slots.size();
+
+  // Members are found through their parent's slot, so writes to the parent have to stay
+  std::vector<bool> isMemberParent(numSlots, false);
+  for (Slot* slot : code->slots)
+  {
+    if (slot->GetType() == SlotType::MEMBER)
+    {
+      isMemberParent[static_cast<MemberSlot*>(slot)->parent->index] = true;
+    }
+  }
+
+  // --- Mark the instructions that are needed ---
+  std::vector<std::vector<unsigned int>> defsOf(numSlots);
+  std::vector<bool> isNeeded(numInstructions, false);
+  std::vector<unsigned int> worklist;
+  LiveOperands operands;
+
+  for (AirInstruction* instruction : graph.instructions)
+  {
+    GetLiveOperands(instruction, operands);
+    for (Slot* def : operands.defs)
+    {
+      defsOf[def->index].push_back(instruction->index);
+    }
+
+    if (IsNeededFor(instruction, isMemberParent))
+    {
+      isNeeded[instruction->index] = true;
+      worklist.push_back(instruction->index);
+    }
+  }
+
+  /*
+   * NOTE(Isaac): slots that aren't in SSA form can be defined more than once, so we keep every definition of a
+   * slot that's used. This also marks the definitions of the values a phi picks between.
+   */
+  while (worklist.size() > 0u)
+  {
+    AirInstruction* instruction = graph.instructions[worklist.back()];
+    worklist.pop_back();
+    GetLiveOperands(instruction, operands);
+
+    for (Slot* use : operands.uses)
+    {
+      for (unsigned int def : defsOf[use->index])
+      {
+        if (!isNeeded[def])
+        {
+          isNeeded[def] = true;
+          worklist.push_back(def);
+        }
+      }
+    }
+  }
+
+  // --- Sweep away the rest ---
+  /*
+   * Phis refer to the last instruction of each of their predecessors, so we keep track of what that is now, and
+   * give predecessors that have been emptied a label to stand in for them (like constant propagation does).
+   */
+  std::vector<AirInstruction*> instructions;
+  std::vector<AirInstruction*> lastInBlock(graph.blocks.size(), nullptr);
+  std::vector<bool> isPhiPredecessor(graph.blocks.size(), false);
+
+  for (AirInstruction* instruction : graph.instructions)
+  {
+    if (isNeeded[instruction->index] && instruction->instructionType == InstructionType::PHI)
+    {
+      for (PhiInstruction::Operand& operand : static_cast<PhiInstruction*>(instruction)->operands)
+      {
+        isPhiPredecessor[graph.blockOf[operand.from->index]] = true;
+      }
+    }
+  }
+
+  for (BasicBlock& block : graph.blocks)
+  {
+    unsigned int blockStart = instructions.size();
+
+    for (unsigned int i = block.first;
+         i <= block.last;
+         i++)
+    {
+      if (isNeeded[i])
+      {
+        instructions.push_back(graph.instructions[i]);
+      }
+    }
+
+    if (instructions.size() == blockStart && isPhiPredecessor[block.index])
+    {
+      instructions.push_back(new LabelInstruction());
+    }
+
+    if (instructions.size() > blockStart)
+    {
+      lastInBlock[block.index] = instructions.back();
+    }
+  }
+
+  for (AirInstruction* instruction : instructions)
+  {
+    if (instruction->instructionType == InstructionType::PHI)
+    {
+      for (PhiInstruction::Operand& operand : static_cast<PhiInstruction*>(instruction)->operands)
+      {
+        operand.from = lastInBlock[graph.blockOf[operand.from->index]];
+      }
+    }
+  }
+
+  ReplaceInstructions(code, instructions);
+
+  for (unsigned int i = 0u;
+       i < numInstructions;
+       i++)
+  {
+    if (!isNeeded[i])
+    {
+      delete graph.instructions[i];
+    }
+  }
+
+  // --- Find the things that are still called ---
+  code->calledThings.clear();
+  for (AirInstruction* instruction : instructions)
+  {
+    if (instruction->instructionType == InstructionType::CALL)
+    {
+      code->calledThings.push_back(static_cast<CallInstruction*>(instruction)->thing);
+    }
+  }
+}
+
+void RemoveUnreachableThings(ParseResult& parse)
+{
+  if (parse.isModule)
+  {
+    return;
+  }
+
+  std::vector<CodeThing*> toVisit;
+  for (CodeThing* thing : parse.codeThings)
+  {
+    if (thing->type == CodeThing::Type::FUNCTION && thing->attribs.isEntry)
+    {
+      toVisit.push_back(thing);
+    }
+  }
+
+  // NOTE(Isaac): if there isn't an entry point, we leave the code generator to complain about it
+  if (toVisit.size() == 0u)
+  {
+    return;
+  }
+
+  std::unordered_set<CodeThing*> reachableThings;
+  while (toVisit.size() > 0u)
+  {
+    CodeThing* thing = toVisit.back();
+    toVisit.pop_back();
+
+    if (reachableThings.insert(thing).second)
+    {
+      toVisit.insert(toVisit.end(), thing->calledThings.begin(), thing->calledThings.end());
+    }
+  }
+
+  auto isUnreachable = [&](CodeThing* thing)
+    {
+      return (reachableThings.count(thing) == 0u && !(thing->errorState->hasErrored));
+    };
+
+  auto firstUnreachable = std::stable_partition(parse.codeThings.begin(), parse.codeThings.end(),
+                                                [&](CodeThing* thing) { return !isUnreachable(thing); });
+  std::vector<CodeThing*> unreachableThings(firstUnreachable, parse.codeThings.end());
+  parse.codeThings.erase(firstUnreachable, parse.codeThings.end());
+
+  // Keep the indices in step with `codeThings`
+  for (auto it = parse.functionsByName.begin();
+       it != parse.functionsByName.end();)
+  {
+    std::vector<FunctionThing*>& overloads = it->second;
+    overloads.erase(std::remove_if(overloads.begin(), overloads.end(), isUnreachable), overloads.end());
+    it = (overloads.size() > 0u ? std::next(it) : parse.functionsByName.erase(it));
+  }
+
+  for (std::vector<OperatorThing*>& overloads : parse.operatorsByToken)
+  {
+    overloads.erase(std::remove_if(overloads.begin(), overloads.end(), isUnreachable), overloads.end());
+  }
+
+  // Nothing refers to them any more, so we can free them (and their arenas) now
+  for (CodeThing* thing : unreachableThings)
+  {
+    delete thing;
+  }
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <air.hpp>
+
+/*
+ * Dead Code Elimination
+ * ---------------------
+ * This removes the instructions whose results are never needed. It works like a mark-and-sweep garbage collector:
+ * instructions that have effects other than writing to a slot (jumps, calls, returns, and writes to precolored
+ * slots or memory) are marked as needed, then so are the instructions that define the slots they use, and so on.
+ * Anything left unmarked is swept away. This gets rid of dead stores, and the temporaries that are left unused by
+ * the AIR generator or by other optimizations, such as constant propagation.
+ *
+ * It then updates the thing's `calledThings` to the things it still calls in its AIR, so things whose calls have
+ * all been inlined or removed can be removed by `RemoveUnreachableThings`.
+ */
+struct DeadCodeEliminationPass : AirTransformPass
+{
+  DeadCodeEliminationPass() : AirTransformPass("Dead code elimination") { }
+
+  void Apply(CodeThing* code);
+};
+
+/*
+ * Removes the code things that can't be reached by following `calledThings` from the entry point, so they aren't
+ * compiled or put into the executable. Things that have errored are kept, so their errors are still reported.
+ * Modules don't have an entry point, and everything in them can be called from outside, so nothing is removed
+ * from them.
+ */
+void RemoveUnreachableThings(ParseResult& parse);
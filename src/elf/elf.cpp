@@ -16,24 +16,19 @@
 #define SECTION_HEADER_ENTRY_SIZE 0x40
 #define SYMBOL_TABLE_ENTRY_SIZE   0x18
 
-ElfString::ElfString(ElfFile& elf, const char* str)
+ElfString::ElfString(ElfFile& elf, InternedString str)
   :offset(elf.stringTableTail)
-  ,str(strdup(str))
+  ,str(str)
 {
-  elf.stringTableTail += strlen(str)+1u;
+  elf.stringTableTail += str.Str().length()+1u;
   elf.strings.push_back(this);
 }
 
-ElfString::~ElfString()
-{
-  delete str;
-}
-
 /*
  * NOTE(Isaac): If `name == nullptr`, the symbol points towards the nulled entry of the string table.
  */
 ElfSymbol::ElfSymbol(ElfFile& elf, const char* name, Binding binding, Type type, uint16_t sectionIndex, uint64_t value)
-  :name(name ? new ElfString(elf, name) : nullptr)
+  :name(name ? GetString(elf, InternedString(name)) : nullptr)
   ,info((binding << 4u) | type)
   ,sectionIndex(sectionIndex)
   ,value(value)
@@ -78,7 +73,7 @@ ElfSegment::ElfSegment(ElfFile& elf, Type type, uint32_t flags, uint64_t address
 }
 
 ElfSection::ElfSection(ElfFile& elf, const char* name, Type type, uint64_t alignment, bool addToElf)
-  :name(name ? new ElfString(elf, name) : nullptr)
+  :name(name ? GetString(elf, InternedString(name)) : nullptr)
   ,type(type)
   ,flags(0u)
   ,address(0u)
@@ -117,11 +112,27 @@ ElfThing::~ElfThing()
   delete data;
 }
 
+ElfString* GetString(ElfFile& elf, InternedString str)
+{
+  auto it = elf.stringsByValue.find(str);
+
+  if (it != elf.stringsByValue.end())
+  {
+    return it->second;
+  }
+
+  ElfString* string = new ElfString(elf, str);
+  elf.stringsByValue.emplace(str, string);
+  return string;
+}
+
 ElfSection* GetSection(ElfFile& elf, const char* name)
 {
+  InternedString internedName(name);
+
   for (ElfSection* section : elf.sections)
   {
-    if (strcmp(section->name->str, name) == 0)
+    if (section->name->str == internedName)
     {
       return section;
     }
@@ -133,6 +144,8 @@ ElfSection* GetSection(ElfFile& elf, const char* name)
 
 ElfSymbol* GetSymbol(ElfFile& elf, const char* name)
 {
+  InternedString internedName(name);
+
   for (ElfSymbol* symbol : elf.symbols)
   {
     if (!(symbol->name))
@@ -140,7 +153,7 @@ ElfSymbol* GetSymbol(ElfFile& elf, const char* name)
       continue;
     }
 
-    if (strcmp(symbol->name->str, name) == 0)
+    if (symbol->name->str == internedName)
     {
       return symbol;
     }
@@ -198,13 +211,7 @@ static ElfString* ExtractString(ElfFile& elf, ElfObject& object, const ElfSectio
     buffer[length++] = c;
   }
 
-  buffer[length++] = '\0';
-  char* str = static_cast<char*>(malloc(sizeof(char) * length));
-  memcpy(str, buffer, sizeof(char) * length);
-
-  ElfString* string = new ElfString(elf, str);
-  free(str);
-  return string;
+  return GetString(elf, InternedString(buffer, length));
 }
 
 static void ParseSectionHeader(ElfFile& elf, ElfObject& object)
@@ -409,6 +416,7 @@ void LinkObject(ElfFile& elf, const char* objectPath)
   }
 
   // Find the .text section
+  static const InternedString TEXT(".text");
   ElfSection* text = nullptr;
   for (ElfSection* section : object.sections)
   {
@@ -417,7 +425,7 @@ void LinkObject(ElfFile& elf, const char* objectPath)
       continue;
     }
 
-    if (strcmp(section->name->str, ".text") == 0)
+    if (section->name->str == TEXT)
     {
       text = section;
       break;
@@ -480,7 +488,7 @@ void LinkObject(ElfFile& elf, const char* objectPath)
     }
 
     // Create a thing for the extracted function
-    ElfSymbol* thingSymbol = new ElfSymbol(elf, symbol->name->str, ElfSymbol::Binding::SYM_BIND_GLOBAL,
+    ElfSymbol* thingSymbol = new ElfSymbol(elf, symbol->name->str.c_str(), ElfSymbol::Binding::SYM_BIND_GLOBAL,
                                            ElfSymbol::Type::SYM_TYPE_FUNCTION, GetSection(elf, ".text")->index, 0u);
     ElfThing* thing = new ElfThing(GetSection(elf, ".text"), thingSymbol);
                                                       
@@ -687,10 +695,10 @@ static void EmitStringTable(FILE* f, ElfFile& elf, const std::vector<ElfString*>
 
   for (ElfString* string : strings)
   {
-    GetSection(elf, ".strtab")->size += strlen(string->str) + 1u;
+    GetSection(elf, ".strtab")->size += string->str.Str().length() + 1u;
 
     // NOTE(Isaac): add 1 to also write the included null-terminator
-    fwrite(string->str, sizeof(char), strlen(string->str) + 1u, f);
+    fwrite(string->str.c_str(), sizeof(char), string->str.Str().length() + 1u, f);
   }
 }
 
@@ -740,7 +748,7 @@ static void ResolveUndefinedSymbols(ErrorState* errorState, ElfFile& elf)
         continue;
       }
 
-      if (strcmp(symbol->name->str, otherSymbol->name->str) == 0u)
+      if (symbol->name->str == otherSymbol->name->str)
       {
         // Coalesce the symbols!
         elf.symbols.erase(it);
@@ -761,7 +769,7 @@ static void ResolveUndefinedSymbols(ErrorState* errorState, ElfFile& elf)
 
     if (!symbolResolved)
     {
-      RaiseError(errorState, ERROR_UNRESOLVED_SYMBOL, symbol->name->str);
+      RaiseError(errorState, ERROR_UNRESOLVED_SYMBOL, symbol->name->str.c_str());
     }
   }
 }
@@ -859,6 +867,7 @@ ElfFile::ElfFile(TargetMachine* target, bool isRelocatable)
   ,segments()
   ,symbols()
   ,strings()
+  ,stringsByValue()
   ,mappings()
   ,relocations()
   ,stringTableTail(1u)    // The ELF standard requires us to have a null byte at the beginning of string tables
@@ -43,15 +43,15 @@ struct ElfHeader
 };
 
 /*
- * The string passed to this is duplicated and then managed separately.
+ * Each distinct string is only put in the string table once, so these should be got with `GetString` instead of
+ * being created directly.
  */
 struct ElfString
 {
-  ElfString(ElfFile& elf, const char* str);
-  ~ElfString();
+  ElfString(ElfFile& elf, InternedString str);
 
-  unsigned int  offset;
-  char*         str;
+  unsigned int    offset;
+  InternedString  str;
 };
 
 #define SEGMENT_ATTRIB_X        0x1         // Marks the segment as executable
@@ -280,12 +280,14 @@ struct ElfFile
   std::vector<ElfSection*>    sections;
   std::vector<ElfSymbol*>     symbols;
   std::vector<ElfString*>     strings;
+  std::unordered_map<InternedString, ElfString*> stringsByValue;
   std::vector<ElfMapping>     mappings;
   std::vector<ElfRelocation*> relocations;
   unsigned int                stringTableTail; // Tail of the string table, relative to the start of the table
   unsigned int                numSymbols;
 };
 
+ElfString* GetString(ElfFile& elf, InternedString str);
 ElfSection* GetSection(ElfFile& elf, const char* name);
 ElfSymbol* GetSymbol(ElfFile& elf, const char* name);
 void MapSection(ElfFile& elf, ElfSegment* segment, ElfSection* section);
@@ -79,6 +79,8 @@ void InitErrorDefs()
   E(ERROR_RETURN_VALUE_NOT_EXPECTED,          DO_NOTHING,           "Shouldn't return anything, trying to return a: %s");
   E(ERROR_MISSING_TYPE_INFORMATION,           DO_NOTHING,           "Missing type information: %s");
   E(ERROR_TYPE_CONSTRUCT_TOO_FEW_EXPRESSIONS, DO_NOTHING,           "Too few expressions to construct all members of type: %s");
+  E(ERROR_UNRECOGNISED_OPTION,                GIVE_UP,              "Unrecognised command-line option: %s");
+  E(ERROR_MALFORMED_OPTION,                   GIVE_UP,              "Malformed command-line option(%s): %s");
 
   I(ICE_GENERIC,                                                    "%s");
   I(ICE_UNHANDLED_TOKEN_TYPE,                                       "Unhandled token type in %s: %s");
@@ -117,8 +119,23 @@ void ErrorState::PrintError(const char* message, const ErrorDef& error)
 
 CodeThingErrorState::CodeThingErrorState(CodeThing* thing)
   :thing(thing)
+  ,errors()
 { }
 
+void CodeThingErrorState::Poison(PoisonStrategy strategy)
+{
+  if (strategy == GIVE_UP)
+  {
+    fputs(errors.c_str(), stderr);
+    Crash();
+  }
+}
+
+void CodeThingErrorState::PrintError(const char* message, const ErrorDef& error)
+{
+  errors += FormatString("%s%s: \x1B[0m%s\n", g_levelColors[error.level], g_levelStrings[error.level], message);
+}
+
 /*
  * XXX: `Assert` must not be used in the following methods, because it executes `RaiseError` to report errors.
  * Instead, use this method to crash with a relatively helpful message.
@@ -62,6 +62,8 @@ enum Error
   ERROR_RETURN_VALUE_NOT_EXPECTED,              // "Shouldn't return anything, trying to return a: %s"
   ERROR_MISSING_TYPE_INFORMATION,               // "Missing type information: %s"
   ERROR_TYPE_CONSTRUCT_TOO_FEW_EXPRESSIONS,     // "Insufficient expressions to construct all members of type: %s"
+  ERROR_UNRECOGNISED_OPTION,                    // "Unrecognised command-line option: %s"
+  ERROR_MALFORMED_OPTION,                       // "Malformed command-line option(%s): %s"
 
   ICE_GENERIC,                                  // "%s"
   ICE_UNHANDLED_TOKEN_TYPE,                     // "Unhandled token type in %s: %s"
@@ -125,14 +127,25 @@ struct ErrorState
   virtual void PrintError(const char* message, const ErrorDef& error);
 };
 
+/*
+ * Thrown by a `ParsingErrorState` that's collecting its errors, instead of crashing, when it has to give up. Files
+ * are only parsed into collected errors on worker threads, so this lets the worker stop parsing, and leaves it to
+ * the thread that reports the errors to crash, once it has reported everything before them.
+ */
+struct ParsingGaveUp
+{
+};
+
 template<typename T>
 struct ParsingErrorState : ErrorState
 {
-  ParsingErrorState(Parser<T>& parser)
+  ParsingErrorState(Parser<T>& parser, std::string* output = nullptr)
     :parser(parser)
+    ,output(output)
   { }
 
-  Parser<T>& parser;
+  Parser<T>&    parser;
+  std::string*  output;   // If this is set, errors are appended to it, rather than printed to `stderr`
 
   void Poison(PoisonStrategy strategy) override
   {
@@ -187,6 +200,11 @@ struct ParsingErrorState : ErrorState
 
       case GIVE_UP:
       {
+        if (output)
+        {
+          throw ParsingGaveUp();
+        }
+
         Crash();
       } break;
     }
@@ -194,18 +212,36 @@ struct ParsingErrorState : ErrorState
 
   void PrintError(const char* message, const ErrorDef& error) override
   {
-    fprintf(stderr, "\x1B[1;37m%s(%u:%u):\x1B[0m %s%s: \x1B[0m%s\n", parser.path.c_str(),
-            parser.currentLine, parser.currentLineOffset, g_levelColors[error.level],
-            g_levelStrings[error.level], message);
+    std::string formatted = FormatString("\x1B[1;37m%s(%u:%u):\x1B[0m %s%s: \x1B[0m%s\n", parser.path.c_str(),
+                                         parser.currentLine, parser.currentLineOffset, g_levelColors[error.level],
+                                         g_levelStrings[error.level], message);
+
+    if (output)
+    {
+      output->append(formatted);
+    }
+    else
+    {
+      fputs(formatted.c_str(), stderr);
+    }
   }
 };
 
+/*
+ * Code things are compiled in parallel, so their errors are collected, rather than printed as they're raised, and
+ * then printed by `ReportCodeThingErrors` in the order the things are in. If one has to give up, we can't come
+ * back to print it later, so its errors are printed before crashing.
+ */
 struct CodeThingErrorState : ErrorState
 {
   CodeThingErrorState(CodeThing* thing);
   ~CodeThingErrorState() { }
 
-  CodeThing* thing;
+  CodeThing*  thing;
+  std::string errors;
+
+  void Poison(PoisonStrategy strategy) override;
+  void PrintError(const char* message, const ErrorDef& error) override;
 };
 
 extern const char* g_levelColors[];
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <intern.hpp>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+/*
+ * The table is split into shards, each with its own lock, so threads interning different names don't usually have
+ * to wait for each other. Each shard is an open-addressed hash table, so we can look names up straight from the
+ * source without making a `std::string` first. The strings themselves are allocated separately, so they don't move
+ * when a shard grows.
+ */
+#define NUM_INTERN_SHARDS     16u
+#define MIN_INTERN_SHARD_SIZE 256u
+
+struct InternSlot
+{
+  uint64_t            hash;
+  const std::string*  str;      // `nullptr` if the slot is empty
+};
+
+struct InternShard
+{
+  std::mutex              lock;
+  std::vector<InternSlot> slots;
+  size_t                  numStrings;
+};
+
+static InternShard* GetInternShards()
+{
+  static InternShard shards[NUM_INTERN_SHARDS];
+  return shards;
+}
+
+// FNV-1a
+static uint64_t HashString(const char* str, size_t length)
+{
+  uint64_t hash = 0xcbf29ce484222325u;
+
+  for (size_t i = 0u;
+       i < length;
+       i++)
+  {
+    hash ^= static_cast<uint8_t>(str[i]);
+    hash *= 0x100000001b3u;
+  }
+
+  return hash;
+}
+
+/*
+ * NOTE(Isaac): the low bits of the hash pick the shard, so we use the bits above them to pick a slot.
+ */
+static size_t GetFirstSlot(uint64_t hash, size_t mask)
+{
+  return (hash / NUM_INTERN_SHARDS) & mask;
+}
+
+static void GrowShard(InternShard& shard)
+{
+  std::vector<InternSlot> oldSlots = std::move(shard.slots);
+  shard.slots.assign((oldSlots.size() ? oldSlots.size() * 2u : MIN_INTERN_SHARD_SIZE), InternSlot{0u, nullptr});
+  size_t mask = shard.slots.size() - 1u;
+
+  for (const InternSlot& slot : oldSlots)
+  {
+    if (!(slot.str))
+    {
+      continue;
+    }
+
+    size_t i = GetFirstSlot(slot.hash, mask);
+    while (shard.slots[i].str)
+    {
+      i = (i + 1u) & mask;
+    }
+
+    shard.slots[i] = slot;
+  }
+}
+
+static const std::string* Intern(const char* str, size_t length)
+{
+  static const std::string emptyString;
+
+  if (length == 0u)
+  {
+    return &emptyString;
+  }
+
+  uint64_t hash = HashString(str, length);
+  InternShard& shard = GetInternShards()[hash % NUM_INTERN_SHARDS];
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  // Keep the shard at most half full, so probe sequences stay short
+  if ((shard.numStrings + 1u) * 2u > shard.slots.size())
+  {
+    GrowShard(shard);
+  }
+
+  size_t mask = shard.slots.size() - 1u;
+  for (size_t i = GetFirstSlot(hash, mask);
+       ;
+       i = (i + 1u) & mask)
+  {
+    InternSlot& slot = shard.slots[i];
+
+    if (!(slot.str))
+    {
+      slot.hash = hash;
+      slot.str  = new std::string(str, length);
+      shard.numStrings++;
+      return slot.str;
+    }
+
+    if (slot.hash == hash && slot.str->length() == length && memcmp(slot.str->data(), str, length) == 0)
+    {
+      return slot.str;
+    }
+  }
+}
+
+InternedString::InternedString()
+  :str(Intern(nullptr, 0u))
+{
+}
+
+InternedString::InternedString(const char* str)
+  :str(Intern(str, strlen(str)))
+{
+}
+
+InternedString::InternedString(const char* str, size_t length)
+  :str(Intern(str, length))
+{
+}
+
+InternedString::InternedString(const std::string& str)
+  :str(Intern(str.data(), str.length()))
+{
+}
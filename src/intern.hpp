@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <functional>
+
+/*
+ * Names (identifiers, type names, mangled names, symbol names etc.) are interned, so each distinct name is only
+ * stored once, and two names are the same exactly when their handles are. Interned strings are never freed.
+ *
+ * NOTE(Isaac): interning is thread-safe, so files can be parsed in parallel. Comparing, hashing and reading
+ * interned strings don't need to lock anything.
+ */
+struct InternedString
+{
+  InternedString();     // The empty string
+  explicit InternedString(const char* str);
+  explicit InternedString(const char* str, size_t length);
+  explicit InternedString(const std::string& str);
+
+  const std::string& Str() const    { return *str; }
+  const char* c_str() const         { return str->c_str(); }
+  bool IsEmpty() const              { return str->empty(); }
+
+  bool operator==(const InternedString& other) const { return str == other.str; }
+  bool operator!=(const InternedString& other) const { return str != other.str; }
+
+private:
+  const std::string* str;
+};
+
+namespace std
+{
+  template<>
+  struct hash<InternedString>
+  {
+    size_t operator()(const InternedString& str) const
+    {
+      return hash<const char*>()(str.c_str());
+    }
+  };
+}
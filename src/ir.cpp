@@ -22,8 +22,36 @@ ParseResult::ParseResult()
   ,types()
   ,strings()
   ,filesToLink()
+  ,useLinearScan(false)
+  ,typesByName()
+  ,functionsByName()
+  ,operatorsByToken()
+  ,arena()
 { }
 
+ParseResult::~ParseResult()
+{
+  for (DependencyDef* dependency : dependencies)
+  {
+    delete dependency;
+  }
+
+  for (CodeThing* thing : codeThings)
+  {
+    delete thing;
+  }
+
+  for (TypeDef* type : types)
+  {
+    delete type;
+  }
+
+  for (StringConstant* string : strings)
+  {
+    delete string;
+  }
+}
+
 DependencyDef::DependencyDef(DependencyDef::Type type, const std::string& path)
   :type(type)
   ,path(path)
@@ -45,7 +73,7 @@ StringConstant::StringConstant(ParseResult& parse, const std::string& str)
   parse.strings.push_back(this);
 }
 
-TypeDef::TypeDef(const std::string& name)
+TypeDef::TypeDef(InternedString name)
   :name(name)
   ,members()
   ,errorState(new ErrorState())
@@ -87,14 +115,6 @@ TypeRef::TypeRef(TypeDef* resolvedType, bool isMutable, bool isReference, bool i
   ,arraySize(arraySize)
 { }
 
-TypeRef::~TypeRef()
-{
-  if (!isArraySizeResolved)
-  {
-    delete arraySizeExpression;
-  }
-}
-
 std::string TypeRef::AsString()
 {
   std::string result;
@@ -112,12 +132,12 @@ std::string TypeRef::AsString()
     }
     else
     {
-      result += resolvedType->name;
+      result += resolvedType->name.Str();
     }
   }
   else
   {
-    result += name;
+    result += name.Str();
   }
 
   if (isArray)
@@ -155,7 +175,7 @@ unsigned int TypeRef::GetSize()
   return size;
 }
 
-MemberDef::MemberDef(const std::string& name, const TypeRef& type, ASTNode* initExpression, int offset)
+MemberDef::MemberDef(InternedString name, const TypeRef& type, ASTNode* initExpression, int offset)
   :name(name)
   ,type(type)
   ,initExpression(initExpression)
@@ -163,12 +183,7 @@ MemberDef::MemberDef(const std::string& name, const TypeRef& type, ASTNode* init
 {
 }
 
-MemberDef::~MemberDef()
-{
-  delete initExpression;
-}
-
-VariableDef::VariableDef(const std::string& name, const TypeRef& type, ASTNode* initExpression, int offset)
+VariableDef::VariableDef(InternedString name, const TypeRef& type, ASTNode* initExpression, int offset)
   :name(name)
   ,type(type)
   ,initExpression(initExpression)
@@ -179,11 +194,6 @@ VariableDef::VariableDef(const std::string& name, const TypeRef& type, ASTNode*
 {
 }
 
-VariableDef::~VariableDef()
-{
-  delete initExpression;
-}
-
 char VariableDef::GetStorageChar()
 {
   switch (storage)
@@ -207,24 +217,33 @@ AttribSet::AttribSet()
 ScopeDef::ScopeDef(CodeThing* thing, ScopeDef* parent)
   :parent(parent)
   ,locals()
+  ,localsByName()
 {
   Assert(thing, "Tried to create scope in nullptr CodeThing");
   thing->scopes.push_back(this);
 }
 
-std::vector<VariableDef*> ScopeDef::GetReachableVariables()
+void ScopeDef::AddLocal(VariableDef* local)
 {
-  std::vector<VariableDef*> reachable;
-  reachable.insert(reachable.end(), locals.begin(), locals.end());
+  locals.push_back(local);
+  localsByName.emplace(local->name, local);
+}
 
-  ScopeDef* parentScope = parent;
-  while (parentScope)
+VariableDef* ScopeDef::FindVariable(InternedString name)
+{
+  for (ScopeDef* scope = this;
+       scope;
+       scope = scope->parent)
   {
-    reachable.insert(reachable.end(), parentScope->locals.begin(), parentScope->locals.end());
-    parentScope = parentScope->parent;
+    auto it = scope->localsByName.find(name);
+
+    if (it != scope->localsByName.end())
+    {
+      return it->second;
+    }
   }
 
-  return reachable;
+  return nullptr;
 }
 
 CodeThing::CodeThing(CodeThing::Type type)
@@ -240,10 +259,13 @@ CodeThing::CodeThing(CodeThing::Type type)
   ,stackFrameSize(0u)
   ,airHead(nullptr)
   ,airTail(nullptr)
+  ,controlFlowGraph(nullptr)
   ,numTemporaries(0u)
   ,numReturnResults(0u)
   ,neededStackSpace(0u)
+  ,numSpilledSlots(0u)
   ,symbol(nullptr)
+  ,arena()
 {
 }
 
@@ -252,19 +274,10 @@ CodeThing::~CodeThing()
   delete errorState;
 
   delete returnType;
-  delete ast;
-  
-  for (Slot* slot : slots)
-  {
-    delete slot;
-  }
-
-  delete airHead;
-  delete airTail;
   delete symbol;
 }
 
-FunctionThing::FunctionThing(const std::string& name)
+FunctionThing::FunctionThing(InternedString name)
   :CodeThing(CodeThing::Type::FUNCTION)
   ,name(name)
 {
@@ -276,17 +289,102 @@ OperatorThing::OperatorThing(TokenType token)
 {
 }
 
-TypeDef* GetTypeByName(ParseResult& parse, const std::string& name)
+void AddType(ParseResult& parse, TypeDef* type)
 {
-  for (TypeDef* type : parse.types)
+  parse.types.push_back(type);
+
+  // NOTE(Isaac): this doesn't replace an existing type with the same name
+  parse.typesByName.emplace(type->name, type);
+}
+
+void AddCodeThing(ParseResult& parse, CodeThing* thing)
+{
+  parse.codeThings.push_back(thing);
+
+  switch (thing->type)
   {
-    if (type->name == name)
+    case CodeThing::Type::FUNCTION:
     {
-      return type;
-    }
+      FunctionThing* function = static_cast<FunctionThing*>(thing);
+      parse.functionsByName[function->name].push_back(function);
+    } break;
+
+    case CodeThing::Type::OPERATOR:
+    {
+      OperatorThing* operatorThing = static_cast<OperatorThing*>(thing);
+      parse.operatorsByToken[operatorThing->token].push_back(operatorThing);
+    } break;
   }
+}
 
-  return nullptr;
+/*
+ * Prints the errors each code thing has collected since this was last called (see `CodeThingErrorState`), in the
+ * order the things are in, so they come out in the same order however the things were scheduled.
+ */
+void ReportCodeThingErrors(ParseResult& parse)
+{
+  for (CodeThing* thing : parse.codeThings)
+  {
+    CodeThingErrorState* errorState = static_cast<CodeThingErrorState*>(thing->errorState);
+    fputs(errorState->errors.c_str(), stderr);
+    errorState->errors.clear();
+  }
+}
+
+/*
+ * Moves everything parsed into `shard` onto the end of `result`, leaving the shard empty. Strings are given new
+ * handles as if they had been parsed straight into `result`, so merging shards in the same order always gives the
+ * same result, however they were produced.
+ */
+void MergeParseResult(ParseResult& result, ParseResult& shard)
+{
+  if (shard.isModule)
+  {
+    result.isModule = true;
+  }
+
+  if (shard.name != "")
+  {
+    result.name = shard.name;
+  }
+
+  if (shard.targetArch != "")
+  {
+    result.targetArch = shard.targetArch;
+  }
+
+  for (StringConstant* string : shard.strings)
+  {
+    string->handle = (result.strings.size() > 0u ? result.strings.back()->handle + 1u : 0u);
+    result.strings.push_back(string);
+  }
+
+  result.dependencies.insert(result.dependencies.end(), shard.dependencies.begin(), shard.dependencies.end());
+
+  for (CodeThing* thing : shard.codeThings)
+  {
+    AddCodeThing(result, thing);
+  }
+
+  for (TypeDef* type : shard.types)
+  {
+    AddType(result, type);
+  }
+
+  result.filesToLink.insert(result.filesToLink.end(), shard.filesToLink.begin(), shard.filesToLink.end());
+  result.arena.Adopt(shard.arena);
+
+  // NOTE(Isaac): these are now owned by the result, so the shard mustn't free them
+  shard.dependencies.clear();
+  shard.codeThings.clear();
+  shard.types.clear();
+  shard.strings.clear();
+}
+
+TypeDef* GetTypeByName(ParseResult& parse, InternedString name)
+{
+  auto it = parse.typesByName.find(name);
+  return (it == parse.typesByName.end() ? nullptr : it->second);
 }
 
 bool AreTypeRefsCompatible(TypeRef* a, TypeRef* b, bool careAboutMutability)
@@ -362,7 +460,7 @@ static std::string MangleName(CodeThing* thing)
     case CodeThing::Type::FUNCTION:
     {
       static const std::string BASE = "_R_";
-      return BASE + dynamic_cast<FunctionThing*>(thing)->name;
+      return BASE + dynamic_cast<FunctionThing*>(thing)->name.Str();
     } break;
 
     case CodeThing::Type::OPERATOR:
@@ -389,7 +487,7 @@ static std::string MangleName(CodeThing* thing)
     
       for (VariableDef* param : thing->params)
       {
-        mangling += std::string("_") + param->type.name;
+        mangling += "_" + param->type.name.Str();
       }
     
       return mangling;
@@ -403,15 +501,13 @@ static void CompleteTypeRef(TypeRef& ref, ParseResult& parse, ErrorState* errorS
 {
   Assert(!(ref.isResolved), "Tried to resolve TypeRef that is already resolved");
 
-  for (TypeDef* type : parse.types)
+  TypeDef* type = GetTypeByName(parse, ref.name);
+
+  if (type)
   {
-    if (ref.name == type->name)
-    {
-      // XXX(Isaac): this would be a good place to increment a usage counter on the type, if we ever needed one
-      ref.isResolved = true;
-      ref.resolvedType = type;
-      break;
-    }
+    // XXX(Isaac): this would be a good place to increment a usage counter on the type, if we ever needed one
+    ref.isResolved = true;
+    ref.resolvedType = type;
   }
 
   if (!(ref.isResolved))
@@ -458,7 +554,7 @@ void CompleteIR(ParseResult& parse, TargetMachine* target)
   for (CodeThing* thing : parse.codeThings)
   {
     // Mangle the thing's name
-    thing->mangledName = MangleName(thing);
+    thing->mangledName = InternedString(MangleName(thing));
 
     // Resolve its return type and the types of its parameters and locals
     if (thing->returnType)
@@ -8,15 +8,21 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <common.hpp>
+#include <intern.hpp>
 #include <parser.hpp>
 #include <error.hpp>
+#include <arena.hpp>
 
 struct Slot;
 struct AirInstruction;
+struct ControlFlowGraph;
 
 struct DependencyDef;
 struct CodeThing;
+struct FunctionThing;
+struct OperatorThing;
 struct MemberDef;
 struct VariableDef;
 struct TypeDef;
@@ -40,9 +46,16 @@ enum IntrinsicOpType
   NUM_INTRINSIC_OP_TYPES,
 };
 
+/*
+ * The `ParseResult` owns the dependencies, code things, types and strings in it, and frees them when it's destroyed.
+ */
 struct ParseResult
 {
   ParseResult();
+  ~ParseResult();
+
+  ParseResult(const ParseResult&) = delete;
+  ParseResult& operator=(const ParseResult&) = delete;
 
   bool                          isModule;
   std::string                   name;
@@ -52,6 +65,22 @@ struct ParseResult
   std::vector<TypeDef*>         types;
   std::vector<StringConstant*>  strings;
   std::vector<std::string>      filesToLink;
+  bool                          useLinearScan;  // Allocate registers quickly, rather than well (`--linear-scan`)
+
+  /*
+   * These index the types and code things above, so we don't have to search through all of them to find one.
+   * They're kept up to date by `AddType` and `AddCodeThing`, which should be used instead of adding to `types` and
+   * `codeThings` directly. Overloads are kept in the order they were added, and the first type added with a name
+   * shadows any later ones, so lookups find the same thing a search through the vectors would.
+   */
+  std::unordered_map<InternedString, TypeDef*>                    typesByName;
+  std::unordered_map<InternedString, std::vector<FunctionThing*>> functionsByName;
+  std::vector<OperatorThing*>                                     operatorsByToken[NUM_TOKENS];
+
+  /*
+   * Everything allocated while parsing (e.g. the AST) and completing the IR is allocated from this.
+   */
+  Arena                         arena;
 };
 
 struct DependencyDef
@@ -91,10 +120,10 @@ struct StringConstant
  */
 struct TypeDef
 {
-  TypeDef(const std::string& name);
+  TypeDef(InternedString name);
   ~TypeDef();
 
-  std::string             name;
+  InternedString          name;
   std::vector<MemberDef*> members;
   ErrorState*             errorState;
 
@@ -114,12 +143,11 @@ struct TypeRef
   TypeRef();
   TypeRef(TypeDef* resolvedType, bool isMutable = false, bool isReference = false, bool isReferenceMutable = false,
           bool isArray = false, unsigned int arraySize = 0u);
-  ~TypeRef();
 
   std::string AsString();
   unsigned int GetSize();
 
-  std::string     name;
+  InternedString  name;
   TypeDef*        resolvedType;        // Nullptr for empty array `initialiser-list`s
   bool            isResolved;
   bool            isMutable;           // For references, this describes the mutability of the reference
@@ -142,12 +170,11 @@ struct TypeRef
  */
 struct MemberDef
 {
-  MemberDef(const std::string& name, const TypeRef& type, ASTNode* initExpression, int offset = 0);
-  ~MemberDef();
+  MemberDef(InternedString name, const TypeRef& type, ASTNode* initExpression, int offset = 0);
 
-  std::string name;
-  TypeRef     type;
-  ASTNode*    initExpression;
+  InternedString  name;
+  TypeRef         type;
+  ASTNode*        initExpression;
 
   /*
    * NOTE(Isaac): this can be used to represent multiple things:
@@ -162,7 +189,7 @@ struct MemberDef
  * This describes the definition of a variable, and can also be used to refer to variables that have already
  * been defined. Its initial value should be assigned to its allocated register/memory when it enters scope.
  */
-struct VariableDef
+struct VariableDef : ArenaObject
 {
   /*
    * This describes where the variable should be located. Usually, it will be in a register unless it is larger
@@ -175,8 +202,7 @@ struct VariableDef
     STACK
   };
 
-  VariableDef(const std::string& name, const TypeRef& typeRef, ASTNode* initExpression, int offset = 0);
-  ~VariableDef();
+  VariableDef(InternedString name, const TypeRef& typeRef, ASTNode* initExpression, int offset = 0);
 
   /*
    * This returns a character representing the storage of this variable. This is used to pretty-print slots etc.
@@ -184,7 +210,7 @@ struct VariableDef
    */
   char GetStorageChar();
 
-  std::string               name;
+  InternedString            name;
   TypeRef                   type;
   ASTNode*                  initExpression;
   Storage                   storage;
@@ -224,19 +250,26 @@ struct AttribSet
  * within it, and can be inside another scope (it's 'parent'). Code inside a scope can also access variables within
  * its scope's parent.
  */
-struct ScopeDef
+struct ScopeDef : ArenaObject
 {
   ScopeDef(CodeThing* thing, ScopeDef* parent);
   ~ScopeDef() { }
  
   /*
-   * This gets a list of all variables reachable from this scope.
-   * (Basically variables in this scope and its parent's scopes (recursively))
+   * Locals should be added with this, rather than by adding to `locals` directly, so they can be found by name.
+   * If this scope already has a local with the same name, the earlier one is the one that will be found.
+   */
+  void AddLocal(VariableDef* local);
+
+  /*
+   * This finds the variable called `name` that is reachable from this scope - the first one found from looking in
+   * this scope and then its parents (recursively). Returns `nullptr` if there isn't one.
    */
-  std::vector<VariableDef*> GetReachableVariables();
+  VariableDef* FindVariable(InternedString name);
 
-  ScopeDef*                 parent;
-  std::vector<VariableDef*> locals;
+  ScopeDef*                                         parent;
+  std::vector<VariableDef*>                         locals;
+  std::unordered_map<InternedString, VariableDef*>  localsByName;
 };
 
 /*
@@ -257,7 +290,7 @@ struct CodeThing
   virtual ~CodeThing();
 
   Type                      type;
-  std::string               mangledName;
+  InternedString            mangledName;
   std::vector<VariableDef*> params;
   std::vector<ScopeDef*>    scopes;
   bool                      shouldAutoReturn;
@@ -275,19 +308,26 @@ struct CodeThing
   unsigned int              stackFrameSize;
   AirInstruction*           airHead;
   AirInstruction*           airTail;
+  ControlFlowGraph*         controlFlowGraph;   // Built from the AIR once it's been generated, for finding liveness
   unsigned int              numTemporaries;
   unsigned int              numReturnResults;
   unsigned int              neededStackSpace;   // This is the size (in bytes) that we need to grow the stack frame by to fit local variables etc.
+  unsigned int              numSpilledSlots;    // How many slots the register allocator had to spill onto the stack
 
   // Final executable stuff
   ElfSymbol*                symbol;
+
+  /*
+   * Everything allocated while running the passes on this thing and generating its AIR is allocated from this.
+   */
+  Arena                     arena;
 };
 
 struct FunctionThing : CodeThing
 {
-  FunctionThing(const std::string& name);
+  FunctionThing(InternedString name);
 
-  std::string name;
+  InternedString name;
 };
 
 struct OperatorThing : CodeThing
@@ -297,6 +337,10 @@ struct OperatorThing : CodeThing
   TokenType token;
 };
 
-TypeDef* GetTypeByName(ParseResult& parse, const std::string& name);
+void AddType(ParseResult& parse, TypeDef* type);
+void AddCodeThing(ParseResult& parse, CodeThing* thing);
+void MergeParseResult(ParseResult& result, ParseResult& shard);
+TypeDef* GetTypeByName(ParseResult& parse, InternedString name);
 bool AreTypeRefsCompatible(TypeRef* a, TypeRef* b, bool careAboutMutability = true);
 void CompleteIR(ParseResult& parse, TargetMachine* target);
+void ReportCodeThingErrors(ParseResult& parse);
@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <liveness.hpp>
+#include <air.hpp>
+#include <utility>
+
+SlotSet::SlotSet(unsigned int numSlots)
+  :words((numSlots + 63u) / 64u, 0u)
+{
+}
+
+bool SlotSet::Union(const SlotSet& other)
+{
+  bool changed = false;
+
+  for (unsigned int i = 0u;
+       i < words.size();
+       i++)
+  {
+    uint64_t merged = words[i] | other.words[i];
+    changed |= (merged != words[i]);
+    words[i] = merged;
+  }
+
+  return changed;
+}
+
+void GetLiveOperands(AirInstruction* instruction, LiveOperands& operands)
+{
+  operands.uses.clear();
+  operands.defs.clear();
+
+  #define USE(slot)\
+    if ((slot) && IsRegisterSlot(slot))\
+    {\
+      operands.uses.push_back(slot);\
+    }
+
+  #define DEF(slot)\
+    if ((slot) && IsRegisterSlot(slot))\
+    {\
+      operands.defs.push_back(slot);\
+    }
+
+  switch (instruction->instructionType)
+  {
+    case InstructionType::LABEL:
+    case InstructionType::JUMP:
+    {
+    } break;
+
+    case InstructionType::RETURN:
+    {
+      USE(static_cast<ReturnInstruction*>(instruction)->returnValue);
+    } break;
+
+    case InstructionType::MOV:
+    {
+      MovInstruction* mov = static_cast<MovInstruction*>(instruction);
+      USE(mov->src);
+      DEF(mov->dest);
+    } break;
+
+    case InstructionType::CMP:
+    {
+      CmpInstruction* cmp = static_cast<CmpInstruction*>(instruction);
+      USE(cmp->a);
+      USE(cmp->b);
+    } break;
+
+    case InstructionType::UNARY_OP:
+    {
+      UnaryOpInstruction* op = static_cast<UnaryOpInstruction*>(instruction);
+      USE(op->operand);
+      DEF(op->result);
+    } break;
+
+    case InstructionType::BINARY_OP:
+    {
+      BinaryOpInstruction* op = static_cast<BinaryOpInstruction*>(instruction);
+      USE(op->left);
+      USE(op->right);
+      DEF(op->result);
+    } break;
+
+    case InstructionType::CALL:
+    {
+      CallInstruction* call = static_cast<CallInstruction*>(instruction);
+
+      for (Slot* param : call->params)
+      {
+        USE(param);
+      }
+
+      DEF(call->returnResult);
+    } break;
+
+    /*
+     * NOTE(Isaac): strictly, a phi's operands are only live on the edges they come in on, but treating them as
+     * being used at the top of the block is good enough until SSA has been destructed.
+     */
+    case InstructionType::PHI:
+    {
+      PhiInstruction* phi = static_cast<PhiInstruction*>(instruction);
+
+      for (PhiInstruction::Operand& operand : phi->operands)
+      {
+        USE(operand.value);
+      }
+
+      DEF(phi->result);
+    } break;
+  }
+
+  #undef USE
+  #undef DEF
+}
+
+BasicBlock::BasicBlock(unsigned int index, unsigned int first)
+  :index(index)
+  ,first(first)
+  ,last(first)
+  ,successors()
+  ,predecessors()
+  ,uses()
+  ,defs()
+  ,liveIn()
+  ,liveOut()
+{
+}
+
+ControlFlowGraph::ControlFlowGraph(CodeThing* code)
+  :numSlots(code->slots.size())
+  ,instructions()
+  ,blocks()
+  ,blockOf()
+  ,dominators()
+  ,postorder()
+{
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    Assert(instruction->index == static_cast<signed int>(instructions.size()), "AIR must be numbered in order");
+    instructions.push_back(instruction);
+  }
+
+  FindBlocks();
+  ComputeLiveness();
+  FindDominators();
+}
+
+BasicBlock& ControlFlowGraph::GetBlock(AirInstruction* instruction)
+{
+  return blocks[blockOf[instruction->index]];
+}
+
+bool ControlFlowGraph::Dominates(unsigned int a, unsigned int b)
+{
+  if (dominators[b] == -1)
+  {
+    return false;
+  }
+
+  // Walk up the dominator tree from `b`, which ends at the entry block (its own immediate dominator)
+  while (b != a)
+  {
+    if (b == 0u)
+    {
+      return false;
+    }
+
+    b = static_cast<unsigned int>(dominators[b]);
+  }
+
+  return true;
+}
+
+signed int ControlFlowGraph::FindSavePoint(const std::vector<bool>& needsSaves)
+{
+  signed int savePoint = -1;
+  for (BasicBlock& block : blocks)
+  {
+    if (needsSaves[block.index] && dominators[block.index] != -1)
+    {
+      savePoint = (savePoint == -1 ? block.index : CommonDominator(savePoint, block.index));
+    }
+  }
+
+  if (savePoint == -1)
+  {
+    return -1;
+  }
+
+  // Saving inside a loop would save the registers every time around it, so move out until we're not in one
+  while (savePoint != 0 && FindReachableBlocks(savePoint, false)[savePoint])
+  {
+    savePoint = dominators[savePoint];
+  }
+
+  std::vector<bool> isReachable = FindReachableBlocks(savePoint, true);
+  for (BasicBlock& block : blocks)
+  {
+    if (block.successors.size() == 0u && isReachable[block.index] && !Dominates(savePoint, block.index))
+    {
+      return 0;
+    }
+  }
+
+  return savePoint;
+}
+
+unsigned int ControlFlowGraph::SlotIndex(Slot* slot)
+{
+  return slot->index;
+}
+
+void ControlFlowGraph::FindBlocks()
+{
+  blockOf.resize(instructions.size());
+
+  // A new block starts at each label, and after each jump or return
+  bool startsBlock = true;
+  for (AirInstruction* instruction : instructions)
+  {
+    if (startsBlock || instruction->instructionType == InstructionType::LABEL)
+    {
+      blocks.push_back(BasicBlock(blocks.size(), instruction->index));
+    }
+
+    blocks.back().last = instruction->index;
+    blockOf[instruction->index] = blocks.back().index;
+
+    startsBlock = (instruction->instructionType == InstructionType::JUMP ||
+                   instruction->instructionType == InstructionType::RETURN);
+  }
+
+  for (BasicBlock& block : blocks)
+  {
+    AirInstruction* tail = instructions[block.last];
+    bool fallsThrough = true;
+
+    if (tail->instructionType == InstructionType::JUMP)
+    {
+      JumpInstruction* jump = static_cast<JumpInstruction*>(tail);
+      Assert(jump->label->index != -1, "Jumped to a label that was never pushed");
+
+      block.successors.push_back(blockOf[jump->label->index]);
+      fallsThrough = (jump->condition != JumpInstruction::Condition::UNCONDITIONAL);
+    }
+    else if (tail->instructionType == InstructionType::RETURN)
+    {
+      fallsThrough = false;
+    }
+
+    // NOTE(Isaac): the last block may fall off the end of the function, but then nothing is live afterwards
+    if (fallsThrough && (block.index + 1u) < blocks.size() &&
+        (block.successors.size() == 0u || block.successors[0u] != block.index + 1u))
+    {
+      block.successors.push_back(block.index + 1u);
+    }
+
+    for (unsigned int successor : block.successors)
+    {
+      blocks[successor].predecessors.push_back(block.index);
+    }
+  }
+}
+
+void ControlFlowGraph::ComputeLiveness()
+{
+  LiveOperands operands;
+
+  for (BasicBlock& block : blocks)
+  {
+    block.uses    = SlotSet(numSlots);
+    block.defs    = SlotSet(numSlots);
+    block.liveIn  = SlotSet(numSlots);
+    block.liveOut = SlotSet(numSlots);
+
+    for (unsigned int i = block.first;
+         i <= block.last;
+         i++)
+    {
+      GetLiveOperands(instructions[i], operands);
+
+      for (Slot* use : operands.uses)
+      {
+        if (!block.defs.Contains(use->index))
+        {
+          block.uses.Add(use->index);
+        }
+      }
+
+      for (Slot* def : operands.defs)
+      {
+        block.defs.Add(def->index);
+      }
+    }
+  }
+
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+
+    for (unsigned int i = blocks.size();
+         i > 0u;
+         i--)
+    {
+      BasicBlock& block = blocks[i - 1u];
+
+      for (unsigned int successor : block.successors)
+      {
+        block.liveOut.Union(blocks[successor].liveIn);
+      }
+
+      // liveIn = uses + (liveOut - defs)
+      for (unsigned int j = 0u;
+           j < block.liveIn.words.size();
+           j++)
+      {
+        uint64_t liveIn = block.uses.words[j] | (block.liveOut.words[j] & ~(block.defs.words[j]));
+        changed |= (liveIn != block.liveIn.words[j]);
+        block.liveIn.words[j] = liveIn;
+      }
+    }
+  }
+}
+
+/*
+ * This is the simple iterative algorithm from "A Simple, Fast Dominance Algorithm" by Cooper, Harvey and Kennedy.
+ * We number the blocks in postorder, so a block's dominators all come after it, and then visit them in reverse
+ * postorder, so most of a block's predecessors have been visited before it. This usually settles in two passes.
+ */
+void ControlFlowGraph::FindDominators()
+{
+  dominators.assign(blocks.size(), -1);
+  postorder.assign(blocks.size(), 0u);
+
+  if (blocks.size() == 0u)
+  {
+    return;
+  }
+
+  // Find a postorder of the blocks reachable from the entry block, without recursing
+  std::vector<unsigned int> order;
+  std::vector<bool> isVisited(blocks.size(), false);
+  std::vector<std::pair<unsigned int, unsigned int>> stack;   // (block, index of the next successor to visit)
+  stack.push_back(std::make_pair(0u, 0u));
+  isVisited[0u] = true;
+
+  while (stack.size() > 0u)
+  {
+    std::pair<unsigned int, unsigned int>& top = stack.back();
+    BasicBlock& block = blocks[top.first];
+
+    if (top.second < block.successors.size())
+    {
+      unsigned int successor = block.successors[top.second++];
+
+      if (!isVisited[successor])
+      {
+        isVisited[successor] = true;
+        stack.push_back(std::make_pair(successor, 0u));
+      }
+    }
+    else
+    {
+      postorder[block.index] = order.size();
+      order.push_back(block.index);
+      stack.pop_back();
+    }
+  }
+
+  dominators[0u] = 0;
+
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+
+    for (unsigned int i = order.size();
+         i > 0u;
+         i--)
+    {
+      unsigned int block = order[i - 1u];
+      if (block == 0u)
+      {
+        continue;
+      }
+
+      signed int newDominator = -1;
+      for (unsigned int predecessor : blocks[block].predecessors)
+      {
+        if (dominators[predecessor] == -1)
+        {
+          continue;
+        }
+
+        newDominator = (newDominator == -1 ? static_cast<signed int>(predecessor) :
+                                             static_cast<signed int>(CommonDominator(predecessor, newDominator)));
+      }
+
+      if (newDominator != dominators[block])
+      {
+        dominators[block] = newDominator;
+        changed = true;
+      }
+    }
+  }
+}
+
+/*
+ * Walks up the dominator tree from both blocks until they meet. Both must be reachable.
+ */
+unsigned int ControlFlowGraph::CommonDominator(unsigned int a, unsigned int b)
+{
+  while (a != b)
+  {
+    while (postorder[a] < postorder[b]) a = static_cast<unsigned int>(dominators[a]);
+    while (postorder[b] < postorder[a]) b = static_cast<unsigned int>(dominators[b]);
+  }
+
+  return a;
+}
+
+/*
+ * Finds the blocks that can be reached by following the edges out of `from`. `from` itself is only included if
+ * `includeFrom` is set, or if it's reachable from itself (so is in a loop).
+ */
+std::vector<bool> ControlFlowGraph::FindReachableBlocks(unsigned int from, bool includeFrom)
+{
+  std::vector<bool> isReachable(blocks.size(), false);
+  std::vector<unsigned int> toVisit(blocks[from].successors);
+
+  if (includeFrom)
+  {
+    isReachable[from] = true;
+  }
+
+  while (toVisit.size() > 0u)
+  {
+    unsigned int block = toVisit.back();
+    toVisit.pop_back();
+
+    if (isReachable[block])
+    {
+      continue;
+    }
+
+    isReachable[block] = true;
+    toVisit.insert(toVisit.end(), blocks[block].successors.begin(), blocks[block].successors.end());
+  }
+
+  return isReachable;
+}
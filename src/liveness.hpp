@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <arena.hpp>
+
+struct Slot;
+struct AirInstruction;
+struct CodeThing;
+
+/*
+ * A set of slots, stored as a bit-vector indexed by the slots' indices.
+ */
+struct SlotSet
+{
+  SlotSet(unsigned int numSlots = 0u);
+
+  bool Contains(unsigned int slot) const  { return (words[slot / 64u] >> (slot % 64u)) & 1u; }
+  void Add(unsigned int slot)             { words[slot / 64u] |=  (uint64_t(1u) << (slot % 64u)); }
+  void Remove(unsigned int slot)          { words[slot / 64u] &= ~(uint64_t(1u) << (slot % 64u)); }
+
+  /*
+   * Adds all of the slots in `other` to this set. Returns whether that added any new ones.
+   */
+  bool Union(const SlotSet& other);
+
+  /*
+   * Calls `visit` with the index of each slot in the set, in ascending order.
+   */
+  template<typename F>
+  void ForEach(F visit) const
+  {
+    for (unsigned int i = 0u;
+         i < words.size();
+         i++)
+    {
+      uint64_t word = words[i];
+
+      while (word)
+      {
+        visit(i * 64u + static_cast<unsigned int>(__builtin_ctzll(word)));
+        word &= (word - 1u);
+      }
+    }
+  }
+
+  std::vector<uint64_t> words;
+};
+
+/*
+ * The slots an instruction reads from (uses) and writes to (defines). Only slots that are kept in registers are
+ * included, as they're the only ones we need to know the liveness of.
+ */
+struct LiveOperands
+{
+  std::vector<Slot*> uses;
+  std::vector<Slot*> defs;
+};
+
+void GetLiveOperands(AirInstruction* instruction, LiveOperands& operands);
+
+/*
+ * A basic block is a run of instructions that's only entered at the top and only left at the bottom: it starts at
+ * a label (or after a jump or return), and ends at a jump or return (or just before a label).
+ */
+struct BasicBlock
+{
+  BasicBlock(unsigned int index, unsigned int first);
+
+  unsigned int              index;        // Into the graph's blocks
+  unsigned int              first;        // Index of the first instruction in the block
+  unsigned int              last;         // Index of the last instruction in the block
+  std::vector<unsigned int> successors;
+  std::vector<unsigned int> predecessors;
+
+  SlotSet                   uses;         // Slots read in this block before they're written in it
+  SlotSet                   defs;         // Slots written in this block
+  SlotSet                   liveIn;
+  SlotSet                   liveOut;
+};
+
+/*
+ * This splits a `CodeThing`'s AIR into basic blocks, and finds which slots are live at the start and end of each
+ * one. A slot is live at a point if its value might be read later on, along some path through the graph. Unlike
+ * looking at the order the instructions are in, this knows that values read at the top of a loop are still needed
+ * at the bottom, and that a value is dead on paths that don't read it.
+ *
+ * Liveness is found with the usual iterative data-flow analysis, where the live-out set of a block is the union of
+ * its successors' live-in sets, and its live-in set is its live-out set, minus what it defines, plus what it uses
+ * before defining. We keep doing this until nothing changes. Visiting the blocks last to first means the
+ * analysis settles after two or three passes, unless loops are deeply nested.
+ *
+ * NOTE(Isaac): this describes the AIR as it was when the graph was built, so must be rebuilt if the AIR is changed.
+ */
+struct ControlFlowGraph : ArenaObject
+{
+  ControlFlowGraph(CodeThing* code);
+  ~ControlFlowGraph() { }
+
+  BasicBlock& GetBlock(AirInstruction* instruction);
+
+  /*
+   * Block `a` dominates block `b` if every path from the entry point to `b` goes through `a`. Blocks that can't
+   * be reached from the entry point aren't dominated by anything.
+   */
+  bool Dominates(unsigned int a, unsigned int b);
+
+  /*
+   * Finds the block to save the callee-saved registers in, given which blocks need them saved, so that paths
+   * through the function that don't need them (early returns, usually) don't pay for saving and restoring them.
+   * They should then be restored at each exit the returned block dominates. This is the nearest block that
+   * dominates every block that needs the registers, as long as it isn't in a loop, and every exit reachable from
+   * it is also dominated by it. If it's not, this falls back to the entry block, and so returns -1 if no blocks
+   * need the registers saved at all.
+   */
+  signed int FindSavePoint(const std::vector<bool>& needsSaves);
+
+  /*
+   * Walks backwards through a block, calling `visit(instruction, live, operands)` for each instruction, where
+   * `live` is the set of slots live just after the instruction.
+   */
+  template<typename F>
+  void WalkBackwards(BasicBlock& block, F visit)
+  {
+    SlotSet live = block.liveOut;
+    LiveOperands operands;
+
+    for (unsigned int i = block.last + 1u;
+         i > block.first;
+         i--)
+    {
+      AirInstruction* instruction = instructions[i - 1u];
+      GetLiveOperands(instruction, operands);
+      visit(instruction, live, operands);
+
+      for (Slot* def : operands.defs)
+      {
+        live.Remove(SlotIndex(def));
+      }
+
+      for (Slot* use : operands.uses)
+      {
+        live.Add(SlotIndex(use));
+      }
+    }
+  }
+
+  unsigned int                  numSlots;
+  std::vector<AirInstruction*>  instructions;   // By index
+  std::vector<BasicBlock>       blocks;         // The first block is the entry point
+  std::vector<unsigned int>     blockOf;        // The block each instruction is in, by instruction index
+  std::vector<signed int>       dominators;     // The immediate dominator of each block, or -1 if unreachable
+  std::vector<unsigned int>     postorder;      // The position of each block in a postorder walk of the graph
+
+private:
+  static unsigned int SlotIndex(Slot* slot);
+
+  void FindBlocks();
+  void ComputeLiveness();
+  void FindDominators();
+  unsigned int CommonDominator(unsigned int a, unsigned int b);
+  std::vector<bool> FindReachableBlocks(unsigned int from, bool includeFrom);
+};
@@ -4,17 +4,23 @@
  */
 
 #include <cstdio>
+#include <cstring>
 #include <common.hpp>
 #include <ir.hpp>
 #include <parsing.hpp>
 #include <ast.hpp>
 #include <air.hpp>
+#include <ssa.hpp>
+#include <constantPropagation.hpp>
+#include <deadCode.hpp>
 #include <error.hpp>
 #include <module.hpp>
 #include <passes/passes.hpp>
 #include <codegen.hpp>
+#include <scheduler.hpp>
 #include <x64/x64.hpp>
 #include <x64/codeGenerator.hpp>
+#include <x64/peephole.hpp>
 
 #if 1
   #define TIME_EXECUTION
@@ -25,27 +31,78 @@
  * Find and compile all .roo files in the specified directory.
  * Returns `true` if the compilation was successful, `false` if an error occured.
  */
-static bool Compile(ParseResult& parse, const char* directoryPath)
+static bool Compile(ParseResult& parse, const char* directoryPath, unsigned int numThreads)
 {
   Directory directory(directoryPath);
-  bool failed = false;
+  std::vector<std::string> filesToParse;
 
   for (File& f : directory.files)
   {
     if (f.extension == "roo")
     {
-      printf("Compiling file \x1B[1;37m%s\x1B[0m\n", f.name.c_str());
-      RooParser parser(parse, f.name);
-      failed |= parser.errorState->hasErrored;
+      filesToParse.push_back(f.name);
     }
   }
 
-  return !failed;
+  return ParseFiles(parse, filesToParse, numThreads);
+}
+
+/*
+ * Runs the AST passes over a single CodeThing. This only touches the thing it's given (other things' signatures are
+ * complete by now), so the things can be compiled in parallel.
+ */
+static void RunPasses(ParseResult& parse, TargetMachine* target, CodeThing* code)
+{
+  ArenaScope arenaScope(code->arena);
+
+  #define APPLY_PASS(PassType)\
+  {\
+    PassType pass;\
+    pass.ApplyTo(parse, target, code);\
+  }
+
+  /*
+   * We emit the DOT of the AST both before and after the passes run, so if one fails, we still have an
+   * AST to look at.
+   */
+#ifdef OUTPUT_DOT
+  APPLY_PASS(DotEmitterPass);
+#endif
+
+  APPLY_PASS(ScopeResolverPass);
+  APPLY_PASS(VariableResolverPass);
+  APPLY_PASS(TypeChecker);
+  APPLY_PASS(ConditionFolderPass);
+
+#ifdef OUTPUT_DOT
+  APPLY_PASS(DotEmitterPass);
+#endif
+
+  #undef APPLY_PASS
+}
+
+/*
+ * Generates the AIR of a single CodeThing and allocates its registers. This reads the (finished) ASTs of the things
+ * it calls, so that they can be inlined, but only changes the thing it's given, so this can also be done in
+ * parallel once the passes have been run over every thing.
+ * If the thing has errored by the time the passes have run, we don't bother generating AIR for it; the errors are
+ * reported once all of the things have been compiled.
+ */
+static void CompileCodeThing(ParseResult& parse, TargetMachine* target, AirPassManager& airPasses, CodeThing* code)
+{
+  if (code->errorState->hasErrored)
+  {
+    return;
+  }
+
+  ArenaScope arenaScope(code->arena);
+  AirGenerator airGenerator(airPasses);
+  airGenerator.ApplyTo(parse, target, code);
 }
 
 #define ROO_MODULE_EXT ".roomod"
 
-int main()
+int main(int argc, char** argv)
 {
 #ifdef TIME_EXECUTION
   auto begin = std::chrono::high_resolution_clock::now();
@@ -53,9 +110,38 @@ int main()
 
   ErrorState* errorState = new ErrorState();
   ParseResult result;
+  ArenaScope arenaScope(result.arena);
+  unsigned int numThreads = 1u;
+
+  for (int i = 1;
+       i < argc;
+       i++)
+  {
+    // `-j N` or `-jN`: compile using up to N threads
+    if (strncmp(argv[i], "-j", 2u) == 0)
+    {
+      const char* count = (argv[i][2u] != '\0' ? &(argv[i][2u]) : ((i + 1) < argc ? argv[++i] : ""));
+      char* end;
+      numThreads = (unsigned int)strtoul(count, &end, 10);
+
+      if (*count == '\0' || *end != '\0' || numThreads == 0u)
+      {
+        RaiseError(errorState, ERROR_MALFORMED_OPTION, "-j", "expected a number of threads");
+      }
+    }
+    // `--linear-scan`: allocate registers with the linear-scan allocator, which is faster but generates worse code
+    else if (strcmp(argv[i], "--linear-scan") == 0)
+    {
+      result.useLinearScan = true;
+    }
+    else
+    {
+      RaiseError(errorState, ERROR_UNRECOGNISED_OPTION, argv[i]);
+    }
+  }
 
   // Compile the current directory
-  if (!Compile(result, "."))
+  if (!Compile(result, ".", numThreads))
   {
     RaiseError(errorState, ERROR_COMPILE_ERRORS);
   }
@@ -110,29 +196,43 @@ int main()
   TargetMachine* target = new TargetMachine_x64(result);
   CompleteIR(result, target);
 
-  #define APPLY_PASS(PassType)\
-  {\
-    PassType pass;\
-    pass.Apply(result, target);\
-  }
-
   /*
-   * We emit the DOT of the AST both before and after the passes run, so if one fails, we still have an
-   * AST to look at.
+   * These are run, in order, over the AIR of each code thing once it's been generated. Optimizations should be
+   * added between SSA construction and destruction.
    */
-#ifdef OUTPUT_DOT
-  APPLY_PASS(DotEmitterPass);
-#endif
+  AirPassManager airPasses;
+  airPasses.Add(new SSAConstructionPass());
+  airPasses.Add(new ConstantPropagationPass());
+  airPasses.Add(new DeadCodeEliminationPass());
+  airPasses.Add(new SSADestructionPass());
 
-  APPLY_PASS(ScopeResolverPass);
-  APPLY_PASS(VariableResolverPass);
-  APPLY_PASS(TypeChecker);
-  //APPLY_PASS(ConstantFolderPass);
-  APPLY_PASS(ConditionFolderPass);
+  // --- Run the passes over every code thing, then generate AIR for each one ---
+  Scheduler scheduler(numThreads);
+  for (CodeThing* thing : result.codeThings)
+  {
+    scheduler.Push([&result, target, thing]()
+      {
+        RunPasses(result, target, thing);
+      });
+  }
+  scheduler.Run();
+  ReportCodeThingErrors(result);
 
-#ifdef OUTPUT_DOT
-  APPLY_PASS(DotEmitterPass);
-#endif
+  // Don't bother generating code for things that are never called
+  RemoveUnreachableThings(result);
+
+  for (CodeThing* thing : result.codeThings)
+  {
+    scheduler.Push([&result, target, &airPasses, thing]()
+      {
+        CompileCodeThing(result, target, airPasses, thing);
+      });
+  }
+  scheduler.Run();
+  ReportCodeThingErrors(result);
+
+  // Some more things may now never be called, if all of the calls to them have been inlined or removed
+  RemoveUnreachableThings(result);
 
   for (CodeThing* thing : result.codeThings)
   {
@@ -147,6 +247,15 @@ int main()
     }
   }
 
+  // Report the things that the register allocator couldn't fit into registers
+  for (CodeThing* thing : result.codeThings)
+  {
+    if (thing->numSpilledSlots > 0u)
+    {
+      printf("Spilled %u slot(s) onto the stack in %s\n", thing->numSpilledSlots, thing->mangledName.c_str());
+    }
+  }
+
   if (result.isModule)
   {
     ErrorState* moduleState = ExportModule(result.name + ROO_MODULE_EXT, result);
@@ -157,17 +266,30 @@ int main()
     delete moduleState;
   }
 
-  // --- Generate AIR for each code thing ---
-  AirGenerator airGenerator;
-  airGenerator.Apply(result, target);
-
   Generate(result.name, target, result);
+  ReportCodeThingErrors(result);
 
 #ifdef TIME_EXECUTION
   auto end = std::chrono::high_resolution_clock::now();
   // NOTE(Isaac): chrono uses integer types to represent ticks, so we use microseconds then convert ourselves.
   double elapsed = (double)(std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count()) / 1000.0;
   printf("Time taken to compile: %f ms\n", elapsed);
+
+  for (AirTransformPass* pass : airPasses.passes)
+  {
+    printf("  of which in AIR pass '%s': %f ms\n", pass->name, (double)(pass->microseconds.load()) / 1000.0);
+  }
+
+  PrintPeepholeStatistics();
+
+  unsigned int numAllocations = result.arena.numAllocations;
+  size_t bytesAllocated = result.arena.bytesAllocated;
+  for (CodeThing* thing : result.codeThings)
+  {
+    numAllocations += thing->arena.numAllocations;
+    bytesAllocated += thing->arena.bytesAllocated;
+  }
+  printf("Allocated %u objects (%zu bytes) from arenas\n", numAllocations, bytesAllocated);
 #endif
 
   return 0;
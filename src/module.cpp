@@ -40,12 +40,18 @@ std::string Read<std::string>(FILE* f)
   return str;
 }
 
+template<>
+InternedString Read<InternedString>(FILE* f)
+{
+  return InternedString(Read<std::string>(f));
+}
+
 template<>
 VariableDef* Read<VariableDef*>(FILE* f)
 {
   TypeRef type;
-  std::string name = Read<std::string>(f);
-  type.name = Read<std::string>(f);
+  InternedString name = Read<InternedString>(f);
+  type.name = Read<InternedString>(f);
   type.isResolved = false;
   type.isMutable = static_cast<bool>(Read<uint8_t>(f));
   type.isReference = static_cast<bool>(Read<uint8_t>(f));
@@ -77,8 +83,8 @@ template<>
 MemberDef* Read<MemberDef*>(FILE* f)
 {
   TypeRef type;
-  std::string name = Read<std::string>(f);
-  type.name = Read<std::string>(f);
+  InternedString name = Read<InternedString>(f);
+  type.name = Read<InternedString>(f);
   type.isResolved = false;
   type.isMutable = static_cast<bool>(Read<uint8_t>(f));
   type.isReference = static_cast<bool>(Read<uint8_t>(f));
@@ -109,7 +115,7 @@ std::vector<MemberDef*> Read<std::vector<MemberDef*>>(FILE* f)
 template<>
 TypeDef* Read<TypeDef*>(FILE* f)
 {
-  TypeDef* type = new TypeDef(Read<std::string>(f));
+  TypeDef* type = new TypeDef(Read<InternedString>(f));
   type->members = Read<std::vector<MemberDef*>>(f);
   type->size = static_cast<unsigned int>(Read<uint32_t>(f));
 
@@ -125,7 +131,7 @@ CodeThing* Read<CodeThing*>(FILE* f)
   {
     case 0u:
     {
-      thing = new FunctionThing(Read<std::string>(f));
+      thing = new FunctionThing(Read<InternedString>(f));
     } break;
 
     case 1u:
@@ -189,14 +195,14 @@ ErrorState* ImportModule(const std::string& modulePath, ParseResult& parse)
        i < typeCount;
        i++)
   {
-    parse.types.push_back(Read<TypeDef*>(f));
+    AddType(parse, Read<TypeDef*>(f));
   }
 
   for (size_t i = 0u;
        i < codeThingCount;
        i++)
   {
-    parse.codeThings.push_back(Read<CodeThing*>(f));
+    AddCodeThing(parse, Read<CodeThing*>(f));
   }
 
   fclose(f);
@@ -224,12 +230,18 @@ void Emit<std::string>(FILE* f, const std::string& value, ErrorState* errorState
   Emit<uint8_t>(f, '\0', errorState);
 }
 
+template<>
+void Emit<InternedString>(FILE* f, const InternedString& value, ErrorState* errorState)
+{
+  Emit<std::string>(f, value.Str(), errorState);
+}
+
 template<>
 void Emit<VariableDef*>(FILE* f, VariableDef* const& value, ErrorState* errorState)
 {
   Assert(value->type.isResolved, "Tried to emit module info for unresolved type of a VariableDef");
-  Emit<std::string>(f, value->name, errorState);
-  Emit<std::string>(f, (value->type.isResolved ? value->type.resolvedType->name : value->type.name.c_str()), errorState);
+  Emit<InternedString>(f, value->name, errorState);
+  Emit<InternedString>(f, (value->type.isResolved ? value->type.resolvedType->name : value->type.name), errorState);
   Emit<uint8_t>(f, static_cast<uint8_t>(value->type.isMutable), errorState);
   Emit<uint8_t>(f, static_cast<uint8_t>(value->type.isReference), errorState);
   Emit<uint8_t>(f, static_cast<uint8_t>(value->type.isReferenceMutable), errorState);
@@ -260,8 +272,8 @@ template<>
 void Emit<MemberDef*>(FILE* f, MemberDef* const& value, ErrorState* errorState)
 {
   Assert(value->type.isResolved, "Tried to emit module info for unresolved type of a MemberDef");
-  Emit<std::string>(f, value->name, errorState);
-  Emit<std::string>(f, (value->type.isResolved ? value->type.resolvedType->name : value->type.name.c_str()), errorState);
+  Emit<InternedString>(f, value->name, errorState);
+  Emit<InternedString>(f, (value->type.isResolved ? value->type.resolvedType->name : value->type.name), errorState);
   Emit<uint8_t>(f, static_cast<uint8_t>(value->type.isMutable), errorState);
   Emit<uint8_t>(f, static_cast<uint8_t>(value->type.isReference), errorState);
   Emit<uint8_t>(f, static_cast<uint8_t>(value->type.isReferenceMutable), errorState);
@@ -291,7 +303,7 @@ void Emit<std::vector<MemberDef*>>(FILE* f, const std::vector<MemberDef*>& value
 template<>
 void Emit<TypeDef*>(FILE* f, TypeDef* const& value, ErrorState* errorState)
 {
-  Emit<std::string>(f, value->name, errorState);
+  Emit<InternedString>(f, value->name, errorState);
   Emit<std::vector<MemberDef*>>(f, value->members, errorState);
   Emit<uint32_t>(f, static_cast<uint32_t>(value->size), errorState);
 }
@@ -304,7 +316,7 @@ void Emit<CodeThing*>(FILE* f, CodeThing* const& thing, ErrorState* errorState)
     case CodeThing::Type::FUNCTION:
     {
       Emit<uint8_t>(f, 0u, errorState);
-      Emit<std::string>(f, dynamic_cast<const FunctionThing*>(thing)->name, errorState);
+      Emit<InternedString>(f, dynamic_cast<const FunctionThing*>(thing)->name, errorState);
       Emit<std::vector<VariableDef*>>(f, thing->params, errorState);
     } break;
 
@@ -7,10 +7,12 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <common.hpp>
+#include <intern.hpp>
+#include <scan.hpp>
 #include <token.hpp>
 #include <error.hpp>
 
@@ -20,18 +22,17 @@
 template<typename T>
 struct Token
 {
-  Token(TokenType type, unsigned int offset, unsigned int line, unsigned int lineOffset, const char* textStart, size_t textLength)
-    :type(type)
-    ,offset(offset)
+  Token(TokenType type, unsigned int line, unsigned int lineOffset, const char* textStart, size_t textLength)
+    :textStart(textStart)
+    ,textLength(static_cast<uint32_t>(textLength))
     ,line(line)
-    ,lineOffset(lineOffset)
-    ,textStart(textStart)
-    ,textLength(textLength)
+    ,lineOffset(static_cast<uint16_t>(lineOffset))
+    ,type(type)
     ,asUnsignedInt(0u)
   {
   }
 
-  std::string AsString()
+  std::string AsString() const
   {
     if (type == TOKEN_KEYWORD)
     {
@@ -43,7 +44,7 @@ struct Token
     }
   }
 
-  std::string GetText()
+  std::string GetText() const
   {
     /*
      * This is the upper bound of the amount of memory we need to store the string representation (because stuff
@@ -84,18 +85,29 @@ struct Token
     return std::string(buffer);
   }
 
-  TokenType       type;
-  unsigned int    offset;
-  unsigned int    line;
-  unsigned int    lineOffset;
+  /*
+   * Names can't contain escape sequences, so they can be interned straight from the source.
+   */
+  InternedString GetName() const
+  {
+    return InternedString(textStart, textLength);
+  }
 
   /*
    * Tokens do not actually store the text they contain, just a pointer to the section within the source (which is
-   * allocated and managed by the parser). Because of this, tokens' text becomes invalid after the parser has been
-   * freed. It is not null terminated.
+   * mapped by `MapFile`). Because of this, tokens' text must not be used after the parser has been freed (the file
+   * may be remapped if it changes). It is not null terminated.
    */
   const char*     textStart;
-  size_t          textLength;
+  uint32_t        textLength;
+
+  /*
+   * NOTE(Isaac): these are packed to keep tokens small, because they're copied in and out of the parser's lookahead
+   * a lot. The position is where the lexer was when it finished lexing the token.
+   */
+  uint32_t        line;
+  uint16_t        lineOffset;     // XXX: this wraps around on lines longer than 65535 chars
+  TokenType       type;
 
   union
   {
@@ -112,86 +124,99 @@ struct Token
 template<typename T>
 struct Parser
 {
-  Parser(const std::string& path)
+  /*
+   * If `errorOutput` is given, errors are collected into it instead of being printed straight away (e.g. so that
+   * files parsed in parallel can still report their errors in a stable order). The fastest scanner the CPU supports
+   * is used, unless we're given another one.
+   */
+  Parser(const std::string& path, std::string* errorOutput = nullptr, const Scanner& scanner = GetScanner())
     :path(path)
-    ,source(ReadFile(path))
+    ,source(MapFile(path))
     ,currentChar(source)
     ,currentLine(1u)
     ,currentLineOffset(0u)
-    ,currentToken(LexNext())
-    ,nextToken(LexNext())
-    ,errorState(new ParsingErrorState<T>(*this))
+    ,scanner(scanner)
+    ,lookahead(8u, Token<T>(TOKEN_INVALID, 0u, 0u, nullptr, 0u))
+    ,lookaheadMask(7u)
+    ,lookaheadStart(0u)
+    ,numLookahead(0u)
+    ,errorState(new ParsingErrorState<T>(*this, errorOutput))
   {
+    // NOTE(Isaac): the current token is always lexed, so we don't need to check for it when peeking at it
+    LexAhead(0u);
   }
 
   virtual ~Parser()
   {
-    delete source;
     delete errorState;
   }
 
-  Token<T> PeekToken(bool ignoreLines = true)
+  /*
+   * Gets the token `k` tokens after the current one, lexing more of the source if we haven't got that far yet.
+   * Peeking past the end of the source gets the final TOKEN_INVALID.
+   *
+   * NOTE(Isaac): the returned reference is only valid until the next time the parser has to lex another token.
+   */
+  const Token<T>& Peek(size_t k)
+  {
+    if (k >= numLookahead)
+    {
+      k = LexAhead(k);
+    }
+
+    return lookahead[(lookaheadStart + k) & lookaheadMask];
+  }
+
+  const Token<T>& PeekToken(bool ignoreLines = true)
   {
     if (ignoreLines)
     {
-      while (currentToken.type == TOKEN_LINE)
+      while (lookahead[lookaheadStart].type == TOKEN_LINE)
       {
-        NextToken();
+        Advance();
       }
     }
 
-    return currentToken;
+    return lookahead[lookaheadStart];
   }
 
-  Token<T> PeekNextToken(bool ignoreLines = true)
+  const Token<T>& PeekNextToken(bool ignoreLines = true)
   {
     if (!ignoreLines)
     {
-      return nextToken;
+      return Peek(1u);
     }
 
     /*
-     * If the next token should be ignored, we need to skip forward to the next token that doesn't, without
-     * actually advancing the token stream.
+     * Skip past any lines before the current token, and then any between it and the next one, without actually
+     * advancing the token stream.
      */
-    const char*  cachedChar       = currentChar;
-    unsigned int cachedLine       = currentLine;
-    unsigned int cachedLineOffset = currentLineOffset;
-    Token<T> next = nextToken;
+    size_t k = 0u;
 
-    while (currentToken.type == TOKEN_LINE)
+    while (Peek(k).type == TOKEN_LINE)
     {
-      next = LexNext();
+      k++;
     }
 
-    currentChar       = cachedChar;
-    currentLine       = cachedLine;
-    currentLineOffset = cachedLineOffset;
+    do
+    {
+      k++;
+    } while (Peek(k).type == TOKEN_LINE);
 
-    return next;
+    return Peek(k);
   }
 
-  Token<T> NextToken(bool ignoreLines = true)
+  const Token<T>& NextToken(bool ignoreLines = true)
   {
-    currentToken = nextToken;
-    nextToken = LexNext();
-
-    if (ignoreLines)
-    {
-      while (currentToken.type == TOKEN_LINE)
-      {
-        NextToken();
-      }
-    }
-
-    return currentToken;
+    Advance();
+    return PeekToken(ignoreLines);
   }
 
   void Consume(TokenType expectedType, bool ignoreLines = true)
   {
     if (PeekToken(ignoreLines).type != expectedType)
     {
-      RaiseError(errorState, ERROR_EXPECTED_BUT_GOT, GetTokenName(expectedType), GetTokenName(currentToken.type));
+      RaiseError(errorState, ERROR_EXPECTED_BUT_GOT, GetTokenName(expectedType), GetTokenName(PeekToken(ignoreLines).type));
     }
   
     NextToken(ignoreLines);
@@ -226,7 +251,7 @@ struct Parser
   {
     if (!(PeekToken(ignoreLines).type == TOKEN_KEYWORD && PeekToken(ignoreLines).asKeyword == expected))
     {
-      RaiseError(errorState, ERROR_EXPECTED_BUT_GOT, GetKeywordName<T>(expected), GetKeywordName<T>(currentToken.asKeyword));
+      RaiseError(errorState, ERROR_EXPECTED_BUT_GOT, GetKeywordName<T>(expected), GetKeywordName<T>(PeekToken(ignoreLines).asKeyword));
     }
   
     NextToken(ignoreLines);
@@ -234,7 +259,7 @@ struct Parser
   
   void ConsumeNext(T expected, bool ignoreLines = true)
   {
-    Token<T> next = NextToken(ignoreLines);
+    const Token<T>& next = NextToken(ignoreLines);
     
     if (!(next.type == TOKEN_KEYWORD && next.asKeyword == expected))
     {
@@ -255,19 +280,94 @@ struct Parser
   }
 
   std::string                         path;
-  char*                               source;
+  const char*                         source;     // NOTE(Isaac): this is mapped by `MapFile`, and is read-only
   const char*                         currentChar;    // This points into source
   unsigned int                        currentLine;
   unsigned int                        currentLineOffset;
+  const Scanner&                      scanner;
 
-  std::unordered_map<const char*, T>  keywordMap;
-  
-  Token<T>                            currentToken;
-  Token<T>                            nextToken;
+  /*
+   * Tokens are lexed into this ring buffer as the parser needs them, starting with the current token, so we can
+   * look ahead without lexing anything twice. Its size is always a power of two, and it grows if the parser ever
+   * needs to look further ahead than it can hold.
+   */
+  std::vector<Token<T>>               lookahead;
+  size_t                              lookaheadMask;
+  size_t                              lookaheadStart;
+  size_t                              numLookahead;
 
   ErrorState*                         errorState;
 
 private:
+  Token<T>& LookaheadSlot(size_t i)
+  {
+    return lookahead[(lookaheadStart + i) & lookaheadMask];
+  }
+
+  /*
+   * Moves on to the next token, unless we're already at the end of the source.
+   */
+  void Advance()
+  {
+    if (lookahead[lookaheadStart].type == TOKEN_INVALID)
+    {
+      return;
+    }
+
+    lookaheadStart = (lookaheadStart + 1u) & lookaheadMask;
+    numLookahead--;
+
+    // NOTE(Isaac): this is the common case, so lex the new current token straight into the buffer
+    if (numLookahead == 0u)
+    {
+      lookahead[lookaheadStart] = LexNext();
+      numLookahead = 1u;
+    }
+  }
+
+  /*
+   * Lexes tokens into the lookahead until it holds the `k`th one, and returns where it ended up (this is before `k`
+   * if we reach the end of the source first).
+   */
+  size_t LexAhead(size_t k)
+  {
+    while (numLookahead <= k)
+    {
+      if (numLookahead > 0u && LookaheadSlot(numLookahead - 1u).type == TOKEN_INVALID)
+      {
+        return numLookahead - 1u;
+      }
+
+      if (numLookahead == lookahead.size())
+      {
+        GrowLookahead();
+      }
+
+      Token<T> token = LexNext();
+      LookaheadSlot(numLookahead++) = token;
+    }
+
+    return k;
+  }
+
+  void GrowLookahead()
+  {
+    std::vector<Token<T>> grown;
+    grown.reserve(lookahead.size() * 2u);
+
+    for (size_t i = 0u;
+         i < numLookahead;
+         i++)
+    {
+      grown.push_back(LookaheadSlot(i));
+    }
+
+    grown.resize(lookahead.size() * 2u, lookahead[0u]);
+    lookahead = grown;
+    lookaheadMask = lookahead.size() - 1u;
+    lookaheadStart = 0u;
+  }
+
   char NextChar()
   {
     // Don't dereference memory past the end of the string
@@ -289,14 +389,36 @@ private:
     return *(currentChar++);
   }
 
-  Token<T> MakeToken(TokenType type, unsigned int offset, const char* startChar, size_t length)
+  /*
+   * Moves forward to `end` (which must be within the source), keeping track of lines as if we'd called `NextChar`
+   * for each char in between.
+   */
+  void SkipTo(const char* end)
+  {
+    const char* lastNewline = nullptr;
+    unsigned int numNewlines = scanner.countNewlines(currentChar, end, lastNewline);
+
+    if (numNewlines > 0u)
+    {
+      currentLine += numNewlines;
+      currentLineOffset = (unsigned int)((uintptr_t)end - (uintptr_t)lastNewline - 1u);
+    }
+    else
+    {
+      currentLineOffset += (unsigned int)((uintptr_t)end - (uintptr_t)currentChar);
+    }
+
+    currentChar = end;
+  }
+
+  Token<T> MakeToken(TokenType type, const char* startChar, size_t length)
   {
-    return Token<T>(type, offset, currentLine, currentLineOffset, startChar, length);
+    return Token<T>(type, currentLine, currentLineOffset, startChar, length);
   }
 
-  Token<T> MakeToken(T keyword, unsigned int offset, const char* startChar, size_t length)
+  Token<T> MakeToken(T keyword, const char* startChar, size_t length)
   {
-    Token<T> token = Token<T>(TOKEN_KEYWORD, offset, currentLine, currentLineOffset, startChar, length);
+    Token<T> token = Token<T>(TOKEN_KEYWORD, currentLine, currentLineOffset, startChar, length);
     token.asKeyword = keyword;
     return token;
   }
@@ -305,25 +427,22 @@ private:
   {
     // We minus one to get the current char as well
     const char* startChar = currentChar - 1u;
-    
-    while (IsName(*currentChar, false))
-    {
-      NextChar();
-    }
+
+    // NOTE(Isaac): names can't contain new-lines, so we don't need to count them
+    const char* endChar = scanner.skipName(currentChar);
+    currentLineOffset += (unsigned int)((uintptr_t)endChar - (uintptr_t)currentChar);
+    currentChar = endChar;
 
     ptrdiff_t length = (ptrdiff_t)((uintptr_t)currentChar - (uintptr_t)startChar);
-    unsigned int tokenOffset = (unsigned int)((uintptr_t)currentChar - (uintptr_t)source);
 
-    for (const std::pair<const char*, T>& keywordMapping : keywordMap)
+    T keyword;
+    if (LookupKeyword<T>(startChar, (size_t)length, keyword))
     {
-      if (memcmp(startChar, keywordMapping.first, strlen(keywordMapping.first)) == 0)
-      {
-        return MakeToken(keywordMapping.second, tokenOffset, startChar, (size_t)length);
-      }
+      return MakeToken(keyword, startChar, (size_t)length);
     }
 
     // It's not a keyword, so create an identifier token
-    return MakeToken(TOKEN_IDENTIFIER, tokenOffset, startChar, (size_t)length);
+    return MakeToken(TOKEN_IDENTIFIER, startChar, (size_t)length);
   }
 
   Token<T> LexNumber()
@@ -360,15 +479,13 @@ private:
       }
     }
 
-    unsigned int tokenOffset = (unsigned int)((uintptr_t)currentChar - (uintptr_t)source);
-
     if (type == TOKEN_SIGNED_INT && *(currentChar) == 'u')
     {
       NextChar();
       type = TOKEN_UNSIGNED_INT;
     }
 
-    Token<T> token = MakeToken(type, tokenOffset, startChar, i);
+    Token<T> token = MakeToken(type, startChar, i);
     switch (type)
     {
       case TOKEN_SIGNED_INT:
@@ -411,8 +528,7 @@ private:
       }
     }
 
-    unsigned int tokenOffset = (unsigned int)((uintptr_t)currentChar - (uintptr_t)source);
-    Token<T> token = MakeToken(TOKEN_UNSIGNED_INT, tokenOffset, startChar, i);
+    Token<T> token = MakeToken(TOKEN_UNSIGNED_INT, startChar, i);
     token.asUnsignedInt = strtol(buffer, nullptr, 16);
 
     return token;
@@ -436,8 +552,7 @@ private:
       }
     }
 
-    unsigned int tokenOffset = (unsigned int)((uintptr_t)currentChar - (uintptr_t)source);
-    Token<T> token = MakeToken(TOKEN_UNSIGNED_INT, tokenOffset, startChar, (size_t)i);
+    Token<T> token = MakeToken(TOKEN_UNSIGNED_INT, startChar, (size_t)i);
     token.asUnsignedInt = strtol(buffer, nullptr, 2);
 
     return token;
@@ -446,19 +561,14 @@ private:
   Token<T> LexString()
   {
     const char* startChar = currentChar;
-
-    while ((*(currentChar) != '\0') && (*(currentChar) != '"'))
-    {
-      NextChar();
-    }
+    SkipTo(scanner.find(currentChar, '"'));
 
     ptrdiff_t length = (ptrdiff_t)((uintptr_t)currentChar - (uintptr_t)startChar);
-    unsigned int tokenOffset = (unsigned int)((uintptr_t)currentChar - (uintptr_t)source);
 
     // NOTE(Isaac): skip the ending '"' character
     NextChar();
 
-    return MakeToken(TOKEN_STRING, tokenOffset, startChar, (size_t)length);
+    return MakeToken(TOKEN_STRING, startChar, (size_t)length);
   }
 
   Token<T> LexCharConstant()
@@ -471,7 +581,7 @@ private:
       RaiseError(errorState, ERROR_EXPECTED, "a ' to end the char constant");
     }
 
-    return MakeToken(TOKEN_CHAR_CONSTANT, (unsigned int)((uintptr_t)c - (uintptr_t)source), c, (size_t)1u);
+    return MakeToken(TOKEN_CHAR_CONSTANT, c, (size_t)1u);
   }
 
   // TODO: Use an EMIT macro to make emitting single character tokens less painfull
@@ -648,12 +758,8 @@ private:
         {
           if (*currentChar == '/')
           {
-            // NOTE(Isaac): We're lexing a line comment, skip forward to the next new-line
-            do
-            {
-              NextChar();
-            } while (*currentChar != '\n');
-  
+            // NOTE(Isaac): We're lexing a line comment, skip forward past the next new-line
+            SkipTo(scanner.find(currentChar + 1u, '\n'));
             NextChar();
           }
           else if (*currentChar == '*')
@@ -661,22 +767,20 @@ private:
             // NOTE(Isaac): We're lexing a block comment, skip forward to the ending token
             NextChar();
   
-            while (currentChar)
+            while (*currentChar != '\0')
             {
+              SkipTo(scanner.find(currentChar, '*'));
+
               if (*currentChar == '*')
               {
                 NextChar();
-  
+
                 if (*currentChar == '/')
                 {
                   NextChar();
                   break;
                 }
               }
-              else
-              {
-                NextChar();
-              }
             }
           }
           else
@@ -704,12 +808,7 @@ private:
         case ' ':
         case '\r':
         {
-          while (*currentChar == ' '  ||
-                 *currentChar == '\r' ||
-                 *currentChar == '\n')
-          {
-            NextChar();
-          }
+          SkipTo(scanner.skipBlank(currentChar));
         } break;
   
         case '\t':
@@ -761,7 +860,7 @@ private:
     }
   
   EmitSimpleToken:
-    return MakeToken(type, (uintptr_t)currentChar - (uintptr_t)source, nullptr, 0u);
+    return MakeToken(type, nullptr, 0u);
   }
 
   /*
@@ -15,6 +15,7 @@
 #include <ir.hpp>
 #include <ast.hpp>
 #include <error.hpp>
+#include <scheduler.hpp>
 
 /*
  * When this flag is set, the parser emits detailed logging throughout the parse.
@@ -59,6 +60,58 @@ const char* GetKeywordName(RooKeyword keyword)
   #undef KEYWORD
 }
 
+template<>
+bool LookupKeyword(const char* name, size_t length, RooKeyword& keyword)
+{
+  /*
+   * NOTE(Isaac): we switch on the length first, so we only compare against keywords that could actually match, and
+   * so names that start with a keyword (e.g. `types`) aren't mistaken for it.
+   */
+  #define KEYWORD(text, tag) if (memcmp(name, text, length) == 0) { keyword = tag; return true; }
+
+  switch (length)
+  {
+    case 2u:
+    {
+      KEYWORD("fn",       KEYWORD_FN);
+      KEYWORD("if",       KEYWORD_IF);
+    } break;
+
+    case 3u:
+    {
+      KEYWORD("mut",      KEYWORD_MUT);
+    } break;
+
+    case 4u:
+    {
+      KEYWORD("type",     KEYWORD_TYPE);
+      KEYWORD("true",     KEYWORD_TRUE);
+      KEYWORD("else",     KEYWORD_ELSE);
+    } break;
+
+    case 5u:
+    {
+      KEYWORD("false",    KEYWORD_FALSE);
+      KEYWORD("break",    KEYWORD_BREAK);
+      KEYWORD("while",    KEYWORD_WHILE);
+    } break;
+
+    case 6u:
+    {
+      KEYWORD("import",   KEYWORD_IMPORT);
+      KEYWORD("return",   KEYWORD_RETURN);
+    } break;
+
+    case 8u:
+    {
+      KEYWORD("operator", KEYWORD_OPERATOR);
+    } break;
+  }
+
+  #undef KEYWORD
+  return false;
+}
+
 void RooParser::PeekNPrint(bool ignoreLines)
 {
   if (PeekToken(ignoreLines).type == TOKEN_IDENTIFIER)
@@ -146,7 +199,7 @@ TypeRef RooParser::ParseTypeRef()
     NextToken();
   }
 
-  ref.name = PeekToken().GetText();
+  ref.name = PeekToken().GetName();
   NextToken();
 
   if (Match(TOKEN_LEFT_BLOCK))
@@ -186,7 +239,7 @@ void RooParser::ParseParameterList(std::vector<VariableDef*>& params)
 
   while (true)
   {
-    std::string varName = PeekToken().GetText();
+    InternedString varName = PeekToken().GetName();
     ConsumeNext(TOKEN_COLON);
 
     TypeRef typeRef = ParseTypeRef();
@@ -209,7 +262,7 @@ void RooParser::ParseParameterList(std::vector<VariableDef*>& params)
 
 VariableDef* RooParser::ParseVariableDef()
 {
-  std::string name = PeekToken().GetText();
+  InternedString name = PeekToken().GetName();
   ConsumeNext(TOKEN_COLON);
 
   TypeRef typeRef = ParseTypeRef();
@@ -415,7 +468,7 @@ ASTNode* RooParser::ParseStatement()
          * Put the variable into the inner-most scope.
          */
         Assert(scopeStack.size() >= 1u, "Parsed statement without surrounding scope");
-        scopeStack.top()->locals.push_back(variable);
+        scopeStack.top()->AddLocal(variable);
         break;
       }
     } // XXX: no break
@@ -440,7 +493,7 @@ void RooParser::ParseTypeDef()
 {
   Log(*this, "--> TypeDef(");
   Consume(KEYWORD_TYPE);
-  TypeDef* type = new TypeDef(PeekToken().GetText());
+  TypeDef* type = new TypeDef(PeekToken().GetName());
   Log(*this, "%s)\n", type->name.c_str());
   
   ConsumeNext(TOKEN_LEFT_BRACE);
@@ -450,11 +503,11 @@ void RooParser::ParseTypeDef()
     VariableDef* member = ParseVariableDef();
     // TODO: clone the initExpression
     type->members.push_back(new MemberDef(member->name, member->type, /*member->initExpression->Clone()*/nullptr, member->offset));
-    free(member);
+    delete member;
   }
 
   Consume(TOKEN_RIGHT_BRACE);
-  result.types.push_back(type);
+  AddType(result, type);
   Log(*this, "<-- TypeDef\n");
 }
 
@@ -495,10 +548,10 @@ void RooParser::ParseFunction(AttribSet& attribs)
   Log(*this, "--> Function(");
   Assert(scopeStack.size() == 0, "Scope stack is not empty at function entry");
 
-  FunctionThing* function = new FunctionThing(NextToken().GetText());
+  FunctionThing* function = new FunctionThing(NextToken().GetName());
   function->attribs = attribs;
   Log(*this, "%s)\n", function->name.c_str());
-  result.codeThings.push_back(function);
+  AddCodeThing(result, function);
   currentThing = function;
 
   NextToken();
@@ -535,7 +588,7 @@ void RooParser::ParseOperator(AttribSet& attribs)
   OperatorThing* operatorDef = new OperatorThing(NextToken().type);
   operatorDef->attribs = attribs;
   Log(*this, "%s)\n", GetTokenName(operatorDef->token));
-  result.codeThings.push_back(operatorDef);
+  AddCodeThing(result, operatorDef);
   currentThing = operatorDef;
 
   switch (operatorDef->token)
@@ -583,15 +636,29 @@ void RooParser::ParseOperator(AttribSet& attribs)
 
 void RooParser::ParseAttribute(AttribSet& attribs)
 {
-  std::string attribName = NextToken().GetText();
+  /*
+   * NOTE(Isaac): the names of the attributes are interned once, up front, so we can compare them with the name of
+   * this attribute without looking at any strings.
+   */
+  static const InternedString ENTRY("Entry");
+  static const InternedString NAME("Name");
+  static const InternedString TARGET_ARCH("TargetArch");
+  static const InternedString MODULE("Module");
+  static const InternedString LINK_FILE("LinkFile");
+  static const InternedString DEFINE_PRIMITIVE("DefinePrimitive");
+  static const InternedString PROTOTYPE("Prototype");
+  static const InternedString INLINE("Inline");
+  static const InternedString NO_INLINE("NoInline");
+
+  InternedString attribName = NextToken().GetName();
   Log(*this, "--> Attribute(%s)\n", attribName.c_str());
 
-  if (attribName == "Entry")
+  if (attribName == ENTRY)
   {
     attribs.isEntry = true;
     NextToken();
   }
-  else if (attribName == "Name")
+  else if (attribName == NAME)
   {
     ConsumeNext(TOKEN_LEFT_PAREN);
 
@@ -605,7 +672,7 @@ void RooParser::ParseAttribute(AttribSet& attribs)
     Log(*this, "Setting program name: %s\n", result.name.c_str());
     ConsumeNext(TOKEN_RIGHT_PAREN);
   }
-  else if (attribName == "TargetArch")
+  else if (attribName == TARGET_ARCH)
   {
     ConsumeNext(TOKEN_LEFT_PAREN);
 
@@ -618,7 +685,7 @@ void RooParser::ParseAttribute(AttribSet& attribs)
     result.targetArch = PeekToken().GetText();
     ConsumeNext(TOKEN_RIGHT_PAREN);
   }
-  else if (attribName == "Module")
+  else if (attribName == MODULE)
   {
     ConsumeNext(TOKEN_LEFT_PAREN);
 
@@ -632,7 +699,7 @@ void RooParser::ParseAttribute(AttribSet& attribs)
     result.name = PeekToken().GetText();
     ConsumeNext(TOKEN_RIGHT_PAREN);
   }
-  else if (attribName == "LinkFile")
+  else if (attribName == LINK_FILE)
   {
     ConsumeNext(TOKEN_LEFT_PAREN);
 
@@ -645,7 +712,7 @@ void RooParser::ParseAttribute(AttribSet& attribs)
     result.filesToLink.push_back(PeekToken().GetText());
     ConsumeNext(TOKEN_RIGHT_PAREN);
   }
-  else if (attribName == "DefinePrimitive")
+  else if (attribName == DEFINE_PRIMITIVE)
   {
     ConsumeNext(TOKEN_LEFT_PAREN);
 
@@ -655,7 +722,7 @@ void RooParser::ParseAttribute(AttribSet& attribs)
       return;
     }
 
-    TypeDef* type = new TypeDef(PeekToken().GetText());
+    TypeDef* type = new TypeDef(InternedString(PeekToken().GetText()));
 
     ConsumeNext(TOKEN_COMMA);
     if (!Match(TOKEN_UNSIGNED_INT))
@@ -665,20 +732,20 @@ void RooParser::ParseAttribute(AttribSet& attribs)
     }
     type->size = PeekToken().asUnsignedInt;
 
-    result.types.push_back(type);
+    AddType(result, type);
     ConsumeNext(TOKEN_RIGHT_PAREN);
   }
-  else if (attribName == "Prototype")
+  else if (attribName == PROTOTYPE)
   {
     attribs.isPrototype = true;
     NextToken();
   }
-  else if (attribName == "Inline")
+  else if (attribName == INLINE)
   {
     attribs.isInline = true;
     NextToken();
   }
-  else if (attribName == "NoInline")
+  else if (attribName == NO_INLINE)
   {
     attribs.isNoInline = true;
     NextToken();
@@ -692,25 +759,12 @@ void RooParser::ParseAttribute(AttribSet& attribs)
   Log(*this, "<-- Attribute\n");
 }
 
-RooParser::RooParser(ParseResult& result, const std::string& path)
-  :Parser(path)
+RooParser::RooParser(ParseResult& result, const std::string& path, std::string* errorOutput)
+  :Parser(path, errorOutput)
   ,result(result)
   ,isInLoop(false)
   ,scopeStack()
 {
-  keywordMap["type"]      = KEYWORD_TYPE;
-  keywordMap["fn"]        = KEYWORD_FN;
-  keywordMap["operator"]  = KEYWORD_OPERATOR;
-  keywordMap["true"]      = KEYWORD_TRUE;
-  keywordMap["false"]     = KEYWORD_FALSE;
-  keywordMap["import"]    = KEYWORD_IMPORT;
-  keywordMap["break"]     = KEYWORD_BREAK;
-  keywordMap["return"]    = KEYWORD_RETURN;
-  keywordMap["if"]        = KEYWORD_IF;
-  keywordMap["else"]      = KEYWORD_ELSE;
-  keywordMap["while"]     = KEYWORD_WHILE;
-  keywordMap["mut"]       = KEYWORD_MUT;
-
   AttribSet attribs;
 
   Log(*this, "--> Parse\n");
@@ -746,6 +800,76 @@ RooParser::RooParser(ParseResult& result, const std::string& path)
   Log(*this, "<-- Parse\n");
 }
 
+bool ParseFiles(ParseResult& parse, const std::vector<std::string>& files, unsigned int numThreads)
+{
+  bool failed = false;
+
+  if (numThreads <= 1u)
+  {
+    for (const std::string& file : files)
+    {
+      printf("Compiling file \x1B[1;37m%s\x1B[0m\n", file.c_str());
+      RooParser parser(parse, file);
+      failed |= parser.errorState->hasErrored;
+    }
+
+    return !failed;
+  }
+
+  struct ParseShard
+  {
+    ParseResult result;
+    std::string errors;
+    bool        hasErrored;
+    bool        gaveUp;
+  };
+
+  std::vector<ParseShard> shards(files.size());
+  Scheduler scheduler(numThreads);
+
+  for (unsigned int i = 0u;
+       i < files.size();
+       i++)
+  {
+    scheduler.Push([&shards, &files, i]()
+      {
+        ArenaScope arenaScope(shards[i].result.arena);
+        shards[i].gaveUp = false;
+
+        try
+        {
+          RooParser parser(shards[i].result, files[i], &(shards[i].errors));
+          shards[i].hasErrored = parser.errorState->hasErrored;
+        }
+        catch (const ParsingGaveUp&)
+        {
+          shards[i].hasErrored = true;
+          shards[i].gaveUp = true;
+        }
+      });
+  }
+  scheduler.Run();
+
+  for (unsigned int i = 0u;
+       i < files.size();
+       i++)
+  {
+    printf("Compiling file \x1B[1;37m%s\x1B[0m\n", files[i].c_str());
+    fputs(shards[i].errors.c_str(), stderr);
+
+    // NOTE(Isaac): this is where we would have crashed if we'd parsed the files one at a time
+    if (shards[i].gaveUp)
+    {
+      Crash();
+    }
+
+    failed |= shards[i].hasErrored;
+    MergeParseResult(parse, shards[i].result);
+  }
+
+  return !failed;
+}
+
 __attribute__((constructor))
 static void InitParseletMaps()
 {
@@ -806,11 +930,11 @@ static void InitParseletMaps()
     [](RooParser& parser) -> ASTNode*
     {
       Log(parser, "--> [PARSELET] Identifier\n");
-      std::string name = parser.PeekToken().GetText();
+      InternedString name = parser.PeekToken().GetName();
 
       parser.NextToken(false);
       Log(parser, "<-- [PARSELET] Identifier\n");
-      return new VariableNode(strdup(name.c_str()));
+      return new VariableNode(name);
     };
 
   g_prefixMap[TOKEN_SIGNED_INT] =
@@ -1124,8 +1248,7 @@ static void InitParseletMaps()
       }
 
       VariableNode* leftAsVariable = reinterpret_cast<VariableNode*>(left);
-      char* functionName = new char[strlen(leftAsVariable->name) + 1u];
-      strcpy(functionName, leftAsVariable->name);
+      InternedString functionName = leftAsVariable->name;
       delete left;
 
       std::vector<ASTNode*> params;
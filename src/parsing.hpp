@@ -6,6 +6,8 @@
 #pragma once
 
 #include <stack>
+#include <vector>
+#include <string>
 #include <error.hpp>
 #include <parser.hpp>
 #include <ir.hpp>
@@ -32,7 +34,7 @@ enum RooKeyword
 
 struct RooParser : Parser<RooKeyword>
 {
-  RooParser(ParseResult& result, const std::string& path);
+  RooParser(ParseResult& result, const std::string& path, std::string* errorOutput = nullptr);
   ~RooParser() { }
 
   ASTNode* ParseExpression(unsigned int precedence = 0u);
@@ -58,3 +60,12 @@ private:
   void PeekNPrint(bool ignoreLines = true);
   void PeekNPrintNext(bool ignoreLines = true);
 };
+
+/*
+ * Parses each of the files into `parse`, printing their errors as it goes. If `numThreads` is more than one, the
+ * files are parsed in parallel, each into its own `ParseResult`. These are then merged in the order the files were
+ * given in, and the errors from each file printed in that order (including crashing after the first file that gave
+ * up), so the output doesn't depend on how the threads were scheduled.
+ * Returns `true` if all of the files parsed without errors.
+ */
+bool ParseFiles(ParseResult& parse, const std::vector<std::string>& files, unsigned int numThreads);
@@ -6,14 +6,11 @@
 #include <passes/passes.hpp>
 #include <target.hpp>
 
-void ConditionFolderPass::Apply(ParseResult& parse, TargetMachine* /*target*/)
+void ConditionFolderPass::ApplyTo(ParseResult& /*parse*/, TargetMachine* /*target*/, CodeThing* code)
 {
-  for (CodeThing* code : parse.codeThings)
+  if (!(code->attribs.isPrototype) && code->ast)
   {
-    if (!(code->attribs.isPrototype) && code->ast)
-    {
-      (void)Dispatch(code->ast, code);
-    }
+    (void)Dispatch(code->ast, code);
   }
 }
 
@@ -27,20 +27,17 @@ struct DotState
   FILE*         f;
 };
 
-void DotEmitterPass::Apply(ParseResult& parse, TargetMachine* /*target*/)
+void DotEmitterPass::ApplyTo(ParseResult& /*parse*/, TargetMachine* /*target*/, CodeThing* code)
 {
-  for (CodeThing* code : parse.codeThings)
+  if (code->attribs.isPrototype || !(code->ast))
   {
-    if (code->attribs.isPrototype || !(code->ast))
-    {
-      continue;
-    }
-
-    DotState state(code->mangledName + ".dot");
-    fprintf(state.f, "digraph G\n{\n");
-    free(Dispatch(code->ast, &state));
-    fprintf(state.f, "}\n");
+    return;
   }
+
+  DotState state(code->mangledName.Str() + ".dot");
+  fprintf(state.f, "digraph G\n{\n");
+  free(Dispatch(code->ast, &state));
+  fprintf(state.f, "}\n");
 }
 
 static char* GetNextNode(DotState* state)
@@ -148,7 +145,7 @@ char* DotEmitterPass::VisitNode(VariableNode* node, DotState* state)
   }
   else
   {
-    fprintf(state->f, "\t%s[label=\"`%s`\n(??)\"];\n", nodeName, node->name);
+    fprintf(state->f, "\t%s[label=\"`%s`\n(??)\"];\n", nodeName, node->name.c_str());
   }
 
   VISIT_NEXT();
@@ -280,7 +277,7 @@ char* DotEmitterPass::VisitNode(CallNode* node, DotState* state)
   }
   else
   {
-    fprintf(state->f, "\t%s[label=\"Call(%s)\"];\n", nodeName, node->name);
+    fprintf(state->f, "\t%s[label=\"Call(%s)\"];\n", nodeName, node->name.c_str());
   }
 
   for (ASTNode* param : node->params)
@@ -12,7 +12,7 @@
   {\
     Name() : ASTPass() { }\
     \
-    void Apply(ParseResult& parse, TargetMachine* target);\
+    void ApplyTo(ParseResult& parse, TargetMachine* target, CodeThing* code);\
     \
     R VisitNode(BreakNode* node                  , T*);\
     R VisitNode(ReturnNode* node                 , T*);\
@@ -6,14 +6,11 @@
 #include <passes/passes.hpp>
 #include <target.hpp>
 
-void ScopeResolverPass::Apply(ParseResult& parse, TargetMachine* /*target*/)
+void ScopeResolverPass::ApplyTo(ParseResult& /*parse*/, TargetMachine* /*target*/, CodeThing* code)
 {
-  for (CodeThing* code : parse.codeThings)
+  if (!(code->attribs.isPrototype) && code->ast)
   {
-    if (!(code->attribs.isPrototype) && code->ast)
-    {
-      Dispatch(code->ast, code);
-    }
+    Dispatch(code->ast, code);
   }
 }
 
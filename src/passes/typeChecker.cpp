@@ -20,18 +20,15 @@ struct TypeCheckingContext
   CodeThing*      code;
 };
 
-void TypeChecker::Apply(ParseResult& parse, TargetMachine* target)
+void TypeChecker::ApplyTo(ParseResult& parse, TargetMachine* target, CodeThing* code)
 {
-  for (CodeThing* code : parse.codeThings)
+  if (code->attribs.isPrototype || !(code->ast))
   {
-    if (code->attribs.isPrototype || !(code->ast))
-    {
-      continue;
-    }
-
-    TypeCheckingContext context(parse, target, code);
-    Dispatch(code->ast, &context);
+    return;
   }
+
+  TypeCheckingContext context(parse, target, code);
+  Dispatch(code->ast, &context);
 }
 
 void TypeChecker::VisitNode(BreakNode* node, TypeCheckingContext* context)
@@ -130,27 +127,33 @@ void TypeChecker::VisitNode(BinaryOpNode* node, TypeCheckingContext* context)
      * We couldn't find a suitable intrinsic operator that we know should exist, so we try to find an overloaded
      * operator that fits the types instead (this also resolves the CodeThing to call for overloaded operations)
      */
-    for (CodeThing* thing : context->parse.codeThings)
+    TokenType token;
+    switch (node->op)
+    {
+      case BinaryOpNode::Operator::ADD:       token = TOKEN_PLUS;     break;
+      case BinaryOpNode::Operator::SUBTRACT:  token = TOKEN_MINUS;    break;
+      case BinaryOpNode::Operator::MULTIPLY:  token = TOKEN_ASTERIX;  break;
+      case BinaryOpNode::Operator::DIVIDE:    token = TOKEN_SLASH;    break;
+
+      // NOTE(Isaac): these can't be overloaded, so we won't find anything
+      default:                                token = TOKEN_INVALID;  break;
+    }
+
+    for (OperatorThing* thing : context->parse.operatorsByToken[token])
     {
-      if (thing->type != CodeThing::Type::OPERATOR || thing->params.size() != 2u)
+      if (thing->params.size() != 2u)
       {
         continue;
       }
 
-      TokenType token = static_cast<OperatorThing*>(thing)->token;
-      if ((token == TOKEN_PLUS    && node->op == BinaryOpNode::Operator::ADD)      ||
-          (token == TOKEN_MINUS   && node->op == BinaryOpNode::Operator::SUBTRACT) ||
-          (token == TOKEN_ASTERIX && node->op == BinaryOpNode::Operator::MULTIPLY) ||
-          (token == TOKEN_SLASH   && node->op == BinaryOpNode::Operator::DIVIDE))
+      if (AreTypeRefsCompatible(node->left->type, &(thing->params[0u]->type)) &&
+          AreTypeRefsCompatible(node->right->type, &(thing->params[1u]->type)))
       {
-        if (AreTypeRefsCompatible(node->left->type, &(thing->params[0u]->type)) &&
-            AreTypeRefsCompatible(node->right->type, &(thing->params[1u]->type)))
-        {
-          node->overloadedOperator = thing;
-          node->type = thing->returnType;
-          node->shouldFreeTypeRef = false;
-          break;
-        }
+        node->overloadedOperator = thing;
+        context->code->calledThings.push_back(thing);
+        node->type = thing->returnType;
+        node->shouldFreeTypeRef = false;
+        break;
       }
     }
 
@@ -263,53 +266,47 @@ void TypeChecker::VisitNode(CallNode* node, TypeCheckingContext* context)
    * This isn't really typechecking, but between typing the parameters and inferring the return type, we need to
    * work out what function / operator we're actually calling.
    */
-  for (CodeThing* thing : context->parse.codeThings)
-  {
-    if (thing->type != CodeThing::Type::FUNCTION)
-    {
-      continue;
-    }
+  auto overloads = context->parse.functionsByName.find(node->name);
 
-    if (node->name != dynamic_cast<FunctionThing*>(thing)->name)
-    {
-      continue;
-    }
-
-    if (node->params.size() != thing->params.size())
+  if (overloads != context->parse.functionsByName.end())
+  {
+    for (FunctionThing* thing : overloads->second)
     {
-      continue;
-    }
+      if (node->params.size() != thing->params.size())
+      {
+        continue;
+      }
 
-    for (unsigned int i = 0u;
-         i < node->params.size();
-         i++)
-    {
-      if (!AreTypeRefsCompatible(node->params[i]->type, &(thing->params[i]->type), false))
+      for (unsigned int i = 0u;
+           i < node->params.size();
+           i++)
       {
-        goto NotCorrectThing;
+        if (!AreTypeRefsCompatible(node->params[i]->type, &(thing->params[i]->type), false))
+        {
+          goto NotCorrectThing;
+        }
       }
-    }
 
-    // This is the correct thing!
-    delete node->name;
-    node->resolvedFunction = thing;
-    node->isResolved = true;
-    context->code->calledThings.push_back(thing);
+      // This is the correct thing!
+      node->resolvedFunction = thing;
+      node->isResolved = true;
+      context->code->calledThings.push_back(thing);
 
-    /*
-     * We can then retrieve the return type from the definition of the function/operator.
-     */
-    node->shouldFreeTypeRef = false;
-    node->type = node->resolvedFunction->returnType;
-    break;
+      /*
+       * We can then retrieve the return type from the definition of the function/operator.
+       */
+      node->shouldFreeTypeRef = false;
+      node->type = node->resolvedFunction->returnType;
+      break;
 
 NotCorrectThing:
-    continue;
+      continue;
+    }
   }
 
   if (!(node->isResolved))
   {
-    RaiseError(context->code->errorState, ERROR_UNDEFINED_FUNCTION, node->name);
+    RaiseError(context->code->errorState, ERROR_UNDEFINED_FUNCTION, node->name.c_str());
   }
 
   if (node->next) Dispatch(node->next, context);
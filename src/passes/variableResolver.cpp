@@ -6,48 +6,44 @@
 #include <passes/passes.hpp>
 #include <target.hpp>
 
-void VariableResolverPass::Apply(ParseResult& parse, TargetMachine* /*target*/)
+void VariableResolverPass::ApplyTo(ParseResult& /*parse*/, TargetMachine* /*target*/, CodeThing* code)
 {
-  for (CodeThing* code : parse.codeThings)
+  if (!(code->attribs.isPrototype) && code->ast)
   {
-    if (!(code->attribs.isPrototype) && code->ast)
-    {
-      Dispatch(code->ast, code);
-    }
+    Dispatch(code->ast, code);
   }
 }
 
 void VariableResolverPass::VisitNode(VariableNode* node, CodeThing* code)
 {
+  VariableDef* local;
+
   if (node->isResolved)
   {
     goto Done;
   }
 
   Assert(node->containingScope, "Must resolve scopes before trying to resolve variables");
-  for (VariableDef* local : node->containingScope->GetReachableVariables())
+  local = node->containingScope->FindVariable(node->name);
+
+  if (local)
   {
-   if (local->name == node->name)
-    {
-      delete node->name;
-      node->var = local;
-      node->isResolved = true;
-      goto Done;
-    }
+    node->var = local;
+    node->isResolved = true;
+    goto Done;
   }
 
   for (VariableDef* param : code->params)
   {
    if (param->name == node->name)
     {
-      delete node->name;
       node->var = param;
       node->isResolved = true;
       goto Done;
     }
   }
 
-  RaiseError(code->errorState, ERROR_VARIABLE_NOT_IN_SCOPE, node->name);
+  RaiseError(code->errorState, ERROR_VARIABLE_NOT_IN_SCOPE, node->name.c_str());
 
 Done:
   if (node->next) Dispatch(node->next, code);
@@ -93,7 +89,7 @@ void VariableResolverPass::VisitNode(MemberAccessNode* node, CodeThing* code)
 
   if (!(node->isResolved))
   {
-    RaiseError(code->errorState, ERROR_MEMBER_NOT_FOUND, child->name, parent->type.name.c_str());
+    RaiseError(code->errorState, ERROR_MEMBER_NOT_FOUND, child->name.c_str(), parent->type.name.c_str());
   }
 
   if (node->next) Dispatch(node->next, code);
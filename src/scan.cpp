@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <scan.hpp>
+#include <cstdint>
+
+#if defined(__x86_64__)
+  #include <immintrin.h>
+  #define SCAN_X86_64
+#endif
+
+static bool IsBlankChar(char c)
+{
+  return (c == ' ' || c == '\r' || c == '\n');
+}
+
+static bool IsNameChar(char c)
+{
+  return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == '_') || (c >= '0' && c <= '9'));
+}
+
+static const char* ScalarSkipBlank(const char* c)
+{
+  while (IsBlankChar(*c))
+  {
+    c++;
+  }
+
+  return c;
+}
+
+static const char* ScalarSkipName(const char* c)
+{
+  while (IsNameChar(*c))
+  {
+    c++;
+  }
+
+  return c;
+}
+
+static const char* ScalarFind(const char* c, char target)
+{
+  while (*c != target && *c != '\0')
+  {
+    c++;
+  }
+
+  return c;
+}
+
+static unsigned int ScalarCountNewlines(const char* start, const char* end, const char*& lastNewline)
+{
+  unsigned int count = 0u;
+
+  for (const char* c = start;
+       c < end;
+       c++)
+  {
+    if (*c == '\n')
+    {
+      count++;
+      lastNewline = c;
+    }
+  }
+
+  return count;
+}
+
+const Scanner g_scalarScanner =
+{
+  ScalarSkipBlank,
+  ScalarSkipName,
+  ScalarFind,
+  ScalarCountNewlines,
+};
+
+#ifdef SCAN_X86_64
+/*
+ * Each block is loaded from an aligned address, and the bits for the bytes before the start of the run are masked
+ * off. The predicates give a mask of the bytes that end the run.
+ */
+#define SCAN_LOOP(BLOCK_SIZE, LOAD, STOP_MASK)\
+  uintptr_t misalignment = reinterpret_cast<uintptr_t>(c) & (BLOCK_SIZE - 1u);\
+  const char* block = c - misalignment;\
+  uint32_t mask = STOP_MASK(LOAD(block)) & (~0u << misalignment);\
+  \
+  while (!mask)\
+  {\
+    block += BLOCK_SIZE;\
+    mask = STOP_MASK(LOAD(block));\
+  }\
+  \
+  return block + __builtin_ctz(mask);
+
+/*
+ * SSE2 is always available on x86_64, so this is our baseline.
+ */
+static __m128i Sse2Load(const char* block)
+{
+  return _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+}
+
+static uint32_t Sse2BlankStops(__m128i bytes)
+{
+  __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                            _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))),
+                                            _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+  return ~static_cast<uint32_t>(_mm_movemask_epi8(blank)) & 0xFFFFu;
+}
+
+static uint32_t Sse2NameStops(__m128i bytes)
+{
+  // NOTE(Isaac): setting bit 5 maps upper-case letters onto lower-case ones, and nothing else onto a letter
+  __m128i lower   = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+  __m128i letter  = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+  __m128i digit   = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), bytes));
+  __m128i name    = _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')));
+  return ~static_cast<uint32_t>(_mm_movemask_epi8(name)) & 0xFFFFu;
+}
+
+static const char* Sse2SkipBlank(const char* c)
+{
+  SCAN_LOOP(16u, Sse2Load, Sse2BlankStops);
+}
+
+static const char* Sse2SkipName(const char* c)
+{
+  SCAN_LOOP(16u, Sse2Load, Sse2NameStops);
+}
+
+static uint32_t Sse2FindStops(__m128i bytes, __m128i targets)
+{
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, targets),
+                                                              _mm_cmpeq_epi8(bytes, _mm_setzero_si128()))));
+}
+
+static const char* Sse2Find(const char* c, char target)
+{
+  __m128i targets = _mm_set1_epi8(target);
+  #define STOPS(bytes) Sse2FindStops(bytes, targets)
+  SCAN_LOOP(16u, Sse2Load, STOPS);
+  #undef STOPS
+}
+
+static unsigned int Sse2CountNewlines(const char* start, const char* end, const char*& lastNewline)
+{
+  if (start >= end)
+  {
+    return 0u;
+  }
+
+  unsigned int count = 0u;
+  uintptr_t misalignment = reinterpret_cast<uintptr_t>(start) & 15u;
+  uint32_t startMask = (~0u << misalignment);
+
+  for (const char* block = start - misalignment;
+       block < end;
+       block += 16u)
+  {
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(Sse2Load(block), _mm_set1_epi8('\n'))));
+    mask &= startMask;
+    startMask = ~0u;
+
+    if (block + 16u > end)
+    {
+      mask &= (1u << (end - block)) - 1u;
+    }
+
+    if (mask)
+    {
+      count += __builtin_popcount(mask);
+      lastNewline = block + (31u - __builtin_clz(mask));
+    }
+  }
+
+  return count;
+}
+
+/*
+ * The AVX2 versions do the same thing 32 bytes at a time. These are only called if the CPU supports AVX2, so they
+ * have to be compiled for it specifically.
+ */
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static __m256i Avx2Load(const char* block)
+{
+  return _mm256_load_si256(reinterpret_cast<const __m256i*>(block));
+}
+
+AVX2 static uint32_t Avx2BlankStops(__m256i bytes)
+{
+  __m256i blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                                  _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))),
+                                                  _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+  return ~static_cast<uint32_t>(_mm256_movemask_epi8(blank));
+}
+
+AVX2 static uint32_t Avx2NameStops(__m256i bytes)
+{
+  __m256i lower   = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+  __m256i letter  = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+  __m256i digit   = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+  __m256i name    = _mm256_or_si256(_mm256_or_si256(letter, digit), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')));
+  return ~static_cast<uint32_t>(_mm256_movemask_epi8(name));
+}
+
+AVX2 static const char* Avx2SkipBlank(const char* c)
+{
+  SCAN_LOOP(32u, Avx2Load, Avx2BlankStops);
+}
+
+AVX2 static const char* Avx2SkipName(const char* c)
+{
+  SCAN_LOOP(32u, Avx2Load, Avx2NameStops);
+}
+
+AVX2 static uint32_t Avx2FindStops(__m256i bytes, __m256i targets)
+{
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, targets),
+                                                                    _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256()))));
+}
+
+AVX2 static const char* Avx2Find(const char* c, char target)
+{
+  __m256i targets = _mm256_set1_epi8(target);
+  #define STOPS(bytes) Avx2FindStops(bytes, targets)
+  SCAN_LOOP(32u, Avx2Load, STOPS);
+  #undef STOPS
+}
+
+AVX2 static unsigned int Avx2CountNewlines(const char* start, const char* end, const char*& lastNewline)
+{
+  if (start >= end)
+  {
+    return 0u;
+  }
+
+  unsigned int count = 0u;
+  uintptr_t misalignment = reinterpret_cast<uintptr_t>(start) & 31u;
+  uint32_t startMask = (~0u << misalignment);
+
+  for (const char* block = start - misalignment;
+       block < end;
+       block += 32u)
+  {
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Avx2Load(block),
+                                                                                 _mm256_set1_epi8('\n'))));
+    mask &= startMask;
+    startMask = ~0u;
+
+    if (block + 32u > end)
+    {
+      mask &= (1u << (end - block)) - 1u;
+    }
+
+    if (mask)
+    {
+      count += __builtin_popcount(mask);
+      lastNewline = block + (31u - __builtin_clz(mask));
+    }
+  }
+
+  return count;
+}
+
+#undef AVX2
+#undef SCAN_LOOP
+
+static const Scanner g_sse2Scanner =
+{
+  Sse2SkipBlank,
+  Sse2SkipName,
+  Sse2Find,
+  Sse2CountNewlines,
+};
+
+static const Scanner g_avx2Scanner =
+{
+  Avx2SkipBlank,
+  Avx2SkipName,
+  Avx2Find,
+  Avx2CountNewlines,
+};
+#endif
+
+const Scanner& GetScanner()
+{
+#ifdef SCAN_X86_64
+  static const Scanner& scanner = (__builtin_cpu_supports("avx2") ? g_avx2Scanner : g_sse2Scanner);
+  return scanner;
+#else
+  return g_scalarScanner;
+#endif
+}
+
+std::vector<const Scanner*> GetSupportedScanners()
+{
+  std::vector<const Scanner*> scanners;
+  scanners.push_back(&g_scalarScanner);
+
+#ifdef SCAN_X86_64
+  scanners.push_back(&g_sse2Scanner);
+
+  if (__builtin_cpu_supports("avx2"))
+  {
+    scanners.push_back(&g_avx2Scanner);
+  }
+#endif
+
+  return scanners;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <vector>
+
+/*
+ * These are used by the lexer to skip over runs of characters (whitespace, comments, and the bodies of names and
+ * strings) many bytes at a time, instead of stepping over them with `NextChar`. Each of them returns a pointer to
+ * the first character that isn't part of the run.
+ *
+ * NOTE(Isaac): the vectorized versions read whole aligned blocks, so can read a little either side of the run. This
+ * is fine because the source must be terminated by a '\0' (which ends every run), and an aligned block can't cross
+ * into a page that doesn't contain any of the source.
+ */
+struct Scanner
+{
+  const char* (*skipBlank)(const char* c);              // Skips ' ', '\r' and '\n'
+  const char* (*skipName)(const char* c);               // Skips [a-zA-Z0-9_]
+  const char* (*find)(const char* c, char target);      // Skips to the next `target` or '\0'
+
+  /*
+   * Counts the number of '\n's in [start, end). If there are any, `lastNewline` is set to the last one.
+   */
+  unsigned int (*countNewlines)(const char* start, const char* end, const char*& lastNewline);
+};
+
+extern const Scanner g_scalarScanner;
+
+/*
+ * Gets the fastest scanner the CPU we're running on supports.
+ */
+const Scanner& GetScanner();
+
+/*
+ * Gets every scanner the CPU we're running on supports, starting with `g_scalarScanner`. These should all behave
+ * in exactly the same way, so this is mainly used to test them against each other.
+ */
+std::vector<const Scanner*> GetSupportedScanners();
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <scheduler.hpp>
+#include <thread>
+#include <error.hpp>
+
+Scheduler::Scheduler(unsigned int numWorkers)
+  :queues(numWorkers)
+  ,nextQueue(0u)
+{
+  Assert(numWorkers > 0u, "Scheduler must have at least one worker");
+}
+
+void Scheduler::Push(const std::function<void()>& task)
+{
+  queues[nextQueue].tasks.push_back(task);
+  nextQueue = (nextQueue + 1u) % queues.size();
+}
+
+bool Scheduler::TakeTask(unsigned int worker, std::function<void()>& task)
+{
+  // Try our own queue first
+  {
+    std::lock_guard<std::mutex> guard(queues[worker].lock);
+
+    if (queues[worker].tasks.size() > 0u)
+    {
+      task = queues[worker].tasks.front();
+      queues[worker].tasks.pop_front();
+      return true;
+    }
+  }
+
+  // Then try to steal from the other workers
+  for (unsigned int i = 1u;
+       i < queues.size();
+       i++)
+  {
+    WorkQueue& victim = queues[(worker + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+
+    if (victim.tasks.size() > 0u)
+    {
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void Scheduler::Work(unsigned int worker)
+{
+  std::function<void()> task;
+
+  while (TakeTask(worker, task))
+  {
+    task();
+  }
+}
+
+void Scheduler::Run()
+{
+  std::vector<std::thread> threads;
+
+  for (unsigned int i = 1u;
+       i < queues.size();
+       i++)
+  {
+    threads.push_back(std::thread(&Scheduler::Work, this, i));
+  }
+
+  Work(0u);
+
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+}
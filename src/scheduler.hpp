@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+/*
+ * This is a simple work-stealing scheduler for running independent tasks (e.g. compiling each CodeThing) across
+ * a number of threads. Tasks are dealt out between the workers' queues as they're pushed. Each worker takes tasks
+ * from the front of its own queue, and once that's empty, steals them from the back of the other workers' queues.
+ *
+ * NOTE(Isaac): tasks can't push more tasks, so once every queue is empty, we know we're done.
+ */
+struct Scheduler
+{
+  Scheduler(unsigned int numWorkers);
+  ~Scheduler() { }
+
+  void Push(const std::function<void()>& task);
+
+  /*
+   * Runs all of the pushed tasks, and returns once they've all finished. The calling thread is used as one of the
+   * workers, so with a single worker the tasks are simply run in the order they were pushed.
+   */
+  void Run();
+
+private:
+  struct WorkQueue
+  {
+    std::mutex                        lock;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  bool TakeTask(unsigned int worker, std::function<void()>& task);
+  void Work(unsigned int worker);
+
+  std::vector<WorkQueue>  queues;
+  unsigned int            nextQueue;
+};
@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <ssa.hpp>
+#include <climits>
+#include <liveness.hpp>
+
+/*
+ * The dominance frontier of a block is made up of the blocks where its dominance ends: those it doesn't strictly
+ * dominate, but does dominate a predecessor of. They're where the values defined in the block meet values from
+ * other paths, and so where phis might be needed. This is found as described by Cooper, Harvey and Kennedy.
+ */
+static std::vector<std::vector<unsigned int>> FindDominanceFrontiers(ControlFlowGraph& graph)
+{
+  std::vector<std::vector<unsigned int>> frontiers(graph.blocks.size());
+
+  for (BasicBlock& block : graph.blocks)
+  {
+    // NOTE(Isaac): the entry block is also entered from outside the function, so is a join point with one predecessor
+    if ((block.predecessors.size() < 2u && block.index != 0u) || graph.dominators[block.index] == -1)
+    {
+      continue;
+    }
+
+    for (unsigned int predecessor : block.predecessors)
+    {
+      if (graph.dominators[predecessor] == -1)
+      {
+        continue;
+      }
+
+      unsigned int runner = predecessor;
+      while (static_cast<signed int>(runner) != graph.dominators[block.index])
+      {
+        if (frontiers[runner].size() == 0u || frontiers[runner].back() != block.index)
+        {
+          frontiers[runner].push_back(block.index);
+        }
+
+        if (runner == 0u)
+        {
+          break;
+        }
+
+        runner = static_cast<unsigned int>(graph.dominators[runner]);
+      }
+    }
+  }
+
+  return frontiers;
+}
+
+static Slot* CreateVersion(CodeThing* code, Slot* original, unsigned int version)
+{
+  if (original->GetType() == SlotType::VARIABLE)
+  {
+    VariableSlot* slot = new VariableSlot(code, static_cast<VariableSlot*>(original)->variable);
+    slot->version = version;
+    return slot;
+  }
+
+  // NOTE(Isaac): versions of a parameter aren't the parameter itself any more, so are just temporaries
+  Assert(original->GetType() == SlotType::TEMPORARY || original->GetType() == SlotType::PARAMETER,
+         "Only variables, parameters and temporaries should be put into SSA form");
+  return new TemporarySlot(code);
+}
+
+/*
+ * This is the usual construction from "Efficiently Computing Static Single Assignment Form and the Control
+ * Dependence Graph" by Cytron et al., but only places phis where the slot is live.
+ */
+void SSAConstructionPass::Apply(CodeThing* code)
+{
+  if (!(code->airHead))
+  {
+    return;
+  }
+
+  ControlFlowGraph graph(code);
+  unsigned int numSlots = code->slots.size();
+  unsigned int numBlocks = graph.blocks.size();
+
+  std::vector<bool> isRenamed(numSlots, false);
+  for (Slot* slot : code->slots)
+  {
+    isRenamed[slot->index] = (IsRegisterSlot(slot) && slot->ShouldColor() && !(slot->IsColored()));
+  }
+
+  // Members are found through their parent's slot, so the parent has to stay as it is
+  for (Slot* slot : code->slots)
+  {
+    if (slot->GetType() == SlotType::MEMBER)
+    {
+      isRenamed[static_cast<MemberSlot*>(slot)->parent->index] = false;
+    }
+  }
+
+  // Find the blocks each slot is defined in
+  std::vector<unsigned int> numDefs(numSlots, 0u);
+  std::vector<std::vector<unsigned int>> defBlocks(numSlots);
+  SlotOperand operands[3u];
+
+  for (BasicBlock& block : graph.blocks)
+  {
+    for (unsigned int i = block.first;
+         i <= block.last;
+         i++)
+    {
+      unsigned int numOperands = GetSlotOperands(graph.instructions[i], operands);
+
+      for (unsigned int j = 0u;
+           j < numOperands;
+           j++)
+      {
+        unsigned int slot = (*operands[j].slot)->index;
+
+        if (!operands[j].isUse && isRenamed[slot])
+        {
+          numDefs[slot]++;
+
+          if (defBlocks[slot].size() == 0u || defBlocks[slot].back() != block.index)
+          {
+            defBlocks[slot].push_back(block.index);
+          }
+        }
+      }
+    }
+  }
+
+  /*
+   * Place the phis. A slot needs one in the dominance frontier of each block it's defined in, and then in the
+   * frontiers of the blocks those phis are in (as they define it too). Phis are only placed where the slot is
+   * live, as otherwise they'd be dead straight away (this is known as "pruned" SSA).
+   */
+  std::vector<std::vector<unsigned int>> frontiers = FindDominanceFrontiers(graph);
+  std::vector<std::vector<PhiInstruction*>> phis(numBlocks);
+  std::vector<std::vector<unsigned int>> phiSlots(numBlocks);   // The original slot of each phi
+  std::vector<unsigned int> hasPhi(numBlocks, UINT_MAX);
+  std::vector<unsigned int> isQueued(numBlocks, UINT_MAX);
+  std::vector<unsigned int> worklist;
+  std::vector<unsigned int> phiBlocks;
+
+  for (unsigned int slot = 0u;
+       slot < numSlots;
+       slot++)
+  {
+    if (!isRenamed[slot] || numDefs[slot] == 0u)
+    {
+      isRenamed[slot] = false;
+      continue;
+    }
+
+    worklist = defBlocks[slot];
+    phiBlocks.clear();
+
+    for (unsigned int block : worklist)
+    {
+      isQueued[block] = slot;
+    }
+
+    while (worklist.size() > 0u)
+    {
+      unsigned int block = worklist.back();
+      worklist.pop_back();
+
+      for (unsigned int frontier : frontiers[block])
+      {
+        if (hasPhi[frontier] == slot || !(graph.blocks[frontier].liveIn.Contains(slot)))
+        {
+          continue;
+        }
+
+        hasPhi[frontier] = slot;
+        phiBlocks.push_back(frontier);
+
+        if (isQueued[frontier] != slot)
+        {
+          isQueued[frontier] = slot;
+          worklist.push_back(frontier);
+        }
+      }
+    }
+
+    /*
+     * NOTE(Isaac): the entry block only needs a phi if the slot is live on entry to the function, which means it's
+     * read before it's given a value. We leave these slots alone, so it can be reported later.
+     */
+    if (hasPhi[0u] == slot || (numDefs[slot] == 1u && phiBlocks.size() == 0u))
+    {
+      isRenamed[slot] = false;
+      continue;
+    }
+
+    for (unsigned int block : phiBlocks)
+    {
+      PhiInstruction* phi = new PhiInstruction(code->slots[slot]);
+
+      for (unsigned int predecessor : graph.blocks[block].predecessors)
+      {
+        phi->operands.push_back(PhiInstruction::Operand{code->slots[slot],
+                                                        graph.instructions[graph.blocks[predecessor].last]});
+      }
+
+      phis[block].push_back(phi);
+      phiSlots[block].push_back(slot);
+    }
+  }
+
+  /*
+   * Rename the slots. Each definition gets a new version of its slot (apart from the first, which keeps the
+   * original), and each use is replaced with the version from the nearest definition that dominates it. We find
+   * these by walking down the dominator tree, keeping a stack of the versions of each slot defined on the way down.
+   */
+  std::vector<std::vector<unsigned int>> children(numBlocks);
+  for (unsigned int i = 1u;
+       i < numBlocks;
+       i++)
+  {
+    if (graph.dominators[i] != -1)
+    {
+      children[graph.dominators[i]].push_back(i);
+    }
+  }
+
+  std::vector<std::vector<Slot*>> versions(numSlots);
+  std::vector<unsigned int> numVersions(numSlots, 0u);
+  std::vector<unsigned int> pushed;   // Slots that have had a version pushed, so they can be popped afterwards
+
+  auto isRenamedSlot = [&isRenamed, numSlots](Slot* slot)
+    {
+      return (slot->index < numSlots && isRenamed[slot->index]);
+    };
+
+  auto define = [&](Slot** slot)
+    {
+      unsigned int index = (*slot)->index;
+      Slot* version = (numVersions[index] == 0u ? *slot : CreateVersion(code, *slot, numVersions[index]));
+
+      numVersions[index]++;
+      versions[index].push_back(version);
+      pushed.push_back(index);
+      *slot = version;
+    };
+
+  struct Frame
+  {
+    unsigned int  block;
+    unsigned int  nextChild;
+    size_t        numPushed;
+  };
+  std::vector<Frame> stack;
+
+  auto enter = [&](unsigned int index)
+    {
+      stack.push_back(Frame{index, 0u, pushed.size()});
+      BasicBlock& block = graph.blocks[index];
+
+      for (PhiInstruction* phi : phis[index])
+      {
+        define(&(phi->result));
+      }
+
+      for (unsigned int i = block.first;
+           i <= block.last;
+           i++)
+      {
+        unsigned int numOperands = GetSlotOperands(graph.instructions[i], operands);
+
+        for (unsigned int j = 0u;
+             j < numOperands;
+             j++)
+        {
+          if (operands[j].isUse && isRenamedSlot(*operands[j].slot))
+          {
+            std::vector<Slot*>& slotVersions = versions[(*operands[j].slot)->index];
+
+            if (slotVersions.size() > 0u)
+            {
+              *operands[j].slot = slotVersions.back();
+            }
+          }
+        }
+
+        for (unsigned int j = 0u;
+             j < numOperands;
+             j++)
+        {
+          if (!operands[j].isUse && isRenamedSlot(*operands[j].slot))
+          {
+            define(operands[j].slot);
+          }
+        }
+      }
+
+      // Fill in the operands of the successors' phis that come from this block
+      AirInstruction* last = graph.instructions[block.last];
+      for (unsigned int successor : block.successors)
+      {
+        for (unsigned int i = 0u;
+             i < phis[successor].size();
+             i++)
+        {
+          std::vector<Slot*>& slotVersions = versions[phiSlots[successor][i]];
+
+          for (PhiInstruction::Operand& operand : phis[successor][i]->operands)
+          {
+            if (operand.from == last && slotVersions.size() > 0u)
+            {
+              operand.value = slotVersions.back();
+            }
+          }
+        }
+      }
+    };
+
+  enter(0u);
+  while (stack.size() > 0u)
+  {
+    Frame& frame = stack.back();
+
+    if (frame.nextChild < children[frame.block].size())
+    {
+      unsigned int child = children[frame.block][frame.nextChild++];
+      enter(child);
+      continue;
+    }
+
+    while (pushed.size() > frame.numPushed)
+    {
+      versions[pushed.back()].pop_back();
+      pushed.pop_back();
+    }
+
+    stack.pop_back();
+  }
+
+  /*
+   * Put the phis into the AIR, just after the labels of their blocks. A block that was just a label now ends with
+   * its last phi, so phis that come from it have to be told.
+   */
+  std::vector<AirInstruction*> instructions;
+  std::vector<AirInstruction*> lastInBlock(numBlocks);
+
+  for (BasicBlock& block : graph.blocks)
+  {
+    for (unsigned int i = block.first;
+         i <= block.last;
+         i++)
+    {
+      instructions.push_back(graph.instructions[i]);
+
+      if (i == block.first && phis[block.index].size() > 0u)
+      {
+        // NOTE(Isaac): blocks with more than one predecessor must be jumped to, so always start with a label
+        Assert(graph.instructions[i]->instructionType == InstructionType::LABEL, "Phis must come after a label");
+        instructions.insert(instructions.end(), phis[block.index].begin(), phis[block.index].end());
+      }
+    }
+
+    lastInBlock[block.index] = instructions.back();
+  }
+
+  for (std::vector<PhiInstruction*>& blockPhis : phis)
+  {
+    for (PhiInstruction* phi : blockPhis)
+    {
+      for (PhiInstruction::Operand& operand : phi->operands)
+      {
+        operand.from = lastInBlock[graph.blockOf[operand.from->index]];
+      }
+    }
+  }
+
+  ReplaceInstructions(code, instructions);
+}
+
+/*
+ * Each phi is replaced by a copy from a new temporary, and each of its operands is copied into that temporary at
+ * the end of the predecessor it comes from. Going through a temporary means the phis at the top of a block still
+ * all happen at once, even if one reads the result of another (the "swap problem"), and that copies made at the
+ * end of a predecessor that branches somewhere else as well don't clobber anything needed on the other path
+ * (a "critical edge"), so we don't have to split these edges by adding new blocks. The register allocator can
+ * usually coalesce the extra copies away.
+ *
+ * NOTE(Isaac): copies into a predecessor that ends in a conditional jump go between the jump and the comparison
+ * before it, which is fine because MOVs don't change the flags.
+ */
+void SSADestructionPass::Apply(CodeThing* code)
+{
+  if (!(code->airHead))
+  {
+    return;
+  }
+
+  unsigned int numInstructions = code->airTail->index + 1u;
+  std::vector<std::vector<AirInstruction*>> copies(numInstructions);    // By the instruction they're made at
+  std::vector<AirInstruction*> replacements(numInstructions, nullptr);
+  std::vector<PhiInstruction*> phis;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType != InstructionType::PHI)
+    {
+      continue;
+    }
+
+    PhiInstruction* phi = static_cast<PhiInstruction*>(instruction);
+    TemporarySlot* temp = new TemporarySlot(code);
+
+    for (PhiInstruction::Operand& operand : phi->operands)
+    {
+      copies[operand.from->index].push_back(new MovInstruction(operand.value, temp));
+    }
+
+    replacements[phi->index] = new MovInstruction(temp, phi->result);
+    phis.push_back(phi);
+  }
+
+  if (phis.size() == 0u)
+  {
+    return;
+  }
+
+  /*
+   * Copies made at a jump or return go before it. Otherwise, they go after the instruction, and after any phis
+   * (now copies) that follow it, as they're part of the same block.
+   */
+  std::vector<AirInstruction*> instructions;
+  std::vector<AirInstruction*> pending;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    std::vector<AirInstruction*>& copiesHere = copies[instruction->index];
+
+    if (instruction->instructionType != InstructionType::PHI)
+    {
+      instructions.insert(instructions.end(), pending.begin(), pending.end());
+      pending.clear();
+    }
+
+    if (instruction->instructionType == InstructionType::JUMP ||
+        instruction->instructionType == InstructionType::RETURN)
+    {
+      instructions.insert(instructions.end(), copiesHere.begin(), copiesHere.end());
+      instructions.push_back(instruction);
+    }
+    else
+    {
+      instructions.push_back(replacements[instruction->index] ? replacements[instruction->index] : instruction);
+      pending.insert(pending.end(), copiesHere.begin(), copiesHere.end());
+    }
+  }
+  instructions.insert(instructions.end(), pending.begin(), pending.end());
+
+  ReplaceInstructions(code, instructions);
+
+  for (PhiInstruction* phi : phis)
+  {
+    delete phi;
+  }
+}
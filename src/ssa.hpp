@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <air.hpp>
+
+/*
+ * Static Single Assignment form
+ * -----------------------------
+ * In SSA form, each slot is written to by exactly one instruction, so finding where a value comes from is just a
+ * case of looking at the instruction that defines its slot, and passes can track values by slot instead of having
+ * to work out which writes reach which reads. Where a slot was written on more than one path into a block, a phi
+ * instruction at the top of the block picks the right version depending on the path taken.
+ *
+ * Only slots the register allocator is free to put anywhere (uncolored variables and temporaries) are put into SSA
+ * form. Precolored slots are left alone, as they stand for values in specific registers (parameters, the arguments
+ * and results of calls etc.), so can't be split up. Passes should therefore be careful with slots that are defined
+ * more than once, or not at all (which parameters aren't).
+ */
+struct SSAConstructionPass : AirTransformPass
+{
+  SSAConstructionPass() : AirTransformPass("SSA construction") { }
+
+  void Apply(CodeThing* code);
+};
+
+/*
+ * Takes the AIR back out of SSA form, by replacing the phis with MOVs, so the register allocator and code
+ * generator don't have to know about them. Most of these MOVs are then coalesced away by the register allocator.
+ */
+struct SSADestructionPass : AirTransformPass
+{
+  SSADestructionPass() : AirTransformPass("SSA destruction") { }
+
+  void Apply(CodeThing* code);
+};
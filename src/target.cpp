@@ -8,9 +8,10 @@
 #include <codegen.hpp>
 #include <elf/elf.hpp>
 
-BaseRegisterDef::BaseRegisterDef(Usage usage, const std::string& name)
+BaseRegisterDef::BaseRegisterDef(Usage usage, const std::string& name, bool isCalleeSaved)
   :usage(usage)
   ,name(name)
+  ,isCalleeSaved(isCalleeSaved)
 {
 }
 
@@ -30,27 +31,27 @@ TargetMachine::TargetMachine(const std::string& name, ParseResult& parse,
   ,functionReturnColor(functionReturnColor)
   ,intrinsicTypes{}
 {
-  if (!(intrinsicTypes[UNSIGNED_INT_INTRINSIC] = new TypeRef(GetTypeByName(parse, "uint"))))
+  if (!(intrinsicTypes[UNSIGNED_INT_INTRINSIC] = new TypeRef(GetTypeByName(parse, InternedString("uint")))))
   {
     RaiseError(ERROR_UNDEFINED_TYPE, "uint");
   }
 
-  if (!(intrinsicTypes[SIGNED_INT_INTRINSIC] = new TypeRef(GetTypeByName(parse, "int"))))
+  if (!(intrinsicTypes[SIGNED_INT_INTRINSIC] = new TypeRef(GetTypeByName(parse, InternedString("int")))))
   {
     RaiseError(ERROR_UNDEFINED_TYPE, "int");
   }
 
-  if (!(intrinsicTypes[FLOAT_INTRINSIC] = new TypeRef(GetTypeByName(parse, "float"))))
+  if (!(intrinsicTypes[FLOAT_INTRINSIC] = new TypeRef(GetTypeByName(parse, InternedString("float")))))
   {
     RaiseError(ERROR_UNDEFINED_TYPE, "float");
   }
 
-  if (!(intrinsicTypes[BOOL_INTRINSIC] = new TypeRef(GetTypeByName(parse, "bool"))))
+  if (!(intrinsicTypes[BOOL_INTRINSIC] = new TypeRef(GetTypeByName(parse, InternedString("bool")))))
   {
     RaiseError(ERROR_UNDEFINED_TYPE, "bool");
   }
 
-  if (!(intrinsicTypes[STRING_INTRINSIC] = new TypeRef(GetTypeByName(parse, "string"))))
+  if (!(intrinsicTypes[STRING_INTRINSIC] = new TypeRef(GetTypeByName(parse, InternedString("string")))))
   {
     RaiseError(ERROR_UNDEFINED_TYPE, "string");
   }
@@ -24,11 +24,12 @@ struct BaseRegisterDef
     SPECIAL
   };
   
-  BaseRegisterDef(Usage usage, const std::string& name);
+  BaseRegisterDef(Usage usage, const std::string& name, bool isCalleeSaved);
   virtual ~BaseRegisterDef() { }
 
   Usage       usage;
   std::string name;
+  bool        isCalleeSaved;  // If a function has to preserve this register's value for its caller
 };
 
 /*
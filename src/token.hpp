@@ -5,10 +5,20 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 template<typename T>
 const char* GetKeywordName(T keyword);
 
-enum TokenType
+/*
+ * Works out if the name of the given length is a keyword, and if so, which one. This is called for every name
+ * we lex, so it should be specialized as a switch, rather than searching through a table of keywords.
+ */
+template<typename T>
+bool LookupKeyword(const char* name, size_t length, T& keyword);
+
+enum TokenType : uint8_t
 {
   TOKEN_KEYWORD,
 
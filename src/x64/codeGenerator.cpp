@@ -5,9 +5,38 @@
 
 #include <x64/codeGenerator.hpp>
 #include <x64/emitter.hpp>
+#include <x64/peephole.hpp>
 
-#define E(...) \
-  Emit(errorState, thing, target, __VA_ARGS__);
+#define E(form, ...) \
+  instrs.push_back(MachineInstr::form(__VA_ARGS__));
+
+static Reg_x64 GetReg(Slot* slot)
+{
+  Assert(slot->IsColored(), "Slot must be in a register");
+  return static_cast<Reg_x64>(slot->color);
+}
+
+/*
+ * Gets the value of an integer or boolean constant as an immediate. Constant propagation can make constants of
+ * either integer type, so anything that can take one should take the other too.
+ * NOTE(Isaac): signed ints are encoded as their two's complement bit pattern.
+ */
+static uint32_t GetImmediate(Slot* slot)
+{
+  switch (slot->GetType())
+  {
+    case SlotType::UNSIGNED_INT_CONSTANT: return static_cast<ConstantSlot<unsigned int>*>(slot)->value;
+    case SlotType::INT_CONSTANT:          return static_cast<uint32_t>(static_cast<ConstantSlot<int>*>(slot)->value);
+    case SlotType::BOOL_CONSTANT:         return (static_cast<ConstantSlot<bool>*>(slot)->value ? 1u : 0u);
+
+    default:
+    {
+      RaiseError(ICE_UNHANDLED_SLOT_TYPE, slot->AsString().c_str(), "GetImmediate");
+    } break;
+  }
+
+  return 0u;
+}
 
 ElfThing* CodeGenerator_x64::GenerateBootstrap(ElfThing* thing, ParseResult& parse)
 {
@@ -29,7 +58,7 @@ ElfThing* CodeGenerator_x64::GenerateBootstrap(ElfThing* thing, ParseResult& par
     {
       if (entrySymbol)
       {
-        RaiseError(errorState, ERROR_MULTIPLE_ENTRY_POINTS, entrySymbol->name->str, thing->mangledName.c_str());
+        RaiseError(errorState, ERROR_MULTIPLE_ENTRY_POINTS, entrySymbol->name->str.c_str(), thing->mangledName.c_str());
       }
       entrySymbol = thing->symbol;
     }
@@ -40,27 +69,26 @@ ElfThing* CodeGenerator_x64::GenerateBootstrap(ElfThing* thing, ParseResult& par
     RaiseError(errorState, ERROR_NO_ENTRY_FUNCTION);
   }
 
+  instrs.clear();
+
   // Clearly mark the outermost stack frame
-  E(I::XOR_REG_REG, RBP, RBP);
+  E(RegReg, I::XOR_REG_REG, RBP, RBP);
 
   // Call the entry point
-  E(I::CALL32, 0x0);
-  new ElfRelocation(file, thing, thing->length - sizeof(uint32_t), ElfRelocation::Type::R_X86_64_PC32, entrySymbol, -0x4);
+  E(Imm, I::CALL32, 0x0);
+  Relocate(ElfRelocation::Type::R_X86_64_PC32, entrySymbol, -0x4);
 
   // Call the SYS_EXIT system call
   // The return value of Main() should be in RAX
-  E(I::MOV_REG_REG, RBX, RAX);
-  E(I::MOV_REG_IMM32, RAX, 1u);
-  E(I::INT_IMM8, 0x80);
+  E(RegReg, I::MOV_REG_REG, RBX, RAX);
+  E(RegImm, I::MOV_REG_IMM32, RAX, 1u);
+  E(Imm, I::INT_IMM8, 0x80);
 
+  Encode(errorState, file, thing, target, instrs);
   delete errorState;
   return thing;
 }
 
-#undef E
-#define E(...) \
-  Emit(code->errorState, elfThing, target, __VA_ARGS__);
-
 ElfThing* CodeGenerator_x64::Generate(CodeThing* code, ElfThing* rodataThing)
 {
   // Don't generate empty functions
@@ -71,27 +99,58 @@ ElfThing* CodeGenerator_x64::Generate(CodeThing* code, ElfThing* rodataThing)
 
   ElfThing* elfThing = new ElfThing(GetSection(file, ".text"), code->symbol);
 
-  // Enter a new stack frame
-  E(I::PUSH_REG, RBP);
-  E(I::MOV_REG_REG, RBP, RSP);
-
-  // Allocate requested space for local variables
-  if (code->neededStackSpace > 0u)
-  {
-    E(I::SUB_REG_IMM32, RSP, code->neededStackSpace);
-  }
-
-  // Emit the instructions for the body of the thing
   // TODO: eww
   this->code = code;
   this->elfThing = elfThing;
   this->rodataThing = rodataThing;
+  instrs.clear();
+  PlanFrame();
 
+  if (usesFramePointer)
+  {
+    // Enter a new stack frame
+    E(Reg, I::PUSH_REG, RBP);
+    E(RegReg, I::MOV_REG_REG, RBP, RSP);
+
+    // Allocate requested space for local variables
+    if (code->neededStackSpace > 0u)
+    {
+      E(RegImm, I::SUB_REG_IMM32, RSP, code->neededStackSpace);
+    }
+  }
+
+  /*
+   * NOTE(Isaac): if the registers are saved in the entry block, we save them here, rather than after its first
+   * instruction, because that could be a label at the top of a loop.
+   */
+  if (savePoint == 0)
+  {
+    EmitCalleeSavedPushes();
+  }
+
+  // Emit the instructions for the body of the thing
+  ControlFlowGraph* graph = code->controlFlowGraph;
   for (AirInstruction* instruction = code->airHead;
        instruction;
        instruction = instruction->next)
   {
+    /*
+     * The registers are saved at the top of the save point, but after its label, so jumps to it also save them.
+     */
+    bool isSavePoint = (savePoint > 0 &&
+                        static_cast<unsigned int>(instruction->index) == graph->blocks[savePoint].first);
+
+    if (isSavePoint && instruction->instructionType != InstructionType::LABEL)
+    {
+      EmitCalleeSavedPushes();
+    }
+
     Dispatch(instruction);
+
+    if (isSavePoint && instruction->instructionType == InstructionType::LABEL)
+    {
+      EmitCalleeSavedPushes();
+    }
   }
 
   /*
@@ -99,29 +158,143 @@ ElfThing* CodeGenerator_x64::Generate(CodeThing* code, ElfThing* rodataThing)
    * Otherwise, it will be done by return statements in the function's code
    */
   if (code->shouldAutoReturn)
+  {
+    EmitEpilogue(graph->blocks.size() - 1u);
+  }
+
+  // Tidy up the instructions we've picked, then encode them
+  OptimizePeephole(instrs);
+  RelaxJumps(target, instrs);
+  Encode(code->errorState, file, elfThing, target, instrs);
+
+  return elfThing;
+}
+
+/*
+ * Works out what the prologue and epilogues of the current function need to do:
+ *    - Which callee-saved registers it writes to, and so must preserve. The register allocator puts values that
+ *      are live across calls in these, so they're saved once, instead of around every call.
+ *    - Where to save them. This is "shrink-wrapping": instead of always saving them on entry, we save them in the
+ *      block found by `ControlFlowGraph::FindSavePoint`, so paths that don't touch them (like early returns) don't
+ *      save them at all. Calls need to know how much has been pushed to keep the stack aligned, so they count
+ *      as needing the saves too.
+ *    - Whether it needs a frame pointer. Leaf functions (that don't call anything) that don't keep anything on
+ *      the stack don't, so can leave out pushing and restoring RBP.
+ */
+void CodeGenerator_x64::PlanFrame()
+{
+  ControlFlowGraph* graph = code->controlFlowGraph;
+  std::vector<bool> needsSaves(graph->blocks.size(), false);
+  bool isWritten[target->numRegisters];
+  memset(isWritten, false, sizeof(bool)*target->numRegisters);
+  bool isLeaf = true;
+  LiveOperands operands;
+
+  calleeSavedRegs.clear();
+
+  for (BasicBlock& block : graph->blocks)
+  {
+    for (unsigned int i = block.first;
+         i <= block.last;
+         i++)
+    {
+      AirInstruction* instruction = graph->instructions[i];
+      GetLiveOperands(instruction, operands);
+
+      if (instruction->instructionType == InstructionType::CALL)
+      {
+        isLeaf = false;
+        needsSaves[block.index] = true;
+      }
+
+      for (Slot* def : operands.defs)
+      {
+        if (def->IsColored() && target->registerSet[def->color]->isCalleeSaved)
+        {
+          isWritten[def->color] = true;
+        }
+      }
+
+      // The saves also need to be made before the registers are read, so we count uses too
+      operands.uses.insert(operands.uses.end(), operands.defs.begin(), operands.defs.end());
+      for (Slot* operand : operands.uses)
+      {
+        if (operand->IsColored() && target->registerSet[operand->color]->isCalleeSaved)
+        {
+          needsSaves[block.index] = true;
+        }
+      }
+    }
+  }
+
+  for (unsigned int i = 0u;
+       i < target->numRegisters;
+       i++)
+  {
+    if (isWritten[i])
+    {
+      calleeSavedRegs.push_back(static_cast<Reg_x64>(i));
+    }
+  }
+
+  savePoint = (calleeSavedRegs.size() > 0u ? graph->FindSavePoint(needsSaves) : -1);
+
+  usesFramePointer = (!isLeaf || code->neededStackSpace > 0u);
+  for (Slot* slot : code->slots)
+  {
+    if (slot->GetType() == SlotType::MEMBER || slot->GetType() == SlotType::SPILL)
+    {
+      usesFramePointer = true;
+    }
+  }
+}
+
+void CodeGenerator_x64::EmitCalleeSavedPushes()
+{
+  for (Reg_x64 reg : calleeSavedRegs)
+  {
+    E(Reg, I::PUSH_REG, reg);
+  }
+}
+
+/*
+ * Emits the code to leave the function from the end of the given block.
+ */
+void CodeGenerator_x64::EmitEpilogue(unsigned int block)
+{
+  if (savePoint != -1 && code->controlFlowGraph->Dominates(savePoint, block))
+  {
+    for (unsigned int i = calleeSavedRegs.size();
+         i > 0u;
+         i--)
+    {
+      E(Reg, I::POP_REG, calleeSavedRegs[i - 1u]);
+    }
+  }
+
+  if (usesFramePointer)
   {
     // Clean up local variables
     if (code->neededStackSpace > 0u)
     {
-      E(I::ADD_REG_IMM32, RSP, code->neededStackSpace);
+      E(RegImm, I::ADD_REG_IMM32, RSP, code->neededStackSpace);
     }
 
-    E(I::LEAVE);
-    E(I::RET);
+    E(None, I::LEAVE);
   }
 
-  return elfThing;
+  E(None, I::RET);
 }
 
 void CodeGenerator_x64::Visit(LabelInstruction* instruction, void*)
 {
   /*
-   * This doesn't correspond to a real instruction, so we don't emit anything.
+   * This doesn't correspond to a real instruction, so nothing is emitted for it.
    *
-   * However, we do need to know where this label lies in the stream as it's emitted, so we can refer to it
-   * while doing relocations later.
+   * However, we do need to know where this label lies in the stream, so the jumps to it can be filled in once
+   * the instructions have been laid out.
    */
-  instruction->offset = elfThing->length;
+  E(Label, instruction);
 }
 
 void CodeGenerator_x64::Visit(ReturnInstruction* instruction, void*)
@@ -131,13 +304,10 @@ void CodeGenerator_x64::Visit(ReturnInstruction* instruction, void*)
     switch (instruction->returnValue->GetType())
     {
       case SlotType::INT_CONSTANT:
-      {
-        E(I::MOV_REG_IMM32, RAX, dynamic_cast<ConstantSlot<int>*>(instruction->returnValue)->value);
-      } break;
-
       case SlotType::UNSIGNED_INT_CONSTANT:
+      case SlotType::BOOL_CONSTANT:
       {
-        E(I::MOV_REG_IMM32, RAX, dynamic_cast<ConstantSlot<unsigned int>*>(instruction->returnValue)->value);
+        E(RegImm, I::MOV_REG_IMM32, RAX, GetImmediate(instruction->returnValue));
       } break;
 
       case SlotType::FLOAT_CONSTANT:
@@ -145,16 +315,11 @@ void CodeGenerator_x64::Visit(ReturnInstruction* instruction, void*)
         // TODO: work out how floats work
       } break;
 
-      case SlotType::BOOL_CONSTANT:
-      {
-        E(I::MOV_REG_IMM32, RAX, (dynamic_cast<ConstantSlot<bool>*>(instruction->returnValue) ? 1u : 0u));
-      } break;
-
       case SlotType::STRING_CONSTANT:
       {
-        E(I::MOV_REG_IMM64, RAX, 0x00);
-        new ElfRelocation(file, elfThing, elfThing->length-sizeof(uint64_t), ElfRelocation::Type::R_X86_64_64,
-                          rodataThing->symbol, dynamic_cast<ConstantSlot<StringConstant*>*>(instruction->returnValue)->value->offset);
+        E(RegImm, I::MOV_REG_IMM64, RAX, 0x00);
+        Relocate(ElfRelocation::Type::R_X86_64_64, rodataThing->symbol,
+                 dynamic_cast<ConstantSlot<StringConstant*>*>(instruction->returnValue)->value->offset);
       } break;
 
       case SlotType::VARIABLE:
@@ -163,26 +328,24 @@ void CodeGenerator_x64::Visit(ReturnInstruction* instruction, void*)
       case SlotType::RETURN_RESULT:
       {
         Assert(instruction->returnValue->IsColored(), "Vars etc. need to be in registers atm");
-        E(I::MOV_REG_REG, RAX, instruction->returnValue->color);
+        E(RegReg, I::MOV_REG_REG, RAX, GetReg(instruction->returnValue));
       } break;
 
       case SlotType::MEMBER:
       {
         MemberSlot* returnValue = dynamic_cast<MemberSlot*>(instruction->returnValue);
         Assert(returnValue->parent->IsColored(), "Parent must be in a register");
-        E(I::MOV_REG_BASE_DISP, RAX, returnValue->parent->color, returnValue->member->offset);
+        E(RegMem, I::MOV_REG_BASE_DISP, RAX, GetReg(returnValue->parent), returnValue->member->offset);
       } break;
-    }
-  }
 
-  // Clean up local variables
-  if (code->neededStackSpace > 0u)
-  {
-    E(I::ADD_REG_IMM32, RSP, code->neededStackSpace);
+      case SlotType::SPILL:
+      {
+        E(RegMem, I::MOV_REG_BASE_DISP, RAX, RBP, dynamic_cast<SpillSlot*>(instruction->returnValue)->offset);
+      } break;
+    }
   }
 
-  E(I::LEAVE);
-  E(I::RET);
+  EmitEpilogue(code->controlFlowGraph->GetBlock(instruction).index);
 }
 
 void CodeGenerator_x64::Visit(JumpInstruction* instruction, void*)
@@ -193,22 +356,20 @@ void CodeGenerator_x64::Visit(JumpInstruction* instruction, void*)
      * TODO: The instructions we actually need to emit here depend on whether the operands of the comparison
      * were unsigned or signed. We should take this into account
      */
-    case JumpInstruction::Condition::UNCONDITIONAL:       E(I::JMP, 0x00);  break;
-    case JumpInstruction::Condition::IF_EQUAL:            E(I::JE,  0x00);  break;
-    case JumpInstruction::Condition::IF_NOT_EQUAL:        E(I::JNE, 0x00);  break;
-    case JumpInstruction::Condition::IF_OVERFLOW:         E(I::JO,  0x00);  break;
-    case JumpInstruction::Condition::IF_NOT_OVERFLOW:     E(I::JNO, 0x00);  break;
-    case JumpInstruction::Condition::IF_SIGN:             E(I::JS,  0x00);  break;
-    case JumpInstruction::Condition::IF_NOT_SIGN:         E(I::JNS, 0x00);  break;
-    case JumpInstruction::Condition::IF_GREATER:          E(I::JG,  0x00);  break;
-    case JumpInstruction::Condition::IF_GREATER_OR_EQUAL: E(I::JGE, 0x00);  break;
-    case JumpInstruction::Condition::IF_LESSER:           E(I::JL,  0x00);  break;
-    case JumpInstruction::Condition::IF_LESSER_OR_EQUAL:  E(I::JLE, 0x00);  break;
-    case JumpInstruction::Condition::IF_PARITY_EVEN:      E(I::JPE, 0x00);  break;
-    case JumpInstruction::Condition::IF_PARITY_ODD:       E(I::JPO, 0x00);  break;
+    case JumpInstruction::Condition::UNCONDITIONAL:       E(Jump, I::JMP, instruction->label);  break;
+    case JumpInstruction::Condition::IF_EQUAL:            E(Jump, I::JE,  instruction->label);  break;
+    case JumpInstruction::Condition::IF_NOT_EQUAL:        E(Jump, I::JNE, instruction->label);  break;
+    case JumpInstruction::Condition::IF_OVERFLOW:         E(Jump, I::JO,  instruction->label);  break;
+    case JumpInstruction::Condition::IF_NOT_OVERFLOW:     E(Jump, I::JNO, instruction->label);  break;
+    case JumpInstruction::Condition::IF_SIGN:             E(Jump, I::JS,  instruction->label);  break;
+    case JumpInstruction::Condition::IF_NOT_SIGN:         E(Jump, I::JNS, instruction->label);  break;
+    case JumpInstruction::Condition::IF_GREATER:          E(Jump, I::JG,  instruction->label);  break;
+    case JumpInstruction::Condition::IF_GREATER_OR_EQUAL: E(Jump, I::JGE, instruction->label);  break;
+    case JumpInstruction::Condition::IF_LESSER:           E(Jump, I::JL,  instruction->label);  break;
+    case JumpInstruction::Condition::IF_LESSER_OR_EQUAL:  E(Jump, I::JLE, instruction->label);  break;
+    case JumpInstruction::Condition::IF_PARITY_EVEN:      E(Jump, I::JPE, instruction->label);  break;
+    case JumpInstruction::Condition::IF_PARITY_ODD:       E(Jump, I::JPO, instruction->label);  break;
   }
-
-  new ElfRelocation(file, elfThing, elfThing->length-sizeof(uint32_t), ElfRelocation::Type::R_X86_64_PC32, code->symbol, -0x4, instruction->label);
 }
 
 void CodeGenerator_x64::Visit(MovInstruction* instruction, void*)
@@ -225,30 +386,22 @@ void CodeGenerator_x64::Visit(MovInstruction* instruction, void*)
       switch (instruction->src->GetType())
       {
         case SlotType::INT_CONSTANT:
-        {
-          E(I::MOV_REG_IMM32, instruction->dest->color, dynamic_cast<ConstantSlot<int>*>(instruction->src)->value);
-        } break;
-
         case SlotType::UNSIGNED_INT_CONSTANT:
+        case SlotType::BOOL_CONSTANT:
         {
-          E(I::MOV_REG_IMM32, instruction->dest->color, dynamic_cast<ConstantSlot<unsigned int>*>(instruction->src)->value);
+          E(RegImm, I::MOV_REG_IMM32, GetReg(instruction->dest), GetImmediate(instruction->src));
         } break;
 
         case SlotType::FLOAT_CONSTANT:
         {
           // TODO
         } break;
-
-        case SlotType::BOOL_CONSTANT:
-        {
-          E(I::MOV_REG_IMM32, instruction->dest->color, dynamic_cast<ConstantSlot<bool>*>(instruction->src)->value ? 1u : 0u);
-        } break;
         
         case SlotType::STRING_CONSTANT:
         {
-          E(I::MOV_REG_IMM64, instruction->dest->color, 0x00);
-          new ElfRelocation(file, elfThing, elfThing->length - sizeof(uint64_t), ElfRelocation::Type::R_X86_64_64,
-                            rodataThing->symbol, dynamic_cast<ConstantSlot<StringConstant*>*>(instruction->src)->value->offset);
+          E(RegImm, I::MOV_REG_IMM64, GetReg(instruction->dest), 0x00);
+          Relocate(ElfRelocation::Type::R_X86_64_64, rodataThing->symbol,
+                   dynamic_cast<ConstantSlot<StringConstant*>*>(instruction->src)->value->offset);
         } break;
 
         case SlotType::VARIABLE:
@@ -257,29 +410,40 @@ void CodeGenerator_x64::Visit(MovInstruction* instruction, void*)
         case SlotType::RETURN_RESULT:
         {
           Assert(instruction->src->IsColored(), "Source slot must be colored as it should also be in a register");
-          E(I::MOV_REG_REG, instruction->dest->color, instruction->src->color);
+
+          // If the register allocator has coalesced the slots, there's nothing to do
+          if (instruction->dest->color != instruction->src->color)
+          {
+            E(RegReg, I::MOV_REG_REG, GetReg(instruction->dest), GetReg(instruction->src));
+          }
         } break;
 
         case SlotType::MEMBER:
         {
-          E(I::MOV_REG_BASE_DISP, instruction->dest->color, RBP, dynamic_cast<MemberSlot*>(instruction->src)->GetBasePointerOffset());
+          E(RegMem, I::MOV_REG_BASE_DISP, GetReg(instruction->dest), RBP, dynamic_cast<MemberSlot*>(instruction->src)->GetBasePointerOffset());
+        } break;
+
+        case SlotType::SPILL:
+        {
+          E(RegMem, I::MOV_REG_BASE_DISP, GetReg(instruction->dest), RBP, dynamic_cast<SpillSlot*>(instruction->src)->offset);
         } break;
       }
     } break;
 
     case SlotType::MEMBER:
+    case SlotType::SPILL:
     {
-      MemberSlot* memberSlot = dynamic_cast<MemberSlot*>(instruction->dest);
+      int offset = (instruction->dest->GetType() == SlotType::MEMBER ?
+                      dynamic_cast<MemberSlot*>(instruction->dest)->GetBasePointerOffset() :
+                      dynamic_cast<SpillSlot*>(instruction->dest)->offset);
+
       switch (instruction->src->GetType())
       {
         case SlotType::INT_CONSTANT:
-        {
-          E(I::MOV_BASE_DISP_IMM32, RBP, memberSlot->GetBasePointerOffset(), dynamic_cast<ConstantSlot<int>*>(instruction->src)->value);
-        } break;
-
         case SlotType::UNSIGNED_INT_CONSTANT:
+        case SlotType::BOOL_CONSTANT:
         {
-          E(I::MOV_BASE_DISP_IMM32, RBP, memberSlot->GetBasePointerOffset(), dynamic_cast<ConstantSlot<unsigned int>*>(instruction->src)->value);
+          E(MemImm, I::MOV_BASE_DISP_IMM32, RBP, offset, GetImmediate(instruction->src));
         } break;
 
         case SlotType::FLOAT_CONSTANT:
@@ -287,16 +451,11 @@ void CodeGenerator_x64::Visit(MovInstruction* instruction, void*)
           // TODO
         } break;
 
-        case SlotType::BOOL_CONSTANT:
-        {
-          E(I::MOV_BASE_DISP_IMM32, RBP, memberSlot->GetBasePointerOffset(), dynamic_cast<ConstantSlot<bool>*>(instruction->src)->value ? 1u : 0u);
-        } break;
-
         case SlotType::STRING_CONSTANT:
         {
-          E(I::MOV_BASE_DISP_IMM64, RBP, memberSlot->GetBasePointerOffset(), 0x00);
-          new ElfRelocation(file, elfThing, elfThing->length - sizeof(uint64_t), ElfRelocation::Type::R_X86_64_64,
-                            rodataThing->symbol, dynamic_cast<ConstantSlot<StringConstant*>*>(instruction->src)->value->offset);
+          E(MemImm, I::MOV_BASE_DISP_IMM64, RBP, offset, 0x00);
+          Relocate(ElfRelocation::Type::R_X86_64_64, rodataThing->symbol,
+                   dynamic_cast<ConstantSlot<StringConstant*>*>(instruction->src)->value->offset);
         } break;
 
         case SlotType::VARIABLE:
@@ -305,10 +464,11 @@ void CodeGenerator_x64::Visit(MovInstruction* instruction, void*)
         case SlotType::RETURN_RESULT:
         {
           Assert(instruction->src->IsColored(), "Source slot must be colored if it should be in a register");
-          E(I::MOV_BASE_DISP_REG, RBP, memberSlot->GetBasePointerOffset(), instruction->src->color);
+          E(MemReg, I::MOV_BASE_DISP_REG, RBP, offset, GetReg(instruction->src));
         } break;
 
         case SlotType::MEMBER:
+        case SlotType::SPILL:
         {
           // TODO: I don't think we can do this on x64!?!?!?
           // This should be a TargetConstraint
@@ -318,7 +478,7 @@ void CodeGenerator_x64::Visit(MovInstruction* instruction, void*)
     
     default:
     {
-      RaiseError(ICE_GENERIC, "Can't move into slot that isn't a VARIABLE, MEMBER, PARAMETER, TEMPORARY or RETURN_RESULT!");
+      RaiseError(ICE_GENERIC, "Can't move into slot that isn't a VARIABLE, MEMBER, PARAMETER, TEMPORARY, RETURN_RESULT or SPILL!");
     } break;
   }
 }
@@ -327,36 +487,21 @@ void CodeGenerator_x64::Visit(CmpInstruction* instruction, void*)
 {
   if (instruction->a->IsColored() && instruction->b->IsColored())
   {
-    E(I::CMP_REG_REG, instruction->a->color, instruction->b->color);
+    E(RegReg, I::CMP_REG_REG, GetReg(instruction->a), GetReg(instruction->b));
   }
   else
   {
-    Slot* reg;
-    Slot* immediate;
+    // NOTE(Isaac): the precolorer makes sure the immediate is always second
+    Assert(instruction->b->IsConstant(), "Either both sides must be colored, or the second must be a constant");
+    Slot* reg       = instruction->a;
+    Slot* immediate = instruction->b;
 
-    if (instruction->a->IsConstant())
-    {
-      immediate = instruction->a;
-      reg       = instruction->b;
-    }
-    else
-    {
-      Assert(instruction->b->IsConstant(), "Either both sides must be colored, or one must be a constant");
-      immediate = instruction->b;
-      reg       = instruction->a;
-    }
-
-    Assert(reg->color == RAX, "Can only compare immediate against RAX on x86");
     switch (immediate->GetType())
     {
       case SlotType::UNSIGNED_INT_CONSTANT:
-      {
-        E(I::CMP_RAX_IMM32, dynamic_cast<ConstantSlot<unsigned int>*>(immediate)->value);
-      } break;
-
       case SlotType::INT_CONSTANT:
       {
-        E(I::CMP_RAX_IMM32, dynamic_cast<ConstantSlot<int>*>(immediate)->value);
+        E(RegImm, I::CMP_REG_IMM32, GetReg(reg), GetImmediate(immediate));
       } break;
 
       case SlotType::FLOAT_CONSTANT:
@@ -380,14 +525,10 @@ void CodeGenerator_x64::Visit(UnaryOpInstruction* instruction, void*)
     switch (instruction->operand->GetType())
     {
       case SlotType::UNSIGNED_INT_CONSTANT:
-      {
-        E(I::MOV_REG_IMM32, dynamic_cast<ConstantSlot<unsigned int>*>(instruction->operand)->value);
-      } break;
-
       case SlotType::INT_CONSTANT:
       {
-        E(I::MOV_REG_IMM32, dynamic_cast<ConstantSlot<int>*>(instruction->operand)->value);
-      };
+        E(RegImm, I::MOV_REG_IMM32, GetReg(instruction->result), GetImmediate(instruction->operand));
+      } break;
 
       case SlotType::FLOAT_CONSTANT:
       {
@@ -402,15 +543,15 @@ void CodeGenerator_x64::Visit(UnaryOpInstruction* instruction, void*)
   }
   else
   {
-    E(I::MOV_REG_REG, instruction->result->color, instruction->operand->color);
+    E(RegReg, I::MOV_REG_REG, GetReg(instruction->result), GetReg(instruction->operand));
   }
 
   switch (instruction->op)
   {
-    case UnaryOpInstruction::Operation::INCREMENT:    E(I::INC_REG, instruction->result->color);  break;
-    case UnaryOpInstruction::Operation::DECREMENT:    E(I::DEC_REG, instruction->result->color);  break;
-    case UnaryOpInstruction::Operation::NEGATE:       E(I::NEG_REG, instruction->result->color);  break;
-    case UnaryOpInstruction::Operation::LOGICAL_NOT:  E(I::NOT_REG, instruction->result->color);  break;
+    case UnaryOpInstruction::Operation::INCREMENT:    E(Reg, I::INC_REG, GetReg(instruction->result));  break;
+    case UnaryOpInstruction::Operation::DECREMENT:    E(Reg, I::DEC_REG, GetReg(instruction->result));  break;
+    case UnaryOpInstruction::Operation::NEGATE:       E(Reg, I::NEG_REG, GetReg(instruction->result));  break;
+    case UnaryOpInstruction::Operation::LOGICAL_NOT:  E(Reg, I::NOT_REG, GetReg(instruction->result));  break;
   }
 }
 
@@ -435,23 +576,23 @@ void CodeGenerator_x64::Visit(BinaryOpInstruction* instruction, void*)
       {
         switch (instruction->op)
         {
-          case BinaryOpInstruction::Operation::ADD:       E(I::ADD_REG_REG, resultReg, instruction->right->color); break;
-          case BinaryOpInstruction::Operation::SUBTRACT:  E(I::SUB_REG_REG, resultReg, instruction->right->color); break;
-          case BinaryOpInstruction::Operation::MULTIPLY:  E(I::MUL_REG_REG, resultReg, instruction->right->color); break;
-          case BinaryOpInstruction::Operation::DIVIDE:    E(I::DIV_REG_REG, resultReg, instruction->right->color); break;
+          case BinaryOpInstruction::Operation::ADD:       E(RegReg, I::ADD_REG_REG, resultReg, GetReg(instruction->right)); break;
+          case BinaryOpInstruction::Operation::SUBTRACT:  E(RegReg, I::SUB_REG_REG, resultReg, GetReg(instruction->right)); break;
+          case BinaryOpInstruction::Operation::MULTIPLY:  E(RegReg, I::MUL_REG_REG, resultReg, GetReg(instruction->right)); break;
+          case BinaryOpInstruction::Operation::DIVIDE:    E(RegReg, I::DIV_REG_REG, resultReg, GetReg(instruction->right)); break;
         }
       }
       else
       {
         Assert(instruction->right->GetType() == SlotType::UNSIGNED_INT_CONSTANT ||
                instruction->right->GetType() == SlotType::INT_CONSTANT, "Intrinsic type doesn't match slot");
-        ConstantSlot<unsigned int>* slot = dynamic_cast<ConstantSlot<unsigned int>*>(instruction->right);
+        uint32_t immediate = GetImmediate(instruction->right);
         switch (instruction->op)
         {
-          case BinaryOpInstruction::Operation::ADD:       E(I::ADD_REG_IMM32, resultReg, slot->value); break;
-          case BinaryOpInstruction::Operation::SUBTRACT:  E(I::SUB_REG_IMM32, resultReg, slot->value); break;
-          case BinaryOpInstruction::Operation::MULTIPLY:  E(I::MUL_REG_IMM32, resultReg, slot->value); break;
-          case BinaryOpInstruction::Operation::DIVIDE:    E(I::DIV_REG_IMM32, resultReg, slot->value); break;
+          case BinaryOpInstruction::Operation::ADD:       E(RegImm, I::ADD_REG_IMM32, resultReg, immediate); break;
+          case BinaryOpInstruction::Operation::SUBTRACT:  E(RegImm, I::SUB_REG_IMM32, resultReg, immediate); break;
+          case BinaryOpInstruction::Operation::MULTIPLY:  E(RegImm, I::MUL_REG_IMM32, resultReg, immediate); break;
+          case BinaryOpInstruction::Operation::DIVIDE:    E(RegImm, I::DIV_REG_IMM32, resultReg, immediate); break;
         }
       }
     } break;
@@ -480,48 +621,63 @@ void CodeGenerator_x64::Visit(BinaryOpInstruction* instruction, void*)
 
 void CodeGenerator_x64::Visit(CallInstruction* instruction, void*)
 {
-  #define SAVE_REG(reg)\
-    if (IsColorInUseAtPoint(code, instruction, reg))\
-    {\
-      E(I::PUSH_REG, reg);\
-    }
-
-  #define RESTORE_REG(reg)\
-    if (IsColorInUseAtPoint(code, instruction, reg))\
-    {\
-      E(I::POP_REG, reg);\
-    }
-
   /*
    * These are the registers that must be saved by the caller (if it cares about their contents).
    * NOTE(Isaac): RSP is technically caller-saved, but functions shouldn't leave anything on the stack unless
    * they're specifically meant to, so we don't need to (or occasionally spefically don't want to) restore it.
    */
-  SAVE_REG(RAX);
-  SAVE_REG(RCX);
-  SAVE_REG(RDX);
-  SAVE_REG(RSI);
-  SAVE_REG(RDI);
-  SAVE_REG(R8 );
-  SAVE_REG(R9 );
-  SAVE_REG(R10);
-  SAVE_REG(R11);
-
-  E(I::CALL32, 0x00);
-  new ElfRelocation(file, elfThing, elfThing->length-sizeof(uint32_t), ElfRelocation::Type::R_X86_64_PC32, instruction->thing->symbol, -0x4);
-
-  RESTORE_REG(R11);
-  RESTORE_REG(R10);
-  RESTORE_REG(R9 );
-  RESTORE_REG(R8 );
-  RESTORE_REG(RDI);
-  RESTORE_REG(RSI);
-  RESTORE_REG(RDX);
-  RESTORE_REG(RCX);
-  RESTORE_REG(RAX);
-
-  #undef SAVE_REG
-  #undef RESTORE_REG
+  static const Reg_x64 callerSaved[] = { RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11 };
+
+  Reg_x64 savedRegs[sizeof(callerSaved) / sizeof(Reg_x64)];
+  unsigned int numSavedRegs = 0u;
+
+  for (Reg_x64 reg : callerSaved)
+  {
+    if (instruction->liveColors & (1u << reg))
+    {
+      savedRegs[numSavedRegs++] = reg;
+    }
+  }
+
+  /*
+   * The stack must be 16-byte aligned at the call. It is after the prologue has pushed RBP, so we pad it if the
+   * stack frame, the callee-saved registers and the registers saved here add up to an odd number of 8-byte slots.
+   * Calls are always after the callee-saved registers have been pushed (see `PlanFrame`).
+   */
+  bool needsPadding = (((code->neededStackSpace + (calleeSavedRegs.size() + numSavedRegs) * 8u) % 16u) != 0u);
+
+  for (unsigned int i = 0u;
+       i < numSavedRegs;
+       i++)
+  {
+    E(Reg, I::PUSH_REG, savedRegs[i]);
+  }
+
+  if (needsPadding)
+  {
+    E(RegImm, I::SUB_REG_IMM32, RSP, 8u);
+  }
+
+  E(Imm, I::CALL32, 0x00);
+  Relocate(ElfRelocation::Type::R_X86_64_PC32, instruction->thing->symbol, -0x4);
+
+  if (needsPadding)
+  {
+    E(RegImm, I::ADD_REG_IMM32, RSP, 8u);
+  }
+
+  for (unsigned int i = numSavedRegs;
+       i > 0u;
+       i--)
+  {
+    E(Reg, I::POP_REG, savedRegs[i - 1u]);
+  }
+}
+
+void CodeGenerator_x64::Visit(PhiInstruction* /*instruction*/, void*)
+{
+  RaiseError(code->errorState, ICE_UNHANDLED_INSTRUCTION_TYPE, "PhiInstruction",
+             "CodeGenerator_x64 (SSA should have been destructed)");
 }
 
 void CodeGenerator_x64::MoveSlotToRegister(Reg_x64 reg, Slot* slot)
@@ -531,14 +687,10 @@ void CodeGenerator_x64::MoveSlotToRegister(Reg_x64 reg, Slot* slot)
     switch (slot->GetType())
     {
       case SlotType::UNSIGNED_INT_CONSTANT:
-      {
-        E(I::MOV_REG_IMM32, reg, dynamic_cast<ConstantSlot<unsigned int>*>(slot)->value);
-      } break;
-
       case SlotType::INT_CONSTANT:
       {
-        E(I::MOV_REG_IMM32, reg, static_cast<ConstantSlot<int>*>(slot)->value);
-      };
+        E(RegImm, I::MOV_REG_IMM32, reg, GetImmediate(slot));
+      } break;
 
       case SlotType::FLOAT_CONSTANT:
       {
@@ -553,7 +705,18 @@ void CodeGenerator_x64::MoveSlotToRegister(Reg_x64 reg, Slot* slot)
   }
   else
   {
-    E(I::MOV_REG_REG, reg, slot->color);
+    E(RegReg, I::MOV_REG_REG, reg, GetReg(slot));
   }
 }
+/*
+ * Makes the last instruction picked refer to the given symbol, which is filled in by a relocation once it's been
+ * encoded.
+ */
+void CodeGenerator_x64::Relocate(ElfRelocation::Type type, ElfSymbol* symbol, int64_t addend)
+{
+  MachineInstr& instr = instrs.back();
+  instr.relocationType  = type;
+  instr.symbol          = symbol;
+  instr.addend          = addend;
+}
 #undef E
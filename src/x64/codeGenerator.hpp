@@ -6,10 +6,12 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <ir.hpp>
 #include <codegen.hpp>
 #include <elf/elf.hpp>
 #include <x64/x64.hpp>
+#include <x64/emitter.hpp>
 
 struct CodeGenerator_x64 : CodeGenerator
 {
@@ -27,10 +29,20 @@ struct CodeGenerator_x64 : CodeGenerator
    * These are for the CodeThing currently being generated
    * TODO: Ideally they should be stored in a state rather than here.
    */
-  ElfFile&        file;
-  ElfThing*       elfThing;
-  CodeThing*      code;
-  ElfThing*       rodataThing;
+  ElfFile&                  file;
+  ElfThing*                 elfThing;
+  CodeThing*                code;
+  ElfThing*                 rodataThing;
+  std::vector<MachineInstr> instrs;       // Picked for the thing, and encoded once it's all been generated
+
+  /*
+   * The callee-saved registers this function writes to, which are pushed at the start of the `savePoint` block
+   * (an index into the CFG's blocks) and popped at the exits that block dominates. The frame pointer is left out
+   * of leaf functions that don't use the stack.
+   */
+  std::vector<Reg_x64>  calleeSavedRegs;
+  signed int            savePoint;
+  bool                  usesFramePointer;
 
   void Visit(LabelInstruction* instruction,     void*);
   void Visit(ReturnInstruction* instruction,    void*);
@@ -40,6 +52,11 @@ struct CodeGenerator_x64 : CodeGenerator
   void Visit(UnaryOpInstruction* instruction,   void*);
   void Visit(BinaryOpInstruction* instruction,  void*);
   void Visit(CallInstruction* instruction,      void*);
+  void Visit(PhiInstruction* instruction,       void*);
 private:
   void MoveSlotToRegister(Reg_x64 reg, Slot* slot);
+  void Relocate(ElfRelocation::Type type, ElfSymbol* symbol, int64_t addend);
+  void PlanFrame();
+  void EmitCalleeSavedPushes();
+  void EmitEpilogue(unsigned int block);
 };
@@ -6,7 +6,6 @@
 #include <x64/emitter.hpp>
 #include <cstdint>
 #include <ctgmath>
-#include <cstdarg>
 #include <elf/elf.hpp>
 
 /*
@@ -42,15 +41,94 @@
  *      0b11 - x8
  * `index`  : the index register to use
  * `base`   : the base register to use
+ *
+ * --- REX prefixes ---
+ * A REX prefix is needed to use 64-bit operands, or to use R8 through R15, as ModR/M bytes, SIBs and opcodes only
+ * have three bits for each register, so the fourth bit of the register's opcode offset goes in the prefix.
+ *
+ * 7               3   2   1   0
+ * +---+---+---+---+---+---+---+---+
+ * | 0   1   0   0 | W | R | X | B |
+ * +---+---+---+---+---+---+---+---+
+ *
+ * `W` : use 64-bit operands
+ * `R` : extends `reg` in the ModR/M byte
+ * `X` : extends `index` in the SIB
+ * `B` : extends `r/m` in the ModR/M byte, `base` in the SIB, or the register added to the opcode
  */
+static uint8_t GetOpcodeOffset(TargetMachine* target, Reg_x64 reg)
+{
+  return static_cast<RegisterDef_x64*>(target->registerSet[reg])->opcodeOffset;
+}
+
+/*
+ * NOTE(Isaac): `reg` and `index` can be left as `NUM_REGISTERS` if the instruction doesn't have them. The prefix is
+ * left out entirely if it's not needed.
+ */
+static uint8_t GetREX(TargetMachine* target, bool is64Bit, Reg_x64 reg, Reg_x64 rm, Reg_x64 index = NUM_REGISTERS)
+{
+  uint8_t rex = 0b01000000;
+
+  if (is64Bit)                                                            rex |= 0b1000;
+  if (reg   != NUM_REGISTERS && (GetOpcodeOffset(target, reg)   & 0b1000))  rex |= 0b0100;
+  if (index != NUM_REGISTERS && (GetOpcodeOffset(target, index) & 0b1000))  rex |= 0b0010;
+  if (rm    != NUM_REGISTERS && (GetOpcodeOffset(target, rm)    & 0b1000))  rex |= 0b0001;
+
+  return rex;
+}
+
+static void EmitREX(ElfThing* thing, TargetMachine* target, bool is64Bit, Reg_x64 reg, Reg_x64 rm,
+                    Reg_x64 index = NUM_REGISTERS)
+{
+  uint8_t rex = GetREX(target, is64Bit, reg, rm, index);
+
+  if (rex != 0b01000000)
+  {
+    Emit<uint8_t>(thing, rex);
+  }
+}
+
+static unsigned int GetREXSize(TargetMachine* target, bool is64Bit, Reg_x64 reg, Reg_x64 rm)
+{
+  return (GetREX(target, is64Bit, reg, rm) != 0b01000000 ? 1u : 0u);
+}
+
 static void EmitRegisterModRM(ElfThing* thing, TargetMachine* target, Reg_x64 a, Reg_x64 b)
 {
   uint8_t modRM = 0b11000000; // NOTE(Isaac): use the register-direct addressing mode
-  modRM |= static_cast<RegisterDef_x64*>(target->registerSet[a])->opcodeOffset << 3u;
-  modRM |= static_cast<RegisterDef_x64*>(target->registerSet[b])->opcodeOffset;
+  modRM |= (GetOpcodeOffset(target, a) & 0b111) << 3u;
+  modRM |= (GetOpcodeOffset(target, b) & 0b111);
   Emit<uint8_t>(thing, modRM);
 }
 
+/*
+ * NOTE(Isaac): an r/m of 0b100 means an SIB follows, so RSP and R12 can only be used as a base with one (with
+ * an index of 0b100, which means no index).
+ */
+static bool NeedsSIB(TargetMachine* target, Reg_x64 base)
+{
+  return ((GetOpcodeOffset(target, base) & 0b111) == 0b100);
+}
+
+/*
+ * NOTE(Isaac): the 1-byte displacement is sign-extended, so it can be used for small negative offsets (from RBP, for
+ * example), but not for positive ones past 127.
+ */
+static bool NeedsLongDisplacement(uint32_t disp)
+{
+  int32_t signedDisp = static_cast<int32_t>(disp);
+  return (signedDisp < INT8_MIN || signedDisp > INT8_MAX);
+}
+
+/*
+ * The size of the ModR/M byte made by `EmitIndirectModRM` (with no index), along with the SIB and displacement
+ * that follow it.
+ */
+static unsigned int GetIndirectModRMSize(TargetMachine* target, Reg_x64 base, uint32_t disp)
+{
+  return 1u + (NeedsSIB(target, base) ? 1u : 0u) + (NeedsLongDisplacement(disp) ? 4u : 1u);
+}
+
 /*
  * NOTE(Isaac): `scale` may be 1, 2, 4 or 8. If left out, no SIB is created.
  */
@@ -58,18 +136,20 @@ static void EmitIndirectModRM(ElfThing* thing, TargetMachine* target, Reg_x64 re
                               Reg_x64 index = NUM_REGISTERS, unsigned int scale = 0u)
 {
   uint8_t modRM = 0u;
-  modRM |= static_cast<RegisterDef_x64*>(target->registerSet[reg])->opcodeOffset << 3u;
+  modRM |= (GetOpcodeOffset(target, reg) & 0b111) << 3u;
 
-  if (scale == 0u)
+  bool needsSIB = (scale != 0u || NeedsSIB(target, base));
+
+  if (needsSIB)
   {
-    modRM |= static_cast<RegisterDef_x64*>(target->registerSet[base])->opcodeOffset;
+    modRM |= 0b100;
   }
   else
   {
-    modRM |= 0b100;
+    modRM |= (GetOpcodeOffset(target, base) & 0b111);
   }
 
-  if (disp>= ((2u<<7u)-1u))
+  if (NeedsLongDisplacement(disp))
   {
     modRM |= 0b10000000;  // NOTE(Isaac): we need four bytes for the displacement
   }
@@ -86,12 +166,16 @@ static void EmitIndirectModRM(ElfThing* thing, TargetMachine* target, Reg_x64 re
 
     // NOTE(Isaac): taking the base-2 log of the scale gives the correct bit sequence... because magic
     sib |= static_cast<uint8_t>(log2(scale)) << 6u;
-    sib |= static_cast<RegisterDef_x64*>(target->registerSet[index])->opcodeOffset << 3u;
-    sib |= static_cast<RegisterDef_x64*>(target->registerSet[base])->opcodeOffset;
+    sib |= (GetOpcodeOffset(target, index) & 0b111) << 3u;
+    sib |= (GetOpcodeOffset(target, base) & 0b111);
     Emit<uint8_t>(thing, sib);
   }
+  else if (needsSIB)
+  {
+    Emit<uint8_t>(thing, 0b00100000 | (GetOpcodeOffset(target, base) & 0b111));
+  }
 
-  if (disp >= ((2u<<7u)-1u))
+  if (NeedsLongDisplacement(disp))
   {
     Emit<uint32_t>(thing, disp);
   }
@@ -105,75 +189,285 @@ static void EmitExtensionModRM(ElfThing* thing, TargetMachine* target, uint8_t e
 {
   uint8_t modRM = 0b11000000;  // NOTE(Isaac): register-direct addressing mode
   modRM |= extension << 3u;
-  modRM |= static_cast<RegisterDef_x64*>(target->registerSet[r])->opcodeOffset;
+  modRM |= (GetOpcodeOffset(target, r) & 0b111);
   Emit<uint8_t>(thing, modRM);
 }
 
-void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I instruction, ...)
+enum class OperandForm
+{
+  NONE,
+  REG,
+  REG_REG,
+  REG_IMM,
+  REG_MEM,
+  MEM_IMM,
+  MEM_REG,
+  IMM,
+  JUMP,
+  LABEL,
+};
+
+static OperandForm GetOperandForm(I opcode)
 {
-  va_list args;
-  va_start(args, instruction);
+  switch (opcode)
+  {
+    case I::LEAVE:
+    case I::RET:
+    {
+      return OperandForm::NONE;
+    }
+
+    case I::PUSH_REG:
+    case I::POP_REG:
+    case I::INC_REG:
+    case I::DEC_REG:
+    case I::NOT_REG:
+    case I::NEG_REG:
+    {
+      return OperandForm::REG;
+    }
+
+    case I::CMP_REG_REG:
+    case I::ADD_REG_REG:
+    case I::SUB_REG_REG:
+    case I::MUL_REG_REG:
+    case I::DIV_REG_REG:
+    case I::XOR_REG_REG:
+    case I::MOV_REG_REG:
+    {
+      return OperandForm::REG_REG;
+    }
+
+    case I::CMP_REG_IMM32:
+    case I::ADD_REG_IMM32:
+    case I::SUB_REG_IMM32:
+    case I::MUL_REG_IMM32:
+    case I::DIV_REG_IMM32:
+    case I::MOV_REG_IMM32:
+    case I::MOV_REG_IMM64:
+    case I::SHL_REG_IMM8:
+    {
+      return OperandForm::REG_IMM;
+    }
+
+    case I::MOV_REG_BASE_DISP:
+    {
+      return OperandForm::REG_MEM;
+    }
+
+    case I::MOV_BASE_DISP_IMM32:
+    case I::MOV_BASE_DISP_IMM64:
+    {
+      return OperandForm::MEM_IMM;
+    }
+
+    case I::MOV_BASE_DISP_REG:
+    {
+      return OperandForm::MEM_REG;
+    }
+
+    case I::CALL32:
+    case I::INT_IMM8:
+    {
+      return OperandForm::IMM;
+    }
+
+    case I::JMP:
+    case I::JE:
+    case I::JNE:
+    case I::JO:
+    case I::JNO:
+    case I::JS:
+    case I::JNS:
+    case I::JG:
+    case I::JGE:
+    case I::JL:
+    case I::JLE:
+    case I::JPE:
+    case I::JPO:
+    {
+      return OperandForm::JUMP;
+    }
 
-  switch (instruction)
+    case I::LABEL:
+    {
+      return OperandForm::LABEL;
+    }
+  }
+
+  __builtin_unreachable();
+}
+
+MachineInstr::MachineInstr(I opcode)
+  :opcode(opcode)
+  ,a(NUM_REGISTERS)
+  ,b(NUM_REGISTERS)
+  ,disp(0u)
+  ,imm(0u)
+  ,relocationType(ElfRelocation::Type::R_X86_64_PC32)
+  ,symbol(nullptr)
+  ,addend(0)
+  ,label(nullptr)
+  ,isShortJump(false)
+{
+}
+
+MachineInstr MachineInstr::None(I opcode)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::NONE, "Opcode takes operands");
+  return MachineInstr(opcode);
+}
+
+MachineInstr MachineInstr::Reg(I opcode, Reg_x64 a)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::REG, "Opcode doesn't take a single register");
+  MachineInstr instr(opcode);
+  instr.a = a;
+  return instr;
+}
+
+MachineInstr MachineInstr::RegReg(I opcode, Reg_x64 a, Reg_x64 b)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::REG_REG, "Opcode doesn't take two registers");
+  MachineInstr instr(opcode);
+  instr.a = a;
+  instr.b = b;
+  return instr;
+}
+
+MachineInstr MachineInstr::RegImm(I opcode, Reg_x64 a, uint64_t imm)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::REG_IMM, "Opcode doesn't take a register and an immediate");
+  MachineInstr instr(opcode);
+  instr.a = a;
+  instr.imm = imm;
+  return instr;
+}
+
+MachineInstr MachineInstr::RegMem(I opcode, Reg_x64 a, Reg_x64 base, uint32_t disp)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::REG_MEM, "Opcode doesn't take a register and a memory operand");
+  MachineInstr instr(opcode);
+  instr.a = a;
+  instr.b = base;
+  instr.disp = disp;
+  return instr;
+}
+
+MachineInstr MachineInstr::MemImm(I opcode, Reg_x64 base, uint32_t disp, uint64_t imm)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::MEM_IMM, "Opcode doesn't take a memory operand and an immediate");
+  MachineInstr instr(opcode);
+  instr.b = base;
+  instr.disp = disp;
+  instr.imm = imm;
+  return instr;
+}
+
+MachineInstr MachineInstr::MemReg(I opcode, Reg_x64 base, uint32_t disp, Reg_x64 a)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::MEM_REG, "Opcode doesn't take a memory operand and a register");
+  MachineInstr instr(opcode);
+  instr.a = a;
+  instr.b = base;
+  instr.disp = disp;
+  return instr;
+}
+
+MachineInstr MachineInstr::Imm(I opcode, uint64_t imm)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::IMM, "Opcode doesn't take a single immediate");
+  MachineInstr instr(opcode);
+  instr.imm = imm;
+  return instr;
+}
+
+MachineInstr MachineInstr::Jump(I opcode, LabelInstruction* label)
+{
+  Assert(GetOperandForm(opcode) == OperandForm::JUMP, "Opcode isn't a jump");
+  MachineInstr instr(opcode);
+  instr.label = label;
+  return instr;
+}
+
+MachineInstr MachineInstr::Label(LabelInstruction* label)
+{
+  MachineInstr instr(I::LABEL);
+  instr.label = label;
+  return instr;
+}
+
+static void EncodeInstr(ErrorState* errorState, ElfFile& file, ElfThing* thing, TargetMachine* target,
+                        const MachineInstr& instr)
+{
+  switch (instr.opcode)
   {
     case I::CMP_REG_REG:
     {
-      Reg_x64 op1 = static_cast<Reg_x64>(va_arg(args, int));
-      Reg_x64 op2 = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 op1 = instr.a;
+      Reg_x64 op2 = instr.b;
 
+      // NOTE(Isaac): this form does `r/m - reg`, so the first operand goes in `r/m`
+      EmitREX(thing, target, false, op2, op1);
       Emit<uint8_t>(thing, 0x39);
-      EmitRegisterModRM(thing, target, op1, op2);
+      EmitRegisterModRM(thing, target, op2, op1);
     } break;
 
-    case I::CMP_RAX_IMM32:
+    case I::CMP_REG_IMM32:
     {
-      uint32_t imm = va_arg(args, uint32_t);
+      Reg_x64 r = instr.a;
+      uint32_t imm = static_cast<uint32_t>(instr.imm);
 
-      Emit<uint8_t>(thing, 0x3D);
+      EmitREX(thing, target, false, NUM_REGISTERS, r);
+      Emit<uint8_t>(thing, 0x81);
+      EmitExtensionModRM(thing, target, 7u, r);
       Emit<uint32_t>(thing, imm);
     } break;
 
     case I::PUSH_REG:
     {
-      Reg_x64 r = static_cast<Reg_x64>(va_arg(args, int));
-      Emit<uint8_t>(thing, 0x50 + static_cast<RegisterDef_x64*>(target->registerSet[r])->opcodeOffset);
+      Reg_x64 r = instr.a;
+      EmitREX(thing, target, false, NUM_REGISTERS, r);
+      Emit<uint8_t>(thing, 0x50 + (GetOpcodeOffset(target, r) & 0b111));
     } break;
 
     case I::POP_REG:
     {
-      Reg_x64 r = static_cast<Reg_x64>(va_arg(args, int));
-      Emit<uint8_t>(thing, 0x58 + static_cast<RegisterDef_x64*>(target->registerSet[r])->opcodeOffset);
+      Reg_x64 r = instr.a;
+      EmitREX(thing, target, false, NUM_REGISTERS, r);
+      Emit<uint8_t>(thing, 0x58 + (GetOpcodeOffset(target, r) & 0b111));
     } break;
 
     case I::ADD_REG_REG:
     {
-      Reg_x64 dest  = static_cast<Reg_x64>(va_arg(args, int));
-      Reg_x64 src   = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 dest  = instr.a;
+      Reg_x64 src   = instr.b;
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, src, dest);
       Emit<uint8_t>(thing, 0x01);
       EmitRegisterModRM(thing, target, src, dest);
     } break;
 
     case I::SUB_REG_REG:
     {
-      Reg_x64 dest = static_cast<Reg_x64>(va_arg(args, int));
-      Reg_x64 src  = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 dest = instr.a;
+      Reg_x64 src  = instr.b;
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, src, dest);
       Emit<uint8_t>(thing, 0x29);
       EmitRegisterModRM(thing, target, src, dest);
     } break;
 
     case I::MUL_REG_REG:
     {
-      Reg_x64 dest = static_cast<Reg_x64>(va_arg(args, int));
-      Reg_x64 src  = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 dest = instr.a;
+      Reg_x64 src  = instr.b;
 
-      Emit<uint8_t>(thing, 0x48);
+      // NOTE(Isaac): unlike the other arithmetic, IMUL puts its result in `reg`, rather than `r/m`
+      EmitREX(thing, target, true, dest, src);
       Emit<uint8_t>(thing, 0x0f);
       Emit<uint8_t>(thing, 0xaf);
-      EmitRegisterModRM(thing, target, src, dest);
+      EmitRegisterModRM(thing, target, dest, src);
     } break;
 
     case I::DIV_REG_REG:
@@ -184,20 +478,20 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::XOR_REG_REG:
     {
-      Reg_x64 dest = static_cast<Reg_x64>(va_arg(args, int));
-      Reg_x64 src  = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 dest = instr.a;
+      Reg_x64 src  = instr.b;
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, src, dest);
       Emit<uint8_t>(thing, 0x31);
       EmitRegisterModRM(thing, target, src, dest);
     } break;
 
     case I::ADD_REG_IMM32:
     {
-      Reg_x64 result = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t imm = va_arg(args, uint32_t);
+      Reg_x64 result = instr.a;
+      uint32_t imm = static_cast<uint32_t>(instr.imm);
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, NUM_REGISTERS, result);
       Emit<uint8_t>(thing, 0x81);
       EmitExtensionModRM(thing, target, 0u, result);
       Emit<uint32_t>(thing, imm);
@@ -205,10 +499,10 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::SUB_REG_IMM32:
     {
-      Reg_x64 result = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t imm = va_arg(args, uint32_t);
+      Reg_x64 result = instr.a;
+      uint32_t imm = static_cast<uint32_t>(instr.imm);
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, NUM_REGISTERS, result);
       Emit<uint8_t>(thing, 0x81);
       EmitExtensionModRM(thing, target, 5u, result);
       Emit<uint32_t>(thing, imm);
@@ -216,15 +510,15 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::MUL_REG_IMM32:
     {
-      Reg_x64 result = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t imm = va_arg(args, uint32_t);
+      Reg_x64 result = instr.a;
+      uint32_t imm = static_cast<uint32_t>(instr.imm);
 
       if (imm >= 256u)
       {
         RaiseError(errorState, ICE_GENERIC, "Multiplication is only supported with byte-wide immediates");
       }
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, result, result);
       Emit<uint8_t>(thing, 0x6b);
       EmitRegisterModRM(thing, target, result, result);
       Emit<uint8_t>(thing, static_cast<uint8_t>(imm));
@@ -237,50 +531,52 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::MOV_REG_REG:
     {
-      Reg_x64 dest = static_cast<Reg_x64>(va_arg(args, int));
-      Reg_x64 src  = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 dest = instr.a;
+      Reg_x64 src  = instr.b;
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, src, dest);
       Emit<uint8_t>(thing, 0x89);
       EmitRegisterModRM(thing, target, src, dest);
     } break;
 
     case I::MOV_REG_IMM32:
     {
-      Reg_x64 dest = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t imm = va_arg(args, uint32_t);
+      Reg_x64 dest = instr.a;
+      uint32_t imm = static_cast<uint32_t>(instr.imm);
 
-      Emit<uint8_t>(thing, 0xB8 + static_cast<RegisterDef_x64*>(target->registerSet[dest])->opcodeOffset);
+      EmitREX(thing, target, false, NUM_REGISTERS, dest);
+      Emit<uint8_t>(thing, 0xB8 + (GetOpcodeOffset(target, dest) & 0b111));
       Emit<uint32_t>(thing, imm);
     } break;
 
     case I::MOV_REG_IMM64:
     {
-      Reg_x64 dest = static_cast<Reg_x64>(va_arg(args, int));
-      uint64_t imm = va_arg(args, uint64_t);
+      Reg_x64 dest = instr.a;
+      uint64_t imm = instr.imm;
 
-      Emit<uint8_t>(thing, 0x48);
-      Emit<uint8_t>(thing, 0xB8 + static_cast<RegisterDef_x64*>(target->registerSet[dest])->opcodeOffset);
+      EmitREX(thing, target, true, NUM_REGISTERS, dest);
+      Emit<uint8_t>(thing, 0xB8 + (GetOpcodeOffset(target, dest) & 0b111));
       Emit<uint64_t>(thing, imm);
     } break;
 
     case I::MOV_REG_BASE_DISP:
     {
-      Reg_x64 dest = static_cast<Reg_x64>(va_arg(args, int));
-      Reg_x64 base = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t displacement = va_arg(args, uint32_t);
+      Reg_x64 dest = instr.a;
+      Reg_x64 base = instr.b;
+      uint32_t displacement = instr.disp;
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, dest, base);
       Emit<uint8_t>(thing, 0x8B);
       EmitIndirectModRM(thing, target, dest, base, displacement);
     } break;
 
     case I::MOV_BASE_DISP_IMM32:
     {
-      Reg_x64 base = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t displacement = va_arg(args, uint32_t);
-      uint32_t imm = va_arg(args, uint32_t);
+      Reg_x64 base = instr.b;
+      uint32_t displacement = instr.disp;
+      uint32_t imm = static_cast<uint32_t>(instr.imm);
 
+      EmitREX(thing, target, false, NUM_REGISTERS, base);
       Emit<uint8_t>(thing, 0xC7);
       EmitIndirectModRM(thing, target, (Reg_x64)0u, base, displacement);
       Emit<uint32_t>(thing, imm);
@@ -288,11 +584,11 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::MOV_BASE_DISP_IMM64:
     {
-      Reg_x64 base = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t displacement = va_arg(args, uint32_t);
-      uint64_t imm = va_arg(args, uint64_t);
+      Reg_x64 base = instr.b;
+      uint32_t displacement = instr.disp;
+      uint64_t imm = instr.imm;
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, NUM_REGISTERS, base);
       Emit<uint8_t>(thing, 0xC7);
       EmitIndirectModRM(thing, target, (Reg_x64)0u, base, displacement);
       Emit<uint64_t>(thing, imm);
@@ -300,50 +596,65 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::MOV_BASE_DISP_REG:
     {
-      Reg_x64 base = static_cast<Reg_x64>(va_arg(args, int));
-      uint32_t displacement = va_arg(args, uint32_t);
-      Reg_x64 src = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 base = instr.b;
+      uint32_t displacement = instr.disp;
+      Reg_x64 src = instr.a;
 
-      Emit<uint8_t>(thing, 0x48);
+      EmitREX(thing, target, true, src, base);
       Emit<uint8_t>(thing, 0x89);
       EmitIndirectModRM(thing, target, src, base, displacement);
     } break;
 
     case I::INC_REG:
     {
-      Reg_x64 r = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 r = instr.a;
 
+      EmitREX(thing, target, false, NUM_REGISTERS, r);
       Emit<uint8_t>(thing, 0xFF);
       EmitExtensionModRM(thing, target, 0u, r);
     } break;
 
     case I::DEC_REG:
     {
-      Reg_x64 r = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 r = instr.a;
 
+      EmitREX(thing, target, false, NUM_REGISTERS, r);
       Emit<uint8_t>(thing, 0xFF);
       EmitExtensionModRM(thing, target, 1u, r);
     } break;
 
     case I::NOT_REG:
     {
-      Reg_x64 r = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 r = instr.a;
 
+      EmitREX(thing, target, false, NUM_REGISTERS, r);
       Emit<uint8_t>(thing, 0xF7);
       EmitExtensionModRM(thing, target, 2u, r);
     } break;
 
     case I::NEG_REG:
     {
-      Reg_x64 r = static_cast<Reg_x64>(va_arg(args, int));
+      Reg_x64 r = instr.a;
 
+      EmitREX(thing, target, false, NUM_REGISTERS, r);
       Emit<uint8_t>(thing, 0xF7);
       EmitExtensionModRM(thing, target, 3u, r);
     } break;
 
+    case I::SHL_REG_IMM8:
+    {
+      Reg_x64 r = instr.a;
+      uint8_t imm = static_cast<uint8_t>(instr.imm);
+
+      EmitREX(thing, target, true, NUM_REGISTERS, r);
+      Emit<uint8_t>(thing, 0xC1);
+      EmitExtensionModRM(thing, target, 4u, r);
+      Emit<uint8_t>(thing, imm);
+    } break;
+
     case I::CALL32:
     {
-      uint32_t offset = va_arg(args, uint32_t);
+      uint32_t offset = static_cast<uint32_t>(instr.imm);
 
       Emit<uint8_t>(thing, 0xE8);
       Emit<uint32_t>(thing, offset);
@@ -351,7 +662,7 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::INT_IMM8:
     {
-      uint8_t intNumber = static_cast<uint8_t>(va_arg(args, int));
+      uint8_t intNumber = static_cast<uint8_t>(instr.imm);
 
       Emit<uint8_t>(thing, 0xCD);
       Emit<uint8_t>(thing, intNumber);
@@ -369,10 +680,16 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
 
     case I::JMP:
     {
-      uint32_t relAddress = va_arg(args, uint32_t);
-
-      Emit<uint8_t>(thing, 0xE9);
-      Emit<uint32_t>(thing, relAddress);
+      if (instr.isShortJump)
+      {
+        Emit<uint8_t>(thing, 0xEB);
+        Emit<uint8_t>(thing, static_cast<uint8_t>(instr.label->offset - (thing->length + 1u)));
+      }
+      else
+      {
+        Emit<uint8_t>(thing, 0xE9);
+        Emit<uint32_t>(thing, static_cast<uint32_t>(instr.label->offset - (thing->length + 4u)));
+      }
     } break;
 
     case I::JE:
@@ -390,13 +707,147 @@ void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I inst
     {
       //                               JE    JNE   JO    JNO   JS    JNS   JG    JGE   JL    JLE   JPE   JPO
       static const uint8_t jumps[] = { 0x84, 0x85, 0x80, 0x81, 0x88, 0x89, 0x8F, 0x8D, 0x8C, 0x8E, 0x8A, 0x8B };
+      uint8_t opcode = jumps[static_cast<unsigned int>(instr.opcode) - static_cast<unsigned int>(I::JE)];
 
-      uint32_t relAddress = va_arg(args, uint32_t);
-      Emit<uint8_t>(thing, 0x0F);
-      Emit<uint8_t>(thing, jumps[static_cast<unsigned int>(instruction) - static_cast<unsigned int>(I::JE)]);
-      Emit<uint32_t>(thing, relAddress);
+      // NOTE(Isaac): the short forms are the same, but 0x10 lower and without the 0x0F escape
+      if (instr.isShortJump)
+      {
+        Emit<uint8_t>(thing, opcode - 0x10);
+        Emit<uint8_t>(thing, static_cast<uint8_t>(instr.label->offset - (thing->length + 1u)));
+      }
+      else
+      {
+        Emit<uint8_t>(thing, 0x0F);
+        Emit<uint8_t>(thing, opcode);
+        Emit<uint32_t>(thing, static_cast<uint32_t>(instr.label->offset - (thing->length + 4u)));
+      }
+    } break;
+
+    case I::LABEL:
+    {
+      Assert(instr.label->offset == thing->length, "Label has moved since the jumps were relaxed");
     } break;
   }
 
-  va_end(args);
+  // The relocated offset or immediate is always at the end of the instruction
+  if (instr.symbol)
+  {
+    unsigned int size = (instr.relocationType == ElfRelocation::Type::R_X86_64_64 ? sizeof(uint64_t) :
+                                                                                    sizeof(uint32_t));
+    new ElfRelocation(file, thing, thing->length - size, instr.relocationType, instr.symbol, instr.addend);
+  }
+}
+
+
+/*
+ * NOTE(Isaac): this has to be kept in step with `EncodeInstr`.
+ */
+static unsigned int GetInstrSize(TargetMachine* target, const MachineInstr& instr)
+{
+  switch (instr.opcode)
+  {
+    case I::CMP_REG_REG:          return GetREXSize(target, false, instr.a, instr.b) + 2u;
+    case I::CMP_REG_IMM32:        return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 6u;
+    case I::PUSH_REG:             return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 1u;
+    case I::POP_REG:              return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 1u;
+    case I::ADD_REG_REG:          return 3u;
+    case I::SUB_REG_REG:          return 3u;
+    case I::MUL_REG_REG:          return 4u;
+    case I::DIV_REG_REG:          return 0u;
+    case I::XOR_REG_REG:          return 3u;
+    case I::ADD_REG_IMM32:        return 7u;
+    case I::SUB_REG_IMM32:        return 7u;
+    case I::MUL_REG_IMM32:        return 4u;
+    case I::DIV_REG_IMM32:        return 0u;
+    case I::MOV_REG_REG:          return 3u;
+    case I::MOV_REG_IMM32:        return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 5u;
+    case I::MOV_REG_IMM64:        return 10u;
+    case I::MOV_REG_BASE_DISP:    return 2u + GetIndirectModRMSize(target, instr.b, instr.disp);
+    case I::MOV_BASE_DISP_IMM32:  return GetREXSize(target, false, NUM_REGISTERS, instr.b) + 1u +
+                                         GetIndirectModRMSize(target, instr.b, instr.disp) + 4u;
+    case I::MOV_BASE_DISP_IMM64:  return 2u + GetIndirectModRMSize(target, instr.b, instr.disp) + 8u;
+    case I::MOV_BASE_DISP_REG:    return 2u + GetIndirectModRMSize(target, instr.b, instr.disp);
+    case I::INC_REG:              return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 2u;
+    case I::DEC_REG:              return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 2u;
+    case I::NOT_REG:              return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 2u;
+    case I::NEG_REG:              return GetREXSize(target, false, NUM_REGISTERS, instr.a) + 2u;
+    case I::SHL_REG_IMM8:         return 4u;
+    case I::CALL32:               return 5u;
+    case I::INT_IMM8:             return 2u;
+    case I::LEAVE:                return 1u;
+    case I::RET:                  return 1u;
+    case I::JMP:                  return (instr.isShortJump ? 2u : 5u);
+    case I::JE:
+    case I::JNE:
+    case I::JO:
+    case I::JNO:
+    case I::JS:
+    case I::JNS:
+    case I::JG:
+    case I::JGE:
+    case I::JL:
+    case I::JLE:
+    case I::JPE:
+    case I::JPO:                  return (instr.isShortJump ? 2u : 6u);
+    case I::LABEL:                return 0u;
+  }
+
+  __builtin_unreachable();
+}
+
+void RelaxJumps(TargetMachine* target, std::vector<MachineInstr>& instrs)
+{
+  for (MachineInstr& instr : instrs)
+  {
+    instr.isShortJump = (GetOperandForm(instr.opcode) == OperandForm::JUMP);
+  }
+
+  std::vector<uint64_t> offsets(instrs.size());
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+
+    // Lay out the instructions with the current forms of the jumps
+    uint64_t offset = 0u;
+    for (unsigned int i = 0u;
+         i < instrs.size();
+         i++)
+    {
+      if (instrs[i].opcode == I::LABEL)
+      {
+        instrs[i].label->offset = offset;
+      }
+
+      offsets[i] = offset;
+      offset += GetInstrSize(target, instrs[i]);
+    }
+
+    // Lengthen the short jumps that don't reach their labels
+    for (unsigned int i = 0u;
+         i < instrs.size();
+         i++)
+    {
+      if (!(instrs[i].isShortJump))
+      {
+        continue;
+      }
+
+      int64_t jump = static_cast<int64_t>(instrs[i].label->offset) - static_cast<int64_t>(offsets[i] + 2u);
+      if (jump < INT8_MIN || jump > INT8_MAX)
+      {
+        instrs[i].isShortJump = false;
+        changed = true;
+      }
+    }
+  }
+}
+
+void Encode(ErrorState* errorState, ElfFile& file, ElfThing* thing, TargetMachine* target,
+            const std::vector<MachineInstr>& instrs)
+{
+  for (const MachineInstr& instr : instrs)
+  {
+    EncodeInstr(errorState, file, thing, target, instr);
+  }
 }
@@ -5,11 +5,11 @@
 
 #pragma once
 
+#include <vector>
 #include <ir.hpp>
 #include <error.hpp>
 #include <x64/x64.hpp>
-
-struct ElfThing;
+#include <elf/elf.hpp>
 
 /*
  * +r - add an register opcode offset to the primary opcode
@@ -19,7 +19,7 @@ struct ElfThing;
 enum class I
 {
   CMP_REG_REG,          // (ModR/M)
-  CMP_RAX_IMM32,        // (4-byte immediate)
+  CMP_REG_IMM32,        // (ModR/M [extension]) (4-byte immediate)
   PUSH_REG,             // +r
   POP_REG,              // +r
   ADD_REG_REG,          // [opcodeSize] (ModR/M)
@@ -42,23 +42,82 @@ enum class I
   DEC_REG,              // (ModR/M [extension])
   NOT_REG,              // (ModR/M [extension])
   NEG_REG,              // (ModR/M [extension])
+  SHL_REG_IMM8,         // (ModR/M [extension]) (1-byte immediate)
   CALL32,               // (4-byte offset to RIP)
   INT_IMM8,             // (1-byte immediate)
   LEAVE,
   RET,
-  JMP,                  // (4-byte offset to RIP)
-  JE,                   // (4-byte offset to RIP)
-  JNE,                  // (4-byte offset to RIP)
-  JO,                   // (4-byte offset to RIP)
-  JNO,                  // (4-byte offset to RIP)
-  JS,                   // (4-byte offset to RIP)
-  JNS,                  // (4-byte offset to RIP)
-  JG,                   // (4-byte offset to RIP)
-  JGE,                  // (4-byte offset to RIP)
-  JL,                   // (4-byte offset to RIP)
-  JLE,                  // (4-byte offset to RIP)
-  JPE,                  // (4-byte offset to RIP)
-  JPO,                  // (4-byte offset to RIP)
+  JMP,                  // (1-byte or 4-byte offset to RIP)
+  JE,                   // (1-byte or 4-byte offset to RIP)
+  JNE,                  // (1-byte or 4-byte offset to RIP)
+  JO,                   // (1-byte or 4-byte offset to RIP)
+  JNO,                  // (1-byte or 4-byte offset to RIP)
+  JS,                   // (1-byte or 4-byte offset to RIP)
+  JNS,                  // (1-byte or 4-byte offset to RIP)
+  JG,                   // (1-byte or 4-byte offset to RIP)
+  JGE,                  // (1-byte or 4-byte offset to RIP)
+  JL,                   // (1-byte or 4-byte offset to RIP)
+  JLE,                  // (1-byte or 4-byte offset to RIP)
+  JPE,                  // (1-byte or 4-byte offset to RIP)
+  JPO,                  // (1-byte or 4-byte offset to RIP)
+
+  LABEL,                // Not a real instruction - marks where a label is
+};
+
+/*
+ * An instruction that's been picked by the code generator, but not yet encoded. The code generator builds a list
+ * of these for each function, so they can be improved by the peephole optimizer before being turned into bytes.
+ * Which fields are used depends on the form of the opcode's operands - instructions should be made with the
+ * constructor for that form, which checks that it fits the opcode.
+ */
+struct MachineInstr
+{
+  static MachineInstr None(I opcode);
+  static MachineInstr Reg(I opcode, Reg_x64 a);
+  static MachineInstr RegReg(I opcode, Reg_x64 a, Reg_x64 b);
+  static MachineInstr RegImm(I opcode, Reg_x64 a, uint64_t imm);
+  static MachineInstr RegMem(I opcode, Reg_x64 a, Reg_x64 base, uint32_t disp);
+  static MachineInstr MemImm(I opcode, Reg_x64 base, uint32_t disp, uint64_t imm);
+  static MachineInstr MemReg(I opcode, Reg_x64 base, uint32_t disp, Reg_x64 a);
+  static MachineInstr Imm(I opcode, uint64_t imm);
+  static MachineInstr Jump(I opcode, LabelInstruction* label);
+  static MachineInstr Label(LabelInstruction* label);
+
+  I         opcode;
+  Reg_x64   a;        // The first register operand (the destination, or the source of a store)
+  Reg_x64   b;        // The second register operand (the source, or the base of a memory operand)
+  uint32_t  disp;
+  uint64_t  imm;
+
+  /*
+   * If `symbol` isn't null, a relocation is made against it once the instruction has been encoded, to fill in
+   * the offset or immediate at the end of the instruction. Jumps go to `label`, which is in the same thing, and
+   * LABELs mark where it is.
+   */
+  ElfRelocation::Type     relocationType;
+  ElfSymbol*              symbol;
+  int64_t                 addend;
+  LabelInstruction*       label;
+
+  bool                    isShortJump;  // Whether a jump uses the form with a 1-byte offset (see `RelaxJumps`)
+
+private:
+  MachineInstr(I opcode);
 };
 
-void Emit(ErrorState* errorState, ElfThing* thing, TargetMachine* target, I instruction, ...);
+/*
+ * Picks which form each jump should use, and works out the offset of each label from the start of the
+ * instructions. Jumps are encoded with a 1-byte offset (2 bytes in all) where it's in range, and a 4-byte offset
+ * (5 or 6 bytes) where it isn't. Making a jump longer can push other jumps out of range, so we start with every
+ * jump short, and lengthen the ones that don't reach until none need to be. Jumps only ever get longer, so this
+ * always finishes.
+ */
+void RelaxJumps(TargetMachine* target, std::vector<MachineInstr>& instrs);
+
+/*
+ * Encodes the given instructions, in order, into an empty thing (label offsets are from the start of it). This is
+ * the last step of code generation, and only ever goes over the instructions once. Jumps are to labels in the same
+ * thing, so their offsets are filled in here from the ones worked out by `RelaxJumps`, rather than by relocations.
+ */
+void Encode(ErrorState* errorState, ElfFile& file, ElfThing* thing, TargetMachine* target,
+            const std::vector<MachineInstr>& instrs);
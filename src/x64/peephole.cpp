@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <x64/peephole.hpp>
+#include <cstdio>
+#include <cstring>
+
+static bool IsConditionalJump(I opcode)
+{
+  return (opcode >= I::JE && opcode <= I::JPO);
+}
+
+static bool IsMove(I opcode)
+{
+  switch (opcode)
+  {
+    case I::MOV_REG_REG:
+    case I::MOV_REG_IMM32:
+    case I::MOV_REG_IMM64:
+    case I::MOV_REG_BASE_DISP:
+    case I::MOV_BASE_DISP_IMM32:
+    case I::MOV_BASE_DISP_IMM64:
+    case I::MOV_BASE_DISP_REG:
+    {
+      return true;
+    }
+
+    default:
+    {
+      return false;
+    }
+  }
+}
+
+/*
+ * Finds if the flags set by the instruction at `i` could be read by a later one. The code generator only reads
+ * the flags with conditional jumps just after the CMP that sets them, in the same block, so they're dead once
+ * another instruction sets them, or we leave the block.
+ */
+static bool AreFlagsRead(const std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  for (unsigned int j = i + 1u;
+       j < instrs.size();
+       j++)
+  {
+    I opcode = instrs[j].opcode;
+
+    if (!IsMove(opcode) && opcode != I::PUSH_REG && opcode != I::POP_REG && opcode != I::NOT_REG &&
+        opcode != I::LEAVE)
+    {
+      return IsConditionalJump(opcode);
+    }
+  }
+
+  return false;
+}
+
+/*
+ * mov a, a
+ */
+static bool RemoveSelfMove(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  if (instrs[i].opcode == I::MOV_REG_REG && instrs[i].a == instrs[i].b)
+  {
+    instrs.erase(instrs.begin() + i);
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * mov a, b       =>    mov a, b
+ * mov b, a
+ */
+static bool RemoveMoveBack(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  if ((i + 1u) < instrs.size() && instrs[i].opcode == I::MOV_REG_REG && instrs[i + 1u].opcode == I::MOV_REG_REG &&
+      instrs[i].a == instrs[i + 1u].b && instrs[i].b == instrs[i + 1u].a)
+  {
+    instrs.erase(instrs.begin() + i + 1u);
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * push a         =>    (nothing)
+ * pop a
+ *
+ * NOTE(Isaac): we don't do the opposite (a register restored after one call and saved again before the next),
+ * because the second call may take its parameters in that register, and so need it restored first.
+ */
+static bool RemovePushPop(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  if ((i + 1u) < instrs.size() && instrs[i].opcode == I::PUSH_REG && instrs[i + 1u].opcode == I::POP_REG &&
+      instrs[i].a == instrs[i + 1u].a)
+  {
+    instrs.erase(instrs.begin() + i, instrs.begin() + i + 2u);
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * add a, n       =>    (moves)
+ * (moves)
+ * sub a, n
+ *
+ * This happens when the stack is padded for one call, and then again for the next. The moves in between can be
+ * left where they are, as long as they don't use `a`.
+ */
+static bool RemoveCancellingAdjustments(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  I opposite;
+  switch (instrs[i].opcode)
+  {
+    case I::ADD_REG_IMM32:  opposite = I::SUB_REG_IMM32; break;
+    case I::SUB_REG_IMM32:  opposite = I::ADD_REG_IMM32; break;
+    default:                return false;
+  }
+
+  for (unsigned int j = i + 1u;
+       j < instrs.size();
+       j++)
+  {
+    if (instrs[j].opcode == opposite && instrs[j].a == instrs[i].a && instrs[j].imm == instrs[i].imm)
+    {
+      if (AreFlagsRead(instrs, j))
+      {
+        return false;
+      }
+
+      instrs.erase(instrs.begin() + j);
+      instrs.erase(instrs.begin() + i);
+      return true;
+    }
+
+    if (!IsMove(instrs[j].opcode) || instrs[j].a == instrs[i].a || instrs[j].b == instrs[i].a)
+    {
+      return false;
+    }
+  }
+
+  return false;
+}
+
+/*
+ * add a, 0       =>    (nothing)
+ */
+static bool RemoveZeroAdjustment(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  if ((instrs[i].opcode == I::ADD_REG_IMM32 || instrs[i].opcode == I::SUB_REG_IMM32) && instrs[i].imm == 0u &&
+      !AreFlagsRead(instrs, i))
+  {
+    instrs.erase(instrs.begin() + i);
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * jmp .label     =>    .label:
+ * .label:
+ */
+static bool RemoveJumpToNext(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  if (instrs[i].opcode != I::JMP && !IsConditionalJump(instrs[i].opcode))
+  {
+    return false;
+  }
+
+  for (unsigned int j = i + 1u;
+       j < instrs.size() && instrs[j].opcode == I::LABEL;
+       j++)
+  {
+    if (instrs[j].label == instrs[i].label)
+    {
+      instrs.erase(instrs.begin() + i);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ * imul a, a, 1   =>    (nothing)
+ * imul a, a, 2^n =>    shl a, n
+ */
+static bool ReduceMultiply(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  MachineInstr& instr = instrs[i];
+  if (instr.opcode != I::MUL_REG_IMM32 || instr.imm == 0u || (instr.imm & (instr.imm - 1u)) != 0u ||
+      AreFlagsRead(instrs, i))
+  {
+    return false;
+  }
+
+  if (instr.imm == 1u)
+  {
+    instrs.erase(instrs.begin() + i);
+    return true;
+  }
+
+  instrs[i] = MachineInstr::RegImm(I::SHL_REG_IMM8, instr.a, __builtin_ctzll(instr.imm));
+  return true;
+}
+
+/*
+ * mov a, 0       =>    xor a, a
+ *
+ * NOTE(Isaac): this changes the flags, so can't be done between a CMP and the jump that reads them.
+ */
+static bool ZeroWithXor(std::vector<MachineInstr>& instrs, unsigned int i)
+{
+  if (instrs[i].opcode == I::MOV_REG_IMM32 && instrs[i].imm == 0u && !AreFlagsRead(instrs, i))
+  {
+    instrs[i] = MachineInstr::RegReg(I::XOR_REG_REG, instrs[i].a, instrs[i].a);
+    return true;
+  }
+
+  return false;
+}
+
+struct PeepholeRule
+{
+  const char*   name;
+  bool          (*apply)(std::vector<MachineInstr>& instrs, unsigned int i);
+  unsigned int  numHits;
+};
+
+/*
+ * NOTE(Isaac): code is generated on one thread, so the hit counts don't need to be atomic.
+ */
+static PeepholeRule rules[] =
+{
+  { "Remove move to the same register",         RemoveSelfMove,              0u },
+  { "Remove move back to the source",           RemoveMoveBack,              0u },
+  { "Remove push and pop of the same register", RemovePushPop,               0u },
+  { "Remove cancelling stack adjustments",      RemoveCancellingAdjustments, 0u },
+  { "Remove adding or subtracting zero",        RemoveZeroAdjustment,        0u },
+  { "Remove jump to the next instruction",      RemoveJumpToNext,            0u },
+  { "Multiply by a power of two with a shift",  ReduceMultiply,              0u },
+  { "Zero a register with XOR",                 ZeroWithXor,                 0u },
+};
+
+void OptimizePeephole(std::vector<MachineInstr>& instrs)
+{
+  // Removing instructions can bring others together that can then be improved, so we go until nothing changes
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+
+    for (unsigned int i = 0u;
+         i < instrs.size();
+         i++)
+    {
+      for (PeepholeRule& rule : rules)
+      {
+        if (i < instrs.size() && rule.apply(instrs, i))
+        {
+          rule.numHits++;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+void PrintPeepholeStatistics()
+{
+  for (PeepholeRule& rule : rules)
+  {
+    printf("  peephole rule '%s' applied %u time(s)\n", rule.name, rule.numHits);
+  }
+}
+
+unsigned int GetNumPeepholeHits(const char* ruleName)
+{
+  for (PeepholeRule& rule : rules)
+  {
+    if (strcmp(rule.name, ruleName) == 0)
+    {
+      return rule.numHits;
+    }
+  }
+
+  return 0u;
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <vector>
+#include <x64/emitter.hpp>
+
+/*
+ * The code generator lowers each AIR instruction on its own, so the instructions it picks often don't fit together
+ * as well as they could: it leaves moves between the same register, pushes registers just to pop them straight off
+ * again, jumps to the very next instruction etc. The peephole optimizer looks over the list of instructions for a
+ * function, and tidies these up with a table of rules, each of which matches a short run of instructions. It also
+ * does some strength reduction, replacing instructions with ones that are cheaper to run or smaller to encode.
+ */
+void OptimizePeephole(std::vector<MachineInstr>& instrs);
+
+/*
+ * Prints how many times each of the rules has been applied.
+ */
+void PrintPeepholeStatistics();
+
+/*
+ * Finds how many times the rule with the given name has been applied. Returns 0 if there isn't a rule called that.
+ */
+unsigned int GetNumPeepholeHits(const char* ruleName);
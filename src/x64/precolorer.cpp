@@ -4,6 +4,7 @@
  */
 
 #include <x64/precolorer.hpp>
+#include <utility>
 #include <x64/x64.hpp>
 
 void InstructionPrecolorer_x64::Visit(LabelInstruction* /*instruction*/,     void*) { }
@@ -14,24 +15,45 @@ void InstructionPrecolorer_x64::Visit(UnaryOpInstruction* /*instruction*/,   voi
 void InstructionPrecolorer_x64::Visit(BinaryOpInstruction* /*instruction*/,  void*) { }
 void InstructionPrecolorer_x64::Visit(CallInstruction* /*instruction*/,      void*) { }
 
+void InstructionPrecolorer_x64::Visit(PhiInstruction* /*instruction*/, void*)
+{
+  RaiseError(ICE_UNHANDLED_INSTRUCTION_TYPE, "PhiInstruction",
+             "InstructionPrecolorer_x64 (SSA should have been destructed)");
+}
+
 void InstructionPrecolorer_x64::Visit(CmpInstruction* instruction, void*)
 {
   /*
    * We should be able to assume that not both of the slots are constants, otherwise the comparison should have
-   * been eliminated by the optimizer.
+   * been eliminated by constant propagation.
    */
   Assert(!(instruction->a->IsConstant() && instruction->b->IsConstant()), "Constant comparison not eliminated");
 
   /*
-   * x86 only allows us to compare a immediate against RAX, so the slot that isn't the immediate must be colored
-   * as being RAX before register allocation.
+   * We can compare any register against an immediate, but only with the immediate second, so if it's first we swap
+   * them around, and mirror the conditions of the jumps that read the result.
    */
-  if (instruction->a->IsConstant())
+  if (!(instruction->a->IsConstant()))
   {
-    instruction->b->color = RAX;
+    return;
   }
-  else if (instruction->b->IsConstant())
+
+  std::swap(instruction->a, instruction->b);
+
+  for (AirInstruction* next = instruction->next;
+       next && next->instructionType == InstructionType::JUMP;
+       next = next->next)
   {
-    instruction->a->color = RAX;
+    JumpInstruction* jump = static_cast<JumpInstruction*>(next);
+
+    switch (jump->condition)
+    {
+      case JumpInstruction::Condition::UNCONDITIONAL:       return;
+      case JumpInstruction::Condition::IF_GREATER:          jump->condition = JumpInstruction::Condition::IF_LESSER;            break;
+      case JumpInstruction::Condition::IF_GREATER_OR_EQUAL: jump->condition = JumpInstruction::Condition::IF_LESSER_OR_EQUAL;   break;
+      case JumpInstruction::Condition::IF_LESSER:           jump->condition = JumpInstruction::Condition::IF_GREATER;           break;
+      case JumpInstruction::Condition::IF_LESSER_OR_EQUAL:  jump->condition = JumpInstruction::Condition::IF_GREATER_OR_EQUAL;  break;
+      default:                                              break;
+    }
   }
 }
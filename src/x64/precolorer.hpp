@@ -20,4 +20,5 @@ struct InstructionPrecolorer_x64 : InstructionPrecolorer
   void Visit(UnaryOpInstruction* instruction,   void*);
   void Visit(BinaryOpInstruction* instruction,  void*);
   void Visit(CallInstruction* instruction,      void*);
+  void Visit(PhiInstruction* instruction,       void*);
 };
@@ -7,8 +7,9 @@
 #include <x64/precolorer.hpp>
 #include <x64/codeGenerator.hpp>
 
-RegisterDef_x64::RegisterDef_x64(BaseRegisterDef::Usage usage, const std::string& name, uint8_t opcodeOffset)
-  :BaseRegisterDef(usage, name)
+RegisterDef_x64::RegisterDef_x64(BaseRegisterDef::Usage usage, const std::string& name, bool isCalleeSaved,
+                                 uint8_t opcodeOffset)
+  :BaseRegisterDef(usage, name, isCalleeSaved)
   ,opcodeOffset(opcodeOffset)
 {
 }
@@ -28,22 +29,23 @@ TargetMachine_x64::TargetMachine_x64(ParseResult& parse)
   intParamColors[4u] = R8;
   intParamColors[5u] = R9;
 
-  registerSet[RAX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RAX", 0u);
-  registerSet[RBX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RBX", 3u);
-  registerSet[RCX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RCX", 1u);
-  registerSet[RDX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RDX", 2u);
-  registerSet[RSP] = new RegisterDef_x64(BaseRegisterDef::Usage::SPECIAL, "RSP", 4u);
-  registerSet[RBP] = new RegisterDef_x64(BaseRegisterDef::Usage::SPECIAL, "RBP", 5u);
-  registerSet[RSI] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RSI", 6u);
-  registerSet[RDI] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RDI", 7u);
-  registerSet[R8 ] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R8" , 8u);
-  registerSet[R9 ] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R9" , 9u);
-  registerSet[R10] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R10", 10u);
-  registerSet[R11] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R11", 11u);
-  registerSet[R12] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R12", 12u);
-  registerSet[R13] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R13", 13u);
-  registerSet[R14] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R14", 14u);
-  registerSet[R15] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R15", 15u);
+  // These follow the System V ABI, where RBX, RSP, RBP and R12 through R15 are preserved across calls
+  registerSet[RAX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RAX", false, 0u);
+  registerSet[RBX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RBX", true,  3u);
+  registerSet[RCX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RCX", false, 1u);
+  registerSet[RDX] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RDX", false, 2u);
+  registerSet[RSP] = new RegisterDef_x64(BaseRegisterDef::Usage::SPECIAL, "RSP", true,  4u);
+  registerSet[RBP] = new RegisterDef_x64(BaseRegisterDef::Usage::SPECIAL, "RBP", true,  5u);
+  registerSet[RSI] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RSI", false, 6u);
+  registerSet[RDI] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "RDI", false, 7u);
+  registerSet[R8 ] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R8" , false, 8u);
+  registerSet[R9 ] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R9" , false, 9u);
+  registerSet[R10] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R10", false, 10u);
+  registerSet[R11] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R11", false, 11u);
+  registerSet[R12] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R12", true,  12u);
+  registerSet[R13] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R13", true,  13u);
+  registerSet[R14] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R14", true,  14u);
+  registerSet[R15] = new RegisterDef_x64(BaseRegisterDef::Usage::GENERAL, "R15", true,  15u);
 }
 
 InstructionPrecolorer* TargetMachine_x64::CreateInstructionPrecolorer()
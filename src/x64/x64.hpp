@@ -33,7 +33,7 @@ enum Reg_x64
 
 struct RegisterDef_x64 : BaseRegisterDef
 {
-  RegisterDef_x64(BaseRegisterDef::Usage usage, const std::string& name, uint8_t opcodeOffset);
+  RegisterDef_x64(BaseRegisterDef::Usage usage, const std::string& name, bool isCalleeSaved, uint8_t opcodeOffset);
 
   uint8_t opcodeOffset;
 };
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <codegen.hpp>
+
+/*
+ * Generates a function with about 100k AIR instructions, which are then put through the precolorer and the code
+ * generator. Each call to `F` is six moves of its arguments into the parameter slots, and then the call.
+ * NOTE(Isaac): the AST passes recurse down the statements of a block, so we can't have too many of them
+ */
+TEST(PrecolorAndGenerate100kInstructions)
+{
+  const unsigned int NUM_CALLS = 14286u;
+
+  std::string source = "#[NoInline]\n"
+                       "fn F(a : uint, b : uint, c : uint, d : uint, e : uint, f : uint) -> uint\n"
+                       "{\n"
+                       "  return a\n"
+                       "}\n"
+                       "\n"
+                       "#[Entry]\n"
+                       "fn Main() -> int\n"
+                       "{\n";
+  for (unsigned int i = 0u;
+       i < NUM_CALLS;
+       i++)
+  {
+    source += "  F(" + std::to_string(i) + "u 1u 2u 3u 4u 5u)\n";
+  }
+  source += "  return 0\n"
+            "}\n";
+
+  // NOTE(Isaac): the graph-coloring allocator would dominate the time taken, so we use the linear-scan one
+  TestProgram program(source, true);
+  CHECK(!program.hasErrored);
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main);
+
+  if (!main)
+  {
+    return;
+  }
+
+  unsigned int numInstructions = 0u;
+  for (AirInstruction* instruction = main->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    numInstructions++;
+  }
+  CHECK(numInstructions >= 7u * NUM_CALLS);
+
+  {
+    InstructionPrecolorer* precolorer = program.target->CreateInstructionPrecolorer();
+    Stopwatch stopwatch;
+
+    for (AirInstruction* instruction = main->airHead;
+         instruction;
+         instruction = instruction->next)
+    {
+      precolorer->Dispatch(instruction);
+    }
+
+    double elapsed = stopwatch.ElapsedMilliseconds();
+    delete precolorer;
+    printf("  Precolored %u instructions in %.3f ms (%.1f ns per instruction)\n", numInstructions, elapsed,
+           elapsed * 1000000.0 / numInstructions);
+  }
+
+  {
+    Stopwatch stopwatch;
+    Generate(program.parse.name, program.target, program.parse);
+    double elapsed = stopwatch.ElapsedMilliseconds();
+    printf("  Generated code for %u instructions in %.3f ms (%.1f ns per instruction)\n", numInstructions, elapsed,
+           elapsed * 1000000.0 / numInstructions);
+  }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <sys/resource.h>
+
+/*
+ * We count the allocations made with `new` (which is how the compiler allocates everything that isn't in an arena,
+ * including the memory owned by `std::vector`s and `std::string`s). The arenas' own blocks are allocated with
+ * `malloc`, and aren't counted.
+ */
+static std::atomic<uint64_t> g_numHeapAllocations(0u);
+static std::atomic<uint64_t> g_heapBytesAllocated(0u);
+
+void* operator new(size_t size)
+{
+  g_numHeapAllocations++;
+  g_heapBytesAllocated += size;
+
+  void* ptr = malloc(size);
+  if (!ptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept
+{
+  free(ptr);
+}
+
+/*
+ * Compiles 50k small functions, each of which calls the next, and reports how much was allocated from the heap
+ * and from arenas along the way.
+ */
+TEST(Compile50kFunctions)
+{
+  const unsigned int NUM_FUNCTIONS = 50000u;
+
+  std::string source;
+  for (unsigned int i = 0u;
+       i < NUM_FUNCTIONS - 1u;
+       i++)
+  {
+    source += FormatString("fn F%u() -> uint\n"
+                           "{\n"
+                           "  b : uint = %uu\n"
+                           "  if (b == 7u)\n"
+                           "  {\n"
+                           "    return b\n"
+                           "  }\n"
+                           "  return F%u()\n"
+                           "}\n\n", i, i % 100u, i + 1u);
+  }
+  source += FormatString("fn F%u() -> uint\n"
+                         "{\n"
+                         "  return 3u\n"
+                         "}\n\n", NUM_FUNCTIONS - 1u);
+  source += "#[Entry]\n"
+            "fn Main() -> int\n"
+            "{\n"
+            "  F0()\n"
+            "  return 0\n"
+            "}\n";
+
+  uint64_t numHeapAllocations = g_numHeapAllocations;
+  uint64_t heapBytesAllocated = g_heapBytesAllocated;
+  Stopwatch compileStopwatch;
+  TestProgram* program = new TestProgram(source);
+  compileStopwatch.Report("Compile 50k functions");
+  CHECK(!program->hasErrored);
+
+  unsigned int numArenaAllocations = program->parse.arena.numAllocations;
+  size_t arenaBytesAllocated = program->parse.arena.bytesAllocated;
+  for (CodeThing* thing : program->parse.codeThings)
+  {
+    numArenaAllocations += thing->arena.numAllocations;
+    arenaBytesAllocated += thing->arena.bytesAllocated;
+  }
+
+  printf("  Allocated %lu objects (%lu bytes) from the heap\n",
+         (unsigned long)(g_numHeapAllocations - numHeapAllocations),
+         (unsigned long)(g_heapBytesAllocated - heapBytesAllocated));
+  printf("  Allocated %u objects (%zu bytes) from arenas still in use\n", numArenaAllocations, arenaBytesAllocated);
+
+  Stopwatch freeStopwatch;
+  delete program;
+  freeStopwatch.Report("Free 50k functions");
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("  Peak RSS: %ld KiB\n", usage.ru_maxrss);
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <cstring>
+#include <typeinfo>
+#include <ast.hpp>
+
+/*
+ * Counts how many nodes of each type it's dispatched on.
+ */
+struct CountingPass : ASTPass<void, unsigned int>
+{
+  void ApplyTo(ParseResult& /*parse*/, TargetMachine* /*target*/, CodeThing* /*code*/) { }
+
+  void VisitNode(BreakNode*                 , unsigned int* counts) { counts[0u]++;   }
+  void VisitNode(ReturnNode*                , unsigned int* counts) { counts[1u]++;   }
+  void VisitNode(UnaryOpNode*               , unsigned int* counts) { counts[2u]++;   }
+  void VisitNode(BinaryOpNode*              , unsigned int* counts) { counts[3u]++;   }
+  void VisitNode(VariableNode*              , unsigned int* counts) { counts[4u]++;   }
+  void VisitNode(ConditionNode*             , unsigned int* counts) { counts[5u]++;   }
+  void VisitNode(CompositeConditionNode*    , unsigned int* counts) { counts[6u]++;   }
+  void VisitNode(BranchNode*                , unsigned int* counts) { counts[7u]++;   }
+  void VisitNode(WhileNode*                 , unsigned int* counts) { counts[8u]++;   }
+  void VisitNode(ConstantNode<unsigned int>*, unsigned int* counts) { counts[9u]++;   }
+  void VisitNode(ConstantNode<int>*         , unsigned int* counts) { counts[10u]++;  }
+  void VisitNode(ConstantNode<float>*       , unsigned int* counts) { counts[11u]++;  }
+  void VisitNode(ConstantNode<bool>*        , unsigned int* counts) { counts[12u]++;  }
+  void VisitNode(StringNode*                , unsigned int* counts) { counts[13u]++;  }
+  void VisitNode(CallNode*                  , unsigned int* counts) { counts[14u]++;  }
+  void VisitNode(VariableAssignmentNode*    , unsigned int* counts) { counts[15u]++;  }
+  void VisitNode(MemberAccessNode*          , unsigned int* counts) { counts[16u]++;  }
+  void VisitNode(ArrayInitNode*             , unsigned int* counts) { counts[17u]++;  }
+  void VisitNode(InfiniteLoopNode*          , unsigned int* counts) { counts[18u]++;  }
+  void VisitNode(ConstructNode*             , unsigned int* counts) { counts[19u]++;  }
+
+  /*
+   * This is how nodes used to be dispatched on, by comparing the name of the node's type with each type in turn.
+   * It's kept here to compare against.
+   */
+  void DispatchByTypeName(ASTNode* node, unsigned int* counts)
+  {
+    #define DISPATCH(nodeType)\
+      if (strcmp(typeid(*node).name(), typeid(nodeType).name()) == 0)\
+      {\
+        VisitNode(reinterpret_cast<nodeType*>(node), counts);\
+      }
+
+         DISPATCH(BreakNode)
+    else DISPATCH(ReturnNode)
+    else DISPATCH(UnaryOpNode)
+    else DISPATCH(BinaryOpNode)
+    else DISPATCH(VariableNode)
+    else DISPATCH(ConditionNode)
+    else DISPATCH(CompositeConditionNode)
+    else DISPATCH(BranchNode)
+    else DISPATCH(WhileNode)
+    else DISPATCH(ConstantNode<unsigned int>)
+    else DISPATCH(ConstantNode<int>)
+    else DISPATCH(ConstantNode<float>)
+    else DISPATCH(ConstantNode<bool>)
+    else DISPATCH(StringNode)
+    else DISPATCH(CallNode)
+    else DISPATCH(VariableAssignmentNode)
+    else DISPATCH(MemberAccessNode)
+    else DISPATCH(ArrayInitNode)
+    else DISPATCH(InfiniteLoopNode)
+    else DISPATCH(ConstructNode)
+
+    #undef DISPATCH
+  }
+};
+
+static ASTNode* CreateNode(unsigned int i)
+{
+  switch (i % 20u)
+  {
+    case 0u:  return new BreakNode();
+    case 1u:  return new ReturnNode(nullptr);
+    case 2u:  return new UnaryOpNode(UnaryOpNode::Operator::NEGATIVE, nullptr);
+    case 3u:  return new BinaryOpNode(BinaryOpNode::Operator::ADD, nullptr, nullptr);
+    case 4u:  return new VariableNode(InternedString("a"));
+    case 5u:  return new ConditionNode(ConditionNode::Condition::EQUAL, nullptr, nullptr);
+    case 6u:  return new CompositeConditionNode(CompositeConditionNode::Type::AND, nullptr, nullptr);
+    case 7u:  return new BranchNode(nullptr, nullptr, nullptr);
+    case 8u:  return new WhileNode(nullptr, nullptr);
+    case 9u:  return new ConstantNode<unsigned int>(i);
+    case 10u: return new ConstantNode<int>((int)i);
+    case 11u: return new ConstantNode<float>((float)i);
+    case 12u: return new ConstantNode<bool>(true);
+    case 13u: return new StringNode(nullptr);
+    case 14u: return new CallNode(InternedString("F"), {});
+    case 15u: return new VariableAssignmentNode(nullptr, nullptr, false);
+    case 16u: return new MemberAccessNode(nullptr, nullptr);
+    case 17u: return new ArrayInitNode({});
+    case 18u: return new InfiniteLoopNode(nullptr);
+    default:  return new ConstructNode(nullptr, InternedString("T"), {});
+  }
+}
+
+TEST(DispatchOnAMillionNodes)
+{
+  const unsigned int NUM_NODES = 1000000u;
+
+  Arena arena;
+  ArenaScope arenaScope(arena);
+  std::vector<ASTNode*> nodes;
+  nodes.reserve(NUM_NODES);
+
+  for (unsigned int i = 0u;
+       i < NUM_NODES;
+       i++)
+  {
+    nodes.push_back(CreateNode(i));
+  }
+
+  CountingPass pass;
+  unsigned int taggedCounts[20u] = {};
+  unsigned int namedCounts[20u] = {};
+
+  {
+    Stopwatch stopwatch;
+    for (ASTNode* node : nodes)
+    {
+      pass.Dispatch(node, taggedCounts);
+    }
+    stopwatch.Report("Dispatch on 1M nodes by type tag");
+  }
+
+  {
+    Stopwatch stopwatch;
+    for (ASTNode* node : nodes)
+    {
+      pass.DispatchByTypeName(node, namedCounts);
+    }
+    stopwatch.Report("Dispatch on 1M nodes by type name (old)");
+  }
+
+  for (unsigned int i = 0u;
+       i < 20u;
+       i++)
+  {
+    CHECK(taggedCounts[i] == NUM_NODES / 20u);
+    CHECK(namedCounts[i] == taggedCounts[i]);
+  }
+}
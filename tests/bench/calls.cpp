@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <codegen.hpp>
+
+/*
+ * Compiles a function with 10k calls, with a few values live across each of them, and reports how long it takes to
+ * find the registers to save around the calls (which is done with the register allocation) and to generate the
+ * code for them.
+ */
+TEST(Compile10kCalls)
+{
+  const unsigned int NUM_CALLS = 10000u;
+
+  std::string source = "#[NoInline]\n"
+                       "fn F(a : uint, b : uint) -> uint\n"
+                       "{\n"
+                       "  return a\n"
+                       "}\n"
+                       "\n"
+                       "#[Entry]\n"
+                       "fn Main() -> int\n"
+                       "{\n"
+                       "  x0 : uint = F(1u 2u)\n"
+                       "  x1 : uint = F(x0 3u)\n"
+                       "  x2 : uint = F(x1 x0)\n";
+  for (unsigned int i = 3u;
+       i < NUM_CALLS;
+       i++)
+  {
+    source += FormatString("  x%u : uint = F(x%u x%u)\n", i, i - 1u, i - 3u);
+  }
+  source += FormatString("  if (x%u == 3u)\n"
+                         "  {\n"
+                         "    return 1\n"
+                         "  }\n"
+                         "  return 0\n"
+                         "}\n", NUM_CALLS - 1u);
+
+  // NOTE(Isaac): the graph-coloring allocator would dominate the time taken, so we use the linear-scan one
+  Stopwatch compileStopwatch;
+  TestProgram program(source, true);
+  compileStopwatch.Report("Compile 10k calls to AIR");
+  CHECK(!program.hasErrored);
+
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main);
+  CHECK(main && CountInstructions(main, InstructionType::CALL) == NUM_CALLS);
+
+  Stopwatch generateStopwatch;
+  Generate(program.parse.name, program.target, program.parse);
+  generateStopwatch.Report("Generate code for 10k calls");
+}
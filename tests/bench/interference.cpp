@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+
+/*
+ * Compiles functions with more and more temporaries, and reports how long compiling them (which includes building
+ * the interference graph and coloring it) takes per slot. Each statement makes a few temporaries, and reads a
+ * variable from eight statements before, so there are always a few values live at once.
+ */
+TEST(InterferenceGraphScalesWithNumberOfTemporaries)
+{
+  const unsigned int numStatements[] = { 250u, 1250u, 2500u, 12500u };
+
+  for (unsigned int n : numStatements)
+  {
+    std::string source = "#[NoInline]\n"
+                         "fn F(p : uint) -> uint\n"
+                         "{\n";
+    for (unsigned int i = 0u;
+         i < n;
+         i++)
+    {
+      if (i < 8u)
+      {
+        source += FormatString("  x%u : uint = p + %uu\n", i, i);
+      }
+      else
+      {
+        source += FormatString("  x%u : uint = x%u + p * x%u + %uu\n", i, i - 1u, i - 8u, i);
+      }
+    }
+    source += FormatString("  return x%u\n"
+                           "}\n\n"
+                           "#[Entry]\n"
+                           "fn Main() -> int\n"
+                           "{\n"
+                           "  F(4u)\n"
+                           "  return 0\n"
+                           "}\n", n - 1u);
+
+    Stopwatch stopwatch;
+    TestProgram program(source);
+    double milliseconds = stopwatch.ElapsedMilliseconds();
+    CHECK(!program.hasErrored);
+
+    CodeThing* f = program.GetThing("F");
+    CHECK(f);
+
+    if (f)
+    {
+      size_t numInterferences = 0u;
+      for (Slot* slot : f->slots)
+      {
+        numInterferences += slot->interferences.size();
+      }
+
+      printf("  Compiled a function with %zu slots (%zu interferences) in %.2fms (%.2fus per slot)\n",
+             f->slots.size(), numInterferences / 2u, milliseconds, (milliseconds * 1000.0) / f->slots.size());
+    }
+  }
+}
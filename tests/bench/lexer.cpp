@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <scan.hpp>
+#include <parsing.hpp>
+
+/*
+ * Lexes a large file of ordinary-looking Roo, and reports how quickly the lexer gets through it. The names are
+ * picked so a lot of them start with (or are a prefix of) a keyword, because they take the longest to reject. Each
+ * scanner the CPU supports is measured in turn.
+ */
+TEST(LexerThroughput)
+{
+  const unsigned int NUM_FUNCTIONS = 100000u;
+
+  std::string source;
+  for (unsigned int i = 0u;
+       i < NUM_FUNCTIONS;
+       i++)
+  {
+    source += FormatString("// Function number %u\n"
+                           "fn types%u(iffy : uint, mutable : mut uint) -> uint\n"
+                           "{\n"
+                           "  returned : uint = iffy + %uu\n"
+                           "  while (returned < 100u)\n"
+                           "  {\n"
+                           "    returned = returned * 2u\n"
+                           "  }\n"
+                           "\n"
+                           "  if (returned == 7u) { return returned } else { return fnord(\"%u\" 1.5) }\n"
+                           "}\n\n", i, i, i, i);
+  }
+
+  std::string path = WriteSourceFile(source);
+  double megabytes = source.length() / (1024.0 * 1024.0);
+  const char* scannerNames[] = { "scalar", "SSE2", "AVX2" };
+  std::vector<const Scanner*> scanners = GetSupportedScanners();
+
+  for (unsigned int i = 0u;
+       i < scanners.size();
+       i++)
+  {
+    unsigned int numTokens = 0u;
+    unsigned int numKeywords = 0u;
+
+    Stopwatch stopwatch;
+    Parser<RooKeyword> parser(path, nullptr, *scanners[i]);
+    while (parser.PeekToken(false).type != TOKEN_INVALID)
+    {
+      if (parser.PeekToken(false).type == TOKEN_KEYWORD)
+      {
+        numKeywords++;
+      }
+
+      numTokens++;
+      parser.NextToken(false);
+    }
+    double milliseconds = stopwatch.ElapsedMilliseconds();
+
+    printf("  Lexed %.1fMB (%u tokens) with the %s scanner in %.2fms: %.1fMB/s\n", megabytes, numTokens,
+           scannerNames[i], milliseconds, megabytes / (milliseconds / 1000.0));
+    CHECK(numKeywords == NUM_FUNCTIONS * 7u);
+  }
+}
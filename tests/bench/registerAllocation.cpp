@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+
+/*
+ * Counts the MOVs that are left for the code generator to emit (a MOV between two slots in the same register
+ * doesn't do anything).
+ */
+static unsigned int CountRealMoves(CodeThing* code)
+{
+  unsigned int count = 0u;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType != InstructionType::MOV)
+    {
+      continue;
+    }
+
+    MovInstruction* mov = static_cast<MovInstruction*>(instruction);
+    if (!(mov->src->IsColored() && mov->dest->IsColored() && mov->src->color == mov->dest->color))
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+static unsigned int CountSpilledSlots(CodeThing* code)
+{
+  unsigned int count = 0u;
+
+  for (Slot* slot : code->slots)
+  {
+    if (slot->GetType() == SlotType::SPILL)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ * Makes a function with `n` statements. Each one reads the variable from `distance` statements before, so about
+ * that many values are live at once, and every eighth one calls another function, so some are live across calls.
+ */
+static std::string MakeFunction(unsigned int n, unsigned int distance)
+{
+  std::string source = "#[NoInline]\n"
+                       "fn G(a : uint, b : uint) -> uint\n"
+                       "{\n"
+                       "  return a + b\n"
+                       "}\n\n"
+                       "#[NoInline]\n"
+                       "fn F(p : uint) -> uint\n"
+                       "{\n";
+  for (unsigned int i = 0u;
+       i < n;
+       i++)
+  {
+    if (i < distance)
+    {
+      source += FormatString("  x%u : uint = p + %uu\n", i, i);
+    }
+    else if (i % 8u == 0u)
+    {
+      source += FormatString("  x%u : uint = G(x%u x%u)\n", i, i - 1u, i - distance);
+    }
+    else
+    {
+      source += FormatString("  x%u : uint = x%u + p * x%u + %uu\n", i, i - 1u, i - distance, i);
+    }
+  }
+
+  source += FormatString("  return x%u\n"
+                         "}\n\n"
+                         "#[Entry]\n"
+                         "fn Main() -> int\n"
+                         "{\n"
+                         "  F(4u)\n"
+                         "  return 0\n"
+                         "}\n", n - 1u);
+  return source;
+}
+
+/*
+ * Compiles the same functions with the graph-coloring allocator and with linear scan, and reports how long each
+ * takes, and how good the code is: how many slots had to be spilled, and how many MOVs are left.
+ */
+TEST(LinearScanAgainstGraphColoring)
+{
+  struct Shape
+  {
+    unsigned int numStatements;
+    unsigned int distance;
+  };
+
+  const Shape shapes[] = { { 1000u, 4u }, { 1000u, 20u }, { 5000u, 4u }, { 5000u, 20u } };
+
+  for (const Shape& shape : shapes)
+  {
+    std::string source = MakeFunction(shape.numStatements, shape.distance);
+    printf("  %u statements, reading %u back:\n", shape.numStatements, shape.distance);
+
+    for (bool useLinearScan : { false, true })
+    {
+      Stopwatch stopwatch;
+      TestProgram program(source, useLinearScan);
+      double milliseconds = stopwatch.ElapsedMilliseconds();
+      CHECK(!program.hasErrored);
+
+      CodeThing* f = program.GetThing("F");
+      CHECK(f);
+
+      if (f)
+      {
+        printf("    %-16s %8.2fms, %4u spilled slots, %5u moves\n",
+               (useLinearScan ? "Linear scan:" : "Graph coloring:"), milliseconds, CountSpilledSlots(f),
+               CountRealMoves(f));
+      }
+    }
+  }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+
+/*
+ * A function with 10k locals, each initialised from the one before, so each lookup is in a scope that's full of
+ * other variables.
+ */
+TEST(ResolveVariablesIn10kLocals)
+{
+  const unsigned int NUM_LOCALS = 10000u;
+
+  std::string source = "fn F(p : uint) -> uint\n"
+                       "{\n"
+                       "  x0 : uint = p\n";
+  for (unsigned int i = 1u;
+       i < NUM_LOCALS;
+       i++)
+  {
+    source += FormatString("  x%u : uint = x%u\n", i, i - 1u);
+  }
+  source += FormatString("  return x%u\n"
+                         "}\n\n"
+                         "#[Entry]\n"
+                         "fn Main() -> int\n"
+                         "{\n"
+                         "  F(4u)\n"
+                         "  return 0\n"
+                         "}\n", NUM_LOCALS - 1u);
+
+  Stopwatch stopwatch;
+  TestProgram program(source, false, false);
+  stopwatch.Report("Analyse a function with 10k locals");
+  CHECK(!program.hasErrored);
+}
+
+/*
+ * 100 nested blocks, each with its own locals, where the innermost blocks use variables from the outermost ones,
+ * so each lookup has to walk up a long chain of scopes.
+ */
+TEST(ResolveVariablesIn100NestedScopes)
+{
+  const unsigned int DEPTH = 100u;
+  const unsigned int NUM_FUNCTIONS = 100u;
+
+  std::string source;
+  for (unsigned int f = 0u;
+       f < NUM_FUNCTIONS;
+       f++)
+  {
+    source += FormatString("fn F%u(p : uint) -> uint\n"
+                           "{\n", f);
+
+    for (unsigned int i = 0u;
+         i < DEPTH;
+         i++)
+    {
+      source += FormatString("  a%u : uint = p\n"
+                             "  b%u : uint = a0\n"
+                             "  if (b%u == a%u)\n"
+                             "  {\n", i, i, i, i);
+    }
+
+    for (unsigned int i = 0u;
+         i < DEPTH;
+         i++)
+    {
+      source += FormatString("  c%u : uint = a%u\n", i, i);
+    }
+
+    for (unsigned int i = 0u;
+         i < DEPTH;
+         i++)
+    {
+      source += "  }\n";
+    }
+
+    source += "  return p\n"
+              "}\n\n";
+  }
+
+  source += "#[Entry]\n"
+            "fn Main() -> int\n"
+            "{\n"
+            "  F0(4u)\n"
+            "  return 0\n"
+            "}\n";
+
+  Stopwatch stopwatch;
+  TestProgram program(source, false, false);
+  stopwatch.Report("Analyse 100 functions with 100 nested scopes");
+  CHECK(!program.hasErrored);
+}
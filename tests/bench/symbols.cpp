@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+
+/*
+ * Analyses programs with more and more functions and types, each function calling the next, and reports how long
+ * each function takes. If looking up types and functions by name takes constant time, this should stay about the
+ * same as the program grows.
+ */
+TEST(AnalysisScalesWithNumberOfFunctions)
+{
+  for (unsigned int numFunctions = 100u;
+       numFunctions <= 100000u;
+       numFunctions *= 10u)
+  {
+    unsigned int numTypes = numFunctions / 10u;
+    std::string source;
+
+    for (unsigned int i = 0u;
+         i < numTypes;
+         i++)
+    {
+      source += FormatString("type T%u\n"
+                             "{\n"
+                             "  a : uint\n"
+                             "}\n\n", i);
+    }
+
+    for (unsigned int i = 0u;
+         i < numFunctions - 1u;
+         i++)
+    {
+      source += FormatString("fn F%u(a : uint) -> uint\n"
+                             "{\n"
+                             "  t : T%u{a}\n"
+                             "  return F%u(a)\n"
+                             "}\n\n", i, i % numTypes, i + 1u);
+    }
+
+    source += FormatString("fn F%u(a : uint) -> uint\n"
+                           "{\n"
+                           "  t : T%u{a}\n"
+                           "  return a\n"
+                           "}\n\n"
+                           "#[Entry]\n"
+                           "fn Main() -> int\n"
+                           "{\n"
+                           "  F0(4u)\n"
+                           "  return 0\n"
+                           "}\n", numFunctions - 1u, (numFunctions - 1u) % numTypes);
+
+    Stopwatch stopwatch;
+    TestProgram* program = new TestProgram(source, false, false);
+    double milliseconds = stopwatch.ElapsedMilliseconds();
+    CHECK(!program->hasErrored);
+    delete program;
+
+    printf("  Analysed %u functions and %u types in %.2fms (%.2fus per function)\n", numFunctions, numTypes,
+           milliseconds, (milliseconds * 1000.0) / numFunctions);
+  }
+}
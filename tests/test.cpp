@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <parsing.hpp>
+#include <error.hpp>
+#include <deadCode.hpp>
+#include <ssa.hpp>
+#include <constantPropagation.hpp>
+#include <codegen.hpp>
+#include <passes/passes.hpp>
+#include <x64/x64.hpp>
+#include <liveness.hpp>
+
+static const char* g_currentTest = nullptr;
+static unsigned int g_numFailedChecks = 0u;
+
+std::vector<TestCase>& GetTestCases()
+{
+  static std::vector<TestCase> testCases;
+  return testCases;
+}
+
+TestRegistration::TestRegistration(const char* name, void (*function)())
+{
+  GetTestCases().push_back(TestCase{name, function});
+}
+
+void FailCheck(const char* file, int line, const char* expression)
+{
+  fprintf(stderr, "  \x1B[1;31mFAILED\x1B[0m %s (%s:%d): %s\n", g_currentTest, file, line, expression);
+  g_numFailedChecks++;
+}
+
+Stopwatch::Stopwatch()
+  :begin(std::chrono::high_resolution_clock::now())
+{
+}
+
+double Stopwatch::ElapsedMilliseconds()
+{
+  auto end = std::chrono::high_resolution_clock::now();
+  // NOTE(Isaac): chrono uses integer types to represent ticks, so we use microseconds then convert ourselves.
+  return (double)(std::chrono::duration_cast<std::chrono::microseconds>(end-begin).count()) / 1000.0;
+}
+
+void Stopwatch::Report(const char* what)
+{
+  printf("  %-60s %10.3f ms\n", what, ElapsedMilliseconds());
+}
+
+std::string WriteSourceFile(const std::string& source)
+{
+  // Each file gets a new name, so a test can have more than one around at once
+  static unsigned int numFiles = 0u;
+  std::string path = FormatString("test%u.roo", numFiles++);
+
+  FILE* f = fopen(path.c_str(), "w");
+  fputs(source.c_str(), f);
+  fclose(f);
+
+  return path;
+}
+
+static const char* g_preamble =
+  "#[Name(test)]\n"
+  "#[DefinePrimitive(\"int\",    4u)]\n"
+  "#[DefinePrimitive(\"uint\",   4u)]\n"
+  "#[DefinePrimitive(\"bool\",   1u)]\n"
+  "#[DefinePrimitive(\"float\",  4u)]\n"
+  "#[DefinePrimitive(\"char\",   1u)]\n"
+  "type string\n"
+  "{\n"
+  "  head : char&\n"
+  "}\n";
+
+QuietStdout::QuietStdout()
+{
+  fflush(stdout);
+  savedStdout = dup(STDOUT_FILENO);
+
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+}
+
+QuietStdout::~QuietStdout()
+{
+  fflush(stdout);
+  dup2(savedStdout, STDOUT_FILENO);
+  close(savedStdout);
+}
+
+TestProgram::TestProgram(const std::string& source, bool useLinearScan, bool generateAir)
+  :parse()
+  ,target(nullptr)
+  ,errors()
+  ,hasErrored(false)
+{
+  QuietStdout quietStdout;
+  ArenaScope arenaScope(parse.arena);
+  parse.useLinearScan = useLinearScan;
+
+  std::string path = WriteSourceFile(g_preamble + source);
+
+  {
+    RooParser parser(parse, path, &errors);
+    hasErrored = parser.errorState->hasErrored;
+  }
+
+  if (hasErrored)
+  {
+    return;
+  }
+
+  target = new TargetMachine_x64(parse);
+  CompleteIR(parse, target);
+
+  // NOTE(Isaac): this should match the passes run by `RunPasses` and `CompileCodeThing` in `main.cpp`
+  for (CodeThing* thing : parse.codeThings)
+  {
+    ArenaScope thingScope(thing->arena);
+
+    ScopeResolverPass().ApplyTo(parse, target, thing);
+    VariableResolverPass().ApplyTo(parse, target, thing);
+    TypeChecker().ApplyTo(parse, target, thing);
+    ConditionFolderPass().ApplyTo(parse, target, thing);
+    hasErrored |= thing->errorState->hasErrored;
+  }
+
+  if (!generateAir)
+  {
+    return;
+  }
+
+  RemoveUnreachableThings(parse);
+
+  AirPassManager airPasses;
+  airPasses.Add(new SSAConstructionPass());
+  airPasses.Add(new ConstantPropagationPass());
+  airPasses.Add(new DeadCodeEliminationPass());
+  airPasses.Add(new SSADestructionPass());
+
+  for (CodeThing* thing : parse.codeThings)
+  {
+    if (thing->errorState->hasErrored)
+    {
+      hasErrored = true;
+      continue;
+    }
+
+    ArenaScope thingScope(thing->arena);
+    AirGenerator airGenerator(airPasses);
+    airGenerator.ApplyTo(parse, target, thing);
+  }
+
+  RemoveUnreachableThings(parse);
+}
+
+TestProgram::~TestProgram()
+{
+  delete target;
+}
+
+CodeThing* TestProgram::GetThing(const char* name)
+{
+  for (CodeThing* thing : parse.codeThings)
+  {
+    if (thing->type == CodeThing::Type::FUNCTION && strcmp(dynamic_cast<FunctionThing*>(thing)->name.c_str(), name) == 0)
+    {
+      return thing;
+    }
+  }
+
+  return nullptr;
+}
+
+int RunProgram(const std::string& source, bool useLinearScan)
+{
+  TestProgram program(source, useLinearScan);
+
+  if (program.hasErrored)
+  {
+    return -1;
+  }
+
+  static unsigned int numPrograms = 0u;
+  std::string path = FormatString("./program%u", numPrograms++);
+
+  {
+    QuietStdout quietStdout;
+    Generate(path, program.target, program.parse);
+  }
+
+  chmod(path.c_str(), 0755);
+  int status = system(path.c_str());
+  return ((status != -1 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1);
+}
+
+unsigned int CountInstructions(CodeThing* code)
+{
+  unsigned int count = 0u;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    count++;
+  }
+
+  return count;
+}
+
+unsigned int CountInstructions(CodeThing* code, InstructionType type)
+{
+  unsigned int count = 0u;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType == type)
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ * NOTE(Isaac): this finds the slots live after each instruction in the simplest way we can, with a set per
+ * instruction that we keep updating until nothing changes. It's slow, but doesn't share anything with the
+ * compiler's liveness analysis other than what counts as a read or a write.
+ */
+std::vector<std::set<unsigned int>> FindLiveSlotsByBruteForce(CodeThing* code)
+{
+  std::vector<AirInstruction*> instructions;
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    instructions.push_back(instruction);
+  }
+
+  std::vector<std::vector<unsigned int>> successors(instructions.size());
+  for (unsigned int i = 0u;
+       i < instructions.size();
+       i++)
+  {
+    AirInstruction* instruction = instructions[i];
+
+    if (instruction->instructionType == InstructionType::RETURN)
+    {
+      continue;
+    }
+
+    if (instruction->instructionType == InstructionType::JUMP)
+    {
+      JumpInstruction* jump = static_cast<JumpInstruction*>(instruction);
+
+      for (unsigned int j = 0u;
+           j < instructions.size();
+           j++)
+      {
+        if (instructions[j] == jump->label)
+        {
+          successors[i].push_back(j);
+        }
+      }
+
+      if (jump->condition == JumpInstruction::Condition::UNCONDITIONAL)
+      {
+        continue;
+      }
+    }
+
+    if (i + 1u < instructions.size())
+    {
+      successors[i].push_back(i + 1u);
+    }
+  }
+
+  std::vector<LiveOperands> operands(instructions.size());
+  for (unsigned int i = 0u;
+       i < instructions.size();
+       i++)
+  {
+    GetLiveOperands(instructions[i], operands[i]);
+  }
+
+  std::vector<std::set<unsigned int>> liveIn(instructions.size());
+  std::vector<std::set<unsigned int>> liveOut(instructions.size());
+  bool hasChanged = true;
+
+  while (hasChanged)
+  {
+    hasChanged = false;
+
+    for (unsigned int i = 0u;
+         i < instructions.size();
+         i++)
+    {
+      std::set<unsigned int> out;
+      for (unsigned int successor : successors[i])
+      {
+        out.insert(liveIn[successor].begin(), liveIn[successor].end());
+      }
+
+      std::set<unsigned int> in = out;
+      for (Slot* def : operands[i].defs) in.erase(def->index);
+      for (Slot* use : operands[i].uses) in.insert(use->index);
+
+      if (in != liveIn[i] || out != liveOut[i])
+      {
+        liveIn[i] = in;
+        liveOut[i] = out;
+        hasChanged = true;
+      }
+    }
+  }
+
+  return liveOut;
+}
+
+/*
+ * Runs every test, or only those with names containing the first argument if one is given. Returns non-zero if any
+ * of the checks failed.
+ */
+int main(int argc, char** argv)
+{
+  const char* filter = (argc > 1 ? argv[1] : nullptr);
+  unsigned int numRun = 0u;
+  unsigned int numFailed = 0u;
+
+  for (TestCase& test : GetTestCases())
+  {
+    if (filter && !strstr(test.name, filter))
+    {
+      continue;
+    }
+
+    printf("%s\n", test.name);
+    g_currentTest = test.name;
+    unsigned int failedChecksBefore = g_numFailedChecks;
+    test.function();
+
+    numRun++;
+    if (g_numFailedChecks != failedChecksBefore)
+    {
+      numFailed++;
+    }
+  }
+
+  printf("Ran %u test(s): %u passed, %u failed\n", numRun, numRun - numFailed, numFailed);
+  return (numFailed == 0u ? 0 : 1);
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <ir.hpp>
+#include <air.hpp>
+
+/*
+ * This is a very small test harness, shared by the unit tests (`make test`) and the benchmarks (`make bench`). Each
+ * test is a function, registered with `TEST`, that uses `CHECK` to test things. A failed check is reported, and
+ * the test carries on, so all of the checks that fail are reported at once.
+ */
+struct TestCase
+{
+  const char* name;
+  void        (*function)();
+};
+
+std::vector<TestCase>& GetTestCases();
+
+struct TestRegistration
+{
+  TestRegistration(const char* name, void (*function)());
+};
+
+#define TEST(name)\
+  static void name();\
+  static TestRegistration name##Registration(#name, name);\
+  static void name()
+
+void FailCheck(const char* file, int line, const char* expression);
+
+#define CHECK(expression)\
+  if (!(expression))\
+  {\
+    FailCheck(__FILE__, __LINE__, #expression);\
+  }
+
+/*
+ * Times how long something takes, for the benchmarks. `Report` prints the time taken since the stopwatch was
+ * created, against what it's been measuring.
+ */
+struct Stopwatch
+{
+  Stopwatch();
+
+  double ElapsedMilliseconds();
+  void Report(const char* what);
+
+  std::chrono::high_resolution_clock::time_point begin;
+};
+
+/*
+ * Writes some source into a new file in the current directory, so it can be mapped by the lexer. Returns its path.
+ */
+std::string WriteSourceFile(const std::string& source);
+
+/*
+ * The compiler prints the AIR of each thing it compiles, which would drown out the results of the tests, so this
+ * points stdout at /dev/null while it's in scope.
+ */
+struct QuietStdout
+{
+  QuietStdout();
+  ~QuietStdout();
+
+  int savedStdout;
+};
+
+/*
+ * Compiles a program from source in the same way as the compiler (see `main.cpp`), up to the point where machine
+ * code would be generated, so tests can look at the IR and AIR it produces. The source is put after a preamble that
+ * names the program and defines the primitive types. If `generateAir` is false, it stops after the program has been
+ * analysed (its variables resolved and types checked), before any unreachable code is removed.
+ */
+struct TestProgram
+{
+  TestProgram(const std::string& source, bool useLinearScan = false, bool generateAir = true);
+  ~TestProgram();
+
+  /*
+   * Finds a function by name. Returns `nullptr` if there isn't one, or if it's been removed because it's never
+   * called.
+   */
+  CodeThing* GetThing(const char* name);
+
+  ParseResult     parse;
+  TargetMachine*  target;
+  std::string     errors;
+  bool            hasErrored;
+};
+
+/*
+ * Compiles a program all the way to an executable, runs it, and returns its exit code. Returns -1 if it failed to
+ * compile, or didn't exit normally.
+ */
+int RunProgram(const std::string& source, bool useLinearScan = false);
+
+/*
+ * Counts the instructions in the AIR of a thing, either all of them or just those of one type.
+ */
+unsigned int CountInstructions(CodeThing* code);
+unsigned int CountInstructions(CodeThing* code, InstructionType type);
+
+/*
+ * Finds the indices of the slots that are live after each instruction in the AIR of a thing, in the order the
+ * instructions are in. This is worked out independently of the compiler's liveness analysis, so can be used to
+ * check things built on top of it.
+ */
+std::vector<std::set<unsigned int>> FindLiveSlotsByBruteForce(CodeThing* code);
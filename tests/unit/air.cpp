@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <air.hpp>
+
+/*
+ * Records the type of instruction that each `Visit` is for, so we can check `Dispatch` picks the right one.
+ */
+struct InstructionTypePass : AirPass<InstructionType>
+{
+  void Visit(LabelInstruction*,     InstructionType* type) { *type = InstructionType::LABEL;     }
+  void Visit(ReturnInstruction*,    InstructionType* type) { *type = InstructionType::RETURN;    }
+  void Visit(JumpInstruction*,      InstructionType* type) { *type = InstructionType::JUMP;      }
+  void Visit(MovInstruction*,       InstructionType* type) { *type = InstructionType::MOV;       }
+  void Visit(CmpInstruction*,       InstructionType* type) { *type = InstructionType::CMP;       }
+  void Visit(UnaryOpInstruction*,   InstructionType* type) { *type = InstructionType::UNARY_OP;  }
+  void Visit(BinaryOpInstruction*,  InstructionType* type) { *type = InstructionType::BINARY_OP; }
+  void Visit(CallInstruction*,      InstructionType* type) { *type = InstructionType::CALL;      }
+  void Visit(PhiInstruction*,       InstructionType* type) { *type = InstructionType::PHI;       }
+};
+
+TEST(DispatchVisitsEachInstructionType)
+{
+  Arena arena;
+  ArenaScope arenaScope(arena);
+
+  LabelInstruction* label = new LabelInstruction();
+  AirInstruction* instructions[] =
+  {
+    label,
+    new ReturnInstruction(nullptr),
+    new JumpInstruction(JumpInstruction::Condition::UNCONDITIONAL, label),
+    new MovInstruction(nullptr, nullptr),
+    new CmpInstruction(nullptr, nullptr),
+    new UnaryOpInstruction(UnaryOpInstruction::Operation::NEGATE, UNSIGNED_INT_INTRINSIC, nullptr, nullptr),
+    new BinaryOpInstruction(BinaryOpInstruction::Operation::ADD, UNSIGNED_INT_INTRINSIC, nullptr, nullptr, nullptr),
+    new CallInstruction(nullptr),
+    new PhiInstruction(nullptr),
+  };
+
+  InstructionTypePass pass;
+  for (AirInstruction* instruction : instructions)
+  {
+    InstructionType visitedType = (instruction->instructionType == InstructionType::LABEL ? InstructionType::PHI :
+                                                                                            InstructionType::LABEL);
+    pass.Dispatch(instruction, &visitedType);
+    CHECK(visitedType == instruction->instructionType);
+  }
+}
+
+TEST(DispatchOverGeneratedAir)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn F(a : uint) -> uint
+    {
+      if (a == 4u)
+      {
+        return a
+      }
+      return 3u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F(4u)
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main && main->airHead);
+
+  if (main)
+  {
+    InstructionTypePass pass;
+    for (AirInstruction* instruction = main->airHead;
+         instruction;
+         instruction = instruction->next)
+    {
+      InstructionType visitedType = InstructionType::PHI;
+      pass.Dispatch(instruction, &visitedType);
+      CHECK(visitedType == instruction->instructionType);
+    }
+
+    CHECK(CountInstructions(main, InstructionType::CALL) == 1u);
+  }
+}
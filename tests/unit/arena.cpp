@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <arena.hpp>
+
+/*
+ * Counts how many times it's been destroyed, and owns some memory of its own, like most arena objects do.
+ */
+struct CountedObject : ArenaObject
+{
+  CountedObject(unsigned int* numDestroyed)
+    :numDestroyed(numDestroyed)
+    ,items(16u, 0u)
+  {
+  }
+
+  ~CountedObject()
+  {
+    (*numDestroyed)++;
+  }
+
+  unsigned int*             numDestroyed;
+  std::vector<unsigned int> items;
+};
+
+TEST(ArenaDestroysItsObjects)
+{
+  unsigned int numDestroyed = 0u;
+
+  {
+    Arena arena;
+    ArenaScope arenaScope(arena);
+
+    for (unsigned int i = 0u;
+         i < 10000u;
+         i++)
+    {
+      new CountedObject(&numDestroyed);
+    }
+
+    CHECK(arena.numAllocations == 10000u);
+    CHECK(numDestroyed == 0u);
+  }
+
+  CHECK(numDestroyed == 10000u);
+}
+
+TEST(ArenaDoesNotDestroyDeletedObjects)
+{
+  unsigned int numDestroyed = 0u;
+
+  {
+    Arena arena;
+    ArenaScope arenaScope(arena);
+
+    CountedObject* a = new CountedObject(&numDestroyed);
+    new CountedObject(&numDestroyed);
+    CountedObject* c = new CountedObject(&numDestroyed);
+
+    delete a;
+    delete c;
+    CHECK(numDestroyed == 2u);
+  }
+
+  CHECK(numDestroyed == 3u);
+}
+
+TEST(AdoptedObjectsAreDestroyedOnce)
+{
+  unsigned int numDestroyed = 0u;
+
+  {
+    Arena arena;
+
+    {
+      Arena shard;
+      ArenaScope arenaScope(shard);
+      new CountedObject(&numDestroyed);
+      new CountedObject(&numDestroyed);
+      arena.Adopt(shard);
+    }
+
+    CHECK(numDestroyed == 0u);
+
+    ArenaScope arenaScope(arena);
+    new CountedObject(&numDestroyed);
+
+    Arena moved(std::move(arena));
+    CHECK(moved.numAllocations == 3u);
+    CHECK(arena.numAllocations == 0u);
+  }
+
+  CHECK(numDestroyed == 3u);
+}
+
+TEST(ArenaObjectsAreAligned)
+{
+  unsigned int numDestroyed = 0u;
+  Arena arena;
+  ArenaScope arenaScope(arena);
+
+  for (unsigned int i = 0u;
+       i < 100u;
+       i++)
+  {
+    CountedObject* object = new CountedObject(&numDestroyed);
+    CHECK(reinterpret_cast<uintptr_t>(object) % alignof(CountedObject) == 0u);
+  }
+}
+
+/*
+ * There are lots of small objects, so each should only cost its own size (rounded up to the size of a pointer) and
+ * a pointer-sized header.
+ */
+TEST(ArenaObjectsHaveSmallHeaders)
+{
+  unsigned int numDestroyed = 0u;
+  Arena arena;
+  ArenaScope arenaScope(arena);
+
+  for (unsigned int i = 0u;
+       i < 100u;
+       i++)
+  {
+    new CountedObject(&numDestroyed);
+  }
+
+  size_t objectSize = (sizeof(CountedObject) + sizeof(void*) - 1u) & ~(sizeof(void*) - 1u);
+  CHECK(arena.bytesAllocated == 100u * (objectSize + sizeof(void*)));
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <ast.hpp>
+
+/*
+ * Returns the type of node that each `VisitNode` is for, so we can check `Dispatch` picks the right one.
+ */
+struct NodeTypePass : ASTPass<NodeType, void>
+{
+  void ApplyTo(ParseResult& /*parse*/, TargetMachine* /*target*/, CodeThing* /*code*/) { }
+
+  NodeType VisitNode(BreakNode*                 , void*) { return NodeType::BREAK;                  }
+  NodeType VisitNode(ReturnNode*                , void*) { return NodeType::RETURN;                 }
+  NodeType VisitNode(UnaryOpNode*               , void*) { return NodeType::UNARY_OP;               }
+  NodeType VisitNode(BinaryOpNode*              , void*) { return NodeType::BINARY_OP;              }
+  NodeType VisitNode(VariableNode*              , void*) { return NodeType::VARIABLE;               }
+  NodeType VisitNode(ConditionNode*             , void*) { return NodeType::CONDITION;              }
+  NodeType VisitNode(CompositeConditionNode*    , void*) { return NodeType::COMPOSITE_CONDITION;    }
+  NodeType VisitNode(BranchNode*                , void*) { return NodeType::BRANCH;                 }
+  NodeType VisitNode(WhileNode*                 , void*) { return NodeType::WHILE;                  }
+  NodeType VisitNode(ConstantNode<unsigned int>*, void*) { return NodeType::CONSTANT_UNSIGNED_INT;  }
+  NodeType VisitNode(ConstantNode<int>*         , void*) { return NodeType::CONSTANT_SIGNED_INT;    }
+  NodeType VisitNode(ConstantNode<float>*       , void*) { return NodeType::CONSTANT_FLOAT;         }
+  NodeType VisitNode(ConstantNode<bool>*        , void*) { return NodeType::CONSTANT_BOOL;          }
+  NodeType VisitNode(StringNode*                , void*) { return NodeType::STRING;                 }
+  NodeType VisitNode(CallNode*                  , void*) { return NodeType::CALL;                   }
+  NodeType VisitNode(VariableAssignmentNode*    , void*) { return NodeType::VARIABLE_ASSIGNMENT;    }
+  NodeType VisitNode(MemberAccessNode*          , void*) { return NodeType::MEMBER_ACCESS;          }
+  NodeType VisitNode(ArrayInitNode*             , void*) { return NodeType::ARRAY_INIT;             }
+  NodeType VisitNode(InfiniteLoopNode*          , void*) { return NodeType::INFINITE_LOOP;          }
+  NodeType VisitNode(ConstructNode*             , void*) { return NodeType::CONSTRUCT;              }
+};
+
+TEST(DispatchVisitsEachNodeType)
+{
+  Arena arena;
+  ArenaScope arenaScope(arena);
+
+  ASTNode* nodes[] =
+  {
+    new BreakNode(),
+    new ReturnNode(nullptr),
+    new UnaryOpNode(UnaryOpNode::Operator::NEGATIVE, nullptr),
+    new BinaryOpNode(BinaryOpNode::Operator::ADD, nullptr, nullptr),
+    new VariableNode(InternedString("a")),
+    new ConditionNode(ConditionNode::Condition::EQUAL, nullptr, nullptr),
+    new CompositeConditionNode(CompositeConditionNode::Type::AND, nullptr, nullptr),
+    new BranchNode(nullptr, nullptr, nullptr),
+    new WhileNode(nullptr, nullptr),
+    new ConstantNode<unsigned int>(4u),
+    new ConstantNode<int>(-4),
+    new ConstantNode<float>(4.0f),
+    new ConstantNode<bool>(true),
+    new StringNode(nullptr),
+    new CallNode(InternedString("F"), {}),
+    new VariableAssignmentNode(nullptr, nullptr, false),
+    new MemberAccessNode(nullptr, nullptr),
+    new ArrayInitNode({}),
+    new InfiniteLoopNode(nullptr),
+    new ConstructNode(nullptr, InternedString("T"), {}),
+  };
+
+  NodeTypePass pass;
+  for (ASTNode* node : nodes)
+  {
+    CHECK(pass.Dispatch(node) == node->nodeType);
+  }
+
+  CHECK(IsNodeOfType<BreakNode>(nodes[0u]));
+  CHECK(!IsNodeOfType<ReturnNode>(nodes[0u]));
+  CHECK(IsNodeOfType<ConstantNode<int>>(nodes[10u]));
+  CHECK(!IsNodeOfType<ConstantNode<unsigned int>>(nodes[10u]));
+  CHECK(IsNodeOfType<ConstructNode>(nodes[19u]));
+}
+
+TEST(DispatchOverParsedProgram)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn F(a : uint) -> mut uint
+    {
+      b : mut uint = a
+      while (b < 10u)
+      {
+        b = 10u
+      }
+      if (b == 10u)
+      {
+        return b
+      }
+      b = 3u
+      return b
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F(4u)
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* f = program.GetThing("F");
+  CHECK(f && f->ast);
+
+  if (f && f->ast)
+  {
+    unsigned int numNodes = 0u;
+    NodeTypePass pass;
+
+    for (ASTNode* node = f->ast;
+         node;
+         node = node->next)
+    {
+      CHECK(pass.Dispatch(node) == node->nodeType);
+      numNodes++;
+    }
+
+    CHECK(numNodes > 0u);
+  }
+}
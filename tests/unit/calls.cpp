@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <map>
+#include <x64/codeGenerator.hpp>
+
+static const char* g_callHeavyProgram = R"(
+  #[NoInline]
+  fn Add(a : uint, b : uint) -> uint
+  {
+    return a + b
+  }
+
+  #[NoInline]
+  fn Three() -> uint
+  {
+    return 3u
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    x : uint = Three()
+    y : uint = Add(x 4u)
+    z : uint = Add(x y)
+    Three()
+    if (z == 10u)
+    {
+      w : uint = Add(z x)
+      return 1
+    }
+    return 0
+  }
+)";
+
+/*
+ * The registers saved around each call should be exactly those holding values that are still needed after it.
+ */
+static void CheckLiveColorsAtCalls(bool useLinearScan)
+{
+  TestProgram program(g_callHeavyProgram, useLinearScan);
+  CHECK(!program.hasErrored);
+
+  unsigned int numCalls = 0u;
+  unsigned int numCallsWithLiveColors = 0u;
+  for (CodeThing* thing : program.parse.codeThings)
+  {
+    std::vector<std::set<unsigned int>> liveOut = FindLiveSlotsByBruteForce(thing);
+    unsigned int i = 0u;
+
+    for (AirInstruction* instruction = thing->airHead;
+         instruction;
+         instruction = instruction->next, i++)
+    {
+      if (instruction->instructionType != InstructionType::CALL)
+      {
+        continue;
+      }
+
+      CallInstruction* call = static_cast<CallInstruction*>(instruction);
+      uint32_t expectedColors = 0u;
+
+      for (unsigned int index : liveOut[i])
+      {
+        Slot* slot = thing->slots[index];
+
+        if (slot->IsColored() && slot != call->returnResult)
+        {
+          expectedColors |= (1u << slot->color);
+        }
+      }
+
+      CHECK(call->liveColors == expectedColors);
+      numCalls++;
+      numCallsWithLiveColors += (call->liveColors ? 1u : 0u);
+    }
+  }
+
+  CHECK(numCalls == 5u);
+  CHECK(numCallsWithLiveColors > 0u);
+}
+
+TEST(LiveColorsAtCallsWithGraphColoring)
+{
+  CheckLiveColorsAtCalls(false);
+}
+
+TEST(LiveColorsAtCallsWithLinearScan)
+{
+  CheckLiveColorsAtCalls(true);
+}
+
+struct FrameSummary
+{
+  unsigned int numThings;
+  unsigned int numShrinkWrapped;    // Things that save their callee-saved registers after the entry block
+  unsigned int numOddSaves;         // Things that save an odd number of callee-saved registers, and make calls
+};
+
+/*
+ * Generates the machine code for each thing in a program, and follows how far the stack pointer has moved through
+ * it: it must be 16-byte aligned at every call, every path to a label must agree on it, and every exit must have
+ * popped exactly what it pushed (so registers are only restored on paths that saved them).
+ */
+static FrameSummary CheckFrames(const char* source, bool useLinearScan)
+{
+  TestProgram program(source, useLinearScan);
+  CHECK(!program.hasErrored);
+
+  ElfFile file(program.target, false);
+  new ElfSection(file, ".text", ElfSection::Type::SHT_PROGBITS, 0x10);
+  CodeGenerator_x64 generator(program.target, file);
+  FrameSummary summary = { 0u, 0u, 0u };
+
+  for (CodeThing* thing : program.parse.codeThings)
+  {
+    if (!generator.Generate(thing, nullptr))
+    {
+      continue;
+    }
+
+    // The depth starts off just below the return address
+    unsigned int depth = 8u;
+    unsigned int frameDepth = 0u;
+    bool isReachable = true;
+    bool makesCalls = false;
+    std::map<LabelInstruction*, unsigned int> labelDepths;
+
+    for (const MachineInstr& instr : generator.instrs)
+    {
+      switch (instr.opcode)
+      {
+        case I::LABEL:
+        {
+          if (!isReachable)
+          {
+            CHECK(labelDepths.count(instr.label) == 1u);
+            depth = labelDepths[instr.label];
+          }
+
+          CHECK(labelDepths.count(instr.label) == 0u || labelDepths[instr.label] == depth);
+          labelDepths[instr.label] = depth;
+          isReachable = true;
+        } break;
+
+        case I::PUSH_REG:       depth += 8u;                                    break;
+        case I::POP_REG:        depth -= 8u;                                    break;
+        case I::SUB_REG_IMM32:  depth += (instr.a == RSP ? instr.imm : 0u);     break;
+        case I::ADD_REG_IMM32:  depth -= (instr.a == RSP ? instr.imm : 0u);     break;
+
+        case I::MOV_REG_REG:
+        {
+          if (instr.a == RBP && instr.b == RSP)
+          {
+            frameDepth = depth;
+          }
+        } break;
+
+        case I::CALL32:
+        {
+          CHECK(depth % 16u == 0u);
+          makesCalls = true;
+        } break;
+
+        case I::LEAVE:
+        {
+          CHECK(depth == frameDepth);
+          depth = frameDepth - 8u;
+        } break;
+
+        case I::RET:
+        {
+          CHECK(depth == 8u);
+          isReachable = false;
+        } break;
+
+        case I::JMP:
+        case I::JE:
+        case I::JNE:
+        case I::JG:
+        case I::JGE:
+        case I::JL:
+        case I::JLE:
+        {
+          CHECK(labelDepths.count(instr.label) == 0u || labelDepths[instr.label] == depth);
+          labelDepths[instr.label] = depth;
+          isReachable = (instr.opcode != I::JMP);
+        } break;
+
+        default:
+        {
+        } break;
+      }
+    }
+
+    summary.numThings++;
+    summary.numShrinkWrapped += (generator.savePoint > 0 ? 1u : 0u);
+    summary.numOddSaves += ((makesCalls && generator.calleeSavedRegs.size() % 2u == 1u) ? 1u : 0u);
+  }
+
+  return summary;
+}
+
+/*
+ * `F` only saves its callee-saved registers once it's past its early return, so that return mustn't restore them.
+ * `Main` keeps `a` in a callee-saved register across the calls, so it would be clobbered if `F` restored them
+ * without saving them first.
+ */
+static const char* g_earlyReturnProgram = R"(
+  #[NoInline]
+  fn Get(a : uint) -> uint
+  {
+    return a
+  }
+
+  #[NoInline]
+  fn F(p : uint) -> uint
+  {
+    if (p == 0u)
+    {
+      return 7u
+    }
+    x : uint = Get(p)
+    y : uint = Get(x)
+    z : uint = Get(y)
+    return x + y + z
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    a : uint = Get(3u)
+    b : uint = F(0u)
+    c : uint = F(a)
+    d : uint = F(0u)
+    e : uint = a + b + c + d
+    if (e == 26u)
+    {
+      return 1
+    }
+    return 0
+  }
+)";
+
+TEST(EarlyReturnsBeforeTheSavePointDontRestore)
+{
+  for (bool useLinearScan : { false, true })
+  {
+    FrameSummary summary = CheckFrames(g_earlyReturnProgram, useLinearScan);
+    CHECK(summary.numShrinkWrapped > 0u);
+    CHECK(RunProgram(g_earlyReturnProgram, useLinearScan) == 1);
+  }
+}
+
+/*
+ * `One` keeps one value across a call, and `Three` keeps three, so they each push an odd number of callee-saved
+ * registers, and have to pad the stack to keep it aligned at their calls.
+ */
+static const char* g_oddSavesProgram = R"(
+  #[NoInline]
+  fn Get(a : uint) -> uint
+  {
+    return a
+  }
+
+  #[NoInline]
+  fn One(p : uint) -> uint
+  {
+    x : uint = Get(p)
+    y : uint = Get(4u)
+    return x + y
+  }
+
+  #[NoInline]
+  fn Three(p : uint) -> uint
+  {
+    x : uint = Get(p)
+    y : uint = Get(x)
+    z : uint = Get(y)
+    w : uint = Get(z)
+    return x + y + z + w
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    a : uint = One(3u)
+    b : uint = Three(2u)
+    c : uint = a + b
+    if (c == 15u)
+    {
+      return 1
+    }
+    return 0
+  }
+)";
+
+TEST(CallsAreAlignedWithOddNumbersOfSavedRegisters)
+{
+  for (bool useLinearScan : { false, true })
+  {
+    FrameSummary summary = CheckFrames(g_oddSavesProgram, useLinearScan);
+    CHECK(summary.numOddSaves >= 2u);
+    CHECK(RunProgram(g_oddSavesProgram, useLinearScan) == 1);
+  }
+}
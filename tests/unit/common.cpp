@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+static void RewriteFile(const std::string& path, const char* contents)
+{
+  FILE* f = fopen(path.c_str(), "w");
+  fputs(contents, f);
+  fclose(f);
+}
+
+/*
+ * Sets when a file was last modified to `secondsAgo` seconds before now, or to `time` if it's given.
+ */
+static void SetModificationTime(const std::string& path, time_t secondsAgo, const timespec* time = nullptr)
+{
+  timespec times[2u];
+  clock_gettime(CLOCK_REALTIME, &times[0u]);
+  times[0u].tv_sec -= secondsAgo;
+  times[1u] = (time ? *time : times[0u]);
+  utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+/*
+ * The file is rewritten with something of the same size, and keeps its modification time, like it would if it was
+ * rewritten straight away on a file system with coarse timestamps.
+ */
+TEST(FilesRewrittenAtTheSameSizeAreMappedAgain)
+{
+  std::string path = WriteSourceFile("fn A() { }");
+  CHECK(strcmp(MapFile(path), "fn A() { }") == 0);
+
+  struct stat info;
+  stat(path.c_str(), &info);
+  RewriteFile(path, "fn B() { }");
+  SetModificationTime(path, 0, &(info.st_mtim));
+
+  CHECK(strcmp(MapFile(path), "fn B() { }") == 0);
+
+  RewriteFile(path, "fn Longer() { }");
+  CHECK(strcmp(MapFile(path), "fn Longer() { }") == 0);
+}
+
+TEST(UnchangedFilesAreOnlyMappedOnce)
+{
+  std::string path = WriteSourceFile("fn A() { }");
+  SetModificationTime(path, 60);
+
+  const char* contents = MapFile(path);
+  CHECK(strcmp(contents, "fn A() { }") == 0);
+  CHECK(MapFile(path) == contents);
+
+  // Once it's changed, it's mapped again
+  RewriteFile(path, "fn Changed() { }");
+  SetModificationTime(path, 30);
+  CHECK(strcmp(MapFile(path), "fn Changed() { }") == 0);
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <ssa.hpp>
+#include <deadCode.hpp>
+#include <constantPropagation.hpp>
+
+/*
+ * Finds what a thing returns, if it only returns in one place.
+ */
+static Slot* GetReturnValue(CodeThing* code)
+{
+  Slot* returnValue = nullptr;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType == InstructionType::RETURN)
+    {
+      if (returnValue)
+      {
+        return nullptr;
+      }
+
+      returnValue = static_cast<ReturnInstruction*>(instruction)->returnValue;
+    }
+  }
+
+  return returnValue;
+}
+
+/*
+ * Generates the AIR of the function `F` in a program, with the same passes as the compiler, but optionally without
+ * constant propagation, and counts how many instructions are left.
+ */
+static unsigned int CountInstructionsInF(const char* source, bool propagateConstants)
+{
+  TestProgram program(source, false, false);
+  CHECK(!program.hasErrored);
+  CodeThing* f = program.GetThing("F");
+  CHECK(f);
+
+  if (!f)
+  {
+    return 0u;
+  }
+
+  AirPassManager airPasses;
+  airPasses.Add(new SSAConstructionPass());
+  if (propagateConstants)
+  {
+    airPasses.Add(new ConstantPropagationPass());
+  }
+  airPasses.Add(new DeadCodeEliminationPass());
+  airPasses.Add(new SSADestructionPass());
+
+  {
+    QuietStdout quietStdout;
+    ArenaScope arenaScope(f->arena);
+    AirGenerator airGenerator(airPasses);
+    airGenerator.ApplyTo(program.parse, program.target, f);
+  }
+
+  return CountInstructions(f);
+}
+
+TEST(ArithmeticOnConstantsIsFolded)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn F() -> uint
+    {
+      a : uint = 3u
+      b : uint = a + 4u
+      c : uint = b * 2u
+      return c - 1u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F()
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* f = program.GetThing("F");
+  CHECK(f);
+
+  if (f)
+  {
+    CHECK(CountInstructions(f, InstructionType::BINARY_OP) == 0u);
+
+    Slot* returnValue = GetReturnValue(f);
+    CHECK(returnValue && returnValue->GetType() == SlotType::UNSIGNED_INT_CONSTANT);
+    CHECK(returnValue && static_cast<ConstantSlot<unsigned int>*>(returnValue)->value == 13u);
+  }
+}
+
+TEST(BranchesOnConstantsAreFolded)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn F() -> mut uint
+    {
+      a : uint = 3u
+      b : mut uint = 5u
+      if (a == 3u)
+      {
+        b = 7u
+      }
+      return b
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F()
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* f = program.GetThing("F");
+  CHECK(f);
+
+  if (f)
+  {
+    CHECK(CountInstructions(f, InstructionType::CMP) == 0u);
+
+    Slot* returnValue = GetReturnValue(f);
+    CHECK(returnValue && returnValue->GetType() == SlotType::UNSIGNED_INT_CONSTANT);
+    CHECK(returnValue && static_cast<ConstantSlot<unsigned int>*>(returnValue)->value == 7u);
+  }
+}
+
+/*
+ * Everything `F` computes is known, so once it's been folded (and the values it folded are removed as dead), it
+ * should be left with just its return.
+ */
+TEST(FoldingRemovesInstructions)
+{
+  const char* source = R"(
+    #[NoInline]
+    fn F() -> mut uint
+    {
+      a : uint = 3u
+      b : uint = a * 4u
+      c : mut uint = b - 2u
+      if (c == 10u)
+      {
+        c = 13u
+      }
+      return c
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      if (F() == 13u)
+      {
+        return 0
+      }
+      return 1
+    }
+  )";
+
+  unsigned int withoutFolding = CountInstructionsInF(source, false);
+  unsigned int withFolding = CountInstructionsInF(source, true);
+  CHECK(withFolding < withoutFolding);
+  CHECK(RunProgram(source) == 0);
+}
+
+TEST(ValuesThatVaryAreNotFolded)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn F(p : uint) -> uint
+    {
+      a : uint = 3u
+      if (p == 4u)
+      {
+        return a
+      }
+      return p + a
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F(4u)
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* f = program.GetThing("F");
+  CHECK(f);
+
+  if (f)
+  {
+    CHECK(CountInstructions(f, InstructionType::CMP) == 1u);
+    CHECK(CountInstructions(f, InstructionType::BINARY_OP) == 1u);
+  }
+}
+
+/*
+ * Constant propagation can put signed constants anywhere an operand can go, which the code generator has to be able
+ * to encode. These used to crash it.
+ */
+TEST(SignedConstantsCanBeGenerated)
+{
+  const char* addedToConstant = R"(
+    #[NoInline]
+    fn Get() -> int
+    {
+      return 5
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      v : int = Get()
+      w : int = v + 100
+      if (w == 105)
+      {
+        return 0
+      }
+      return 1
+    }
+  )";
+
+  CHECK(RunProgram(addedToConstant) == 0);
+  CHECK(RunProgram(addedToConstant, true) == 0);
+
+  const char* subtractedFromCall = R"(
+    #[NoInline]
+    fn Get() -> int
+    {
+      return 5
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      a : int = 2
+      b : int = a + 3
+      c : int = Get() - b
+      if (c == 0)
+      {
+        return 0
+      }
+      return 1
+    }
+  )";
+
+  CHECK(RunProgram(subtractedFromCall) == 0);
+  CHECK(RunProgram(subtractedFromCall, true) == 0);
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+
+TEST(UnusedValuesAreRemoved)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn F(p : uint) -> uint
+    {
+      a : uint = p + 1u
+      b : uint = a * 2u
+      c : uint = p - 3u
+      return c
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F(4u)
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* f = program.GetThing("F");
+  CHECK(f);
+
+  // `b` is never used, and so neither is `a` once `b` has gone
+  CHECK(f && CountInstructions(f, InstructionType::BINARY_OP) == 1u);
+}
+
+TEST(CallsAreKeptEvenIfTheirResultsAreNot)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn Get() -> uint
+    {
+      return 4u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      a : uint = Get()
+      b : uint = a + 1u
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main && CountInstructions(main, InstructionType::CALL) == 1u);
+  CHECK(main && CountInstructions(main, InstructionType::BINARY_OP) == 0u);
+}
+
+TEST(ThingsThatAreNeverCalledAreRemoved)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn Used() -> uint
+    {
+      return 4u
+    }
+
+    #[NoInline]
+    fn CalledByUnused() -> uint
+    {
+      return 5u
+    }
+
+    #[NoInline]
+    fn Unused() -> uint
+    {
+      return CalledByUnused()
+    }
+
+    fn Inlined(a : uint) -> uint
+    {
+      return a
+    }
+
+    fn CalledOnlyFromDeadCode() -> uint
+    {
+      return 3u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      a : uint = Inlined(Used())
+      b : uint = CalledOnlyFromDeadCode()
+      if (a == 4u)
+      {
+        return 0
+      }
+      return 1
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CHECK(program.GetThing("Main"));
+  CHECK(program.GetThing("Used"));
+  CHECK(!program.GetThing("Unused"));
+  CHECK(!program.GetThing("CalledByUnused"));
+
+  // These were inlined, so nothing calls them any more
+  CHECK(!program.GetThing("Inlined"));
+  CHECK(!program.GetThing("CalledOnlyFromDeadCode"));
+  CHECK(program.parse.codeThings.size() == 2u);
+}
+
+TEST(ProgramsRunCorrectlyWithoutDeadCode)
+{
+  const char* source = R"(
+    #[NoInline]
+    fn F(p : uint) -> uint
+    {
+      a : uint = p + 1u
+      b : uint = a * 2u
+      c : uint = p - 3u
+      if (c == 1u)
+      {
+        d : uint = b + c
+        return c
+      }
+      return 7u
+    }
+
+    #[NoInline]
+    fn Unused() -> uint
+    {
+      return 5u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      if (F(4u) == 1u)
+      {
+        return 0
+      }
+      return 1
+    }
+  )";
+
+  CHECK(RunProgram(source) == 0);
+  CHECK(RunProgram(source, true) == 0);
+}
@@ -0,0 +1,520 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <elf/elf.hpp>
+#include <x64/x64.hpp>
+#include <x64/emitter.hpp>
+
+/*
+ * Somewhere to encode instructions for the x64, outside of a real program.
+ */
+struct EncodingTest
+{
+  EncodingTest()
+    :program(R"(
+       #[Entry]
+       fn Main() -> int
+       {
+         return 0
+       }
+     )")
+    ,file(program.target, false)
+    ,text(new ElfSection(file, ".text", ElfSection::Type::SHT_PROGBITS, 0x10))
+    ,errorState()
+  {
+  }
+
+  /*
+   * Lays out and encodes some instructions into a new thing, and returns the bytes they were encoded into.
+   */
+  std::vector<uint8_t> Encode(std::vector<MachineInstr> instrs)
+  {
+    ElfThing* thing = new ElfThing(text, nullptr);
+    RelaxJumps(program.target, instrs);
+    ::Encode(&errorState, file, thing, program.target, instrs);
+    return std::vector<uint8_t>(thing->data, thing->data + thing->length);
+  }
+
+  TestProgram program;
+  ElfFile     file;
+  ElfSection* text;
+  ErrorState  errorState;
+};
+
+/*
+ * Instructions of every form that can be encoded, using registers that need a REX prefix and ones that don't,
+ * and bases that need a SIB or a displacement of each size.
+ */
+static std::vector<MachineInstr> GetInstructionsOfEveryForm()
+{
+  const Reg_x64 regs[] = { RAX, RCX, RSP, RBP, RDI, R8, R12, R13, R15 };
+  const uint32_t disps[] = { 0u, 8u, 127u, 128u, 200u, 4096u, static_cast<uint32_t>(-8), static_cast<uint32_t>(-128),
+                             static_cast<uint32_t>(-129) };
+  std::vector<MachineInstr> instrs;
+
+  instrs.push_back(MachineInstr::None(I::LEAVE));
+  instrs.push_back(MachineInstr::None(I::RET));
+  instrs.push_back(MachineInstr::Imm(I::CALL32, 0u));
+  instrs.push_back(MachineInstr::Imm(I::INT_IMM8, 0x80));
+
+  for (Reg_x64 a : regs)
+  {
+    for (I opcode : { I::PUSH_REG, I::POP_REG, I::INC_REG, I::DEC_REG, I::NOT_REG, I::NEG_REG })
+    {
+      instrs.push_back(MachineInstr::Reg(opcode, a));
+    }
+
+    for (I opcode : { I::CMP_REG_IMM32, I::ADD_REG_IMM32, I::SUB_REG_IMM32, I::MUL_REG_IMM32, I::MOV_REG_IMM32,
+                      I::MOV_REG_IMM64, I::SHL_REG_IMM8 })
+    {
+      instrs.push_back(MachineInstr::RegImm(opcode, a, 3u));
+    }
+
+    for (Reg_x64 b : regs)
+    {
+      for (I opcode : { I::CMP_REG_REG, I::ADD_REG_REG, I::SUB_REG_REG, I::MUL_REG_REG, I::XOR_REG_REG,
+                        I::MOV_REG_REG })
+      {
+        instrs.push_back(MachineInstr::RegReg(opcode, a, b));
+      }
+
+      for (uint32_t disp : disps)
+      {
+        instrs.push_back(MachineInstr::RegMem(I::MOV_REG_BASE_DISP, a, b, disp));
+        instrs.push_back(MachineInstr::MemReg(I::MOV_BASE_DISP_REG, b, disp, a));
+        instrs.push_back(MachineInstr::MemImm(I::MOV_BASE_DISP_IMM32, b, disp, 7u));
+        instrs.push_back(MachineInstr::MemImm(I::MOV_BASE_DISP_IMM64, b, disp, 7u));
+      }
+    }
+  }
+
+  return instrs;
+}
+
+/*
+ * `RelaxJumps` lays out the instructions from the sizes it thinks they'll be, so each label has to be where the
+ * encoder actually puts it, or jumps would land in the middle of instructions.
+ */
+TEST(EncodedInstructionsMatchTheirLayout)
+{
+  Arena arena;
+  ArenaScope arenaScope(arena);
+  EncodingTest test;
+
+  // Put a label after each instruction, and jumps both ways over all of them
+  std::vector<MachineInstr> body = GetInstructionsOfEveryForm();
+  LabelInstruction* start = new LabelInstruction();
+  LabelInstruction* end = new LabelInstruction();
+  std::vector<MachineInstr> instrs;
+
+  instrs.push_back(MachineInstr::Label(start));
+  instrs.push_back(MachineInstr::Jump(I::JE, end));
+  instrs.push_back(MachineInstr::Jump(I::JMP, start));
+  for (const MachineInstr& instr : body)
+  {
+    instrs.push_back(instr);
+    instrs.push_back(MachineInstr::Label(new LabelInstruction()));
+  }
+  instrs.push_back(MachineInstr::Jump(I::JNE, start));
+  instrs.push_back(MachineInstr::Jump(I::JMP, end));
+  instrs.push_back(MachineInstr::Label(end));
+
+  RelaxJumps(test.program.target, instrs);
+  CHECK(!(instrs[1u].isShortJump));
+  CHECK(instrs[2u].isShortJump);
+  CHECK(!(instrs[instrs.size() - 3u].isShortJump));
+  CHECK(instrs[instrs.size() - 2u].isShortJump);
+
+  // Encode the instructions one at a time, so we can see where each one ends
+  ElfThing* thing = new ElfThing(test.text, nullptr);
+  for (const MachineInstr& instr : instrs)
+  {
+    if (instr.opcode == I::LABEL)
+    {
+      CHECK(instr.label->offset == thing->length);
+      continue;
+    }
+
+    Encode(&(test.errorState), test.file, thing, test.program.target, { instr });
+  }
+
+  CHECK(end->offset == thing->length);
+  CHECK(!(test.errorState.hasErrored));
+}
+
+struct GoldenEncoding
+{
+  MachineInstr          instr;
+  std::vector<uint8_t>  bytes;
+};
+
+/*
+ * These were checked against what a disassembler makes of them.
+ */
+TEST(InstructionsAreEncodedCorrectly)
+{
+  EncodingTest test;
+  const uint32_t MINUS_8 = static_cast<uint32_t>(-8);
+  const GoldenEncoding encodings[] =
+  {
+    { MachineInstr::Reg(I::PUSH_REG, RBP),                    { 0x55 } },
+    { MachineInstr::Reg(I::PUSH_REG, R12),                    { 0x41, 0x54 } },
+    { MachineInstr::Reg(I::POP_REG, RDI),                     { 0x5F } },
+    { MachineInstr::Reg(I::POP_REG, R15),                     { 0x41, 0x5F } },
+    { MachineInstr::RegReg(I::MOV_REG_REG, RBP, RSP),         { 0x48, 0x89, 0xE5 } },
+    { MachineInstr::RegReg(I::MOV_REG_REG, R8, RAX),          { 0x49, 0x89, 0xC0 } },
+    { MachineInstr::RegReg(I::ADD_REG_REG, RAX, RBX),         { 0x48, 0x01, 0xD8 } },
+    { MachineInstr::RegReg(I::SUB_REG_REG, RCX, R9),          { 0x4C, 0x29, 0xC9 } },
+    { MachineInstr::RegReg(I::MUL_REG_REG, RAX, RSI),         { 0x48, 0x0F, 0xAF, 0xC6 } },
+    { MachineInstr::RegReg(I::MUL_REG_REG, R10, RDX),         { 0x4C, 0x0F, 0xAF, 0xD2 } },
+    { MachineInstr::RegReg(I::XOR_REG_REG, RAX, RAX),         { 0x48, 0x31, 0xC0 } },
+    { MachineInstr::RegReg(I::CMP_REG_REG, RDI, RSI),         { 0x39, 0xF7 } },
+    { MachineInstr::RegReg(I::CMP_REG_REG, R8, RAX),          { 0x41, 0x39, 0xC0 } },
+    { MachineInstr::RegImm(I::CMP_REG_IMM32, RAX, 5u),        { 0x81, 0xF8, 0x05, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegImm(I::CMP_REG_IMM32, RDI, 5u),        { 0x81, 0xFF, 0x05, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegImm(I::CMP_REG_IMM32, R9, 5u),         { 0x41, 0x81, 0xF9, 0x05, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegImm(I::ADD_REG_IMM32, RSP, 16u),       { 0x48, 0x81, 0xC4, 0x10, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegImm(I::SUB_REG_IMM32, RSP, 16u),       { 0x48, 0x81, 0xEC, 0x10, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegImm(I::MUL_REG_IMM32, RAX, 3u),        { 0x48, 0x6B, 0xC0, 0x03 } },
+    { MachineInstr::RegImm(I::SHL_REG_IMM8, RCX, 2u),         { 0x48, 0xC1, 0xE1, 0x02 } },
+    { MachineInstr::RegImm(I::MOV_REG_IMM32, RAX, 5u),        { 0xB8, 0x05, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegImm(I::MOV_REG_IMM32, R9, 5u),         { 0x41, 0xB9, 0x05, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegImm(I::MOV_REG_IMM64, RDI, 0x1122334455667788u),
+                                                              { 0x48, 0xBF, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22,
+                                                                0x11 } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RAX, RBP, MINUS_8),  { 0x48, 0x8B, 0x45, 0xF8 } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RAX, RSP, 8u),       { 0x48, 0x8B, 0x44, 0x24, 0x08 } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RAX, R13, 0u),       { 0x49, 0x8B, 0x45, 0x00 } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RCX, RBX, 200u),     { 0x48, 0x8B, 0x8B, 0xC8, 0x00, 0x00, 0x00 } },
+    { MachineInstr::MemReg(I::MOV_BASE_DISP_REG, RBP, 0xFFFFFFF0, RDI), { 0x48, 0x89, 0x7D, 0xF0 } },
+    { MachineInstr::MemReg(I::MOV_BASE_DISP_REG, R12, 16u, R11),      { 0x4D, 0x89, 0x5C, 0x24, 0x10 } },
+    { MachineInstr::MemImm(I::MOV_BASE_DISP_IMM32, RBP, 0xFFFFFFFC, 7u),
+                                                              { 0xC7, 0x45, 0xFC, 0x07, 0x00, 0x00, 0x00 } },
+    { MachineInstr::Reg(I::INC_REG, RAX),                     { 0xFF, 0xC0 } },
+    { MachineInstr::Reg(I::DEC_REG, RCX),                     { 0xFF, 0xC9 } },
+    { MachineInstr::Reg(I::NOT_REG, RDX),                     { 0xF7, 0xD2 } },
+    { MachineInstr::Reg(I::NEG_REG, R8),                      { 0x41, 0xF7, 0xD8 } },
+    { MachineInstr::Imm(I::CALL32, 0u),                       { 0xE8, 0x00, 0x00, 0x00, 0x00 } },
+    { MachineInstr::Imm(I::INT_IMM8, 0x80),                   { 0xCD, 0x80 } },
+    { MachineInstr::None(I::LEAVE),                           { 0xC9 } },
+    { MachineInstr::None(I::RET),                             { 0xC3 } },
+  };
+
+  for (const GoldenEncoding& encoding : encodings)
+  {
+    CHECK(test.Encode({ encoding.instr }) == encoding.bytes);
+  }
+
+  CHECK(!(test.errorState.hasErrored));
+}
+
+struct BaselineEncoding
+{
+  MachineInstr          instr;
+  std::vector<uint8_t>  baseline;
+  std::vector<uint8_t>  corrected;
+};
+
+/*
+ * The bytes the emitter made for a fixed function body before instructions were encoded in their own pass (so
+ * straight from `Emit`), which the encoder should reproduce exactly. The only differences allowed are the
+ * encodings that have been fixed since, which are given after the baseline:
+ *   - displacements of 128 and over were encoded in one byte, and so sign-extended to a different address
+ *   - negative displacements that fit in one byte were always encoded in four (which was correct, but longer)
+ *   - CMP and IMUL between two registers had their operands backwards
+ *   - comparing with an immediate only worked on EAX (and now works on any register)
+ * Jumps aren't included, because their offsets were filled in by relocations, and are checked by the layout test.
+ */
+TEST(EncodingMatchesTheBaselineEmitter)
+{
+  EncodingTest test;
+  const uint32_t MINUS_8 = static_cast<uint32_t>(-8);
+  const uint32_t MINUS_16 = static_cast<uint32_t>(-16);
+  const uint32_t MINUS_200 = static_cast<uint32_t>(-200);
+  const BaselineEncoding encodings[] =
+  {
+    { MachineInstr::Reg(I::PUSH_REG, RBP),
+      { 0x55 }, { } },
+    { MachineInstr::RegReg(I::MOV_REG_REG, RBP, RSP),
+      { 0x48, 0x89, 0xE5 }, { } },
+    { MachineInstr::Reg(I::PUSH_REG, RBX),
+      { 0x53 }, { } },
+    { MachineInstr::Reg(I::PUSH_REG, R12),
+      { 0x41, 0x54 }, { } },
+    { MachineInstr::RegImm(I::SUB_REG_IMM32, RSP, 24u),
+      { 0x48, 0x81, 0xEC, 0x18, 0x00, 0x00, 0x00 }, { } },
+    { MachineInstr::MemReg(I::MOV_BASE_DISP_REG, RBP, MINUS_8, RDI),
+      { 0x48, 0x89, 0xBD, 0xF8, 0xFF, 0xFF, 0xFF },
+      { 0x48, 0x89, 0x7D, 0xF8 } },
+    { MachineInstr::MemImm(I::MOV_BASE_DISP_IMM32, RBP, MINUS_16, 5u),
+      { 0xC7, 0x85, 0xF0, 0xFF, 0xFF, 0xFF, 0x05, 0x00, 0x00, 0x00 },
+      { 0xC7, 0x45, 0xF0, 0x05, 0x00, 0x00, 0x00 } },
+    { MachineInstr::MemImm(I::MOV_BASE_DISP_IMM64, RBP, MINUS_200, 0x1122334455667788u),
+      { 0x48, 0xC7, 0x85, 0x38, 0xFF, 0xFF, 0xFF, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 }, { } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RAX, RBP, MINUS_8),
+      { 0x48, 0x8B, 0x85, 0xF8, 0xFF, 0xFF, 0xFF },
+      { 0x48, 0x8B, 0x45, 0xF8 } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RCX, RBP, MINUS_200),
+      { 0x48, 0x8B, 0x8D, 0x38, 0xFF, 0xFF, 0xFF }, { } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RDX, RBX, 200u),
+      { 0x48, 0x8B, 0x53, 0xC8 },
+      { 0x48, 0x8B, 0x93, 0xC8, 0x00, 0x00, 0x00 } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, RAX, RSP, 8u),
+      { 0x48, 0x8B, 0x44, 0x24, 0x08 }, { } },
+    { MachineInstr::RegMem(I::MOV_REG_BASE_DISP, R8, R13, 0u),
+      { 0x4D, 0x8B, 0x45, 0x00 }, { } },
+    { MachineInstr::MemReg(I::MOV_BASE_DISP_REG, R12, 16u, R11),
+      { 0x4D, 0x89, 0x5C, 0x24, 0x10 }, { } },
+    { MachineInstr::RegReg(I::MOV_REG_REG, R12, RAX),
+      { 0x49, 0x89, 0xC4 }, { } },
+    { MachineInstr::RegReg(I::ADD_REG_REG, R12, RCX),
+      { 0x49, 0x01, 0xCC }, { } },
+    { MachineInstr::RegReg(I::SUB_REG_REG, RAX, R8),
+      { 0x4C, 0x29, 0xC0 }, { } },
+    { MachineInstr::RegReg(I::MUL_REG_REG, RAX, RSI),
+      { 0x48, 0x0F, 0xAF, 0xF0 },
+      { 0x48, 0x0F, 0xAF, 0xC6 } },
+    { MachineInstr::RegReg(I::MUL_REG_REG, R10, RDX),
+      { 0x49, 0x0F, 0xAF, 0xD2 },
+      { 0x4C, 0x0F, 0xAF, 0xD2 } },
+    { MachineInstr::RegImm(I::MUL_REG_IMM32, RAX, 3u),
+      { 0x48, 0x6B, 0xC0, 0x03 }, { } },
+    { MachineInstr::RegImm(I::ADD_REG_IMM32, RCX, 1000u),
+      { 0x48, 0x81, 0xC1, 0xE8, 0x03, 0x00, 0x00 }, { } },
+    { MachineInstr::RegImm(I::SHL_REG_IMM8, RCX, 2u),
+      { 0x48, 0xC1, 0xE1, 0x02 }, { } },
+    { MachineInstr::RegReg(I::XOR_REG_REG, RDX, RDX),
+      { 0x48, 0x31, 0xD2 }, { } },
+    { MachineInstr::RegImm(I::MOV_REG_IMM32, RBX, 7u),
+      { 0xBB, 0x07, 0x00, 0x00, 0x00 }, { } },
+    { MachineInstr::RegImm(I::MOV_REG_IMM64, R9, 0x1122334455667788u),
+      { 0x49, 0xB9, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 }, { } },
+    { MachineInstr::Reg(I::INC_REG, RAX),
+      { 0xFF, 0xC0 }, { } },
+    { MachineInstr::Reg(I::DEC_REG, R9),
+      { 0x41, 0xFF, 0xC9 }, { } },
+    { MachineInstr::Reg(I::NOT_REG, RDX),
+      { 0xF7, 0xD2 }, { } },
+    { MachineInstr::Reg(I::NEG_REG, R8),
+      { 0x41, 0xF7, 0xD8 }, { } },
+    { MachineInstr::RegReg(I::CMP_REG_REG, RAX, RCX),
+      { 0x39, 0xC1 },
+      { 0x39, 0xC8 } },
+    { MachineInstr::RegReg(I::CMP_REG_REG, R8, RAX),
+      { 0x44, 0x39, 0xC0 },
+      { 0x41, 0x39, 0xC0 } },
+    { MachineInstr::RegImm(I::CMP_REG_IMM32, RAX, 9u),
+      { 0x3D, 0x09, 0x00, 0x00, 0x00 },
+      { 0x81, 0xF8, 0x09, 0x00, 0x00, 0x00 } },
+    { MachineInstr::Imm(I::INT_IMM8, 0x80),
+      { 0xCD, 0x80 }, { } },
+    { MachineInstr::RegImm(I::ADD_REG_IMM32, RSP, 24u),
+      { 0x48, 0x81, 0xC4, 0x18, 0x00, 0x00, 0x00 }, { } },
+    { MachineInstr::Reg(I::POP_REG, R12),
+      { 0x41, 0x5C }, { } },
+    { MachineInstr::Reg(I::POP_REG, RBX),
+      { 0x5B }, { } },
+    { MachineInstr::None(I::LEAVE),
+      { 0xC9 }, { } },
+    { MachineInstr::None(I::RET),
+      { 0xC3 }, { } },
+  };
+
+  for (const BaselineEncoding& encoding : encodings)
+  {
+    std::vector<uint8_t> bytes = test.Encode({ encoding.instr });
+    CHECK(bytes == (encoding.corrected.empty() ? encoding.baseline : encoding.corrected));
+  }
+
+  CHECK(!(test.errorState.hasErrored));
+}
+
+TEST(JumpsAreEncodedCorrectly)
+{
+  Arena arena;
+  ArenaScope arenaScope(arena);
+  EncodingTest test;
+  LabelInstruction* label = new LabelInstruction();
+
+  // Short jumps, forwards and backwards
+  CHECK(test.Encode({ MachineInstr::Jump(I::JMP, label), MachineInstr::Label(label) }) ==
+        std::vector<uint8_t>({ 0xEB, 0x00 }));
+  CHECK(test.Encode({ MachineInstr::Label(label), MachineInstr::Jump(I::JE, label) }) ==
+        std::vector<uint8_t>({ 0x74, 0xFE }));
+  CHECK(test.Encode({ MachineInstr::Jump(I::JG, label), MachineInstr::None(I::RET), MachineInstr::Label(label) }) ==
+        std::vector<uint8_t>({ 0x7F, 0x01, 0xC3 }));
+
+  // Long jumps, over 100 instructions of 7 bytes each
+  std::vector<MachineInstr> instrs = { MachineInstr::Jump(I::JNE, label), MachineInstr::Jump(I::JMP, label) };
+  for (unsigned int i = 0u;
+       i < 100u;
+       i++)
+  {
+    instrs.push_back(MachineInstr::RegImm(I::ADD_REG_IMM32, RAX, 1u));
+  }
+  instrs.push_back(MachineInstr::Label(label));
+
+  std::vector<uint8_t> bytes = test.Encode(instrs);
+  CHECK(bytes.size() == 711u);
+  CHECK(std::vector<uint8_t>(bytes.begin(), bytes.begin() + 11u) ==
+        std::vector<uint8_t>({ 0x0F, 0x85, 0xC1, 0x02, 0x00, 0x00, 0xE9, 0xBC, 0x02, 0x00, 0x00 }));
+}
+
+/*
+ * Makes a jump over `n` bytes of RETs, forwards to a label after them, or backwards to one before them.
+ */
+static std::vector<MachineInstr> JumpOver(I opcode, unsigned int n, bool isForwards, LabelInstruction* label)
+{
+  std::vector<MachineInstr> instrs;
+
+  if (!isForwards)
+  {
+    instrs.push_back(MachineInstr::Label(label));
+  }
+  else
+  {
+    instrs.push_back(MachineInstr::Jump(opcode, label));
+  }
+
+  for (unsigned int i = 0u;
+       i < n;
+       i++)
+  {
+    instrs.push_back(MachineInstr::None(I::RET));
+  }
+
+  if (isForwards)
+  {
+    instrs.push_back(MachineInstr::Label(label));
+  }
+  else
+  {
+    instrs.push_back(MachineInstr::Jump(opcode, label));
+  }
+
+  return instrs;
+}
+
+/*
+ * A short jump's offset is from the end of the jump, and has to fit in [-128, 127]. Backwards jumps also jump back
+ * over themselves, so only reach 126 bytes of other instructions.
+ */
+TEST(JumpsAreShortJustInsideTheirRange)
+{
+  Arena arena;
+  ArenaScope arenaScope(arena);
+  EncodingTest test;
+  LabelInstruction* label = new LabelInstruction();
+
+  std::vector<uint8_t> bytes = test.Encode(JumpOver(I::JMP, 127u, true, label));
+  CHECK(bytes.size() == 129u && bytes[0u] == 0xEB && bytes[1u] == 0x7F);
+
+  bytes = test.Encode(JumpOver(I::JE, 127u, true, label));
+  CHECK(bytes.size() == 129u && bytes[0u] == 0x74 && bytes[1u] == 0x7F);
+
+  bytes = test.Encode(JumpOver(I::JMP, 126u, false, label));
+  CHECK(bytes.size() == 128u && bytes[126u] == 0xEB && bytes[127u] == 0x80);
+
+  bytes = test.Encode(JumpOver(I::JNE, 126u, false, label));
+  CHECK(bytes.size() == 128u && bytes[126u] == 0x75 && bytes[127u] == 0x80);
+  CHECK(!(test.errorState.hasErrored));
+}
+
+TEST(JumpsAreLongJustOutsideTheirRange)
+{
+  Arena arena;
+  ArenaScope arenaScope(arena);
+  EncodingTest test;
+  LabelInstruction* label = new LabelInstruction();
+
+  std::vector<uint8_t> bytes = test.Encode(JumpOver(I::JMP, 128u, true, label));
+  CHECK(bytes.size() == 133u);
+  CHECK(std::vector<uint8_t>(bytes.begin(), bytes.begin() + 5u) ==
+        std::vector<uint8_t>({ 0xE9, 0x80, 0x00, 0x00, 0x00 }));
+
+  bytes = test.Encode(JumpOver(I::JE, 128u, true, label));
+  CHECK(bytes.size() == 134u);
+  CHECK(std::vector<uint8_t>(bytes.begin(), bytes.begin() + 6u) ==
+        std::vector<uint8_t>({ 0x0F, 0x84, 0x80, 0x00, 0x00, 0x00 }));
+
+  // The long form is longer, so jumps back over more of itself: -(127 + 5) and -(127 + 6)
+  bytes = test.Encode(JumpOver(I::JMP, 127u, false, label));
+  CHECK(bytes.size() == 132u);
+  CHECK(std::vector<uint8_t>(bytes.begin() + 127u, bytes.end()) ==
+        std::vector<uint8_t>({ 0xE9, 0x7C, 0xFF, 0xFF, 0xFF }));
+
+  bytes = test.Encode(JumpOver(I::JNE, 127u, false, label));
+  CHECK(bytes.size() == 133u);
+  CHECK(std::vector<uint8_t>(bytes.begin() + 127u, bytes.end()) ==
+        std::vector<uint8_t>({ 0x0F, 0x85, 0x7B, 0xFF, 0xFF, 0xFF }));
+  CHECK(!(test.errorState.hasErrored));
+}
+
+/*
+ * The JE only just reaches its label while the JMP it jumps over is short, but the JMP doesn't reach its own label,
+ * so once it's been lengthened, the JE has to be too.
+ */
+TEST(LengtheningAJumpCanPushAnotherOutOfRange)
+{
+  Arena arena;
+  ArenaScope arenaScope(arena);
+  LabelInstruction* end = new LabelInstruction();
+  LabelInstruction* far = new LabelInstruction();
+
+  std::vector<MachineInstr> instrs = JumpOver(I::JE, 125u, true, end);
+  instrs.insert(instrs.end() - 1u, MachineInstr::Jump(I::JMP, far));
+  for (unsigned int i = 0u;
+       i < 130u;
+       i++)
+  {
+    instrs.push_back(MachineInstr::None(I::RET));
+  }
+  instrs.push_back(MachineInstr::Label(far));
+
+  EncodingTest test;
+  RelaxJumps(test.program.target, instrs);
+  CHECK(!(instrs[0u].isShortJump));
+  CHECK(!(instrs[126u].isShortJump));
+  CHECK(end->offset == 6u + 125u + 5u);
+  CHECK(far->offset == end->offset + 130u);
+}
+
+/*
+ * Comparisons and multiplications between two registers have operands in both fields of the ModR/M byte, so get
+ * them the wrong way around if they're encoded backwards.
+ */
+static const char* g_registerOperandsProgram = R"(
+  #[NoInline]
+  fn Less(a : int, b : int) -> int
+  {
+    if (a < b)
+    {
+      return 1
+    }
+    return 0
+  }
+
+  #[NoInline]
+  fn Mul(a : int, b : int) -> int
+  {
+    c : int = a * b
+    return c + a
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    l : int = Less(3 5)
+    m : int = Mul(6 7)
+    return l * 100 + m
+  }
+)";
+
+TEST(RegisterOperandsAreTheRightWayAround)
+{
+  CHECK(RunProgram(g_registerOperandsProgram) == 148);
+  CHECK(RunProgram(g_registerOperandsProgram, true) == 148);
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+
+/*
+ * Counts the calls a thing makes to the function called `name`.
+ */
+static unsigned int CountCallsTo(CodeThing* code, const char* name)
+{
+  unsigned int count = 0u;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType == InstructionType::CALL)
+    {
+      CodeThing* thing = static_cast<CallInstruction*>(instruction)->thing;
+
+      if (thing->type == CodeThing::Type::FUNCTION && static_cast<FunctionThing*>(thing)->name.Str() == name)
+      {
+        count++;
+      }
+    }
+  }
+
+  return count;
+}
+
+/*
+ * A function that's definitely over the inlining budget, by doing lots of work on its parameter.
+ */
+static std::string MakeBigFunction(const char* attribute, const char* name)
+{
+  std::string source = FormatString("%s\n"
+                                    "fn %s(p : uint) -> uint\n"
+                                    "{\n"
+                                    "  x0 : uint = p + 1u\n", attribute, name);
+  for (unsigned int i = 1u;
+       i < 20u;
+       i++)
+  {
+    source += FormatString("  x%u : uint = x%u + p\n", i, i - 1u);
+  }
+
+  source += "  return x19\n"
+            "}\n\n";
+  return source;
+}
+
+static const char* g_getFunction = R"(
+  #[NoInline]
+  fn Get() -> uint
+  {
+    return 4u
+  }
+)";
+
+TEST(SmallFunctionsAreInlined)
+{
+  TestProgram program(g_getFunction + std::string(R"(
+    fn Small(a : uint) -> uint
+    {
+      return a + 1u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      if (Small(Get()) == 5u)
+      {
+        return 0
+      }
+      return 1
+    }
+  )"));
+
+  CHECK(!program.hasErrored);
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main && CountCallsTo(main, "Get") == 1u);
+  CHECK(main && CountCallsTo(main, "Small") == 0u);
+  CHECK(main && CountInstructions(main, InstructionType::BINARY_OP) == 1u);
+}
+
+TEST(NoInlineFunctionsAreNeverInlined)
+{
+  TestProgram program(g_getFunction + std::string(R"(
+    #[NoInline]
+    fn Small(a : uint) -> uint
+    {
+      return a
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      Small(Get())
+      Small(3u)
+      return 0
+    }
+  )"));
+
+  CHECK(!program.hasErrored);
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main && CountCallsTo(main, "Small") == 2u);
+}
+
+TEST(BigFunctionsAreOnlyInlinedIfAskedFor)
+{
+  TestProgram program(g_getFunction + MakeBigFunction("", "Big") + MakeBigFunction("#[Inline]", "BigInline") + R"(
+    #[Entry]
+    fn Main() -> int
+    {
+      Big(Get())
+      BigInline(Get())
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main && CountCallsTo(main, "Big") == 1u);
+  CHECK(main && CountCallsTo(main, "BigInline") == 0u);
+}
+
+/*
+ * Calls are inlined into inlined code, but only so deep, so a long chain of calls is eventually broken by a real
+ * call.
+ */
+TEST(InliningStopsAtMaximumDepth)
+{
+  TestProgram program(g_getFunction + std::string(R"(
+    fn A(x : uint) -> uint
+    {
+      return B(x)
+    }
+
+    fn B(x : uint) -> uint
+    {
+      return C(x)
+    }
+
+    fn C(x : uint) -> uint
+    {
+      return D(x)
+    }
+
+    fn D(x : uint) -> uint
+    {
+      return E(x)
+    }
+
+    fn E(x : uint) -> uint
+    {
+      return F(x)
+    }
+
+    fn F(x : uint) -> uint
+    {
+      return x
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      A(Get())
+      return 0
+    }
+  )"));
+
+  CHECK(!program.hasErrored);
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main && CountInstructions(main, InstructionType::CALL) == 2u);
+  CHECK(main && CountCallsTo(main, "Get") == 1u);
+  CHECK(main && CountCallsTo(main, "E") == 1u);
+}
+
+TEST(RecursiveCallsAreNotInlinedIntoThemselves)
+{
+  TestProgram program(g_getFunction + std::string(R"(
+    fn R(n : uint) -> uint
+    {
+      if (n == 0u)
+      {
+        return n
+      }
+      m : uint = n - 1u
+      return R(m)
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      R(Get())
+      return 0
+    }
+  )"));
+
+  CHECK(!program.hasErrored);
+  CodeThing* r = program.GetThing("R");
+  CHECK(r && CountCallsTo(r, "R") == 1u);
+
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main && CountCallsTo(main, "R") == 1u);
+}
+
+TEST(InlinedCodeRunsCorrectly)
+{
+  std::string source = g_getFunction + MakeBigFunction("#[Inline]", "BigInline") + R"(
+    fn Add(a : uint, b : uint) -> uint
+    {
+      return a + b
+    }
+
+    fn Pick(a : uint) -> uint
+    {
+      if (a == 4u)
+      {
+        return 7u
+      }
+      return 9u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      x : uint = Add(Get() 3u)
+      y : uint = Pick(Get())
+      z : uint = BigInline(Get())
+      if (x == y)
+      {
+        if (z == 81u)
+        {
+          return 0
+        }
+        return 2
+      }
+      return 1
+    }
+  )";
+
+  CHECK(RunProgram(source) == 0);
+  CHECK(RunProgram(source, true) == 0);
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <set>
+#include <utility>
+#include <liveness.hpp>
+
+/*
+ * Works out which slots interfere in the simplest way we can: each slot an instruction writes interferes with
+ * everything live after it, and everything else it reads (apart from the source of a MOV).
+ */
+static std::set<std::pair<unsigned int, unsigned int>> FindInterferencesByBruteForce(CodeThing* code)
+{
+  std::vector<std::set<unsigned int>> liveOut = FindLiveSlotsByBruteForce(code);
+  std::set<std::pair<unsigned int, unsigned int>> interferences;
+  LiveOperands operands;
+  unsigned int i = 0u;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next, i++)
+  {
+    GetLiveOperands(instruction, operands);
+    Slot* moveSource = (instruction->instructionType == InstructionType::MOV ?
+                          static_cast<MovInstruction*>(instruction)->src : nullptr);
+
+    for (Slot* def : operands.defs)
+    {
+      std::set<unsigned int> others = liveOut[i];
+      for (Slot* use : operands.uses) others.insert(use->index);
+
+      for (unsigned int other : others)
+      {
+        if (other != def->index && (!moveSource || other != moveSource->index))
+        {
+          interferences.insert(std::make_pair(def->index, other));
+          interferences.insert(std::make_pair(other, def->index));
+        }
+      }
+    }
+  }
+
+  return interferences;
+}
+
+static void CheckInterferenceGraph(const std::string& source)
+{
+  TestProgram program(source);
+  CHECK(!program.hasErrored);
+
+  for (CodeThing* thing : program.parse.codeThings)
+  {
+    if (!(thing->airHead))
+    {
+      continue;
+    }
+
+    std::set<std::pair<unsigned int, unsigned int>> expected = FindInterferencesByBruteForce(thing);
+    std::set<std::pair<unsigned int, unsigned int>> found;
+    unsigned int numFound = 0u;
+
+    for (Slot* slot : thing->slots)
+    {
+      for (Slot* interference : slot->interferences)
+      {
+        found.insert(std::make_pair(slot->index, interference->index));
+        numFound++;
+      }
+    }
+
+    // Each interference should be found, only once, and in both directions
+    CHECK(found == expected);
+    CHECK(numFound == found.size());
+  }
+}
+
+TEST(InterferenceGraphOfBranchesAndLoops)
+{
+  CheckInterferenceGraph(R"(
+    fn Pick(n : mut uint) -> mut uint
+    {
+      a : mut uint = 1u
+      b : mut uint = 2u
+      if (n == 3u)
+      {
+        a = b
+        b = 9u
+      }
+      else
+      {
+        b = a
+      }
+      while (n < 10u)
+      {
+        t : mut uint = a
+        a = b
+        b = t
+      }
+      return b
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      Pick(3u)
+      return 0
+    }
+  )");
+}
+
+/*
+ * The edges are checked against the brute-force graph, but that can't tell whether the registers the slots end up
+ * in are actually right, so the program is run too.
+ */
+TEST(InterferenceGraphAcrossCalls)
+{
+  const char* source = R"(
+    #[NoInline]
+    fn Add(a : uint, b : uint, c : uint) -> uint
+    {
+      return a + b + c
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      x : uint = Add(1u 2u 3u)
+      y : uint = Add(x 4u 5u)
+      z : uint = Add(x y x)
+      if (z == 27u)
+      {
+        return 1
+      }
+      return 0
+    }
+  )";
+
+  CheckInterferenceGraph(source);
+  CHECK(RunProgram(source) == 1);
+}
+
+/*
+ * This has more values live at once than there are registers, so some are spilled, and the graph that's left is
+ * the one built after the AIR has been rewritten to load and store them.
+ */
+TEST(InterferenceGraphAfterSpilling)
+{
+  std::string source = "#[NoInline]\n"
+                       "fn Many(p : uint) -> uint\n"
+                       "{\n";
+  for (unsigned int i = 0u;
+       i < 24u;
+       i++)
+  {
+    source += FormatString("  a%u : uint = p + %uu\n", i, i);
+  }
+
+  source += "  return a0";
+  for (unsigned int i = 1u;
+       i < 24u;
+       i++)
+  {
+    source += FormatString(" + a%u", i);
+  }
+
+  source += "\n"
+            "}\n\n"
+            "#[Entry]\n"
+            "fn Main() -> int\n"
+            "{\n"
+            "  Many(3u)\n"
+            "  return 0\n"
+            "}\n";
+
+  CheckInterferenceGraph(source);
+}
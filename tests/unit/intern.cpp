@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <type_traits>
+#include <intern.hpp>
+
+/*
+ * Interning a string means looking it up in the table, so it should never happen without being asked for.
+ */
+static_assert(!std::is_convertible<const char*, InternedString>::value, "Strings shouldn't be interned implicitly");
+static_assert(!std::is_convertible<std::string, InternedString>::value, "Strings shouldn't be interned implicitly");
+
+TEST(InternedStringsAreTheSameExactlyWhenTheirTextIs)
+{
+  std::string name = "NoInline";
+  const char* source = "NoInlineX";
+
+  InternedString a("NoInline");
+  CHECK(a == InternedString(name));
+  CHECK(a == InternedString(source, 8u));
+  CHECK(a.c_str() == InternedString(name).c_str());
+  CHECK(a != InternedString(source, 9u));
+  CHECK(a != InternedString("Inline"));
+  CHECK(a.Str() == "NoInline");
+
+  CHECK(InternedString().IsEmpty());
+  CHECK(InternedString("") == InternedString());
+  CHECK(InternedString(source, 0u) == InternedString());
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <cstring>
+#include <parsing.hpp>
+
+static bool IsKeyword(const char* name, RooKeyword expected)
+{
+  RooKeyword keyword;
+  return LookupKeyword<RooKeyword>(name, strlen(name), keyword) && (keyword == expected);
+}
+
+static bool IsNotKeyword(const char* name)
+{
+  RooKeyword keyword;
+  return !LookupKeyword<RooKeyword>(name, strlen(name), keyword);
+}
+
+TEST(KeywordsAreMatchedExactly)
+{
+  CHECK(IsKeyword("type",     KEYWORD_TYPE));
+  CHECK(IsKeyword("fn",       KEYWORD_FN));
+  CHECK(IsKeyword("true",     KEYWORD_TRUE));
+  CHECK(IsKeyword("false",    KEYWORD_FALSE));
+  CHECK(IsKeyword("import",   KEYWORD_IMPORT));
+  CHECK(IsKeyword("break",    KEYWORD_BREAK));
+  CHECK(IsKeyword("return",   KEYWORD_RETURN));
+  CHECK(IsKeyword("if",       KEYWORD_IF));
+  CHECK(IsKeyword("else",     KEYWORD_ELSE));
+  CHECK(IsKeyword("while",    KEYWORD_WHILE));
+  CHECK(IsKeyword("mut",      KEYWORD_MUT));
+  CHECK(IsKeyword("operator", KEYWORD_OPERATOR));
+
+  CHECK(IsNotKeyword(""));
+  CHECK(IsNotKeyword("f"));
+  CHECK(IsNotKeyword("ty"));
+  CHECK(IsNotKeyword("typ"));
+  CHECK(IsNotKeyword("types"));
+  CHECK(IsNotKeyword("iff"));
+  CHECK(IsNotKeyword("mutable"));
+  CHECK(IsNotKeyword("returns"));
+  CHECK(IsNotKeyword("operators"));
+  CHECK(IsNotKeyword("Type"));
+}
+
+TEST(NamesStartingWithKeywordsAreIdentifiers)
+{
+  Parser<RooKeyword> parser(WriteSourceFile("types type fn fnord if iffy mut mutable returned return"));
+
+  const TokenType expectedTypes[] =
+  {
+    TOKEN_IDENTIFIER, TOKEN_KEYWORD, TOKEN_KEYWORD, TOKEN_IDENTIFIER, TOKEN_KEYWORD,
+    TOKEN_IDENTIFIER, TOKEN_KEYWORD, TOKEN_IDENTIFIER, TOKEN_IDENTIFIER, TOKEN_KEYWORD,
+  };
+
+  for (TokenType expectedType : expectedTypes)
+  {
+    CHECK(parser.PeekToken(false).type == expectedType);
+    parser.NextToken(false);
+  }
+
+  CHECK(parser.PeekToken(false).type == TOKEN_INVALID);
+}
+
+static std::string GetText(const Token<RooKeyword>& token)
+{
+  return std::string(token.textStart, token.textLength);
+}
+
+/*
+ * Makes a source with the identifiers `a0`, `a1` etc., with `numLines` line breaks between each one.
+ */
+static std::string MakeIdentifiers(unsigned int count, unsigned int numLines)
+{
+  std::string source;
+
+  for (unsigned int i = 0u;
+       i < count;
+       i++)
+  {
+    source += FormatString("a%u", i) + std::string(numLines, '\n') + " ";
+  }
+
+  return source;
+}
+
+/*
+ * Peeking a few tokens ahead of each one moves the start of the lookahead all the way around its buffer, many
+ * times, without it having to grow.
+ */
+TEST(LookaheadWrapsAroundItsBuffer)
+{
+  const unsigned int NUM_TOKENS = 50u;
+  Parser<RooKeyword> parser(WriteSourceFile(MakeIdentifiers(NUM_TOKENS, 0u)));
+  size_t bufferSize = parser.lookahead.size();
+  bool hasWrapped = false;
+
+  for (unsigned int i = 0u;
+       i < NUM_TOKENS;
+       i++)
+  {
+    for (unsigned int k = 0u;
+         k < 5u && (i + k) < NUM_TOKENS;
+         k++)
+    {
+      CHECK(GetText(parser.Peek(k)) == FormatString("a%u", i + k));
+    }
+
+    hasWrapped |= (parser.lookaheadStart + parser.numLookahead > bufferSize);
+    parser.NextToken();
+  }
+
+  CHECK(hasWrapped);
+  CHECK(parser.lookahead.size() == bufferSize);
+  CHECK(parser.PeekToken().type == TOKEN_INVALID);
+  CHECK(parser.Peek(3u).type == TOKEN_INVALID);
+}
+
+/*
+ * When the lookahead grows while it's wrapped around, the tokens at the end of the buffer and the ones that have
+ * wrapped around to the start have to stay in order.
+ */
+TEST(LookaheadGrowsWhileWrappedAround)
+{
+  const unsigned int NUM_TOKENS = 50u;
+  Parser<RooKeyword> parser(WriteSourceFile(MakeIdentifiers(NUM_TOKENS, 0u)));
+  size_t bufferSize = parser.lookahead.size();
+
+  // Move the start of the lookahead to near the end of its buffer, with tokens wrapped around to the start
+  for (unsigned int i = 0u;
+       i < bufferSize - 2u;
+       i++)
+  {
+    parser.Peek(3u);
+    parser.NextToken();
+  }
+  CHECK(parser.lookaheadStart + parser.numLookahead > bufferSize);
+
+  const unsigned int first = bufferSize - 2u;
+  CHECK(GetText(parser.Peek(20u)) == FormatString("a%u", first + 20u));
+  CHECK(parser.lookahead.size() > bufferSize);
+
+  for (unsigned int i = first;
+       i < NUM_TOKENS;
+       i++)
+  {
+    for (unsigned int k = 0u;
+         k < 30u && (i + k) < NUM_TOKENS;
+         k++)
+    {
+      CHECK(GetText(parser.Peek(k)) == FormatString("a%u", i + k));
+    }
+
+    parser.NextToken();
+  }
+
+  CHECK(parser.PeekToken().type == TOKEN_INVALID);
+}
+
+/*
+ * `PeekNextToken` has to look past all the lines between the current token and the next one, which here is further
+ * than the lookahead can hold to start with.
+ */
+TEST(PeekNextTokenLooksPastLines)
+{
+  const unsigned int NUM_TOKENS = 20u;
+  Parser<RooKeyword> parser(WriteSourceFile(MakeIdentifiers(NUM_TOKENS, 12u)));
+  size_t bufferSize = parser.lookahead.size();
+
+  for (unsigned int i = 0u;
+       i + 1u < NUM_TOKENS;
+       i++)
+  {
+    CHECK(GetText(parser.PeekNextToken()) == FormatString("a%u", i + 1u));
+    CHECK(GetText(parser.PeekToken()) == FormatString("a%u", i));
+    CHECK(parser.PeekNextToken(false).type == TOKEN_LINE);
+    parser.NextToken();
+  }
+
+  CHECK(parser.lookahead.size() > bufferSize);
+  CHECK(GetText(parser.PeekToken()) == FormatString("a%u", NUM_TOKENS - 1u));
+  CHECK(parser.PeekNextToken().type == TOKEN_INVALID);
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <liveness.hpp>
+
+/*
+ * `k` is given a value before the loop, and read in every iteration after a call, so it has to be live across the
+ * calls and around the loop's back edge, even though nothing after the loop reads it.
+ */
+static const char* g_loopCarriedProgram = R"(
+  #[NoInline]
+  fn Get() -> uint
+  {
+    return 5u
+  }
+
+  #[NoInline]
+  fn Add(a : uint, b : uint) -> uint
+  {
+    return a + b
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    k : uint = Get()
+    s : mut uint = 0u
+    i : mut uint = 0u
+    while (i < 4u)
+    {
+      i = Add(i 1u)
+      s = Add(s k)
+    }
+    if (s == 20u)
+    {
+      return 1
+    }
+    return 0
+  }
+)";
+
+static bool IsVersionOf(Slot* slot, const char* name)
+{
+  return (slot->GetType() == SlotType::VARIABLE && static_cast<VariableSlot*>(slot)->variable->name.Str() == name);
+}
+
+TEST(LoopCarriedValuesAreLiveAcrossCalls)
+{
+  TestProgram program(g_loopCarriedProgram);
+  CHECK(!program.hasErrored);
+
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main);
+  if (!main)
+  {
+    return;
+  }
+
+  // Find what the compiler thinks is live after each instruction
+  ControlFlowGraph* graph = main->controlFlowGraph;
+  std::vector<std::set<unsigned int>> liveOut(graph->instructions.size());
+
+  for (BasicBlock& block : graph->blocks)
+  {
+    graph->WalkBackwards(block, [&liveOut](AirInstruction* instruction, SlotSet& live, LiveOperands& /*operands*/)
+      {
+        live.ForEach([&](unsigned int slot)
+          {
+            liveOut[instruction->index].insert(slot);
+          });
+      });
+  }
+
+  CHECK(liveOut == FindLiveSlotsByBruteForce(main));
+
+  // `k` should be live after every call apart from the first (which gives it its value), and at the back edge
+  unsigned int numCallsWithK = 0u;
+  bool isLiveAtBackEdge = false;
+
+  for (AirInstruction* instruction : graph->instructions)
+  {
+    bool isKLive = false;
+    for (unsigned int slot : liveOut[instruction->index])
+    {
+      isKLive |= IsVersionOf(main->slots[slot], "k");
+    }
+
+    if (instruction->instructionType == InstructionType::CALL)
+    {
+      numCallsWithK += (isKLive ? 1u : 0u);
+    }
+    else if (instruction->instructionType == InstructionType::JUMP &&
+             static_cast<JumpInstruction*>(instruction)->label->index < instruction->index)
+    {
+      isLiveAtBackEdge |= isKLive;
+    }
+  }
+
+  CHECK(numCallsWithK == 2u);
+  CHECK(isLiveAtBackEdge);
+
+  CHECK(RunProgram(g_loopCarriedProgram) == 1);
+  CHECK(RunProgram(g_loopCarriedProgram, true) == 1);
+}
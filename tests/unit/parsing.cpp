@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <parsing.hpp>
+
+struct ParseOutput
+{
+  std::string out;
+  std::string errors;
+  int         status;
+};
+
+static std::string ReadFile(const std::string& path)
+{
+  std::string contents;
+  FILE* f = fopen(path.c_str(), "r");
+  char buffer[256u];
+  size_t length;
+
+  while (f && (length = fread(buffer, 1u, sizeof(buffer), f)) > 0u)
+  {
+    contents.append(buffer, length);
+  }
+
+  if (f)
+  {
+    fclose(f);
+  }
+
+  return contents;
+}
+
+/*
+ * Parses some files like the compiler does, and collects what it prints. This is done in a child process, because
+ * an error that gives up crashes the compiler.
+ */
+static ParseOutput ParseFilesInChild(const std::vector<std::string>& files, unsigned int numThreads)
+{
+  static unsigned int numRuns = 0u;
+  std::string outPath = FormatString("parse%u.out", numRuns);
+  std::string errorPath = FormatString("parse%u.err", numRuns++);
+  fflush(stdout);
+  fflush(stderr);
+
+  pid_t child = fork();
+  if (child == 0)
+  {
+    int out = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int errors = open(errorPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(out, STDOUT_FILENO);
+    dup2(errors, STDERR_FILENO);
+    setvbuf(stdout, nullptr, _IONBF, 0u);
+
+    ParseResult parse;
+    ArenaScope arenaScope(parse.arena);
+    bool succeeded = ParseFiles(parse, files, numThreads);
+    _exit(succeeded ? 0 : 1);
+  }
+
+  ParseOutput output;
+  waitpid(child, &(output.status), 0);
+  output.out = ReadFile(outPath);
+  output.errors = ReadFile(errorPath);
+  return output;
+}
+
+static const char* g_fileWithoutErrors = R"(
+  fn Fine(a : uint) -> uint
+  {
+    return a
+  }
+)";
+
+static const char* g_fileWithError = R"(
+  fn Recovers() -> uint
+  {
+    return 4u
+  }
+  5u
+)";
+
+static const char* g_fileThatGivesUp = R"(
+  fn GivesUp() -> uint
+  {
+    return )
+  }
+)";
+
+TEST(ParseErrorsAreReportedInFileOrder)
+{
+  std::vector<std::string> files = { WriteSourceFile(g_fileWithError),
+                                     WriteSourceFile(g_fileWithoutErrors),
+                                     WriteSourceFile(g_fileWithError),
+                                     WriteSourceFile(g_fileWithoutErrors) };
+
+  ParseOutput oneThread = ParseFilesInChild(files, 1u);
+  ParseOutput fourThreads = ParseFilesInChild(files, 4u);
+
+  CHECK(WIFEXITED(oneThread.status) && WEXITSTATUS(oneThread.status) == 1);
+  CHECK(oneThread.errors.find(files[0u]) < oneThread.errors.find(files[2u]));
+  CHECK(oneThread.errors.find(files[2u]) != std::string::npos);
+  CHECK(oneThread.out == fourThreads.out);
+  CHECK(oneThread.errors == fourThreads.errors);
+  CHECK(oneThread.status == fourThreads.status);
+}
+
+/*
+ * When a file gives up, the errors from the files before it should still be reported, and none of the ones after
+ * it, even though they might have been parsed first.
+ */
+TEST(ParsingGivesUpAfterReportingEarlierFiles)
+{
+  std::vector<std::string> files = { WriteSourceFile(g_fileWithError),
+                                     WriteSourceFile(g_fileWithoutErrors),
+                                     WriteSourceFile(g_fileThatGivesUp),
+                                     WriteSourceFile(g_fileWithError) };
+
+  ParseOutput oneThread = ParseFilesInChild(files, 1u);
+  ParseOutput fourThreads = ParseFilesInChild(files, 4u);
+
+  CHECK(WIFSIGNALED(oneThread.status) || (WIFEXITED(oneThread.status) && WEXITSTATUS(oneThread.status) != 0));
+  CHECK(oneThread.errors.find(files[0u]) != std::string::npos);
+  CHECK(oneThread.errors.find(files[2u]) != std::string::npos);
+  CHECK(oneThread.errors.find(files[3u]) == std::string::npos);
+  CHECK(oneThread.out.find(files[3u]) == std::string::npos);
+  CHECK(oneThread.out == fourThreads.out);
+  CHECK(oneThread.errors == fourThreads.errors);
+  CHECK(oneThread.status == fourThreads.status);
+}
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <x64/peephole.hpp>
+
+TEST(PushThenPopIsRemoved)
+{
+  std::vector<MachineInstr> instrs;
+  instrs.push_back(MachineInstr::Reg(I::PUSH_REG, RDI));
+  instrs.push_back(MachineInstr::Reg(I::POP_REG, RDI));
+  instrs.push_back(MachineInstr::None(I::RET));
+
+  OptimizePeephole(instrs);
+  CHECK(instrs.size() == 1u);
+  CHECK(instrs[0u].opcode == I::RET);
+}
+
+/*
+ * A register restored after one call and saved again before the next has to stay restored in between, because the
+ * second call may take its parameters in it.
+ */
+TEST(PopThenPushBetweenCallsIsKept)
+{
+  std::vector<MachineInstr> instrs;
+  instrs.push_back(MachineInstr::Reg(I::PUSH_REG, RDI));
+  instrs.push_back(MachineInstr::RegImm(I::SUB_REG_IMM32, RSP, 8u));
+  instrs.push_back(MachineInstr::Imm(I::CALL32, 0u));
+  instrs.push_back(MachineInstr::RegImm(I::ADD_REG_IMM32, RSP, 8u));
+  instrs.push_back(MachineInstr::Reg(I::POP_REG, RDI));
+  instrs.push_back(MachineInstr::Reg(I::PUSH_REG, RDI));
+  instrs.push_back(MachineInstr::RegImm(I::SUB_REG_IMM32, RSP, 8u));
+  instrs.push_back(MachineInstr::Imm(I::CALL32, 0u));
+  instrs.push_back(MachineInstr::RegImm(I::ADD_REG_IMM32, RSP, 8u));
+  instrs.push_back(MachineInstr::Reg(I::POP_REG, RDI));
+
+  OptimizePeephole(instrs);
+
+  unsigned int numPops = 0u;
+  bool isRestoredBeforeSecondCall = false;
+  unsigned int numCalls = 0u;
+  for (const MachineInstr& instr : instrs)
+  {
+    if (instr.opcode == I::CALL32)
+    {
+      numCalls++;
+    }
+    else if (instr.opcode == I::POP_REG && instr.a == RDI)
+    {
+      numPops++;
+      isRestoredBeforeSecondCall |= (numCalls == 1u);
+    }
+  }
+
+  CHECK(numCalls == 2u);
+  CHECK(numPops == 2u);
+  CHECK(isRestoredBeforeSecondCall);
+}
+
+/*
+ * `F` clobbers the register it takes its parameter in, so `x` has to be restored into it after the call to `F`,
+ * before it's passed to `Id`.
+ */
+static const char* g_restoreBetweenCallsProgram = R"(
+  #[NoInline]
+  fn Get() -> int
+  {
+    return 5
+  }
+
+  #[NoInline]
+  fn Clobber(a : int) -> int
+  {
+    return a
+  }
+
+  #[NoInline]
+  fn F(v : int) -> int
+  {
+    return Clobber(7)
+  }
+
+  #[NoInline]
+  fn Id(v : int) -> int
+  {
+    return v
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    x : int = Get()
+    F(x)
+    y : int = Id(x)
+    return x + y
+  }
+)";
+
+TEST(RegistersAreRestoredBetweenCalls)
+{
+  CHECK(RunProgram(g_restoreBetweenCallsProgram) == 10);
+  CHECK(RunProgram(g_restoreBetweenCallsProgram, true) == 10);
+}
+
+/*
+ * The flags set by a CMP have to survive until the jump that reads them, so the instructions in between can't be
+ * swapped for ones that set the flags.
+ */
+TEST(FlagsAreKeptForTheJumpThatReadsThem)
+{
+  for (MachineInstr between : { MachineInstr::RegImm(I::MOV_REG_IMM32, RAX, 0u),
+                                MachineInstr::RegImm(I::ADD_REG_IMM32, RCX, 0u),
+                                MachineInstr::RegImm(I::MUL_REG_IMM32, RDX, 4u) })
+  {
+    std::vector<MachineInstr> instrs;
+    instrs.push_back(MachineInstr::RegReg(I::CMP_REG_REG, RDI, RSI));
+    instrs.push_back(between);
+    instrs.push_back(MachineInstr::Jump(I::JGE, nullptr));
+
+    OptimizePeephole(instrs);
+    CHECK(instrs.size() == 3u);
+    CHECK(instrs[1u].opcode == between.opcode);
+  }
+}
+
+/*
+ * Runs a program, and checks both that it returns what it should, and that the given rule was used to compile it.
+ * NOTE(Isaac): the code generator never pushes a register just before popping it, so that rule is only tested on
+ * its own, by `PushThenPopIsRemoved`.
+ */
+static void CheckRuleRunsCorrectly(const char* rule, const char* source, int expected, bool useLinearScan = false)
+{
+  unsigned int numHitsBefore = GetNumPeepholeHits(rule);
+  CHECK(RunProgram(source, useLinearScan) == expected);
+  CHECK(GetNumPeepholeHits(rule) > numHitsBefore);
+}
+
+static const char* g_callsProgram = R"(
+  #[NoInline]
+  fn Three() -> uint
+  {
+    return 3u
+  }
+
+  #[NoInline]
+  fn Scale(x : uint) -> uint
+  {
+    return x * 4u
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    a : uint = Three()
+    b : uint = Three()
+    d : uint = a + b
+    c : uint = Scale(d)
+    if (c == 24u)
+    {
+      return 1
+    }
+    return 0
+  }
+)";
+
+TEST(SelfMovesAreRemoved)
+{
+  CheckRuleRunsCorrectly("Remove move to the same register", g_callsProgram, 1);
+}
+
+/*
+ * Linear scan doesn't coalesce, so it leaves moves to a temporary and straight back again.
+ */
+TEST(MovesBackToTheSourceAreRemoved)
+{
+  CheckRuleRunsCorrectly("Remove move back to the source", g_callsProgram, 1, true);
+}
+
+/*
+ * The stack is padded for each of the calls to `Three`, and the padding after the first cancels out the padding
+ * before the second.
+ */
+TEST(CancellingStackAdjustmentsAreRemoved)
+{
+  CheckRuleRunsCorrectly("Remove cancelling stack adjustments", g_callsProgram, 1);
+}
+
+TEST(MultipliesByPowersOfTwoAreShifts)
+{
+  CheckRuleRunsCorrectly("Multiply by a power of two with a shift", g_callsProgram, 1);
+}
+
+TEST(AddingZeroIsRemoved)
+{
+  CheckRuleRunsCorrectly("Remove adding or subtracting zero", R"(
+    #[NoInline]
+    fn Same(c : uint) -> uint
+    {
+      d : uint = c + 0u
+      return d
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      if (Same(4u) == 4u)
+      {
+        return 1
+      }
+      return 0
+    }
+  )", 1);
+}
+
+/*
+ * The code in the `if` is dead, so once it's removed, the jump over it goes to the very next instruction.
+ */
+TEST(JumpsToTheNextInstructionAreRemoved)
+{
+  CheckRuleRunsCorrectly("Remove jump to the next instruction", R"(
+    #[NoInline]
+    fn Skip(c : uint) -> uint
+    {
+      if (c < 5u)
+      {
+        d : uint = c + 1u
+      }
+      return c
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      if (Skip(3u) == 3u)
+      {
+        return 1
+      }
+      return 0
+    }
+  )", 1);
+}
+
+/*
+ * The copy of `0u` into `x` for the path that skips the `if` is made between the CMP and the jump, so can't be
+ * done with an XOR. If it was, the jump would always be taken, and `Pick(3u)` would return 0.
+ */
+TEST(RegistersAreZeroedWithXor)
+{
+  CheckRuleRunsCorrectly("Zero a register with XOR", R"(
+    #[NoInline]
+    fn Pick(c : uint) -> mut uint
+    {
+      x : mut uint = 0u
+      if (c < 5u)
+      {
+        x = 7u
+      }
+      return x
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      a : mut uint = Pick(3u)
+      b : mut uint = Pick(9u)
+      if (a == 7u)
+      {
+        if (b == 0u)
+        {
+          return 1
+        }
+      }
+      return 0
+    }
+  )", 1);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+
+/*
+ * `x` is passed in a different register to each call, and is live across them, so it can't just be kept in the
+ * register it's passed in.
+ */
+TEST(ArgumentsLiveAcrossCallsAreKept)
+{
+  const char* source = R"(
+    #[NoInline]
+    fn Add(a : uint, b : uint, c : uint) -> uint
+    {
+      return a + b + c
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      x : uint = Add(1u 2u 3u)
+      y : uint = Add(x 4u 5u)
+      z : uint = Add(x y x)
+      if (z == 27u)
+      {
+        return 1
+      }
+      return 0
+    }
+  )";
+
+  CHECK(RunProgram(source) == 1);
+  CHECK(RunProgram(source, true) == 1);
+}
+
+/*
+ * `s` and `i` are both passed as the first argument, and both compared against immediates, so would be put in the
+ * same registers if their slots were precolored.
+ */
+TEST(ArgumentsAreKeptAcrossLoops)
+{
+  const char* source = R"(
+    #[NoInline]
+    fn Add(a : uint, b : uint) -> uint
+    {
+      return a + b
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      s : mut uint = 0u
+      i : mut uint = 0u
+      while (i < 4u)
+      {
+        s = Add(s i)
+        i = Add(i 1u)
+      }
+      if (s == 6u)
+      {
+        return 1
+      }
+      return 0
+    }
+  )";
+
+  CHECK(RunProgram(source) == 1);
+  CHECK(RunProgram(source, true) == 1);
+}
+
+/*
+ * `a` and `b` are passed in opposite registers to the two calls in the middle.
+ */
+TEST(ArgumentsCanBePassedInAnyOrder)
+{
+  const char* source = R"(
+    #[NoInline]
+    fn Add(a : int, b : int) -> int
+    {
+      return a + b
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      a : int = Add(1 0)
+      b : int = Add(2 0)
+      c : int = Add(a b)
+      d : int = Add(b a)
+      e : int = Add(c d)
+      return e
+    }
+  )";
+
+  CHECK(RunProgram(source) == 6);
+  CHECK(RunProgram(source, true) == 6);
+}
+
+/*
+ * Slots compared against immediates aren't forced into a particular register any more, and the immediate can be on
+ * either side.
+ */
+TEST(ImmediatesCanBeComparedOnEitherSide)
+{
+  const char* source = R"(
+    #[NoInline]
+    fn Get(x : uint) -> uint
+    {
+      return x
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      a : uint = Get(5u)
+      b : uint = Get(7u)
+      if (3u < a)
+      {
+        if (b > 6u)
+        {
+          if (8u <= b)
+          {
+            return 3
+          }
+          return 1
+        }
+      }
+      return 2
+    }
+  )";
+
+  CHECK(RunProgram(source) == 1);
+  CHECK(RunProgram(source, true) == 1);
+}
+
+/*
+ * More values are live at once than there are registers, so some are spilled, by both allocators.
+ */
+TEST(SpilledSlotsAreKept)
+{
+  std::string source = "#[NoInline]\n"
+                       "fn Many(p : uint) -> uint\n"
+                       "{\n";
+  for (unsigned int i = 0u;
+       i < 24u;
+       i++)
+  {
+    source += FormatString("  a%u : uint = p + %uu\n", i, i);
+  }
+
+  source += "  return a0";
+  for (unsigned int i = 1u;
+       i < 24u;
+       i++)
+  {
+    source += FormatString(" + a%u", i);
+  }
+
+  // This is 24 + (0 + 1 + ... + 23), which still fits into an exit code
+  source += "\n"
+            "}\n\n"
+            "#[Entry]\n"
+            "fn Main() -> uint\n"
+            "{\n"
+            "  return Many(1u) - 100u\n"
+            "}\n";
+
+  CHECK(RunProgram(source) == 200);
+  CHECK(RunProgram(source, true) == 200);
+}
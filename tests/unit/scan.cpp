@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <random>
+#include <scan.hpp>
+#include <parsing.hpp>
+
+/*
+ * The vectorized scanners read whole aligned blocks, so the buffers we test them on are aligned and padded out to
+ * the largest block size, with everything after the end of the run filled with '\0's.
+ */
+static const size_t BUFFER_SIZE = 256u;
+
+/*
+ * Makes a random run of characters that's mostly blanks, name characters and the characters the lexer looks for,
+ * so runs of each kind are short and end in lots of different places within a block.
+ */
+static void FillBuffer(char* buffer, size_t length, std::mt19937& random)
+{
+  static const char alphabet[] = "  \n\n\r\r_aZ09\"\"**//.(";
+  std::uniform_int_distribution<size_t> pick(0u, sizeof(alphabet) - 2u);
+
+  for (size_t i = 0u;
+       i < BUFFER_SIZE;
+       i++)
+  {
+    buffer[i] = (i < length ? alphabet[pick(random)] : '\0');
+  }
+}
+
+TEST(ScannersAgreeWithScalarScanner)
+{
+  std::vector<const Scanner*> scanners = GetSupportedScanners();
+  CHECK(scanners[0u] == &g_scalarScanner);
+
+  alignas(32) char buffer[BUFFER_SIZE];
+  std::mt19937 random(42u);
+
+  for (unsigned int i = 0u;
+       i < 2000u;
+       i++)
+  {
+    size_t length = i % (BUFFER_SIZE - 64u);
+    FillBuffer(buffer, length, random);
+
+    for (size_t start = 0u;
+         start <= length;
+         start++)
+    {
+      const char* c = &buffer[start];
+      const char* end = &buffer[length];
+      const char* expectedLastNewline = nullptr;
+      unsigned int expectedNewlines = g_scalarScanner.countNewlines(c, end, expectedLastNewline);
+
+      for (const Scanner* scanner : scanners)
+      {
+        CHECK(scanner->skipBlank(c) == g_scalarScanner.skipBlank(c));
+        CHECK(scanner->skipName(c) == g_scalarScanner.skipName(c));
+        CHECK(scanner->find(c, '"') == g_scalarScanner.find(c, '"'));
+        CHECK(scanner->find(c, '*') == g_scalarScanner.find(c, '*'));
+        CHECK(scanner->find(c, '\n') == g_scalarScanner.find(c, '\n'));
+
+        const char* lastNewline = nullptr;
+        CHECK(scanner->countNewlines(c, end, lastNewline) == expectedNewlines);
+        CHECK(lastNewline == expectedLastNewline);
+      }
+    }
+  }
+}
+
+/*
+ * Lexes the same source with each scanner, and checks they produce exactly the same tokens, in the same places.
+ */
+TEST(ScannersLexTheSameTokens)
+{
+  std::string source;
+  for (unsigned int i = 0u;
+       i < 200u;
+       i++)
+  {
+    source += FormatString("// Line comment %u\n"
+                           "/* Block comment\n"
+                           " * that spans %u lines **/\n"
+                           "fn %s%u(a : uint, b_%u : mut uint) -> uint\n"
+                           "{%*s\n"
+                           "  s : string = \"a string %u\\n with a newline escape\"\r\n"
+                           "  return a + %uu\n"
+                           "}\n\n", i, i, (i % 2u ? "types" : "t"), i, i, (int)(i % 40u), "", i, i);
+  }
+
+  std::string path = WriteSourceFile(source);
+  std::vector<const Scanner*> scanners = GetSupportedScanners();
+  Parser<RooKeyword> expected(path, nullptr, g_scalarScanner);
+
+  std::vector<Parser<RooKeyword>*> parsers;
+  for (const Scanner* scanner : scanners)
+  {
+    parsers.push_back(new Parser<RooKeyword>(path, nullptr, *scanner));
+  }
+
+  unsigned int numTokens = 0u;
+  while (true)
+  {
+    const Token<RooKeyword>& token = expected.PeekToken(false);
+
+    for (Parser<RooKeyword>* parser : parsers)
+    {
+      const Token<RooKeyword>& other = parser->PeekToken(false);
+      CHECK(other.type == token.type);
+      CHECK(other.textStart == token.textStart);
+      CHECK(other.textLength == token.textLength);
+      CHECK(other.line == token.line);
+      CHECK(other.lineOffset == token.lineOffset);
+      parser->NextToken(false);
+    }
+
+    if (token.type == TOKEN_INVALID)
+    {
+      break;
+    }
+
+    numTokens++;
+    expected.NextToken(false);
+  }
+
+  CHECK(numTokens > 200u * 20u);
+
+  for (Parser<RooKeyword>* parser : parsers)
+  {
+    delete parser;
+  }
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <atomic>
+#include <memory>
+#include <cstdio>
+#include <unistd.h>
+#include <scheduler.hpp>
+#include <error.hpp>
+
+TEST(EachTaskIsRunOnce)
+{
+  const unsigned int NUM_TASKS = 1000u;
+
+  for (unsigned int numWorkers : { 1u, 2u, 4u, 8u })
+  {
+    std::unique_ptr<std::atomic<unsigned int>[]> numRuns(new std::atomic<unsigned int>[NUM_TASKS]);
+    Scheduler scheduler(numWorkers);
+
+    for (unsigned int i = 0u;
+         i < NUM_TASKS;
+         i++)
+    {
+      numRuns[i] = 0u;
+      scheduler.Push([&numRuns, i]()
+        {
+          numRuns[i]++;
+        });
+    }
+    scheduler.Run();
+
+    bool eachRunOnce = true;
+    for (unsigned int i = 0u;
+         i < NUM_TASKS;
+         i++)
+    {
+      eachRunOnce &= (numRuns[i] == 1u);
+    }
+    CHECK(eachRunOnce);
+  }
+}
+
+TEST(OneWorkerRunsTasksInOrder)
+{
+  std::vector<unsigned int> order;
+  Scheduler scheduler(1u);
+
+  for (unsigned int i = 0u;
+       i < 100u;
+       i++)
+  {
+    scheduler.Push([&order, i]()
+      {
+        order.push_back(i);
+      });
+  }
+  scheduler.Run();
+
+  bool isInOrder = (order.size() == 100u);
+  for (unsigned int i = 0u;
+       i < order.size();
+       i++)
+  {
+    isInOrder &= (order[i] == i);
+  }
+  CHECK(isInOrder);
+}
+
+/*
+ * The compiler uses the same scheduler to run the passes over every thing, and then to generate their AIR, so it
+ * has to be able to run again once it's emptied.
+ */
+TEST(SchedulerCanBeRunAgain)
+{
+  std::atomic<unsigned int> numRuns(0u);
+  Scheduler scheduler(4u);
+
+  for (unsigned int run = 0u;
+       run < 3u;
+       run++)
+  {
+    for (unsigned int i = 0u;
+         i < 50u;
+         i++)
+    {
+      scheduler.Push([&numRuns]()
+        {
+          numRuns++;
+        });
+    }
+    scheduler.Run();
+    CHECK(numRuns == 50u * (run + 1u));
+  }
+}
+
+/*
+ * Prints the errors the things have collected, and returns what was printed.
+ */
+static std::string ReportErrorsToString(ParseResult& parse)
+{
+  fflush(stderr);
+  int savedStderr = dup(STDERR_FILENO);
+  FILE* f = tmpfile();
+  dup2(fileno(f), STDERR_FILENO);
+
+  ReportCodeThingErrors(parse);
+
+  fflush(stderr);
+  dup2(savedStderr, STDERR_FILENO);
+  close(savedStderr);
+
+  std::string errors;
+  char buffer[256u];
+  size_t length;
+  rewind(f);
+  while ((length = fread(buffer, 1u, sizeof(buffer), f)) > 0u)
+  {
+    errors.append(buffer, length);
+  }
+  fclose(f);
+
+  return errors;
+}
+
+/*
+ * Things are compiled in parallel, so their errors shouldn't be printed as they're found, but once they've all
+ * been compiled, in the order the things are in.
+ */
+TEST(CodeThingErrorsAreReportedInOrder)
+{
+  TestProgram program(R"(
+    fn A() -> uint
+    {
+      return true
+    }
+
+    fn B() -> uint
+    {
+      return 4u
+    }
+
+    fn C() -> uint
+    {
+      return 3
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      return 0
+    }
+  )", false, false);
+
+  CHECK(program.hasErrored);
+  CodeThing* a = program.GetThing("A");
+  CodeThing* c = program.GetThing("C");
+  CHECK(a && static_cast<CodeThingErrorState*>(a->errorState)->errors.find("got a 'bool'") != std::string::npos);
+  CHECK(c && static_cast<CodeThingErrorState*>(c->errorState)->errors.find("got a 'int'") != std::string::npos);
+
+  std::string errors = ReportErrorsToString(program.parse);
+  size_t errorInA = errors.find("got a 'bool'");
+  size_t errorInC = errors.find("got a 'int'");
+  CHECK(errorInA != std::string::npos && errorInC != std::string::npos && errorInA < errorInC);
+
+  // Each error is only reported once
+  CHECK(ReportErrorsToString(program.parse) == "");
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <ir.hpp>
+
+TEST(VariablesAreFoundThroughParentScopes)
+{
+  ParseResult parse;
+  ArenaScope arenaScope(parse.arena);
+
+  FunctionThing* function = new FunctionThing(InternedString("F"));
+  AddCodeThing(parse, function);
+
+  ScopeDef* outer = new ScopeDef(function, nullptr);
+  ScopeDef* middle = new ScopeDef(function, outer);
+  ScopeDef* inner = new ScopeDef(function, middle);
+  ScopeDef* sibling = new ScopeDef(function, outer);
+
+  VariableDef* outerA = new VariableDef(InternedString("a"), TypeRef(), nullptr);
+  VariableDef* outerB = new VariableDef(InternedString("b"), TypeRef(), nullptr);
+  VariableDef* innerA = new VariableDef(InternedString("a"), TypeRef(), nullptr);
+  VariableDef* innerC = new VariableDef(InternedString("c"), TypeRef(), nullptr);
+  VariableDef* secondInnerC = new VariableDef(InternedString("c"), TypeRef(), nullptr);
+  outer->AddLocal(outerA);
+  outer->AddLocal(outerB);
+  inner->AddLocal(innerA);
+  inner->AddLocal(innerC);
+  inner->AddLocal(secondInnerC);
+
+  CHECK(function->scopes.size() == 4u);
+  CHECK(inner->locals.size() == 3u);
+
+  CHECK(outer->FindVariable(InternedString("a")) == outerA);
+  CHECK(middle->FindVariable(InternedString("a")) == outerA);
+  CHECK(middle->FindVariable(InternedString("b")) == outerB);
+  CHECK(middle->FindVariable(InternedString("c")) == nullptr);
+
+  // Variables in inner scopes shadow those in their parents, and the first of two in the same scope is found
+  CHECK(inner->FindVariable(InternedString("a")) == innerA);
+  CHECK(inner->FindVariable(InternedString("b")) == outerB);
+  CHECK(inner->FindVariable(InternedString("c")) == innerC);
+
+  CHECK(sibling->FindVariable(InternedString("a")) == outerA);
+  CHECK(sibling->FindVariable(InternedString("c")) == nullptr);
+  CHECK(inner->FindVariable(InternedString("d")) == nullptr);
+}
+
+TEST(VariablesInProgramsAreResolved)
+{
+  TestProgram program(R"(
+    fn F(p : uint) -> uint
+    {
+      a : uint = p
+      if (a == 1u)
+      {
+        b : uint = a
+        if (b == p)
+        {
+          c : uint = b
+          return c
+        }
+      }
+      return a
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F(1u)
+      return 0
+    }
+  )", false, false);
+
+  CHECK(!program.hasErrored);
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <ssa.hpp>
+
+/*
+ * Runs a check over the AIR at some point between the other passes. The AIR is only in SSA form while the passes are
+ * running, so this is the only place we can look at the phis.
+ */
+struct AirCheckPass : AirTransformPass
+{
+  AirCheckPass(std::function<void(CodeThing*)> check)
+    :AirTransformPass("Checking the AIR")
+    ,check(check)
+  {
+  }
+
+  void Apply(CodeThing* code)
+  {
+    check(code);
+  }
+
+  std::function<void(CodeThing*)> check;
+};
+
+/*
+ * Generates the AIR of the function `F` in a program, with the given passes.
+ */
+static void GenerateF(const char* source, AirPassManager& airPasses)
+{
+  TestProgram program(source, false, false);
+  CHECK(!program.hasErrored);
+  CodeThing* f = program.GetThing("F");
+  CHECK(f);
+
+  if (f)
+  {
+    QuietStdout quietStdout;
+    ArenaScope arenaScope(f->arena);
+    AirGenerator airGenerator(airPasses);
+    airGenerator.ApplyTo(program.parse, program.target, f);
+  }
+}
+
+static std::vector<PhiInstruction*> GetPhis(CodeThing* code)
+{
+  std::vector<PhiInstruction*> phis;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    if (instruction->instructionType == InstructionType::PHI)
+    {
+      phis.push_back(static_cast<PhiInstruction*>(instruction));
+    }
+  }
+
+  return phis;
+}
+
+/*
+ * Checks that each slot the SSA passes are allowed to rename is given a value by at most one instruction, and that
+ * each phi is at the top of its block, with a different version of the slot coming from each predecessor.
+ */
+static bool IsInSSAForm(CodeThing* code)
+{
+  std::map<Slot*, unsigned int> numDefs;
+  SlotOperand operands[3u];
+  bool isAtTopOfBlock = false;
+
+  for (AirInstruction* instruction = code->airHead;
+       instruction;
+       instruction = instruction->next)
+  {
+    unsigned int numOperands = GetSlotOperands(instruction, operands);
+
+    for (unsigned int i = 0u;
+         i < numOperands;
+         i++)
+    {
+      Slot* slot = *operands[i].slot;
+
+      if (!operands[i].isUse && slot->ShouldColor() && !(slot->IsColored()))
+      {
+        numDefs[slot]++;
+      }
+    }
+
+    if (instruction->instructionType == InstructionType::PHI)
+    {
+      PhiInstruction* phi = static_cast<PhiInstruction*>(instruction);
+
+      if (!isAtTopOfBlock || phi->operands.size() < 2u)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      isAtTopOfBlock = (instruction->instructionType == InstructionType::LABEL);
+    }
+  }
+
+  for (auto& slotDefs : numDefs)
+  {
+    if (slotDefs.second > 1u)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static const char* g_diamondProgram = R"(
+  #[NoInline]
+  fn F(p : uint) -> mut uint
+  {
+    x : mut uint = 1u
+    if (p == 3u)
+    {
+      x = 2u
+    }
+    else
+    {
+      x = 4u
+    }
+    return x
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    a : uint = F(3u)
+    b : uint = F(5u)
+    c : uint = a + b + b
+    if (c == 10u)
+    {
+      return 1
+    }
+    return 0
+  }
+)";
+
+/*
+ * `x` is given a different value on each side of the `if`, so needs a phi where they meet, and nowhere else.
+ */
+TEST(PhisArePlacedWhereBranchesMeet)
+{
+  AirPassManager airPasses;
+  airPasses.Add(new SSAConstructionPass());
+  airPasses.Add(new AirCheckPass([](CodeThing* f)
+    {
+      CHECK(IsInSSAForm(f));
+      std::vector<PhiInstruction*> phis = GetPhis(f);
+      CHECK(phis.size() == 1u);
+
+      if (phis.size() == 1u)
+      {
+        PhiInstruction* phi = phis[0u];
+        CHECK(phi->operands.size() == 2u);
+        CHECK(phi->operands[0u].value != phi->operands[1u].value);
+        CHECK(phi->operands[0u].from != phi->operands[1u].from);
+
+        // The return reads the phi's version of `x`
+        AirInstruction* next = phi->next;
+        while (next && next->instructionType != InstructionType::RETURN)
+        {
+          next = next->next;
+        }
+        CHECK(next && static_cast<ReturnInstruction*>(next)->returnValue == phi->result);
+      }
+    }));
+  airPasses.Add(new SSADestructionPass());
+
+  GenerateF(g_diamondProgram, airPasses);
+}
+
+static const char* g_loopProgram = R"(
+  #[NoInline]
+  fn F(n : uint) -> mut uint
+  {
+    i : mut uint = 0u
+    a : mut uint = 1u
+    b : mut uint = 2u
+    while (i < n)
+    {
+      t : mut uint = a
+      a = b
+      b = t
+      i++
+    }
+    return b
+  }
+
+  #[Entry]
+  fn Main() -> int
+  {
+    x : uint = F(3u)
+    y : uint = F(4u)
+    z : uint = x + y + y
+    if (z == 5u)
+    {
+      return 1
+    }
+    return 0
+  }
+)";
+
+/*
+ * `i`, `a` and `b` are all changed in the loop, so each needs a phi at the top of it, picking between the value
+ * from before the loop and the one from the end of the last iteration. `t` is only used inside the loop, so it
+ * doesn't need one.
+ */
+TEST(PhisArePlacedAtTheTopOfLoops)
+{
+  AirPassManager airPasses;
+  airPasses.Add(new SSAConstructionPass());
+  airPasses.Add(new AirCheckPass([](CodeThing* f)
+    {
+      CHECK(IsInSSAForm(f));
+      std::vector<PhiInstruction*> phis = GetPhis(f);
+      CHECK(phis.size() == 3u);
+
+      for (PhiInstruction* phi : phis)
+      {
+        CHECK(phi->operands.size() == 2u);
+
+        // One value comes from before the loop, and one from the back edge, which comes after the phi
+        unsigned int numFromBackEdge = 0u;
+        for (PhiInstruction::Operand& operand : phi->operands)
+        {
+          numFromBackEdge += (operand.from->index > phi->index ? 1u : 0u);
+        }
+        CHECK(numFromBackEdge == 1u);
+      }
+
+      // The loop's condition is checked each time around, so has to read the version of `i` from the phi
+      AirInstruction* condition = (phis.size() > 0u ? phis.back()->next : nullptr);
+      CHECK(condition && condition->instructionType == InstructionType::CMP);
+
+      if (condition && condition->instructionType == InstructionType::CMP)
+      {
+        Slot* i = static_cast<CmpInstruction*>(condition)->a;
+        CHECK(std::any_of(phis.begin(), phis.end(), [i](PhiInstruction* phi) { return phi->result == i; }));
+      }
+    }));
+  airPasses.Add(new SSADestructionPass());
+
+  GenerateF(g_loopProgram, airPasses);
+}
+
+/*
+ * Each phi becomes a copy from a new temporary, which each predecessor copies its value into, so there's a MOV for
+ * the phi, and one for each of its operands.
+ */
+TEST(PhisAreReplacedWithCopies)
+{
+  for (const char* source : { g_diamondProgram, g_loopProgram })
+  {
+    unsigned int numMovs = 0u;
+    unsigned int numCopies = 0u;
+
+    AirPassManager airPasses;
+    airPasses.Add(new SSAConstructionPass());
+    airPasses.Add(new AirCheckPass([&numMovs, &numCopies](CodeThing* f)
+      {
+        numMovs = CountInstructions(f, InstructionType::MOV);
+        for (PhiInstruction* phi : GetPhis(f))
+        {
+          numCopies += 1u + phi->operands.size();
+        }
+      }));
+    airPasses.Add(new SSADestructionPass());
+    airPasses.Add(new AirCheckPass([&numMovs, &numCopies](CodeThing* f)
+      {
+        CHECK(numCopies > 0u);
+        CHECK(CountInstructions(f, InstructionType::PHI) == 0u);
+        CHECK(CountInstructions(f, InstructionType::MOV) == numMovs + numCopies);
+      }));
+
+    GenerateF(source, airPasses);
+  }
+
+  // The loop swaps `a` and `b` each time around, so this only works if each copy reads the right version
+  CHECK(RunProgram(g_diamondProgram) == 1);
+  CHECK(RunProgram(g_diamondProgram, true) == 1);
+  CHECK(RunProgram(g_loopProgram) == 1);
+  CHECK(RunProgram(g_loopProgram, true) == 1);
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017, Isaac Woods.
+ * See LICENCE.md
+ */
+
+#include <test.hpp>
+#include <ir.hpp>
+#include <passes/passes.hpp>
+
+TEST(IndexesAreKeptInStepWithParseResult)
+{
+  ParseResult parse;
+  ArenaScope arenaScope(parse.arena);
+
+  TypeDef* first = new TypeDef(InternedString("T"));
+  TypeDef* second = new TypeDef(InternedString("T"));
+  AddType(parse, first);
+  AddType(parse, second);
+  AddType(parse, new TypeDef(InternedString("U")));
+
+  CHECK(parse.types.size() == 3u);
+  CHECK(GetTypeByName(parse, InternedString("T")) == first);
+  CHECK(GetTypeByName(parse, InternedString("U")) == parse.types[2u]);
+  CHECK(GetTypeByName(parse, InternedString("V")) == nullptr);
+
+  FunctionThing* f = new FunctionThing(InternedString("F"));
+  FunctionThing* overload = new FunctionThing(InternedString("F"));
+  OperatorThing* plus = new OperatorThing(TOKEN_PLUS);
+  AddCodeThing(parse, f);
+  AddCodeThing(parse, plus);
+  AddCodeThing(parse, overload);
+
+  CHECK(parse.codeThings.size() == 3u);
+  CHECK(parse.functionsByName.size() == 1u);
+  CHECK(parse.functionsByName[InternedString("F")].size() == 2u);
+  CHECK(parse.functionsByName[InternedString("F")][0u] == f);
+  CHECK(parse.functionsByName[InternedString("F")][1u] == overload);
+  CHECK(parse.operatorsByToken[TOKEN_PLUS].size() == 1u);
+  CHECK(parse.operatorsByToken[TOKEN_PLUS][0u] == plus);
+  CHECK(parse.operatorsByToken[TOKEN_MINUS].size() == 0u);
+}
+
+TEST(CallsResolveToTheRightOverload)
+{
+  TestProgram program(R"(
+    operator +(s : string, b : uint) -> uint
+    {
+      return b
+    }
+
+    fn F(a : uint) -> uint
+    {
+      return a
+    }
+
+    fn F(a : int) -> int
+    {
+      return a
+    }
+
+    fn F(a : uint, b : uint) -> uint
+    {
+      return b
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      a : int = F(3)
+      b : uint = F(3u 4u)
+      c : uint = "hello" + 2u
+      return 0
+    }
+  )", false, false);
+
+  CHECK(!program.hasErrored);
+  CHECK(program.parse.functionsByName[InternedString("F")].size() == 3u);
+  CHECK(program.parse.operatorsByToken[TOKEN_PLUS].size() == 1u);
+
+  CodeThing* main = program.GetThing("Main");
+  CHECK(main);
+
+  if (main)
+  {
+    std::vector<FunctionThing*>& overloads = program.parse.functionsByName[InternedString("F")];
+    CHECK(main->calledThings.size() == 3u);
+    CHECK(std::find(main->calledThings.begin(), main->calledThings.end(), overloads[0u]) == main->calledThings.end());
+    CHECK(std::find(main->calledThings.begin(), main->calledThings.end(), overloads[1u]) != main->calledThings.end());
+    CHECK(std::find(main->calledThings.begin(), main->calledThings.end(), overloads[2u]) != main->calledThings.end());
+    CHECK(std::find(main->calledThings.begin(), main->calledThings.end(),
+                    program.parse.operatorsByToken[TOKEN_PLUS][0u]) != main->calledThings.end());
+  }
+}
+
+TEST(UnreachableThingsAreRemovedFromIndexes)
+{
+  TestProgram program(R"(
+    #[NoInline]
+    fn F(a : uint) -> uint
+    {
+      return a
+    }
+
+    fn F(a : int) -> int
+    {
+      return a
+    }
+
+    fn G() -> uint
+    {
+      return 4u
+    }
+
+    #[Entry]
+    fn Main() -> int
+    {
+      F(3u)
+      return 0
+    }
+  )");
+
+  CHECK(!program.hasErrored);
+  CHECK(program.parse.functionsByName.count(InternedString("G")) == 0u);
+  CHECK(program.parse.functionsByName[InternedString("F")].size() == 1u);
+  CHECK(program.parse.functionsByName[InternedString("F")][0u] == program.GetThing("F"));
+}